@@ -0,0 +1,177 @@
+/**************************************************************************//**
+*  @par Language: C
+*******************************************************************************
+*  @par 	Project:
+*  @brief   Enqueue cost of MqttClient_SendData() against MqttClient_SendBatch()
+*  @author  dr-paradox
+*  @version 1.0.0
+*******************************************************************************
+*  @file 	BatchBenchmark.c
+*
+*  Bursts of MQTT_SERVICE_QUEUE_DEPTH messages are queued one by one, then as a batch, and canceled after each
+*  burst so the queue is empty again. Only the submissions are timed. Nothing is sent: the client is never
+*  driven, its queue only fills and empties. The log lines of the library are written to /dev/null, the results
+*  to stderr.
+*
+*  Build and run:
+*      gcc -O2 -pthread -o BatchBenchmark BatchBenchmark.c MqttClient*.c
+*      ./BatchBenchmark [rounds]
+*
+*******************************************************************************/
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "MqttClient.h"
+#include "MqttClientCfg.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* Messages of a burst, the most a service queue holds */
+#define BENCH_BURST					MQTT_SERVICE_QUEUE_DEPTH
+
+/* Bursts timed by default */
+#define BENCH_DEFAULT_ROUNDS		((unsigned int)100000)
+
+/* Size of the payload of each message */
+#define BENCH_PAYLOAD_SIZE			((unsigned short)32)
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+ * @brief	Result callback of the benchmarked requests, results are not needed.
+ *
+ * @param[in]	: handle			: handle of the request
+ * @param[in]	: server_response	: result of the request
+ * @param[in]	: user_ctx			: NULL
+ * @return 	void
+ *
+*/
+static void BenchResp(t_MqttRequestHandle handle, unsigned char server_response, void *user_ctx);
+
+/**
+ * @brief	Read the monotonic clock.
+ *
+ * @return 	uint64_t
+ * @retval	nano seconds
+ *
+*/
+static uint64_t BenchNowNs(void);
+
+/* -------------------------------- Routines -------------------------------- */
+
+/**
+ * @brief	Result callback of the benchmarked requests, results are not needed.
+ *
+ * @param[in]	: handle			: handle of the request
+ * @param[in]	: server_response	: result of the request
+ * @param[in]	: user_ctx			: NULL
+ * @return 	void
+ *
+*/
+static void BenchResp(t_MqttRequestHandle handle, unsigned char server_response, void *user_ctx)
+{
+	(void)handle;
+	(void)server_response;
+	(void)user_ctx;
+}
+
+/**
+ * @brief	Read the monotonic clock.
+ *
+ * @return 	uint64_t
+ * @retval	nano seconds
+ *
+*/
+static uint64_t BenchNowNs(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned char payload[BENCH_PAYLOAD_SIZE];
+	t_MqttMessage msgs[BENCH_BURST];
+	t_MqttRequestHandle handles[BENCH_BURST];
+	t_MqttClientConfig config;
+	t_MqttClient *client = NULL;
+	unsigned int rounds = (argc > 1) ? (unsigned int)strtoul(argv[1], NULL, 10) : BENCH_DEFAULT_ROUNDS;
+	unsigned int round;
+	unsigned short msg;
+	uint64_t single_ns = 0U;
+	uint64_t batch_ns = 0U;
+	uint64_t start_ns;
+	unsigned int failures = 0U;
+
+	/* the library logs each submission on stdout, formatting them is part of the cost but not the terminal */
+	if ( NULL == freopen("/dev/null", "w", stdout) )
+	{
+		fprintf(stderr, "BatchBenchmark: can't discard stdout\n");
+		return 1;
+	}
+
+	/* a broker nobody listens to, the client is never driven anyway */
+	memset(&config, 0, sizeof(config));
+	config.server_address = "127.0.0.1";
+	config.server_port = 1;
+	config.client_id = "batch-benchmark";
+	client = MqttClient_Init(&config);
+	if ( (NULL == client) || (0U == rounds) )
+	{
+		fprintf(stderr, "BatchBenchmark: no client context or no round\n");
+		return 1;
+	}
+
+	memset(payload, 'x', sizeof(payload));
+	memset(msgs, 0, sizeof(msgs));
+	for (msg = 0U; msg < BENCH_BURST; msg++)
+	{
+		msgs[msg].json = payload;
+		msgs[msg].size = BENCH_PAYLOAD_SIZE;
+	}
+
+	for (round = 0U; round < rounds; round++)
+	{
+		/* before: one call per message */
+		start_ns = BenchNowNs();
+		for (msg = 0U; msg < BENCH_BURST; msg++)
+		{
+			handles[msg] = MqttClient_SendData(client, payload, BENCH_PAYLOAD_SIZE, SERVICE_REQ_1, BenchResp, NULL);
+		}
+		single_ns += BenchNowNs() - start_ns;
+
+		for (msg = 0U; msg < BENCH_BURST; msg++)
+		{
+			failures += (MQTT_INVALID_REQUEST_HANDLE == handles[msg]) ? 1U : 0U;
+			MqttClient_CancelRequest(client, handles[msg]);
+		}
+
+		/* after: the whole burst at once */
+		start_ns = BenchNowNs();
+		if ( MQTT_SUBMIT_OK != MqttClient_SendBatch(client, msgs, BENCH_BURST, SERVICE_REQ_1, BenchResp, NULL, 0U, handles) )
+		{
+			failures += BENCH_BURST;
+		}
+		batch_ns += BenchNowNs() - start_ns;
+
+		for (msg = 0U; msg < BENCH_BURST; msg++)
+		{
+			MqttClient_CancelRequest(client, handles[msg]);
+		}
+	}
+
+	fprintf(stderr, "BatchBenchmark: %u bursts of %u messages of %u bytes\n", rounds, (unsigned int)BENCH_BURST, (unsigned int)BENCH_PAYLOAD_SIZE);
+	fprintf(stderr, "  MqttClient_SendData()  : %6.1f ns per message\n", (double)single_ns / ((double)rounds * BENCH_BURST));
+	fprintf(stderr, "  MqttClient_SendBatch() : %6.1f ns per message\n", (double)batch_ns / ((double)rounds * BENCH_BURST));
+	fprintf(stderr, "  rejected submissions   : %u\n", failures);
+
+	return (0U == failures) ? 0 : 1;
+}
@@ -13,72 +13,480 @@
 
 /* -------------------------------- Includes -------------------------------- */
 
+#include <pthread.h>
+#include <unistd.h>
 #include "MqttClient.h"
 #include "MqttClientCfg.h"
-#include "MqttClientFunctions.h"
+#include "MqttClientContext.h"
 #include "MqttClientMng.h"
 #include "MqttClientTimerMng.h"
+#include "MqttClientPool.h"
 
 /* -------------------------------- Defines --------------------------------- */
 
+/* Invalid file descriptor */
+#define INVALID_FD					((int)-1)
+
 /* ------------------------------- Data Types ------------------------------- */
 
 /* ---------------------------- Global Variables ---------------------------- */
 
+/* Client contexts, the context of FSM instance N is client_instances[N] */
+static t_MqttClient client_instances[MQTT_MAX_CLIENTS];
+/* Protects the allocation of client_instances, contexts may be created from any thread */
+static pthread_mutex_t clients_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /* --------------------------- Routine prototypes --------------------------- */
 
+/**
+* @brief	Copy the configuration of a client context, missing fields take the values of MqttClientCfg.h.
+*
+* @param[in]	: client	: client context
+* @param[in]	: config	: configuration given to MqttClient_Init(), may be NULL
+* @return		void
+*/
+static void MqttClientSetConfig(t_MqttClient *client, const t_MqttClientConfig *config);
+
+/**
+* @brief	Create a client context and start its FSMs.
+*
+* @param[in]	: config		: broker and credentials of the context, NULL for MqttClientCfg.h values
+* @param[in]	: self_driven	: start an I/O thread driving the context
+* @param[in]	: cpu			: cpu the I/O thread is pinned to, MQTT_NO_CPU to let it run anywhere
+* @return		t_MqttClient*
+* @retval		NULL : MQTT_MAX_CLIENTS contexts already created or error in starting the I/O thread
+*/
+static t_MqttClient* MqttClientCreate(const t_MqttClientConfig *config, bool self_driven, int cpu);
+
+/**
+* @brief	Stop the I/O thread of a client context, close its sockets and files and give its slot back.
+*
+* @param[in]	: client	: client context
+* @return		void
+*/
+static void MqttClientRelease(t_MqttClient *client);
+
+/**
+* @brief	Send a message with its options, see MqttClient_SendMessage(), holding a pool routing bucket.
+*
+* @param[in]	: client		: client context
+* @param[in]	: msg			: message to be sent and its options
+* @param[in]	: service_id	: service id of calling service
+* @param[in]	: cbk			: callback to notify status
+* @param[in]	: user_ctx		: user context pointer passed back to cbk
+* @param[in]	: route			: pool routing bucket held for the message, kept by the queued request and released
+* 								  otherwise, MQTT_NO_ROUTE if none
+* @return		t_MqttRequestHandle
+* @retval		handle of the accepted request
+* @retval		MQTT_INVALID_REQUEST_HANDLE : bad request
+*/
+static t_MqttRequestHandle MqttClientSendRouted(t_MqttClient *client, const t_MqttMessage *msg, unsigned char service_id, RxCbk cbk,
+													void *user_ctx, unsigned short route);
+
 /* -------------------------------- Routines -------------------------------- */
+
+/**
+* @brief	Copy the configuration of a client context, missing fields take the values of MqttClientCfg.h.
+*
+* @param[in]	: client	: client context
+* @param[in]	: config	: configuration given to MqttClient_Init(), may be NULL
+* @return		void
+*/
+static void MqttClientSetConfig(t_MqttClient *client, const t_MqttClientConfig *config)
+{
+	client->config.server_address = SERVER_ADDRESS;
+	client->config.server_port = SERVER_PORT;
+	client->config.client_id = CLIENT_ID;
+	client->config.username = USERNAME;
+	client->config.password = PASSWORD;
+	client->config.clock = NULL;
+	client->config.clock_ctx = NULL;
+	client->config.uplink_interface = MQTT_UPLINK_INTERFACE;
+	client->config.brokers = NULL;
+	client->config.broker_count = 0U;
+	client->config.warm_standby = MQTT_WARM_STANDBY;
+	client->config.standby_client_id = NULL;
+	client->config.spool_dir = MQTT_SPOOL_DIR;
+
+	if ( config != NULL )
+	{
+		if ( config->server_address != NULL )
+		{
+			client->config.server_address = config->server_address;
+		}
+		if ( config->server_port != 0 )
+		{
+			client->config.server_port = config->server_port;
+		}
+		if ( config->client_id != NULL )
+		{
+			client->config.client_id = config->client_id;
+		}
+		if ( config->username != NULL )
+		{
+			client->config.username = config->username;
+		}
+		if ( config->password != NULL )
+		{
+			client->config.password = config->password;
+		}
+		if ( config->clock != NULL )
+		{
+			client->config.clock = config->clock;
+			client->config.clock_ctx = config->clock_ctx;
+		}
+		if ( config->uplink_interface != NULL )
+		{
+			client->config.uplink_interface = config->uplink_interface;
+		}
+		if ( (config->brokers != NULL) && (config->broker_count != 0U) )
+		{
+			client->config.brokers = config->brokers;
+			client->config.broker_count = config->broker_count;
+		}
+		if ( config->warm_standby != 0U )
+		{
+			client->config.warm_standby = config->warm_standby;
+		}
+		if ( config->standby_client_id != NULL )
+		{
+			client->config.standby_client_id = config->standby_client_id;
+		}
+		if ( config->spool_dir != NULL )
+		{
+			client->config.spool_dir = config->spool_dir;
+		}
+	}
+}
+
 /**
- * @brief	MqttClientH2 initialization
+ * @brief	Get the client context driven by a FSM instance.
  *
- * @param[in]	: void
- * @return		void
+ * @param[in]	: handler	: FSM instance
+ * @return 		t_MqttClient*
  *
 */
- void MqttClient_Init(void)
+t_MqttClient* MqttClientGetContext(unsigned char handler)
+{
+	t_MqttClient *client = NULL;
+
+	if ( handler < MQTT_MAX_CLIENTS )
+	{
+		client = &client_instances[handler];
+	}
+
+	return client;
+}
+
+/**
+* @brief	Queue messages of a service, or spool them when the service is durable and the client is offline, its queue
+* 			is full or older messages of the service are spooled.
+*
+* @param[in]	: client		: client context
+* @param[in]	: msgs			: messages to be sent, already validated
+* @param[in]	: count			: number of messages
+* @param[in]	: service_id	: service id of calling service
+* @param[in]	: cbk			: callback to notify status
+* @param[in]	: user_ctx		: user context pointer passed back to cbk
+* @param[in]	: shed			: apply the shedding policy of the service when there is no room
+* @param[in]	: combined		: notify cbk once for the whole batch
+* @param[in]	: route			: pool routing bucket held for a single message, kept by the queued request or the spooled
+* 								  record and released otherwise, MQTT_NO_ROUTE if none
+* @param[out]	: handles		: handles of the accepted requests, count entries
+* @return		t_MqttSubmitStatus
+* @retval		MQTT_SUBMIT_OK			: messages queued or spooled
+* @retval		MQTT_SUBMIT_WOULD_BLOCK	: no room, cbk is not called
+* @retval		MQTT_SUBMIT_DROPPED		: shed by the overload policy of the service
+*/
+t_MqttSubmitStatus MqttClientSubmit(t_MqttClient *client, const t_MqttMessage *msgs, unsigned short count, unsigned char service_id,
+										RxCbk cbk, void *user_ctx, bool shed, bool combined, unsigned short route,
+										t_MqttRequestHandle *handles)
+{
+	t_MqttSubmitStatus status = MQTT_SUBMIT_WOULD_BLOCK;
+	bool durable = (0U != (MqttClientSpoolGetDurable(client) & (1UL << service_id)));
+	bool queued = false;
+
+	/* messages of a durable service keep their order: once one is spooled, the next ones follow it there */
+	if ( true == MqttClientSpoolWanted(client, service_id, (0U != MqttClient_IsConnected(client))) )
+	{
+		status = MqttClientSpoolSubmit(client, msgs, count, service_id, cbk, user_ctx, combined, route, handles);
+	}
+	else
+	{
+		if ( 1U == count )
+		{
+			status = MqttClientQueueSubmit(client, &msgs[0], service_id, cbk, user_ctx, (shed && !durable), route, &handles[0]);
+			queued = (MQTT_SUBMIT_OK == status);
+		}
+		else
+		{
+			status = MqttClientQueueSubmitBatch(client, msgs, count, service_id, cbk, user_ctx, combined, handles);
+		}
+
+		/* a durable service overflows into the spool rather than losing messages */
+		if ( (MQTT_SUBMIT_WOULD_BLOCK == status) && (true == durable) )
+		{
+			status = MqttClientSpoolSubmit(client, msgs, count, service_id, cbk, user_ctx, combined, route, handles);
+		}
+	}
+
+	/* the spool is full, the shedding policy decides what is lost unless queueing would overtake spooled messages */
+	if ( (MQTT_SUBMIT_WOULD_BLOCK == status) && (true == durable) && (true == shed) && (1U == count) &&
+		 (false == MqttClientSpoolWanted(client, service_id, true)) )
+	{
+		status = MqttClientQueueSubmit(client, &msgs[0], service_id, cbk, user_ctx, true, route, &handles[0]);
+		queued = (MQTT_SUBMIT_OK == status);
+	}
+
+	/* a spooled message keeps its key on the client through its record, counted on the routing bucket */
+	if ( false == queued )
+	{
+		MqttClientQueueRouteRelease(client, route);
+	}
+
+	return status;
+}
+
+/**
+* @brief	Create a client context and start its FSMs.
+*
+* @param[in]	: config		: broker and credentials of the context, NULL for MqttClientCfg.h values
+* @param[in]	: self_driven	: start an I/O thread driving the context
+* @param[in]	: cpu			: cpu the I/O thread is pinned to, MQTT_NO_CPU to let it run anywhere
+* @return		t_MqttClient*
+* @retval		NULL : MQTT_MAX_CLIENTS contexts already created or error in starting the I/O thread
+*/
+static t_MqttClient* MqttClientCreate(const t_MqttClientConfig *config, bool self_driven, int cpu)
+{
+	t_MqttClient *client = NULL;
+	unsigned char handler;
+
+	pthread_mutex_lock(&clients_lock);
+
+	for (handler = 0U; handler < MQTT_MAX_CLIENTS; handler++)
+	{
+		if ( false == client_instances[handler].in_use )
+		{
+			client = &client_instances[handler];
+			client->in_use = true;
+			client->handler = handler;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&clients_lock);
+
+	if ( client == NULL )
+	{
+		printf("MqttClient: No client context left, %d already created", MQTT_MAX_CLIENTS);
+	}
+	else
+	{
+		MqttClientSetConfig(client, config);
+		MqttClientSessionInit(client);
+		MqttClientQueueInit(client);
+		MqttClientNotifyInit(client);
+		MqttClientShardInit(client);
+		MqttClientSpoolInit(client);
+		(void)MqttClientNetlinkInit(client);
+		MqttClientTimerInit(&client->timers, client->config.clock, client->config.clock_ctx);
+		MqttClientFailoverInit(client);
+		MqttClientH2Mng_Init(client->handler);
+		MqttClientH2TimerMng_Init(client->handler);
+
+		/* In self driven mode the client is run by its own I/O thread, woken up by submissions, socket data and timers */
+		if ( true == self_driven )
+		{
+			if ( false == MqttClientIoStart(client, cpu) )
+			{
+				/* nothing would ever drive the context */
+				MqttClientRelease(client);
+				client = NULL;
+			}
+		}
+		/* Otherwise the client may be run by a host event loop through MqttClient_GetPollFds() */
+		else if ( false == MqttClientIoInit(client) )
+		{
+			printf("MqttClient: Error in creating event loop resources");
+		}
+		else
+		{
+			/* driven by MqttClient_Task() or the host event loop */
+		}
+	}
+
+	if ( client != NULL )
+	{
+		printf("MqttClient %d initialized with broker %s:%d of %d", client->handler, MqttClientFailoverGetBroker(client)->address,
+				MqttClientFailoverGetBroker(client)->port, client->failover.broker_count);
+	}
+
+	return client;
+}
+
+/**
+* @brief	Stop the I/O thread of a client context, close its sockets and files and give its slot back.
+*
+* @param[in]	: client	: client context
+* @return		void
+*/
+static void MqttClientRelease(t_MqttClient *client)
 {
-    MqttClientH2Mng_Init(MQTTCLIENTH2_HANDLER);
-    MqttClientH2TimerMng_Init(MQTTCLIENTH2_HANDLER);
+	/* once the I/O thread is joined nothing else runs the FSM of the context */
+	MqttClientIoStop(client);
+
+	if ( INVALID_FD != MqttClientGetSocket(client) )
+	{
+		MqttClientTransportClose(client);
+	}
 
-    printf("MqttClient initialized");
+	MqttClientFailoverClose(client);
+	MqttClientNetlinkClose(client);
+	MqttClientSpoolClose(client);
+	MqttClientNotifyClose(client);
+
+	printf("MqttClient %d released", client->handler);
+
+	pthread_mutex_lock(&clients_lock);
+	client->in_use = false;
+	pthread_mutex_unlock(&clients_lock);
+}
+
+/**
+ * @brief	MqttClientH2 initialization: create a client context and start its FSMs
+ *
+ * @param[in]	: config	: broker and credentials of the context, NULL for MqttClientCfg.h values
+ * @return 		t_MqttClient*
+ * @retval		client context
+ * @retval		NULL : MQTT_MAX_CLIENTS contexts already created or error in starting the I/O thread
+ *
+*/
+ t_MqttClient* MqttClient_Init(const t_MqttClientConfig *config)
+{
+	return MqttClientCreate(config, (MQTT_SELF_DRIVEN_MODE != ZERO), MQTT_NO_CPU);
 }
 
 /**
  * @brief	MqttClientH2 periodical task
  *
- * @param[in]	: void
+ * @param[in]	: client	: client context
  * @return		void
  *
 */
- void MqttClient_Task(void)
+ void MqttClient_Task(t_MqttClient *client)
 {
-	MqttClientH2Mng_Task(MQTTCLIENTH2_HANDLER);
-	MqttClientH2TimerMng_Task(MQTTCLIENTH2_HANDLER);
+	/* The I/O thread is the only one running the FSMs in self driven mode */
+	if ( (client != NULL) && (false == client->io.self_driven) )
+	{
+		/* Without event loop every transition is evaluated on each cycle */
+		MqttClientIoPost(client, MQTT_EVT_ALL);
+		MqttClientShardDrain(client);
+		MqttClientQueueExpire(client);
+		MqttClientNetlinkProcess(client);
+		MqttClientFailoverProcess(client);
+		MqttClientH2Mng_Task(client->handler);
+		MqttClientH2TimerMng_Task(client->handler);
+	}
 }
 
 /**
  * @brief		External API called to send data to server by other services
  *
+ * @param[in]	: client		: client context
  * @param[in]	: json			: json message to be sent
  * @param[in]	: size			: size of json message to be sent
  * @param[in]	: service_id	: service id of calling service
  * @param[out]	: cbk			: callback to notify status
- * @return 		void
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @return 		t_MqttRequestHandle
+ * @retval		handle of the accepted request
+ * @retval		MQTT_INVALID_REQUEST_HANDLE : bad request
+ *
+*/
+ t_MqttRequestHandle MqttClient_SendData(t_MqttClient *client, unsigned char *json, unsigned short size, unsigned char service_id, RxCbk cbk, void *user_ctx)
+{
+	return MqttClient_SendDataTtl(client, json, size, service_id, 0U, cbk, user_ctx);
+}
+
+/**
+ * @brief		Send data that is useless once older than its time to live. A request still queued when it expires is
+ * 				dropped and notified SERVERCOM_EXPIRED, a request in flight is not retransmitted anymore. With MQTT_V_5
+ * 				the time left is also given to the broker as Message Expiry Interval.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: json			: json message to be sent
+ * @param[in]	: size			: size of json message to be sent
+ * @param[in]	: service_id	: service id of calling service
+ * @param[in]	: ttl_ms		: time to live of the message from now, 0 if it never expires
+ * @param[out]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @return 		t_MqttRequestHandle
+ * @retval		handle of the accepted request
+ * @retval		MQTT_INVALID_REQUEST_HANDLE : bad request
  *
 */
- void MqttClient_SendData(unsigned char *json, unsigned short size, unsigned char service_id, RxCbk cbk)
+ t_MqttRequestHandle MqttClient_SendDataTtl(t_MqttClient *client, unsigned char *json, unsigned short size, unsigned char service_id, unsigned int ttl_ms, RxCbk cbk, void *user_ctx)
+{
+	t_MqttMessage msg;
+
+	msg.json = json;
+	msg.size = size;
+	msg.ttl_ms = ttl_ms;
+	msg.key = NULL;
+	msg.key_len = 0U;
+	msg.order_key = NULL;
+	msg.order_key_len = 0U;
+
+	return MqttClient_SendMessage(client, &msg, service_id, cbk, user_ctx);
+}
+
+/**
+* @brief	Send a message with its options, see MqttClient_SendMessage(), holding a pool routing bucket.
+*
+* @param[in]	: client		: client context
+* @param[in]	: msg			: message to be sent and its options
+* @param[in]	: service_id	: service id of calling service
+* @param[in]	: cbk			: callback to notify status
+* @param[in]	: user_ctx		: user context pointer passed back to cbk
+* @param[in]	: route			: pool routing bucket held for the message, kept by the queued request and released
+* 								  otherwise, MQTT_NO_ROUTE if none
+* @return		t_MqttRequestHandle
+* @retval		handle of the accepted request
+* @retval		MQTT_INVALID_REQUEST_HANDLE : bad request
+*/
+static t_MqttRequestHandle MqttClientSendRouted(t_MqttClient *client, const t_MqttMessage *msg, unsigned char service_id, RxCbk cbk,
+													void *user_ctx, unsigned short route)
 {
+	t_MqttRequestHandle handle = MQTT_INVALID_REQUEST_HANDLE;
+	t_MqttSubmitStatus status = MQTT_SUBMIT_OK;
+	unsigned short size = (msg != NULL) ? msg->size : 0U;
+
 	printf("MqttClient: Service %d want to send a %d bytes message", service_id, size);
 
-	if (( service_id >= SERVICE_LAST ) || ( json == NULL) ||
-		( cbk == NULL ) || ( size > SERVER_COM_JSON_MAX_SIZE ))
+	if (( client == NULL ) || ( service_id >= SERVICE_LAST ) || ( msg == NULL ) || ( msg->json == NULL) ||
+		( cbk == NULL ) || ( size > SERVER_COM_JSON_MAX_SIZE ) ||
+		( msg->key_len > MQTT_COALESCE_KEY_SIZE ) || (( msg->key_len != 0U ) && ( msg->key == NULL )) ||
+		(( msg->order_key_len != 0U ) && ( msg->order_key == NULL )))
 	{
 		printf("MqttClient: Bad request received, service id: %d, json size:%d ", service_id, size);
 
-		/*Notify the service that is send a bad request*/
-		if ( cbk != NULL )
+		/*Notify the service that is send a bad request, without context it can only be done inline*/
+		if ( (cbk != NULL) && (client == NULL) )
+		{
+			cbk(MQTT_INVALID_REQUEST_HANDLE, (unsigned char)SERVERCOM_BAD_REQUEST, user_ctx);
+		}
+		else if ( cbk != NULL )
+		{
+			MqttClientNotifyDispatch(client, cbk, MQTT_INVALID_REQUEST_HANDLE, SERVERCOM_BAD_REQUEST, user_ctx, service_id);
+		}
+		else
+		{
+			/* nobody to notify */
+		}
+
+		if ( client != NULL )
 		{
-			cbk((unsigned char)SERVERCOM_BAD_REQUEST);
+			MqttClientQueueRouteRelease(client, route);
 		}
 	}
 	else
@@ -86,30 +494,846 @@
 
 		printf("MqttClient: Request received from service %d, size %d", service_id, size);
 
-		/*Store the json*/
-		memcpy( &ServiceRequestList[service_id].json, json, size);
+		/*Queue or spool the request, the shedding policy of the service decides what is lost when there is no room*/
+		status = MqttClientSubmit(client, msg, 1U, service_id, cbk, user_ctx, true, false, route, &handle);
+
+		if ( MQTT_SUBMIT_OK == status )
+		{
+			MqttClientIoWake(client, MQTT_EVT_DATA_SUBMITTED);
+		}
+		else
+		{
+			printf("MqttClient: Request of service %d shed by overload policy", service_id);
+			handle = MQTT_INVALID_REQUEST_HANDLE;
+			MqttClientNotifyDispatch(client, cbk, MQTT_INVALID_REQUEST_HANDLE, SERVERCOM_DROPPED, user_ctx, service_id);
+		}
+	}
+
+	return handle;
+}
+
+/**
+ * @brief		Send a message with its options. A message with a coalescing key replaces the value of the same key and
+ * 				service still queued: the replaced request is notified SERVERCOM_SUPERSEDED and the new value takes
+ * 				its place in the queue, so a congested link sends one current value per key instead of a backlog.
+ * 				Messages of durable services are not coalesced. Messages with an ordering key are published ahead of
+ * 				the PUBACK of other keys, up to MQTT_ORDERED_WINDOW in flight, and after the PUBACK of the previous
+ * 				message of their own key, also when it has to be published again on a new connection.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: msg			: message to be sent and its options
+ * @param[in]	: service_id	: service id of calling service
+ * @param[out]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @return 		t_MqttRequestHandle
+ * @retval		handle of the accepted request
+ * @retval		MQTT_INVALID_REQUEST_HANDLE : bad request
+ *
+*/
+ t_MqttRequestHandle MqttClient_SendMessage(t_MqttClient *client, const t_MqttMessage *msg, unsigned char service_id, RxCbk cbk, void *user_ctx)
+{
+	return MqttClientSendRouted(client, msg, service_id, cbk, user_ctx, MQTT_NO_ROUTE);
+}
+
+/**
+ * @brief		Non blocking submission: the request is queued only if room is available, no shedding is applied
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: json			: json message to be sent
+ * @param[in]	: size			: size of json message to be sent
+ * @param[in]	: service_id	: service id of calling service
+ * @param[out]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @param[out]	: handle		: handle of the accepted request, may be NULL
+ * @return 		t_MqttSubmitStatus
+ * @retval		MQTT_SUBMIT_OK			: request queued
+ * @retval		MQTT_SUBMIT_WOULD_BLOCK	: no room, cbk is not called
+ * @retval		MQTT_SUBMIT_BAD_REQUEST	: bad request, cbk is not called
+ *
+*/
+ t_MqttSubmitStatus MqttClient_TrySendData(t_MqttClient *client, unsigned char *json, unsigned short size, unsigned char service_id, RxCbk cbk, void *user_ctx, t_MqttRequestHandle *handle)
+{
+	t_MqttRequestHandle req_handle = MQTT_INVALID_REQUEST_HANDLE;
+	t_MqttSubmitStatus status = MQTT_SUBMIT_BAD_REQUEST;
+	t_MqttMessage msg;
+
+	if (( client == NULL ) || ( service_id >= SERVICE_LAST ) || ( json == NULL) ||
+		( cbk == NULL ) || ( size > SERVER_COM_JSON_MAX_SIZE ))
+	{
+		printf("MqttClient: Bad request received, service id: %d, json size:%d ", service_id, size);
+	}
+	else
+	{
+		msg.json = json;
+		msg.size = size;
+		msg.ttl_ms = 0U;
+		msg.key = NULL;
+		msg.key_len = 0U;
+		msg.order_key = NULL;
+		msg.order_key_len = 0U;
+		status = MqttClientSubmit(client, &msg, 1U, service_id, cbk, user_ctx, false, false, MQTT_NO_ROUTE, &req_handle);
+	}
+
+	if ( MQTT_SUBMIT_OK == status )
+	{
+		MqttClientIoWake(client, MQTT_EVT_DATA_SUBMITTED);
+	}
+
+	if ( handle != NULL )
+	{
+		*handle = req_handle;
+	}
+
+	return status;
+}
+
+/**
+ * @brief		Submit several messages of a service at once. Validation and queue reservation are done once
+ * 				for the whole batch: either every message is queued or none, no shedding is applied.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: msgs			: messages to be sent
+ * @param[in]	: count			: number of messages
+ * @param[in]	: service_id	: service id of calling service
+ * @param[out]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @param[in]	: combined		: 1 to notify cbk once with the handle of the first message and the first failure
+ * 								  of the batch, 0 to notify every message
+ * @param[out]	: handles		: handles of the accepted requests, count entries
+ * @return 		t_MqttSubmitStatus
+ * @retval		MQTT_SUBMIT_OK			: every message queued
+ * @retval		MQTT_SUBMIT_WOULD_BLOCK	: no room for the whole batch, cbk is not called
+ * @retval		MQTT_SUBMIT_BAD_REQUEST	: bad request, cbk is not called
+ *
+*/
+ t_MqttSubmitStatus MqttClient_SendBatch(t_MqttClient *client, const t_MqttMessage *msgs, unsigned short count, unsigned char service_id, RxCbk cbk, void *user_ctx, unsigned char combined, t_MqttRequestHandle *handles)
+{
+	t_MqttSubmitStatus status = MQTT_SUBMIT_OK;
+	unsigned short msg;
+
+	if (( client == NULL ) || ( service_id >= SERVICE_LAST ) || ( msgs == NULL) || ( handles == NULL) ||
+		( cbk == NULL ) || ( count == 0U ) || ( count > MQTT_SERVICE_QUEUE_DEPTH ))
+	{
+		status = MQTT_SUBMIT_BAD_REQUEST;
+	}
 
-		/*Store the service notification cbk*/
-		ServiceRequestList[service_id].cbk = cbk;
+	for (msg = 0U; (MQTT_SUBMIT_OK == status) && (msg < count); msg++)
+	{
+		if (( msgs[msg].json == NULL ) || ( msgs[msg].size > SERVER_COM_JSON_MAX_SIZE ) ||
+			(( msgs[msg].order_key_len != 0U ) && ( msgs[msg].order_key == NULL )))
+		{
+			status = MQTT_SUBMIT_BAD_REQUEST;
+		}
+	}
 
-		ServiceRequestList[service_id].json_size = size;
+	if ( MQTT_SUBMIT_OK == status )
+	{
+		status = MqttClientSubmit(client, msgs, count, service_id, cbk, user_ctx, false, (combined != 0U), MQTT_NO_ROUTE, handles);
+	}
 
-		/*Load the retry counter. This must be the last instruction because setting the retry_count
-		 * marks the request as being active. So if this function is interrupted by ServerCom thread
-		 * it shouldn't be the situation in which the retry_counter value !=0 and the rest of the request data not set yet*/
-		ServiceRequestList[service_id].retry_count = MAX_REQ_RETRY_COUNT;
+	if ( MQTT_SUBMIT_OK == status )
+	{
+		MqttClientIoWake(client, MQTT_EVT_DATA_SUBMITTED);
 	}
+
+	/*Logged once for the whole batch*/
+	printf("MqttClient: Batch of %d messages from service %d submitted with status %d", count, service_id, status);
+
+	return status;
 }
 
 /**
- * @brief		External API called to send data to server by other services
+ * @brief		Configure the shedding policy applied by MqttClient_SendData() to a service
  *
- * @param[in]	: void
- * @return		void
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service id to configure
+ * @param[in]	: policy		: shedding policy
+ * @param[in]	: keep_one_in	: N for MQTT_SHED_KEEP_ONE_IN_N, ignored otherwise
+ * @return 		void
+ *
+*/
+ void MqttClient_SetShedPolicy(t_MqttClient *client, unsigned char service_id, t_MqttShedPolicy policy, unsigned short keep_one_in)
+{
+	if ( (client != NULL) && (service_id < SERVICE_LAST) )
+	{
+		MqttClientQueueSetPolicy(client, service_id, policy, keep_one_in);
+	}
+	else
+	{
+		printf("MqttClient: Bad shedding policy request, service id: %d", service_id);
+	}
+}
+
+/**
+ * @brief		Select whether the messages of a service are also published on the warm standby connection, so that
+ * 				the standby broker already holds them when the session fails over
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service id to configure
+ * @param[in]	: enable		: 1 to mirror the messages of the service, 0 to stop
+ * @return 		void
+ *
+*/
+ void MqttClient_SetMirror(t_MqttClient *client, unsigned char service_id, unsigned char enable)
+{
+	if ( (client != NULL) && (service_id < SERVICE_LAST) )
+	{
+		MqttClientFailoverSetMirror(client, service_id, (0U != enable));
+	}
+	else
+	{
+		printf("MqttClient: Bad mirror request, service id: %d", service_id);
+	}
+}
+
+/**
+ * @brief		Make the messages of a service durable: they go to the spool while the client is offline or the queue of
+ * 				the service is full, and are published from there in order once connected
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service id to configure
+ * @param[in]	: enable		: 1 to make the messages of the service durable, 0 to stop
+ * @return 		void
  *
 */
- void MqttClient_CancelRequest(void)
+ void MqttClient_SetDurable(t_MqttClient *client, unsigned char service_id, unsigned char enable)
 {
-	printf("MqttClient: Cancel request received!");
-	cancel_request = true;
+	if ( (client != NULL) && (service_id < SERVICE_LAST) )
+	{
+		MqttClientSpoolSetDurable(client, service_id, (0U != enable));
+	}
+	else
+	{
+		printf("MqttClient: Bad durable request, service id: %d", service_id);
+	}
+}
+
+/**
+ * @brief		Get the number of spooled messages not yet acknowledged by the broker
+ *
+ * @param[in]	: client		: client context
+ * @return 		unsigned int
+ *
+*/
+ unsigned int MqttClient_GetSpoolDepth(t_MqttClient *client)
+{
+	unsigned int depth = 0U;
+
+	if ( client != NULL )
+	{
+		depth = MqttClientSpoolDepth(client);
+	}
+
+	return depth;
+}
+
+/**
+ * @brief		Register the callback notified when the request queue crosses its watermarks
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: cbk			: watermark callback, NULL to disable
+ * @return 		void
+ *
+*/
+ void MqttClient_SetWatermarkCbk(t_MqttClient *client, WatermarkCbk cbk)
+{
+	if ( client != NULL )
+	{
+		MqttClientQueueSetWatermarkCbk(client, cbk);
+	}
+}
+
+/**
+ * @brief		Select how request results are delivered. In MQTT_NOTIFY_COMPLETION_QUEUE mode the protocol engine never
+ * 				calls RxCbk, results are queued and signalled through the completion fd.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: mode			: notification mode
+ * @return 		void
+ *
+*/
+ void MqttClient_SetNotifyMode(t_MqttClient *client, t_MqttNotifyMode mode)
+{
+	if ( client != NULL )
+	{
+		MqttClientNotifySetMode(client, mode);
+	}
+}
+
+/**
+ * @brief		Opt in busy polling for the lowest latency: after each wake up the I/O thread spins on the submissions and
+ * 				the socket for spin_budget_us before sleeping again, and submissions don't signal the eventfd while it
+ * 				spins. The broker socket gets SO_BUSY_POLL and TCP_NODELAY from the next connection. It costs a core while
+ * 				traffic flows, only the self driven I/O thread spins.
+ *
+ * @param[in]	: client			: client context
+ * @param[in]	: spin_budget_us	: time spent spinning before sleeping, 0 to disable
+ * @return 		void
+ *
+*/
+ void MqttClient_SetBusyPoll(t_MqttClient *client, unsigned int spin_budget_us)
+{
+	if ( client != NULL )
+	{
+		__atomic_store_n(&client->io.spin_budget_us, spin_budget_us, __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * @brief		Register the callback notified by the callback executor about callbacks exceeding their budget
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: cbk			: slow callback notification, NULL to disable
+ * @return 		void
+ *
+*/
+ void MqttClient_SetSlowCallbackCbk(t_MqttClient *client, SlowCbkNotify cbk)
+{
+	if ( client != NULL )
+	{
+		MqttClientNotifySetSlowCbk(client, cbk);
+	}
+}
+
+/**
+ * @brief		Get the eventfd signalled when completions are queued, to be watched for readability
+ *
+ * @param[in]	: client		: client context
+ * @return 		int
+ * @retval		>=0 : eventfd
+ * @retval		<0  : completion queue mode not enabled
+ *
+*/
+ int MqttClient_GetCompletionFd(t_MqttClient *client)
+{
+	int fd = -1;
+
+	if ( client != NULL )
+	{
+		fd = MqttClientNotifyGetFd(client);
+	}
+
+	return fd;
+}
+
+/**
+ * @brief		Harvest queued completions, to be called by the application from its own thread
+ *
+ * @param[in]	: client		: client context
+ * @param[out]	: completions	: array receiving the completions
+ * @param[in]	: max			: size of completions array
+ * @return 		unsigned short
+ * @retval		number of completions harvested
+ *
+*/
+ unsigned short MqttClient_HarvestCompletions(t_MqttClient *client, t_MqttCompletion *completions, unsigned short max)
+{
+	unsigned short harvested = 0U;
+
+	if ( (client != NULL) && (completions != NULL) )
+	{
+		harvested = MqttClientNotifyHarvest(client, completions, max);
+	}
+
+	return harvested;
+}
+
+/**
+ * @brief		Get the number of completions that did not fit in the completion queue and waited in its overflow list,
+ * 				none of them is lost
+ *
+ * @param[in]	: client		: client context
+ * @return 		unsigned int
+ *
+*/
+ unsigned int MqttClient_GetCompletionOverflows(t_MqttClient *client)
+{
+	unsigned int overflows = 0U;
+
+	if ( client != NULL )
+	{
+		overflows = MqttClientNotifyGetOverflows(client);
+	}
+
+	return overflows;
+}
+
+/**
+ * @brief		Get the number of callbacks of a service that did not fit in its callback executor queue in
+ * 				MQTT_NOTIFY_EXECUTOR mode and waited in its overflow list: a slow callback only delays results of
+ * 				its own service, none is lost
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service id
+ * @return 		unsigned int
+ *
+*/
+ unsigned int MqttClient_GetExecutorOverflows(t_MqttClient *client, unsigned char service_id)
+{
+	unsigned int overflows = 0U;
+
+	if ( (client != NULL) && (service_id < SERVICE_LAST) )
+	{
+		overflows = MqttClientNotifyGetExecutorOverflows(client, service_id);
+	}
+
+	return overflows;
+}
+
+/**
+ * @brief		External API called to cancel a single request. Other pending requests are not affected.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: handle		: handle returned by MqttClient_SendData()
+ * @return		void
+ *
+*/
+ void MqttClient_CancelRequest(t_MqttClient *client, t_MqttRequestHandle handle)
+{
+	printf("MqttClient: Cancel request received for handle %u", handle);
+
+	/*A stale handle is ignored*/
+	if ( (client == NULL) || (false == MqttClientQueueCancel(client, handle)) )
+	{
+		printf("MqttClient: No pending request with handle %u", handle);
+	}
+	else
+	{
+		MqttClientIoWake(client, MQTT_EVT_DATA_SUBMITTED);
+	}
+}
+
+/**
+ * @brief		Get the file descriptors a host event loop has to watch instead of calling MqttClient_Task().
+ * 				The set changes on reconnection, it has to be fetched again before each wait.
+ *
+ * @param[in]	: client		: client context
+ * @param[out]	: fds		: array receiving the fds, MQTT_MAX_POLL_FDS entries are enough
+ * @param[in]	: max		: size of fds array
+ * @return 		unsigned char
+ * @retval		number of fds reported, 0 in self driven mode
+ *
+*/
+ unsigned char MqttClient_GetPollFds(t_MqttClient *client, t_MqttPollFd *fds, unsigned char max)
+{
+	unsigned char count = 0U;
+
+	/* The I/O thread already watches the fds in self driven mode */
+	if ( (client != NULL) && (false == client->io.self_driven) && (fds != NULL) )
+	{
+		count = MqttClientIoGetFds(client, fds, max);
+	}
+
+	return count;
+}
+
+/**
+ * @brief		Get the time until MqttClient_ProcessEvents() has to be called even if no fd is ready
+ *
+ * @param[in]	: client		: client context
+ * @return 		int
+ * @retval		timeout in milli seconds, to be given to poll() or epoll_wait()
+ * @retval		-1 : no deadline, an idle client only waits for its fds, or self driven mode
+ *
+*/
+ int MqttClient_GetTimeoutMs(t_MqttClient *client)
+{
+	int timeout_ms = -1;
+
+	if ( (client != NULL) && (false == client->io.self_driven) )
+	{
+		timeout_ms = MqttClientIoNextTimeoutMs(client);
+	}
+
+	return timeout_ms;
+}
+
+/**
+ * @brief		Process events, to be called by the host event loop when a reported fd is ready or
+ * 				when the timeout elapsed
+ *
+ * @param[in]	: client		: client context
+ * @return		void
+ *
+*/
+ void MqttClient_ProcessEvents(t_MqttClient *client)
+{
+	/* The I/O thread is the only one running the FSMs in self driven mode */
+	if ( (client != NULL) && (false == client->io.self_driven) )
+	{
+		/* The ready fd is not known, the sockets are read without waiting */
+		MqttClientIoPost(client, MQTT_EVT_BYTES_READABLE);
+		MqttClientNetlinkProcess(client);
+		MqttClientFailoverProcess(client);
+		MqttClientIoProcess(client);
+	}
+}
+
+/**
+ * @brief		Check whether the client is connected to its broker and able to publish
+ *
+ * @param[in]	: client		: client context
+ * @return 		unsigned char
+ * @retval		1 : connected, queued requests are being sent
+ * @retval		0 : not connected yet or reconnecting
+ *
+*/
+ unsigned char MqttClient_IsConnected(t_MqttClient *client)
+{
+	unsigned char connected = 0U;
+
+	/* the state of the FSM is only read by the thread running it, the others read what it published */
+	if ( (client != NULL) && (true == MqttClientShardIsUp(client)) )
+	{
+		connected = 1U;
+	}
+
+	return connected;
+}
+
+/**
+ * @brief		Create a connection pool: one client context per configuration, started as by MqttClient_Init()
+ *
+ * @param[in]	: configs		: configuration of each member, NULL for MqttClientCfg.h values
+ * @param[in]	: count			: number of members
+ * @return 		t_MqttClientPool*
+ * @retval		connection pool
+ * @retval		NULL : bad request, MQTT_MAX_POOLS pools or MQTT_MAX_CLIENTS contexts already created, or error in
+ * 				  starting a member, the members already started are released
+ *
+*/
+ t_MqttClientPool* MqttClient_PoolInit(const t_MqttClientConfig *configs, unsigned char count)
+{
+	t_MqttClientPool *pool = NULL;
+	t_MqttClient *members[MQTT_MAX_CLIENTS];
+	unsigned char idx;
+
+	if ( (count == ZERO) || (count > MQTT_MAX_CLIENTS) )
+	{
+		printf("MqttClient: Bad pool request, %d members", count);
+	}
+	else
+	{
+		for (idx = 0U; idx < count; idx++)
+		{
+			members[idx] = MqttClient_Init((configs != NULL) ? &configs[idx] : NULL);
+			if ( members[idx] == NULL )
+			{
+				break;
+			}
+		}
+
+		if ( idx == count )
+		{
+			pool = MqttClientPoolCreate(members, count);
+		}
+
+		/* a pool is created whole or not at all, the members already created are given back */
+		if ( pool == NULL )
+		{
+			printf("MqttClient: Pool of %d members can't be created", count);
+			while ( idx > 0U )
+			{
+				idx--;
+				MqttClientRelease(members[idx]);
+			}
+		}
+	}
+
+	return pool;
+}
+
+/**
+ * @brief		Get the member owning a key. A key keeps its member as long as the member is connected or still
+ * 				holds queued, spooled or in flight requests of the key, so the messages of a key keep their order.
+ * 				The other keys of a member that lost its broker move to the next connected members of the ring.
+ *
+ * @param[in]	: pool			: connection pool
+ * @param[in]	: key			: routing key, usually the topic or the device id of the message
+ * @param[in]	: key_len		: length of key
+ * @return 		t_MqttClient*
+ * @retval		member owning the key, every API of the client context may be used on it
+ * @retval		NULL : bad request
+ *
+*/
+ t_MqttClient* MqttClient_PoolRoute(t_MqttClientPool *pool, const unsigned char *key, unsigned short key_len)
+{
+	t_MqttClient *member = NULL;
+
+	if ( (pool != NULL) && (key != NULL) )
+	{
+		member = MqttClientPoolRoute(pool, key, key_len, NULL);
+	}
+
+	return member;
+}
+
+/**
+ * @brief		Send data through the member owning a key, see MqttClient_SendData()
+ *
+ * @param[in]	: pool			: connection pool
+ * @param[in]	: key			: routing key, NULL to route by service id
+ * @param[in]	: key_len		: length of key
+ * @param[in]	: json			: json message to be sent
+ * @param[in]	: size			: size of json message to be sent
+ * @param[in]	: service_id	: service id of calling service
+ * @param[out]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @param[out]	: member		: member the request was given to, needed to cancel it, may be NULL
+ * @return 		t_MqttRequestHandle
+ * @retval		handle of the accepted request
+ * @retval		MQTT_INVALID_REQUEST_HANDLE : bad request
+ *
+*/
+ t_MqttRequestHandle MqttClient_PoolSendData(t_MqttClientPool *pool, const unsigned char *key, unsigned short key_len,
+		 unsigned char *json, unsigned short size, unsigned char service_id, RxCbk cbk, void *user_ctx, t_MqttClient **member)
+{
+	t_MqttClient *client = NULL;
+	t_MqttMessage msg;
+	unsigned short route = MQTT_NO_ROUTE;
+
+	if ( pool != NULL )
+	{
+		/* Without key the messages of a service keep their order on a single member */
+		client = (key != NULL) ? MqttClientPoolRoute(pool, key, key_len, &route) :
+								 MqttClientPoolRoute(pool, &service_id, 1U, &route);
+
+		/* the key stays on this member until the request is released */
+		MqttClientQueueRouteHold(client, route);
+	}
+
+	if ( member != NULL )
+	{
+		*member = client;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.json = json;
+	msg.size = size;
+
+	/* A NULL client reports the bad request through cbk */
+	return MqttClientSendRouted(client, &msg, service_id, cbk, user_ctx, route);
+}
+
+/**
+ * @brief		Get a member of a pool, to drive it from a host event loop or to change its settings
+ *
+ * @param[in]	: pool			: connection pool
+ * @param[in]	: index			: index of the member, in the order of the configurations
+ * @return 		t_MqttClient*
+ * @retval		NULL : no such member
+ *
+*/
+ t_MqttClient* MqttClient_PoolGetMember(t_MqttClientPool *pool, unsigned char index)
+{
+	t_MqttClient *member = NULL;
+
+	if ( (pool != NULL) && (index < pool->member_count) )
+	{
+		member = pool->members[index];
+	}
+
+	return member;
+}
+
+/**
+ * @brief		Periodical task of a pool, runs MqttClient_Task() of every member
+ *
+ * @param[in]	: pool			: connection pool
+ * @return 		void
+ *
+*/
+ void MqttClient_PoolTask(t_MqttClientPool *pool)
+{
+	unsigned char idx;
+
+	if ( pool != NULL )
+	{
+		for (idx = 0U; idx < pool->member_count; idx++)
+		{
+			MqttClient_Task(pool->members[idx]);
+		}
+	}
+}
+
+/**
+ * @brief		Create a sharded runtime: one self driven client context per configuration, the I/O thread of
+ * 				shard i pinned to cpu i. A shard owns its connection, queues and timers and is only run by its
+ * 				own thread, nothing is shared between shards. Messages are routed as in a connection pool.
+ *
+ * @param[in]	: configs		: configuration of each shard, NULL for MqttClientCfg.h values
+ * @param[in]	: count			: number of shards, usually the number of cores
+ * @return 		t_MqttClientPool*
+ * @retval		pool of the shards
+ * @retval		NULL : bad request, MQTT_MAX_POOLS pools or MQTT_MAX_CLIENTS contexts already created, or error in
+ * 				  starting a shard, the shards already started are released
+ *
+*/
+ t_MqttClientPool* MqttClient_ShardsInit(const t_MqttClientConfig *configs, unsigned char count)
+{
+	t_MqttClientPool *pool = NULL;
+	t_MqttClient *members[MQTT_MAX_CLIENTS];
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned char idx;
+
+	if ( (count == ZERO) || (count > MQTT_MAX_CLIENTS) )
+	{
+		printf("MqttClient: Bad shards request, %d shards", count);
+	}
+	else
+	{
+		if ( cpus < 1 )
+		{
+			cpus = 1;
+		}
+
+		for (idx = 0U; idx < count; idx++)
+		{
+			/* more shards than cores share the cores round robin */
+			members[idx] = MqttClientCreate((configs != NULL) ? &configs[idx] : NULL, true, (int)(idx % cpus));
+			if ( members[idx] == NULL )
+			{
+				break;
+			}
+		}
+
+		if ( idx == count )
+		{
+			pool = MqttClientPoolCreate(members, count);
+		}
+
+		/* the I/O threads of the shards already started are stopped and their contexts given back */
+		if ( pool == NULL )
+		{
+			printf("MqttClient: %d shards can't be created", count);
+			while ( idx > 0U )
+			{
+				idx--;
+				MqttClientRelease(members[idx]);
+			}
+		}
+	}
+
+	return pool;
+}
+
+/**
+ * @brief		Send data from any thread through the shard owning a key. The message is copied in a lock free
+ * 				handoff and queued by the I/O thread of the shard, the handle of the request is given to cbk.
+ *
+ * @param[in]	: pool			: pool of the shards
+ * @param[in]	: key			: routing key, NULL to route by service id
+ * @param[in]	: key_len		: length of key
+ * @param[in]	: json			: json message to be sent
+ * @param[in]	: size			: size of json message to be sent
+ * @param[in]	: service_id	: service id of calling service
+ * @param[out]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @return 		t_MqttSubmitStatus
+ * @retval		MQTT_SUBMIT_OK			: request handed off
+ * @retval		MQTT_SUBMIT_WOULD_BLOCK	: handoff of the shard full, cbk is not called
+ * @retval		MQTT_SUBMIT_BAD_REQUEST	: bad request, cbk is not called
+ *
+*/
+ t_MqttSubmitStatus MqttClient_ShardSendData(t_MqttClientPool *pool, const unsigned char *key, unsigned short key_len,
+		 unsigned char *json, unsigned short size, unsigned char service_id, RxCbk cbk, void *user_ctx)
+{
+	t_MqttSubmitStatus status = MQTT_SUBMIT_BAD_REQUEST;
+	t_MqttClient *shard = NULL;
+	unsigned short route = MQTT_NO_ROUTE;
+
+	if (( pool == NULL ) || ( service_id >= SERVICE_LAST ) || ( json == NULL) ||
+		( cbk == NULL ) || ( size > SERVER_COM_JSON_MAX_SIZE ))
+	{
+		printf("MqttClient: Bad request received, service id: %d, json size:%d ", service_id, size);
+	}
+	else
+	{
+		/* routing only reads the held buckets published by each shard, the shard holds the bucket once it drains the cell */
+		shard = (key != NULL) ? MqttClientPoolRoute(pool, key, key_len, &route) :
+								MqttClientPoolRoute(pool, &service_id, 1U, &route);
+
+		if ( true == MqttClientShardPush(shard, json, size, service_id, cbk, user_ctx, route) )
+		{
+			status = MQTT_SUBMIT_OK;
+			MqttClientIoWake(shard, MQTT_EVT_DATA_SUBMITTED);
+		}
+		else
+		{
+			status = MQTT_SUBMIT_WOULD_BLOCK;
+		}
+	}
+
+	return status;
+}
+
+/**
+ * @brief		Clock callback reading a virtual clock, to be set as clock of a configuration
+ *
+ * @param[in]	: clock_ctx		: t_MqttVirtualClock
+ * @return 		uint64_t
+ * @retval		current virtual time in milli seconds
+ *
+*/
+ uint64_t MqttClient_VirtualClockNow(void *clock_ctx)
+{
+	t_MqttVirtualClock *clock = (t_MqttVirtualClock *)clock_ctx;
+
+	return __atomic_load_n(&clock->now_ms, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief		Move a virtual clock straight to the next cycle of the timer wheels of its clients and wake them
+ * 				up, so that keep alive, retry and reconnection scenarios run without waiting for the wall clock.
+ * 				A cycle is a deadline, or the time a distant timer moves down the wheel: a scenario advances the
+ * 				clock until the transition it waits for, see VirtualTimeScenario.c. The clients then run their
+ * 				elapsed timers in MqttClient_ProcessEvents() or MqttClient_Task(). The deadlines of self driven
+ * 				clients are owned by their I/O thread, they are only woken up.
+ *
+ * @param[in]	: clock		: virtual clock
+ * @param[in]	: clients	: client contexts using the clock
+ * @param[in]	: count		: number of clients
+ * @return 		int
+ * @retval		milli seconds the clock moved, 0 when a client has work pending at the current time
+ * @retval		-1 : no timer running, only socket data can wake the clients up
+ *
+*/
+ int MqttClient_VirtualClockAdvance(t_MqttVirtualClock *clock, t_MqttClient * const *clients, unsigned char count)
+{
+	int step_ms = -1;
+	int timeout_ms = -1;
+	unsigned char idx;
+
+	if ( (clock != NULL) && (clients != NULL) )
+	{
+		/* the earliest deadline of all clients, a later one would make the others fire late */
+		for (idx = 0U; idx < count; idx++)
+		{
+			if ( (clients[idx] != NULL) && (false == clients[idx]->io.self_driven) )
+			{
+				timeout_ms = MqttClientIoNextTimeoutMs(clients[idx]);
+
+				if ( (timeout_ms >= 0) && ((step_ms < 0) || (timeout_ms < step_ms)) )
+				{
+					step_ms = timeout_ms;
+				}
+			}
+		}
+
+		if ( step_ms > 0 )
+		{
+			(void)__atomic_add_fetch(&clock->now_ms, (uint64_t)step_ms, __ATOMIC_SEQ_CST);
+		}
+
+		/* a host driven client is run by the caller, only an I/O thread has to be told the time moved */
+		for (idx = 0U; idx < count; idx++)
+		{
+			if ( (clients[idx] != NULL) && (true == clients[idx]->io.self_driven) )
+			{
+				MqttClientIoWake(clients[idx], 0U);
+			}
+		}
+	}
+
+	return step_ms;
 }
@@ -15,18 +15,100 @@
 #ifndef MQTTCLIENT_H
 #define MQTTCLIENT_H
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* -------------------------------- Includes -------------------------------- */
 
+#include <stdint.h>
+
 /* -------------------------------- Defines --------------------------------- */
 /**
-* @def MQTTCLIENTH2_HANDLER
-* Defines MqttClientH2 component handler for FSM.
+* @def MQTT_INVALID_REQUEST_HANDLE
+* Handle returned when a request could not be accepted.
+*/
+#define MQTT_INVALID_REQUEST_HANDLE       ((t_MqttRequestHandle)0)
+
+/**
+* @def MQTT_HANDLE_INDEX_BITS
+* Number of low order bits of a request handle holding the request pool index.
+*/
+#define MQTT_HANDLE_INDEX_BITS            ((unsigned int)8)
+
+/**
+* @def MQTT_POLL_IN
+* Event flag of t_MqttPollFd: the fd has to be watched for readability.
+*/
+#define MQTT_POLL_IN                      ((unsigned short)0x0001)
+
+/**
+* @def MQTT_POLL_OUT
+* Event flag of t_MqttPollFd: the fd has to be watched for writability.
+*/
+#define MQTT_POLL_OUT                     ((unsigned short)0x0002)
+
+/**
+* @def MQTT_MAX_POLL_FDS
+* Max number of fds reported by MqttClient_GetPollFds().
 */
-#define MQTTCLIENTH2_HANDLER              ((unsigned char)0)
+#define MQTT_MAX_POLL_FDS                 ((unsigned char)4)
 /* ------------------------------- Data Types ------------------------------- */
 
-/*Callback function for service notification*/
-typedef void (*RxCbk)(unsigned char server_response);
+/*Client context: connection to a broker with its own queues, timers and FSM instances. Every API takes the
+ * context returned by MqttClient_Init(), different contexts may be driven from different threads */
+typedef struct s_MqttClient t_MqttClient;
+
+/*Connection pool: several client contexts, possibly connected to different brokers of a cluster. Each message is
+ * routed to a member by consistent hashing of its key, so messages of a key keep their order */
+typedef struct s_MqttClientPool t_MqttClientPool;
+
+/*Clock read by the timers of a client context: current time in milli seconds of a monotonic time base*/
+typedef uint64_t (*MqttClockCbk)(void *clock_ctx);
+
+/*Virtual clock: time only moves when MqttClient_VirtualClockAdvance() is called, given as clock_ctx of the
+ * configuration together with MqttClient_VirtualClockNow(). Several contexts may share one clock*/
+typedef struct {
+	uint64_t		now_ms;/*current virtual time*/
+} t_MqttVirtualClock;
+
+/*Broker of the ordered broker list of a configuration*/
+typedef struct {
+	const char		*address;/*broker host name or address*/
+	int				port;/*broker port, 0 for SERVER_PORT*/
+} t_MqttBroker;
+
+/*Configuration of a client context, a NULL field keeps the value of MqttClientCfg.h. Strings are referenced,
+ * not copied, they have to stay valid as long as the context is used */
+typedef struct {
+	const char		*server_address;/*broker host name or address*/
+	int				server_port;/*broker port, 0 for SERVER_PORT*/
+	const char		*client_id;/*client id sent in connect packet*/
+	const char		*username;/*user name sent in connect packet*/
+	const char		*password;/*password sent in connect packet*/
+	MqttClockCbk	clock;/*clock of the timers, NULL for the monotonic clock*/
+	void			*clock_ctx;/*context given to clock*/
+	const char		*uplink_interface;/*interface reaching the broker, "" for the one owning the local address*/
+	const t_MqttBroker	*brokers;/*brokers in order of preference, NULL for server_address alone*/
+	unsigned char	broker_count;/*number of brokers, at most MQTT_MAX_BROKERS*/
+	unsigned char	warm_standby;/*1 to keep a connection to the next broker of the list ready for failover*/
+	const char		*standby_client_id;/*client id of the standby connection, NULL for client_id with MQTT_STANDBY_ID_SUFFIX*/
+	const char		*spool_dir;/*directory of the spool of durable services, "" to disable*/
+} t_MqttClientConfig;
+
+/*Handle identifying a single request submitted by MqttClient_SendData() */
+typedef unsigned int t_MqttRequestHandle;
+
+/*Callback function for service notification, receives the handle of the completed request and the
+ * user context pointer given on submission */
+typedef void (*RxCbk)(t_MqttRequestHandle handle, unsigned char server_response, void *user_ctx);
+
+/*Callback function notified by the callback executor when a RxCbk ran longer than MQTT_CALLBACK_BUDGET_US*/
+typedef void (*SlowCbkNotify)(unsigned char service_id, t_MqttRequestHandle handle, unsigned int duration_us);
+
+/*Callback function for queue watermark notification: high is 1 when the high watermark is crossed upwards
+ * and 0 when the queue drained below the low watermark. depth is the number of queued requests */
+typedef void (*WatermarkCbk)(unsigned char high, unsigned short depth);
 
 /*Services ID used by MqttClientH2_SendData() */
 typedef enum {
@@ -42,51 +124,509 @@ typedef enum {
 	SERVERCOM_CANCELED,
 	SERVERCOM_BAD_REQUEST,/*Properly formatted response was received from server but status code is not 200 or 480*/
 	SERVERCOM_BAD_FORMAT_RESPONSE,/*Response with invalid format was received from server*/
+	SERVERCOM_DROPPED,/*Request was shed by the overload policy of its service*/
+	SERVERCOM_SPOOLED,/*Message of a durable service was stored in the spool, it is published from there and can't be canceled*/
+	SERVERCOM_EXPIRED,/*Time to live of the request elapsed before it was acknowledged, it is not sent anymore*/
+	SERVERCOM_SUPERSEDED,/*Request replaced by a newer value of its coalescing key before it was sent*/
 } t_ServerReplyCodes;
 
+/*Status returned by MqttClient_TrySendData()*/
+typedef enum {
+	MQTT_SUBMIT_OK = 0,
+	MQTT_SUBMIT_WOULD_BLOCK,/*Queue of the service or request pool is full, nothing was queued*/
+	MQTT_SUBMIT_DROPPED,/*Request was shed by the overload policy of its service*/
+	MQTT_SUBMIT_BAD_REQUEST,
+} t_MqttSubmitStatus;
+
+/*How request results are delivered to the services*/
+typedef enum {
+	MQTT_NOTIFY_INLINE = 0,/*RxCbk is called by the protocol engine itself*/
+	MQTT_NOTIFY_COMPLETION_QUEUE,/*Results are queued and harvested by the application with MqttClient_HarvestCompletions()*/
+	MQTT_NOTIFY_EXECUTOR,/*RxCbk is called by the worker thread of its service in the callback executor, in order*/
+} t_MqttNotifyMode;
+
+/*Result harvested from the completion queue*/
+typedef struct {
+	RxCbk				cbk;/*callback given on submission, the application may call it from its own thread*/
+	t_MqttRequestHandle	handle;/*handle of the completed request*/
+	void				*user_ctx;/*user context pointer given on submission*/
+	unsigned char		server_response;/*one of t_ServerReplyCodes*/
+} t_MqttCompletion;
+
+/*Message submitted by MqttClient_SendMessage() or in a batch by MqttClient_SendBatch()*/
+typedef struct {
+	unsigned char	*json;/*json message to be sent*/
+	unsigned short	size;/*size of json message to be sent*/
+	unsigned int	ttl_ms;/*time to live of the message from its submission, 0 if it never expires*/
+	const unsigned char	*key;/*coalescing key, a newer value of the key replaces the queued one not sent yet. NULL to send
+						 * every value, ignored in a batch*/
+	unsigned short	key_len;/*length of key, at most MQTT_COALESCE_KEY_SIZE*/
+	const unsigned char	*order_key;/*ordering key, messages of the service sharing it are published one at a time in
+						 * submission order while other keys are published in parallel. NULL to be published
+						 * through the single request in flight*/
+	unsigned short	order_key_len;/*length of order_key*/
+} t_MqttMessage;
+
+/*File descriptor the host event loop has to watch, reported by MqttClient_GetPollFds()*/
+typedef struct {
+	int				fd;/*file descriptor*/
+	unsigned short	events;/*MQTT_POLL_IN and/or MQTT_POLL_OUT*/
+} t_MqttPollFd;
+
+/*Overload shedding policies applied by MqttClient_SendData() when a service queue is saturated*/
+typedef enum {
+	MQTT_SHED_DROP_NEWEST = 0,/*The new request is rejected*/
+	MQTT_SHED_DROP_OLDEST,/*The oldest request not yet sent is dropped to make room*/
+	MQTT_SHED_KEEP_ONE_IN_N,/*Above the high watermark only one request out of N is accepted*/
+} t_MqttShedPolicy;
+
 /* ---------------------------- Global Variables ---------------------------- */
 
 /* --------------------------- Routine prototypes --------------------------- */
 
 /**
- * @brief	MqttClientH2 initialization
+ * @brief	MqttClientH2 initialization: create a client context and start its FSMs
  *
- * @param[in]	: void
- * @return 		void
+ * @param[in]	: config	: broker and credentials of the context, NULL for MqttClientCfg.h values
+ * @return 		t_MqttClient*
+ * @retval		client context
+ * @retval		NULL : MQTT_MAX_CLIENTS contexts already created or error in starting the I/O thread
  *
 */
- void MqttClient_Init(void);
+ t_MqttClient* MqttClient_Init(const t_MqttClientConfig *config);
 
 /**
  * @brief	MqttClientH2 periodical task
  *
- * @param[in]	: void
+ * @param[in]	: client	: client context
  * @return 		void
  *
 */
- void MqttClient_Task(void);
+ void MqttClient_Task(t_MqttClient *client);
 
 /**
  * @brief		External API called to send data to server by other services
  *
+ * @param[in]	: client		: client context
+ * @param[in]	: json			: json message to be sent
+ * @param[in]	: size			: size of json message to be sent
+ * @param[in]	: service_id	: service id of calling service
+ * @param[out]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @return 		t_MqttRequestHandle
+ * @retval		handle of the accepted request
+ * @retval		MQTT_INVALID_REQUEST_HANDLE : bad request
+ *
+*/
+ t_MqttRequestHandle MqttClient_SendData(t_MqttClient *client, unsigned char *json, unsigned short size, unsigned char service_id, RxCbk cbk, void *user_ctx);
+
+/**
+ * @brief		Send data that is useless once older than its time to live. A request still queued when it expires is
+ * 				dropped and notified SERVERCOM_EXPIRED, a request in flight is not retransmitted anymore. With MQTT_V_5
+ * 				the time left is also given to the broker as Message Expiry Interval.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: json			: json message to be sent
+ * @param[in]	: size			: size of json message to be sent
+ * @param[in]	: service_id	: service id of calling service
+ * @param[in]	: ttl_ms		: time to live of the message from now, 0 if it never expires
+ * @param[out]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @return 		t_MqttRequestHandle
+ * @retval		handle of the accepted request
+ * @retval		MQTT_INVALID_REQUEST_HANDLE : bad request
+ *
+*/
+ t_MqttRequestHandle MqttClient_SendDataTtl(t_MqttClient *client, unsigned char *json, unsigned short size, unsigned char service_id, unsigned int ttl_ms, RxCbk cbk, void *user_ctx);
+
+/**
+ * @brief		Send a message with its options. A message with a coalescing key replaces the value of the same key and
+ * 				service still queued: the replaced request is notified SERVERCOM_SUPERSEDED and the new value takes
+ * 				its place in the queue, so a congested link sends one current value per key instead of a backlog.
+ * 				Messages of durable services are not coalesced. Messages with an ordering key are published ahead of
+ * 				the PUBACK of other keys, up to MQTT_ORDERED_WINDOW in flight, and after the PUBACK of the previous
+ * 				message of their own key, also when it has to be published again on a new connection.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: msg			: message to be sent and its options
+ * @param[in]	: service_id	: service id of calling service
+ * @param[out]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @return 		t_MqttRequestHandle
+ * @retval		handle of the accepted request
+ * @retval		MQTT_INVALID_REQUEST_HANDLE : bad request
+ *
+*/
+ t_MqttRequestHandle MqttClient_SendMessage(t_MqttClient *client, const t_MqttMessage *msg, unsigned char service_id, RxCbk cbk, void *user_ctx);
+
+/**
+ * @brief		Non blocking submission: the request is queued only if room is available, no shedding is applied
+ *
+ * @param[in]	: client		: client context
  * @param[in]	: json			: json message to be sent
  * @param[in]	: size			: size of json message to be sent
  * @param[in]	: service_id	: service id of calling service
  * @param[out]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @param[out]	: handle		: handle of the accepted request, may be NULL
+ * @return 		t_MqttSubmitStatus
+ * @retval		MQTT_SUBMIT_OK			: request queued
+ * @retval		MQTT_SUBMIT_WOULD_BLOCK	: no room, cbk is not called
+ * @retval		MQTT_SUBMIT_BAD_REQUEST	: bad request, cbk is not called
+ *
+*/
+ t_MqttSubmitStatus MqttClient_TrySendData(t_MqttClient *client, unsigned char *json, unsigned short size, unsigned char service_id, RxCbk cbk, void *user_ctx, t_MqttRequestHandle *handle);
+
+/**
+ * @brief		Submit several messages of a service at once. Validation and queue reservation are done once
+ * 				for the whole batch: either every message is queued or none, no shedding is applied.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: msgs			: messages to be sent
+ * @param[in]	: count			: number of messages
+ * @param[in]	: service_id	: service id of calling service
+ * @param[out]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @param[in]	: combined		: 1 to notify cbk once with the handle of the first message and the first failure
+ * 								  of the batch, 0 to notify every message
+ * @param[out]	: handles		: handles of the accepted requests, count entries
+ * @return 		t_MqttSubmitStatus
+ * @retval		MQTT_SUBMIT_OK			: every message queued
+ * @retval		MQTT_SUBMIT_WOULD_BLOCK	: no room for the whole batch, cbk is not called
+ * @retval		MQTT_SUBMIT_BAD_REQUEST	: bad request, cbk is not called
+ *
+*/
+ t_MqttSubmitStatus MqttClient_SendBatch(t_MqttClient *client, const t_MqttMessage *msgs, unsigned short count, unsigned char service_id, RxCbk cbk, void *user_ctx, unsigned char combined, t_MqttRequestHandle *handles);
+
+/**
+ * @brief		Configure the shedding policy applied by MqttClient_SendData() to a service
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service id to configure
+ * @param[in]	: policy		: shedding policy
+ * @param[in]	: keep_one_in	: N for MQTT_SHED_KEEP_ONE_IN_N, ignored otherwise
  * @return 		void
  *
 */
- void MqttClient_SendData(unsigned char *json, unsigned short size, unsigned char service_id, RxCbk cbk);
+ void MqttClient_SetShedPolicy(t_MqttClient *client, unsigned char service_id, t_MqttShedPolicy policy, unsigned short keep_one_in);
 
 /**
- * @brief		External API called to send data to server by other services
+ * @brief		Mirror the messages of a service to the broker of the warm standby as well. The copy is sent once when the
+ * 				message is first published and is not retransmitted, the result of the request is the one of the broker
+ * 				in use. Nothing is mirrored while the standby is not connected.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service id to configure
+ * @param[in]	: enable		: 1 to mirror the messages of the service, 0 to stop
+ * @return 		void
+ *
+*/
+ void MqttClient_SetMirror(t_MqttClient *client, unsigned char service_id, unsigned char enable);
+
+/**
+ * @brief		Make the messages of a service durable. They are appended to the spool instead of the request queue while
+ * 				the client is offline, while the queue of the service is full, or while older messages of the service
+ * 				are still spooled. Such messages are notified SERVERCOM_SPOOLED, survive a restart of the process and are
+ * 				published at least once, in order, when the client is connected. Requests of a durable service are not
+ * 				timed out while offline. Nothing is spooled without spool directory.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service id to configure
+ * @param[in]	: enable		: 1 to make the messages of the service durable, 0 to stop
+ * @return 		void
+ *
+*/
+ void MqttClient_SetDurable(t_MqttClient *client, unsigned char service_id, unsigned char enable);
+
+/**
+ * @brief		Get the number of spooled messages not yet acknowledged by the broker
+ *
+ * @param[in]	: client		: client context
+ * @return 		unsigned int
+ *
+*/
+ unsigned int MqttClient_GetSpoolDepth(t_MqttClient *client);
+
+/**
+ * @brief		Register the callback notified when the request queue crosses its watermarks
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: cbk			: watermark callback, NULL to disable
+ * @return 		void
+ *
+*/
+ void MqttClient_SetWatermarkCbk(t_MqttClient *client, WatermarkCbk cbk);
+
+/**
+ * @brief		Select how request results are delivered. In MQTT_NOTIFY_COMPLETION_QUEUE mode the protocol engine never
+ * 				calls RxCbk, results are queued and signalled through the completion fd.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: mode			: notification mode
+ * @return 		void
+ *
+*/
+ void MqttClient_SetNotifyMode(t_MqttClient *client, t_MqttNotifyMode mode);
+
+/**
+ * @brief		Opt in busy polling for the lowest latency: after each wake up the I/O thread spins on the submissions and
+ * 				the socket for spin_budget_us before sleeping again, and submissions don't signal the eventfd while it
+ * 				spins. The broker socket gets SO_BUSY_POLL and TCP_NODELAY from the next connection. It costs a core while
+ * 				traffic flows, only the self driven I/O thread spins.
+ *
+ * @param[in]	: client			: client context
+ * @param[in]	: spin_budget_us	: time spent spinning before sleeping, 0 to disable
+ * @return 		void
+ *
+*/
+ void MqttClient_SetBusyPoll(t_MqttClient *client, unsigned int spin_budget_us);
+
+/**
+ * @brief		Register the callback notified by the callback executor about callbacks exceeding their budget
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: cbk			: slow callback notification, NULL to disable
+ * @return 		void
+ *
+*/
+ void MqttClient_SetSlowCallbackCbk(t_MqttClient *client, SlowCbkNotify cbk);
+
+/**
+ * @brief		Get the eventfd signalled when completions are queued, to be watched for readability
+ *
+ * @param[in]	: client		: client context
+ * @return 		int
+ * @retval		>=0 : eventfd
+ * @retval		<0  : completion queue mode not enabled
+ *
+*/
+ int MqttClient_GetCompletionFd(t_MqttClient *client);
+
+/**
+ * @brief		Harvest queued completions, to be called by the application from its own thread
+ *
+ * @param[in]	: client		: client context
+ * @param[out]	: completions	: array receiving the completions
+ * @param[in]	: max			: size of completions array
+ * @return 		unsigned short
+ * @retval		number of completions harvested
+ *
+*/
+ unsigned short MqttClient_HarvestCompletions(t_MqttClient *client, t_MqttCompletion *completions, unsigned short max);
+
+/**
+ * @brief		Get the number of completions that did not fit in the completion queue and waited in its overflow list,
+ * 				none of them is lost
+ *
+ * @param[in]	: client		: client context
+ * @return 		unsigned int
+ *
+*/
+ unsigned int MqttClient_GetCompletionOverflows(t_MqttClient *client);
+
+/**
+ * @brief		Get the number of callbacks of a service that did not fit in its callback executor queue in
+ * 				MQTT_NOTIFY_EXECUTOR mode and waited in its overflow list: a slow callback only delays results of
+ * 				its own service, none is lost
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service id
+ * @return 		unsigned int
+ *
+*/
+ unsigned int MqttClient_GetExecutorOverflows(t_MqttClient *client, unsigned char service_id);
+
+/**
+ * @brief		External API called to cancel a single request. Other pending requests are not affected.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: handle		: handle returned by MqttClient_SendData()
+ * @return 		void
+ *
+*/
+ void MqttClient_CancelRequest(t_MqttClient *client, t_MqttRequestHandle handle);
+
+/**
+ * @brief		Get the file descriptors a host event loop has to watch instead of calling MqttClient_Task().
+ * 				The set changes on reconnection, it has to be fetched again before each wait.
+ *
+ * @param[in]	: client		: client context
+ * @param[out]	: fds		: array receiving the fds, MQTT_MAX_POLL_FDS entries are enough
+ * @param[in]	: max		: size of fds array
+ * @return 		unsigned char
+ * @retval		number of fds reported, 0 in self driven mode
+ *
+*/
+ unsigned char MqttClient_GetPollFds(t_MqttClient *client, t_MqttPollFd *fds, unsigned char max);
+
+/**
+ * @brief		Get the time until MqttClient_ProcessEvents() has to be called even if no fd is ready
+ *
+ * @param[in]	: client		: client context
+ * @return 		int
+ * @retval		timeout in milli seconds, to be given to poll() or epoll_wait()
+ * @retval		-1 : no deadline, an idle client only waits for its fds, or self driven mode
+ *
+*/
+ int MqttClient_GetTimeoutMs(t_MqttClient *client);
+
+/**
+ * @brief		Process events, to be called by the host event loop when a reported fd is ready or
+ * 				when the timeout elapsed
+ *
+ * @param[in]	: client		: client context
+ * @return 		void
+ *
+*/
+ void MqttClient_ProcessEvents(t_MqttClient *client);
+
+/**
+ * @brief		Check whether the client is connected to its broker and able to publish
+ *
+ * @param[in]	: client		: client context
+ * @return 		unsigned char
+ * @retval		1 : connected, queued requests are being sent
+ * @retval		0 : not connected yet or reconnecting
+ *
+*/
+ unsigned char MqttClient_IsConnected(t_MqttClient *client);
+
+/**
+ * @brief		Create a connection pool: one client context per configuration, started as by MqttClient_Init()
+ *
+ * @param[in]	: configs		: configuration of each member, NULL for MqttClientCfg.h values
+ * @param[in]	: count			: number of members
+ * @return 		t_MqttClientPool*
+ * @retval		connection pool
+ * @retval		NULL : bad request, MQTT_MAX_POOLS pools or MQTT_MAX_CLIENTS contexts already created, or error in
+ * 				  starting a member, the members already started are released
+ *
+*/
+ t_MqttClientPool* MqttClient_PoolInit(const t_MqttClientConfig *configs, unsigned char count);
+
+/**
+ * @brief		Get the member owning a key. A key keeps its member as long as the member is connected or still
+ * 				holds queued, spooled or in flight requests of the key, so the messages of a key keep their order.
+ * 				The other keys of a member that lost its broker move to the next connected members of the ring.
+ *
+ * @param[in]	: pool			: connection pool
+ * @param[in]	: key			: routing key, usually the topic or the device id of the message
+ * @param[in]	: key_len		: length of key
+ * @return 		t_MqttClient*
+ * @retval		member owning the key, every API of the client context may be used on it
+ * @retval		NULL : bad request
+ *
+*/
+ t_MqttClient* MqttClient_PoolRoute(t_MqttClientPool *pool, const unsigned char *key, unsigned short key_len);
+
+/**
+ * @brief		Send data through the member owning a key, see MqttClient_SendData()
+ *
+ * @param[in]	: pool			: connection pool
+ * @param[in]	: key			: routing key, NULL to route by service id
+ * @param[in]	: key_len		: length of key
+ * @param[in]	: json			: json message to be sent
+ * @param[in]	: size			: size of json message to be sent
+ * @param[in]	: service_id	: service id of calling service
+ * @param[out]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @param[out]	: member		: member the request was given to, needed to cancel it, may be NULL
+ * @return 		t_MqttRequestHandle
+ * @retval		handle of the accepted request
+ * @retval		MQTT_INVALID_REQUEST_HANDLE : bad request
+ *
+*/
+ t_MqttRequestHandle MqttClient_PoolSendData(t_MqttClientPool *pool, const unsigned char *key, unsigned short key_len,
+		 unsigned char *json, unsigned short size, unsigned char service_id, RxCbk cbk, void *user_ctx, t_MqttClient **member);
+
+/**
+ * @brief		Get a member of a pool, to drive it from a host event loop or to change its settings
+ *
+ * @param[in]	: pool			: connection pool
+ * @param[in]	: index			: index of the member, in the order of the configurations
+ * @return 		t_MqttClient*
+ * @retval		NULL : no such member
+ *
+*/
+ t_MqttClient* MqttClient_PoolGetMember(t_MqttClientPool *pool, unsigned char index);
+
+/**
+ * @brief		Periodical task of a pool, runs MqttClient_Task() of every member
  *
- * @param[in]	: void
+ * @param[in]	: pool			: connection pool
  * @return 		void
  *
 */
- void MqttClient_CancelRequest(void);
+ void MqttClient_PoolTask(t_MqttClientPool *pool);
+
+/**
+ * @brief		Create a sharded runtime: one self driven client context per configuration, the I/O thread of
+ * 				shard i pinned to cpu i. A shard owns its connection, queues and timers and is only run by its
+ * 				own thread, nothing is shared between shards. Messages are routed as in a connection pool.
+ *
+ * @param[in]	: configs		: configuration of each shard, NULL for MqttClientCfg.h values
+ * @param[in]	: count			: number of shards, usually the number of cores
+ * @return 		t_MqttClientPool*
+ * @retval		pool of the shards
+ * @retval		NULL : bad request, MQTT_MAX_POOLS pools or MQTT_MAX_CLIENTS contexts already created, or error in
+ * 				  starting a shard, the shards already started are released
+ *
+*/
+ t_MqttClientPool* MqttClient_ShardsInit(const t_MqttClientConfig *configs, unsigned char count);
+
+/**
+ * @brief		Send data from any thread through the shard owning a key. The message is copied in a lock free
+ * 				handoff and queued by the I/O thread of the shard, the handle of the request is given to cbk.
+ *
+ * @param[in]	: pool			: pool of the shards
+ * @param[in]	: key			: routing key, NULL to route by service id
+ * @param[in]	: key_len		: length of key
+ * @param[in]	: json			: json message to be sent
+ * @param[in]	: size			: size of json message to be sent
+ * @param[in]	: service_id	: service id of calling service
+ * @param[out]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @return 		t_MqttSubmitStatus
+ * @retval		MQTT_SUBMIT_OK			: request handed off
+ * @retval		MQTT_SUBMIT_WOULD_BLOCK	: handoff of the shard full, cbk is not called
+ * @retval		MQTT_SUBMIT_BAD_REQUEST	: bad request, cbk is not called
+ *
+*/
+ t_MqttSubmitStatus MqttClient_ShardSendData(t_MqttClientPool *pool, const unsigned char *key, unsigned short key_len,
+		 unsigned char *json, unsigned short size, unsigned char service_id, RxCbk cbk, void *user_ctx);
+
+/**
+ * @brief		Clock callback reading a virtual clock, to be set as clock of a configuration
+ *
+ * @param[in]	: clock_ctx		: t_MqttVirtualClock
+ * @return 		uint64_t
+ * @retval		current virtual time in milli seconds
+ *
+*/
+ uint64_t MqttClient_VirtualClockNow(void *clock_ctx);
+
+/**
+ * @brief		Move a virtual clock straight to the next cycle of the timer wheels of its clients and wake them
+ * 				up, so that keep alive, retry and reconnection scenarios run without waiting for the wall clock.
+ * 				A cycle is a deadline, or the time a distant timer moves down the wheel: a scenario advances the
+ * 				clock until the transition it waits for, see VirtualTimeScenario.c. The clients then run their
+ * 				elapsed timers in MqttClient_ProcessEvents() or MqttClient_Task(). The deadlines of self driven
+ * 				clients are owned by their I/O thread, they are only woken up.
+ *
+ * @param[in]	: clock		: virtual clock
+ * @param[in]	: clients	: client contexts using the clock
+ * @param[in]	: count		: number of clients
+ * @return 		int
+ * @retval		milli seconds the clock moved, 0 when a client has work pending at the current time
+ * @retval		-1 : no timer running, only socket data can wake the clients up
+ *
+*/
+ int MqttClient_VirtualClockAdvance(t_MqttVirtualClock *clock, t_MqttClient * const *clients, unsigned char count);
 
 /* -------------------------------- Routines -------------------------------- */
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* MQTTCLIENTH2_H */
@@ -19,9 +19,85 @@
 
 /* -------------------------------- Defines --------------------------------- */
 
+/* Number of client contexts, each one with its own connection, queues, timers and FSM instances */
+#define MQTT_MAX_CLIENTS						((unsigned char)4)
+
+/* Number of connection pools, each one striping messages across several client contexts */
+#define MQTT_MAX_POOLS							((unsigned char)2)
+
+/* Points of each pool member on the consistent hashing ring, more points spread the keys more evenly */
+#define MQTT_POOL_VNODES						((unsigned short)32)
+
+/* Buckets of the routing keys of a pool, must be a power of 2: a member holding requests of a bucket keeps its keys,
+ * so the keys of a member that lost its broker only move once their queued and spooled requests are gone */
+#define MQTT_POOL_ROUTE_BUCKETS					((unsigned short)64)
+
+/* Number of requests waiting in the lock free handoff of a shard, must be a power of 2 */
+#define MQTT_SHARD_HANDOFF_SIZE					((unsigned int)16)
+
+/* Size of a cache line, data written by different threads is kept on different lines */
+#define MQTT_CACHE_LINE_SIZE					64
+
 /* Service cycle time set as One second */
 #define SERVICE_CYCLE_TIME						((unsigned char)1)
 
+/* Self driven mode: 1 to let MqttClient_Init() start an I/O thread driving the client, MqttClient_Task() is then not needed */
+#define MQTT_SELF_DRIVEN_MODE					((unsigned char)0)
+
+/* Busy poll spin budget of the I/O thread until changed by MqttClient_SetBusyPoll(), 0 to always sleep in epoll_wait() */
+#define MQTT_BUSY_POLL_BUDGET_US				((unsigned int)0)
+
+/* SO_BUSY_POLL of the broker socket of a busy polling client, the kernel polls the device for this long on a read */
+#define MQTT_SO_BUSY_POLL_US					((int)50)
+
+/* Max number of FSM transitions executed in a row when woken up by an event */
+#define MQTT_IO_MAX_FSM_STEPS					((unsigned char)8)
+
+/* Levels of the timer wheel, each level of 64 slots. 4 levels hold timers up to 64^4 ms (about 4.6 hours) */
+#define MQTT_TIMER_WHEEL_LEVELS					((unsigned char)4)
+
+/* Reconnection backoff: the first attempt after a connection loss is immediate, then each attempt waits a random
+ * delay up to MQTT_RECONNECT_BASE_MS doubled on every failed attempt, capped to MQTT_RECONNECT_CAP_MS */
+#define MQTT_RECONNECT_BASE_MS					((unsigned int)1000)
+#define MQTT_RECONNECT_CAP_MS					((unsigned int)60000)
+
+/* Time a connection has to stay up for the next loss to be retried at once again */
+#define MQTT_RECONNECT_STABLE_MS				((unsigned int)30000)
+
+/* Interface reaching the broker watched for link, address and default route changes, "" for the interface owning
+ * the local address of the broker socket */
+#define MQTT_UPLINK_INTERFACE			""
+
+/* Max number of brokers in the ordered broker list of a client context */
+#define MQTT_MAX_BROKERS				((unsigned char)4)
+
+/* Warm standby of a client context configured without it: 1 to keep a connection accepted by the next broker of the
+ * list, the session moves onto it at once when the broker in use fails */
+#define MQTT_WARM_STANDBY				((unsigned char)0)
+
+/* Suffix of the client id of the standby connection when none is configured, brokers of a cluster would otherwise
+ * close one connection when the other one connects */
+#define MQTT_STANDBY_ID_SUFFIX			"-standby"
+
+/* Time the standby connection has to be accepted by its broker */
+#define MQTT_STANDBY_CONNECT_MS			((unsigned int)5000)
+
+/* Spool directory of a client context configured without it, "" to disable: messages of durable services are
+ * appended there while offline or while the request queue is full, and published from there once connected */
+#define MQTT_SPOOL_DIR					""
+
+/* Size of a spool segment file and max number of segments, the disk used by the spool is bounded by their product */
+#define MQTT_SPOOL_SEGMENT_SIZE			((unsigned int)1048576)
+#define MQTT_SPOOL_MAX_SEGMENTS			((unsigned char)16)
+
+/* Number of spooled messages published ahead of their PUBACK */
+#define MQTT_SPOOL_WINDOW				((unsigned short)32)
+
+/* 1 to flush each spooled message to disk before it is reported spooled, 0 to leave it to the kernel: a process
+ * crash loses nothing either way, only a power loss does */
+#define MQTT_SPOOL_SYNC					((unsigned char)0)
+
+/* Broker and client id of a client context created without configuration */
 #define SERVER_ADDRESS					"iot.eclipse.org"
 #define SERVER_PORT						((int)1883)
 
@@ -29,9 +105,13 @@
 #define KEEP_ALIVE_INTERVAL				((unsigned short)20)
 #define CLEAN_SESSION_FLAG				((unsigned char)1)
 #define MQTT_V_3_1_1					((unsigned char)4)
+#define MQTT_V_5						((unsigned char)5)
 #define USERNAME						((char *)"insert_uname_here")
 #define PASSWORD						((char *)"insert_passwd_here")
 
+/* Protocol level spoken with the broker, MQTT_V_5 gives the time to live of messages to the broker as well */
+#define MQTT_PROTOCOL_VERSION			MQTT_V_3_1_1
+
 /* topic string length */
 #define TOPIC_LENGTH					((unsigned short)21)
 
@@ -51,6 +131,76 @@
 /* How many times a request will be resend */
 #define MAX_REQ_RETRY_COUNT				((unsigned char)3)
 
+/* PUBACK timeout before any round trip was measured, then derived from the measured round trips within bounds */
+#define MQTT_RTO_INITIAL_MS				((unsigned int)1000)
+#define MQTT_RTO_MIN_MS					((unsigned int)200)
+#define MQTT_RTO_MAX_MS					((unsigned int)20000)
+
+/* Margin added to the PUBACK timeout to get the PINGRESP deadline, a ping missing it closes the connection, as does
+ * data the broker left unacknowledged for as long (TCP_USER_TIMEOUT) */
+#define MQTT_PINGRESP_MARGIN_MS			((unsigned int)500)
+
+/* TCP_NOTSENT_LOWAT of the broker socket: written bytes the kernel may keep unsent before it stops taking more */
+#define MQTT_TCP_NOTSENT_LOWAT			((int)2048)
+
+/* Send budget: bytes written and not yet acknowledged by the broker above which publishes wait in the request queue,
+ * where requests of a lower service id overtake them. Grown by MQTT_SEND_BUDGET_STEP on each PUBACK while the TCP
+ * round trip stays within MQTT_QUEUE_DELAY_MS of the lowest one seen, halved on queueing delay or PUBACK timeout */
+#define MQTT_SEND_BUDGET_MIN			((unsigned int)2048)
+#define MQTT_SEND_BUDGET_MAX			((unsigned int)65536)
+#define MQTT_SEND_BUDGET_STEP			((unsigned int)1024)
+#define MQTT_QUEUE_DELAY_MS				((unsigned int)100)
+
+/* TCP keepalive probes sent within one keep alive interval once the connection stayed idle for a keep alive interval */
+#define MQTT_TCP_KEEPALIVE_PROBES		((int)3)
+
+/* Number of requests that can be queued by all services together (max 256) */
+#define MQTT_REQ_POOL_SIZE				((unsigned short)16)
+
+/* Number of requests that can be queued by a single service */
+#define MQTT_SERVICE_QUEUE_DEPTH		((unsigned short)8)
+
+/* Max length of the coalescing key of a message, a longer key is a bad request */
+#define MQTT_COALESCE_KEY_SIZE			((unsigned short)32)
+
+/* Buckets of the hash index of the coalescing keys of the queued requests, must be a power of 2 */
+#define MQTT_COALESCE_BUCKETS			((unsigned short)32)
+
+/* Number of requests with an ordering key published ahead of their PUBACK, one of each key at most: the messages
+ * of a key keep their order while different keys share the window (at most MQTT_REQ_POOL_SIZE) */
+#define MQTT_ORDERED_WINDOW				((unsigned short)8)
+
+/* Most requests queued at once: every service queue full, within the request pool */
+#define MQTT_QUEUE_CAPACITY				((unsigned short)(((MQTT_SERVICE_QUEUE_DEPTH * (unsigned short)SERVICE_LAST) < MQTT_REQ_POOL_SIZE) ? \
+											(MQTT_SERVICE_QUEUE_DEPTH * (unsigned short)SERVICE_LAST) : MQTT_REQ_POOL_SIZE))
+
+/* Queue depth notified as link saturated and as link drained again, at three quarters and one quarter of the
+ * capacity (at most MQTT_QUEUE_CAPACITY, LOW below HIGH) */
+#define MQTT_QUEUE_HIGH_WATERMARK		((unsigned short)((MQTT_QUEUE_CAPACITY * 3U) / 4U))
+#define MQTT_QUEUE_LOW_WATERMARK		((unsigned short)(MQTT_QUEUE_CAPACITY / 4U))
+
+/* Shedding policy of every service until changed by MqttClient_SetShedPolicy() */
+#define MQTT_DEFAULT_SHED_POLICY		MQTT_SHED_DROP_NEWEST
+
+/* Notification mode until changed by MqttClient_SetNotifyMode() */
+#define MQTT_DEFAULT_NOTIFY_MODE		MQTT_NOTIFY_INLINE
+
+/* Number of completions the completion queue can hold, must be a power of 2 */
+#define MQTT_COMPLETION_QUEUE_SIZE		((unsigned int)64)
+
+/* Number of callbacks waiting in the callback executor for each service, each service has its own worker thread.
+ * Callbacks of a service finding its queue full wait in an overflow list, none is dropped */
+#define MQTT_EXECUTOR_QUEUE_SIZE		((unsigned short)256)
+
+/* Duration above which a callback run by the executor is reported as slow */
+#define MQTT_CALLBACK_BUDGET_US			((unsigned int)1000)
+
+/* Size of the blocks of the coroutine frame pool of MqttClientCoro.hpp, larger frames are allocated from the heap */
+#define MQTT_CORO_FRAME_SIZE			((unsigned int)512)
+
+/* Number of free coroutine frames kept by each thread for reuse */
+#define MQTT_CORO_FRAME_POOL_SIZE		((unsigned int)256)
+
 /* ------------------------------- Data Types ------------------------------- */
 
 /* ---------------------------- Global Variables ---------------------------- */
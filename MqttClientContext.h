@@ -0,0 +1,96 @@
+/**************************************************************************//**
+*  @par Language  : C
+*******************************************************************************
+*  @brief       MqttClient client context header file.
+*  @author      dr-paradox
+*  @version     1.0.0
+*******************************************************************************
+*  @page 	MqttClientContext
+*  @ref 	MqttClient "API Reference" header file
+*  @file 	MqttClientContext.h
+*
+*******************************************************************************/
+
+#ifndef MQTTCLIENT_CONTEXT_H
+#define MQTTCLIENT_CONTEXT_H
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "MqttClient.h"
+#include "MqttClientCfg.h"
+#include "MqttClientQueue.h"
+#include "MqttClientNotify.h"
+#include "MqttClientFunctions.h"
+#include "MqttClientTimer.h"
+#include "MqttClientIo.h"
+#include "MqttClientShard.h"
+#include "MqttClientNetlink.h"
+#include "MqttClientFailover.h"
+#include "MqttClientSpool.h"
+#include "MqttClientMng.h"
+#include "MqttClientTimerMng.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* Client context. Each part is written by a different party (submitting threads, protocol engine, completion
+ * consumer) and starts on its own cache line, contexts driven from different threads share no line */
+struct s_MqttClient {
+	t_MqttQueue			queue		__attribute__((aligned(MQTT_CACHE_LINE_SIZE)));	/*requests submitted by the services*/
+	t_MqttNotifier		notifier	__attribute__((aligned(MQTT_CACHE_LINE_SIZE)));	/*delivery of the request results*/
+	t_MqttSession		session		__attribute__((aligned(MQTT_CACHE_LINE_SIZE)));	/*protocol state of the broker connection*/
+	t_MqttTimerWheel	timers		__attribute__((aligned(MQTT_CACHE_LINE_SIZE)));	/*timers of the FSMs*/
+	t_MqttIo			io			__attribute__((aligned(MQTT_CACHE_LINE_SIZE)));	/*event loop*/
+	t_MqttShard			shard		__attribute__((aligned(MQTT_CACHE_LINE_SIZE)));	/*requests handed off by other threads*/
+	t_MqttNetlink		netlink;		/*uplink watcher, used by the thread running the FSM*/
+	t_MqttFailover		failover;		/*broker list and standby connection, used by the thread running the FSM*/
+	t_MqttSpool			spool		__attribute__((aligned(MQTT_CACHE_LINE_SIZE)));	/*durable spool, appended by any thread*/
+	t_mqttclienth2mng_instance_struct		mng		__attribute__((aligned(MQTT_CACHE_LINE_SIZE)));	/*protocol FSM instance*/
+	t_mqttclienth2timermng_instance_struct	timer_mng;	/*timer FSM instance, run by the same thread*/
+	t_MqttClientConfig	config;			/*broker and credentials, defaults applied*/
+	unsigned char		handler;		/*FSM instance of the context*/
+	bool				in_use;			/*context handed out by MqttClient_Init()*/
+} __attribute__((aligned(MQTT_CACHE_LINE_SIZE)));
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+ * @brief	Get the client context driven by a FSM instance.
+ *
+ * @param[in]	: handler	: FSM instance
+ * @return 		t_MqttClient*
+ *
+*/
+t_MqttClient* MqttClientGetContext(unsigned char handler);
+
+/**
+* @brief	Queue messages of a service, or spool them when the service is durable and the client is offline, its queue
+* 			is full or older messages of the service are spooled.
+*
+* @param[in]	: client		: client context
+* @param[in]	: msgs			: messages to be sent, already validated
+* @param[in]	: count			: number of messages
+* @param[in]	: service_id	: service id of calling service
+* @param[in]	: cbk			: callback to notify status
+* @param[in]	: user_ctx		: user context pointer passed back to cbk
+* @param[in]	: shed			: apply the shedding policy of the service when there is no room
+* @param[in]	: combined		: notify cbk once for the whole batch
+* @param[in]	: route			: pool routing bucket held for a single message, kept by the queued request or the spooled
+* 								  record and released otherwise, MQTT_NO_ROUTE if none
+* @param[out]	: handles		: handles of the accepted requests, count entries
+* @return		t_MqttSubmitStatus
+* @retval		MQTT_SUBMIT_OK			: messages queued or spooled
+* @retval		MQTT_SUBMIT_WOULD_BLOCK	: no room, cbk is not called
+* @retval		MQTT_SUBMIT_DROPPED		: shed by the overload policy of the service
+*/
+t_MqttSubmitStatus MqttClientSubmit(t_MqttClient *client, const t_MqttMessage *msgs, unsigned short count, unsigned char service_id,
+										RxCbk cbk, void *user_ctx, bool shed, bool combined, unsigned short route,
+										t_MqttRequestHandle *handles);
+
+/* -------------------------------- Routines -------------------------------- */
+
+#endif /* MQTTCLIENT_CONTEXT_H */
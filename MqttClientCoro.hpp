@@ -0,0 +1,637 @@
+/**************************************************************************//**
+*  @par Language  : C++20
+*******************************************************************************
+*  @brief       MqttClient coroutine interface header file.
+*  @author      dr-paradox
+*  @version     1.0.0
+*******************************************************************************
+*  @page 	MqttClientCoro
+*  @ref 	MqttClient "API Reference" header file
+*  @file 	MqttClientCoro.hpp
+*
+*  Header only layer over the C API: a publish is awaited until its PUBACK or its
+*  failure, a connection until the broker is reached. The results are harvested
+*  from the completion queue of the client by Driver::Poll(), so every coroutine
+*  runs on the thread of the application event loop and no lock is needed:
+*
+*  @code
+*  MqttClientCoro::Task<> Report(MqttClientCoro::Driver &driver, unsigned char *json, unsigned short size)
+*  {
+*  	co_await driver.Connect();
+*  	MqttClientCoro::PublishResult result = co_await driver.Publish(json, size, SERVICE_REQ_1);
+*  	...
+*  }
+*
+*  MqttClientCoro::Spawn(Report(driver, json, size));
+*  ... event loop: driver.Poll() when driver.GetFd() is readable and after each MqttClient_ProcessEvents()
+*  @endcode
+*******************************************************************************/
+
+#ifndef MQTTCLIENT_CORO_HPP
+#define MQTTCLIENT_CORO_HPP
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <optional>
+#include <utility>
+
+#include "MqttClient.h"
+#include "MqttClientCfg.h"
+
+namespace MqttClientCoro {
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/*Result of an awaited publish*/
+struct PublishResult
+{
+	t_MqttRequestHandle	handle;/*handle of the request, MQTT_INVALID_REQUEST_HANDLE if it was never queued*/
+	unsigned char		server_response;/*one of t_ServerReplyCodes*/
+};
+
+/*Executor hook: decides where a coroutine waiting for the client is resumed once its result is known. Post() is
+ * called from Driver::Poll(), an application loop may queue the handle and resume it later from the same thread*/
+class Executor
+{
+public:
+	virtual ~Executor() = default;
+
+	virtual void Post(std::coroutine_handle<> handle) = 0;
+};
+
+/*Default executor: the coroutine is resumed at once, from Driver::Poll()*/
+class InlineExecutor final : public Executor
+{
+public:
+	void Post(std::coroutine_handle<> handle) override
+	{
+		handle.resume();
+	}
+};
+
+/*Pool of coroutine frames: frames up to MQTT_CORO_FRAME_SIZE bytes are recycled through a free list of the
+ * thread releasing them, once the pool is warm a coroutine costs no heap allocation*/
+class FramePool
+{
+public:
+	static void* Allocate(std::size_t size)
+	{
+		FreeList &list = Local();
+		void *frame = nullptr;
+
+		if ( size > MQTT_CORO_FRAME_SIZE )
+		{
+			frame = ::operator new(size);
+		}
+		else if ( list.head != nullptr )
+		{
+			frame = list.head;
+			list.head = list.head->next;
+			list.count--;
+		}
+		else
+		{
+			frame = ::operator new(MQTT_CORO_FRAME_SIZE);
+		}
+
+		return frame;
+	}
+
+	static void Release(void *frame, std::size_t size) noexcept
+	{
+		FreeList &list = Local();
+		Block *block = nullptr;
+
+		if ( (size <= MQTT_CORO_FRAME_SIZE) && (list.count < MQTT_CORO_FRAME_POOL_SIZE) )
+		{
+			block = static_cast<Block*>(frame);
+			block->next = list.head;
+			list.head = block;
+			list.count++;
+		}
+		else
+		{
+			::operator delete(frame);
+		}
+	}
+
+private:
+	struct Block
+	{
+		Block	*next;
+	};
+
+	struct FreeList
+	{
+		Block			*head = nullptr;
+		unsigned int	count = 0U;
+
+		~FreeList()
+		{
+			Block *block = nullptr;
+
+			while ( head != nullptr )
+			{
+				block = head;
+				head = head->next;
+				::operator delete(block);
+			}
+		}
+	};
+
+	static FreeList& Local() noexcept
+	{
+		static thread_local FreeList list;
+
+		return list;
+	}
+};
+
+template <typename T = void>
+class Task;
+
+namespace Detail {
+
+/*Part of the promise independent from the result type: frame allocation, continuation and detached tasks*/
+class PromiseBase
+{
+	struct FinalAwaiter
+	{
+		bool await_ready() const noexcept
+		{
+			return false;
+		}
+
+		template <typename Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+		{
+			PromiseBase &promise = handle.promise();
+			std::coroutine_handle<> next = std::noop_coroutine();
+
+			if ( promise.continuation )
+			{
+				/* symmetric transfer to the awaiting coroutine, the stack does not grow */
+				next = promise.continuation;
+			}
+			else if ( true == promise.detached )
+			{
+				/* nobody can observe the failure of a detached task */
+				if ( promise.error )
+				{
+					std::terminate();
+				}
+				handle.destroy();
+			}
+			else
+			{
+				/* finished before being awaited, the owning Task destroys the frame */
+			}
+
+			return next;
+		}
+
+		void await_resume() const noexcept
+		{
+		}
+	};
+
+public:
+	static void* operator new(std::size_t size)
+	{
+		return FramePool::Allocate(size);
+	}
+
+	static void operator delete(void *frame, std::size_t size) noexcept
+	{
+		FramePool::Release(frame, size);
+	}
+
+	std::suspend_always initial_suspend() const noexcept
+	{
+		return {};
+	}
+
+	FinalAwaiter final_suspend() const noexcept
+	{
+		return {};
+	}
+
+	void unhandled_exception() noexcept
+	{
+		error = std::current_exception();
+	}
+
+	std::coroutine_handle<>	continuation;
+	std::exception_ptr		error;
+	bool					detached = false;
+};
+
+template <typename T>
+class Promise final : public PromiseBase
+{
+public:
+	Task<T> get_return_object() noexcept;
+
+	void return_value(T value)
+	{
+		result.emplace(std::move(value));
+	}
+
+	T Take()
+	{
+		if ( error )
+		{
+			std::rethrow_exception(error);
+		}
+
+		return std::move(*result);
+	}
+
+private:
+	std::optional<T>	result;
+};
+
+template <>
+class Promise<void> final : public PromiseBase
+{
+public:
+	Task<void> get_return_object() noexcept;
+
+	void return_void() const noexcept
+	{
+	}
+
+	void Take() const
+	{
+		if ( error )
+		{
+			std::rethrow_exception(error);
+		}
+	}
+};
+
+} /* namespace Detail */
+
+/*Lazy coroutine: it starts when awaited, or when handed to Spawn()*/
+template <typename T>
+class [[nodiscard]] Task
+{
+public:
+	using promise_type = Detail::Promise<T>;
+
+	explicit Task(std::coroutine_handle<promise_type> handle) noexcept : coro(handle)
+	{
+	}
+
+	Task(Task &&other) noexcept : coro(std::exchange(other.coro, nullptr))
+	{
+	}
+
+	Task(const Task &) = delete;
+	Task& operator=(const Task &) = delete;
+	Task& operator=(Task &&) = delete;
+
+	~Task()
+	{
+		if ( coro )
+		{
+			coro.destroy();
+		}
+	}
+
+	bool await_ready() const noexcept
+	{
+		return false;
+	}
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+	{
+		coro.promise().continuation = awaiting;
+
+		return coro;
+	}
+
+	T await_resume()
+	{
+		return coro.promise().Take();
+	}
+
+	/* give up the ownership of the frame */
+	std::coroutine_handle<promise_type> Release() noexcept
+	{
+		return std::exchange(coro, nullptr);
+	}
+
+private:
+	std::coroutine_handle<promise_type>	coro;
+};
+
+template <typename T>
+Task<T> Detail::Promise<T>::get_return_object() noexcept
+{
+	return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Detail::Promise<void>::get_return_object() noexcept
+{
+	return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+/**
+ * @brief	Start a task without awaiting it, its frame is released when it finishes. Each spawned task is one
+ * 			more concurrent flow of the application, no thread is created.
+ *
+ * @param[in]	: task	: task to start
+ * @return 	void
+ *
+*/
+inline void Spawn(Task<void> task)
+{
+	std::coroutine_handle<Detail::Promise<void>> handle = task.Release();
+
+	handle.promise().detached = true;
+	handle.resume();
+}
+
+/*Drives the coroutines using one client context. The client is switched to MQTT_NOTIFY_COMPLETION_QUEUE, its
+ * notify mode must not be changed afterwards. A suspended coroutine must not be destroyed, its awaiter is
+ * referenced by the driver until it is resumed*/
+class Driver
+{
+public:
+	/*Awaiter of Publish(): resumes with the result of the request once its PUBACK arrived or it failed. A full
+	 * queue suspends the publish until Poll() finds room for it, in submission order*/
+	class PublishAwaiter
+	{
+	public:
+		PublishAwaiter(Driver &driver, unsigned char *json, unsigned short size, unsigned char service_id) noexcept
+			: driver(driver), json(json), size(size), service_id(service_id)
+		{
+		}
+
+		bool await_ready() const noexcept
+		{
+			return false;
+		}
+
+		bool await_suspend(std::coroutine_handle<> handle) noexcept
+		{
+			bool suspended = true;
+
+			waiting = handle;
+
+			if ( nullptr != driver.blocked_head )
+			{
+				/* keep the order of the publishes already waiting for room */
+				driver.Block(this);
+			}
+			else
+			{
+				switch ( Submit() )
+				{
+				case MQTT_SUBMIT_OK:
+					break;
+				case MQTT_SUBMIT_WOULD_BLOCK:
+					driver.Block(this);
+					break;
+				default:
+					suspended = false;
+					break;
+				}
+			}
+
+			return suspended;
+		}
+
+		PublishResult await_resume() const noexcept
+		{
+			return result;
+		}
+
+	private:
+		friend class Driver;
+
+		t_MqttSubmitStatus Submit() noexcept
+		{
+			t_MqttSubmitStatus status = MqttClient_TrySendData(driver.client, json, size, service_id,
+																&PublishAwaiter::Complete, this, &result.handle);
+
+			if ( MQTT_SUBMIT_BAD_REQUEST == status )
+			{
+				result.server_response = (unsigned char)SERVERCOM_BAD_REQUEST;
+			}
+
+			return status;
+		}
+
+		static void Complete(t_MqttRequestHandle handle, unsigned char server_response, void *user_ctx)
+		{
+			PublishAwaiter *awaiter = static_cast<PublishAwaiter*>(user_ctx);
+
+			awaiter->result.handle = handle;
+			awaiter->result.server_response = server_response;
+			/* the awaiter is gone once the coroutine is resumed */
+			awaiter->driver.executor->Post(awaiter->waiting);
+		}
+
+		Driver					&driver;
+		unsigned char			*json;
+		unsigned short			size;
+		unsigned char			service_id;
+		PublishResult			result = { MQTT_INVALID_REQUEST_HANDLE, (unsigned char)SERVERCOM_OK };
+		std::coroutine_handle<>	waiting;
+		PublishAwaiter			*next = nullptr;
+	};
+
+	/*Awaiter of Connect(): resumes once the client is connected to its broker*/
+	class ConnectAwaiter
+	{
+	public:
+		explicit ConnectAwaiter(Driver &driver) noexcept : driver(driver)
+		{
+		}
+
+		bool await_ready() const noexcept
+		{
+			return ( 0U != MqttClient_IsConnected(driver.client) );
+		}
+
+		void await_suspend(std::coroutine_handle<> handle) noexcept
+		{
+			waiting = handle;
+			next = driver.connecting;
+			driver.connecting = this;
+		}
+
+		void await_resume() const noexcept
+		{
+		}
+
+	private:
+		friend class Driver;
+
+		Driver					&driver;
+		std::coroutine_handle<>	waiting;
+		ConnectAwaiter			*next = nullptr;
+	};
+
+	explicit Driver(t_MqttClient *client, Executor *executor = nullptr) noexcept
+		: client(client), executor((executor != nullptr) ? executor : &inline_executor)
+	{
+		MqttClient_SetNotifyMode(client, MQTT_NOTIFY_COMPLETION_QUEUE);
+	}
+
+	Driver(const Driver &) = delete;
+	Driver& operator=(const Driver &) = delete;
+
+	/**
+	 * @brief	Get the fd becoming readable when results are waiting for Poll().
+	 *
+	 * @return 	int
+	 *
+	*/
+	int GetFd() const noexcept
+	{
+		return MqttClient_GetCompletionFd(client);
+	}
+
+	/**
+	 * @brief	Check whether coroutines wait for a connection or for room in the queue. Those are only resumed
+	 * 			by Poll(), the loop has to call it at least every MqttClient_GetTimeoutMs() while this is true.
+	 *
+	 * @return 	bool
+	 *
+	*/
+	bool HasWaiters() const noexcept
+	{
+		return ( (connecting != nullptr) || (blocked_head != nullptr) );
+	}
+
+	/**
+	 * @brief	Resume the coroutines whose result is known, to be called from the application loop. Not reentrant,
+	 * 			the resumed coroutines may publish again but must not call Poll().
+	 *
+	 * @return 	void
+	 *
+	*/
+	void Poll()
+	{
+		t_MqttCompletion completions[HARVEST_BATCH];
+		unsigned short count = 0U;
+		unsigned short idx;
+		ConnectAwaiter *ready = nullptr;
+		ConnectAwaiter *connect = nullptr;
+		PublishAwaiter *publish = nullptr;
+
+		/* results of the publishes, other users of the client get their callback called from here as well */
+		do
+		{
+			count = MqttClient_HarvestCompletions(client, completions, HARVEST_BATCH);
+			for (idx = 0U; idx < count; idx++)
+			{
+				completions[idx].cbk(completions[idx].handle, completions[idx].server_response, completions[idx].user_ctx);
+			}
+		} while ( HARVEST_BATCH == count );
+
+		if ( (connecting != nullptr) && (0U != MqttClient_IsConnected(client)) )
+		{
+			ready = std::exchange(connecting, nullptr);
+			while ( ready != nullptr )
+			{
+				connect = ready;
+				ready = ready->next;
+				executor->Post(connect->waiting);
+			}
+		}
+
+		/* publishes waiting for room, the first one still without room stops the retries */
+		while ( blocked_head != nullptr )
+		{
+			publish = blocked_head;
+			blocked_head = publish->next;
+			if ( blocked_head == nullptr )
+			{
+				blocked_tail = nullptr;
+			}
+			publish->next = nullptr;
+
+			t_MqttSubmitStatus status = publish->Submit();
+
+			if ( MQTT_SUBMIT_WOULD_BLOCK == status )
+			{
+				publish->next = blocked_head;
+				blocked_head = publish;
+				if ( blocked_tail == nullptr )
+				{
+					blocked_tail = publish;
+				}
+				break;
+			}
+			else if ( MQTT_SUBMIT_OK != status )
+			{
+				executor->Post(publish->waiting);
+			}
+			else
+			{
+				/* queued, resumed by its completion */
+			}
+		}
+	}
+
+	/**
+	 * @brief	Publish a message, the json is copied when the request is queued.
+	 *
+	 * @param[in]	: json			: json message to be sent, valid until the awaiter resumes
+	 * @param[in]	: size			: size of json message to be sent
+	 * @param[in]	: service_id	: service id of calling service
+	 * @return 		PublishAwaiter
+	 *
+	*/
+	PublishAwaiter Publish(unsigned char *json, unsigned short size, unsigned char service_id) noexcept
+	{
+		return PublishAwaiter(*this, json, size, service_id);
+	}
+
+	/**
+	 * @brief	Wait for the client to be connected to its broker, ready at once when it already is.
+	 *
+	 * @return 	ConnectAwaiter
+	 *
+	*/
+	ConnectAwaiter Connect() noexcept
+	{
+		return ConnectAwaiter(*this);
+	}
+
+private:
+	/* number of completions harvested at once by Poll() */
+	static constexpr unsigned short HARVEST_BATCH = 16U;
+
+	void Block(PublishAwaiter *publish) noexcept
+	{
+		if ( blocked_tail != nullptr )
+		{
+			blocked_tail->next = publish;
+		}
+		else
+		{
+			blocked_head = publish;
+		}
+		blocked_tail = publish;
+	}
+
+	t_MqttClient	*client;
+	InlineExecutor	inline_executor;
+	Executor		*executor;
+	ConnectAwaiter	*connecting = nullptr;
+	PublishAwaiter	*blocked_head = nullptr;
+	PublishAwaiter	*blocked_tail = nullptr;
+};
+
+} /* namespace MqttClientCoro */
+
+#endif /* MQTTCLIENT_CORO_HPP */
@@ -0,0 +1,718 @@
+/**************************************************************************//**
+*  @par Language: C
+*******************************************************************************
+*  @par 	Project:
+*  @brief   MqttClient broker failover implementation
+*  @author  dr-paradox
+*  @version 1.0.0
+*******************************************************************************
+*  @ref 	MqttClient "API Reference"
+*  @file 	MqttClientFailover.c
+*******************************************************************************/
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include "MqttClientFailover.h"
+#include "MqttClientContext.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* Invalid file descriptor */
+#define INVALID_FD					((int)-1)
+
+/* Ping interval of the standby connection, half the keep alive the broker expects */
+#define STANDBY_PING_INTERVAL_MS	((uint32_t)KEEP_ALIVE_INTERVAL * 500U)
+
+/* Control packet types read on the standby connection */
+#define STANDBY_CONNACK				((unsigned char)2)
+#define STANDBY_PINGRESP			((unsigned char)13)
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* ---------------------------- Global Variables ---------------------------- */
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+ * @brief	Get the broker following another one in the list, the broker of the session is skipped.
+ *
+ * @param[in]	: failover	: broker list
+ * @param[in]	: broker	: broker to start from
+ * @return 	unsigned char
+ *
+*/
+static unsigned char MqttClientFailoverFollowing(const t_MqttFailover *failover, unsigned char broker);
+
+/**
+ * @brief	Timer wheel callback of the standby connection: open it, give it up when not accepted in time, or ping it.
+ *
+ * @param[in]	: arg	: client context
+ * @return 	void
+ *
+*/
+static void MqttClientFailoverElapsed(void *arg);
+
+/**
+ * @brief	Start a non blocking TCP connection to the standby broker.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+static void MqttClientFailoverOpenStandby(t_MqttClient *client);
+
+/**
+ * @brief	Send the connect packet once the TCP connection to the standby broker is established.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+static void MqttClientFailoverSendConnect(t_MqttClient *client);
+
+/**
+ * @brief	Close the standby connection and schedule the next one. A failed connection is retried on the next broker
+ * 			of the list, after a delay doubled on every failure in a row.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: failed	: the connection failed, false when it is closed on purpose
+ * @return 	void
+ *
+*/
+static void MqttClientFailoverCloseStandby(t_MqttClient *client, bool failed);
+
+/**
+ * @brief	Handle the complete packets received on the standby connection.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+static void MqttClientFailoverProcessPackets(t_MqttClient *client);
+
+/* -------------------------------- Routines -------------------------------- */
+
+/**
+ * @brief	Get the broker following another one in the list, the broker of the session is skipped.
+ *
+ * @param[in]	: failover	: broker list
+ * @param[in]	: broker	: broker to start from
+ * @return 	unsigned char
+ *
+*/
+static unsigned char MqttClientFailoverFollowing(const t_MqttFailover *failover, unsigned char broker)
+{
+	unsigned char next = (unsigned char)((broker + 1U) % failover->broker_count);
+
+	if ( (next == failover->active) && (failover->broker_count > 1U) )
+	{
+		next = (unsigned char)((next + 1U) % failover->broker_count);
+	}
+
+	return next;
+}
+
+/**
+ * @brief	Timer wheel callback of the standby connection: open it, give it up when not accepted in time, or ping it.
+ *
+ * @param[in]	: arg	: client context
+ * @return 	void
+ *
+*/
+static void MqttClientFailoverElapsed(void *arg)
+{
+	t_MqttClient *client = (t_MqttClient *)arg;
+	t_MqttFailover *failover = &client->failover;
+	unsigned char ping_packet_buffer[MAX_PING_PACK_SIZE] = {0};
+	int len = 0;
+
+	switch (failover->state)
+	{
+		case MQTT_STANDBY_IDLE:
+			MqttClientFailoverOpenStandby(client);
+			break;
+
+		case MQTT_STANDBY_CONNECTING:
+		case MQTT_STANDBY_WAIT_CONNACK:
+			printf("MqttClient: Standby broker %s:%d did not accept the connection in time",
+					failover->brokers[failover->standby].address, failover->brokers[failover->standby].port);
+			MqttClientFailoverCloseStandby(client, true);
+			break;
+
+		case MQTT_STANDBY_READY:
+			/* a standby broker that stopped answering would only be found out on failover */
+			if ( true == failover->ping_pending )
+			{
+				printf("MqttClient: Standby broker %s:%d stopped answering", failover->brokers[failover->standby].address,
+						failover->brokers[failover->standby].port);
+				MqttClientFailoverCloseStandby(client, true);
+				break;
+			}
+
+			len = MqttClientCreatePingPacket(ping_packet_buffer);
+			if ( true == MqttClientTransportSendPacketBuffer(failover->fd, ping_packet_buffer, len) )
+			{
+				failover->ping_pending = true;
+				failover->sent_ms = MqttClientTimerNowMs(&client->timers);
+				MqttClientTimerStart(&client->timers, &failover->timer, STANDBY_PING_INTERVAL_MS, MqttClientFailoverElapsed, client);
+			}
+			else
+			{
+				MqttClientFailoverCloseStandby(client, true);
+			}
+			break;
+
+		default:
+			/* Do nothing */
+			break;
+	}
+}
+
+/**
+ * @brief	Start a non blocking TCP connection to the standby broker.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+static void MqttClientFailoverOpenStandby(t_MqttClient *client)
+{
+	t_MqttFailover *failover = &client->failover;
+	const t_MqttBroker *broker = &failover->brokers[failover->standby];
+	struct addrinfo hints = {0, AF_INET, SOCK_STREAM, IPPROTO_TCP, 0, NULL, NULL, NULL};
+	struct addrinfo *result = NULL;
+	struct sockaddr_in address;
+	int ret_code = 0;
+
+	/* the name is resolved as for the session, only the connection itself does not wait */
+	if ( getaddrinfo(broker->address, NULL, &hints, &result) != 0 )
+	{
+		printf("MqttClient: Error in getting address info of standby broker %s", broker->address);
+		MqttClientFailoverCloseStandby(client, true);
+		return;
+	}
+
+	memcpy(&address, result->ai_addr, sizeof(address));
+	address.sin_port = htons(broker->port);
+	freeaddrinfo(result);
+
+	failover->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if ( INVALID_FD == failover->fd )
+	{
+		printf("MqttClient: Error in creating standby socket, errno %d", errno);
+		MqttClientFailoverCloseStandby(client, true);
+		return;
+	}
+
+	MqttClientTransportConfigure(client, failover->fd);
+	failover->generation++;
+	failover->state = MQTT_STANDBY_CONNECTING;
+	MqttClientTimerStart(&client->timers, &failover->timer, MQTT_STANDBY_CONNECT_MS, MqttClientFailoverElapsed, client);
+
+	ret_code = connect(failover->fd, (struct sockaddr *)&address, sizeof(address));
+	if ( SYS_SUCCESS == ret_code )
+	{
+		MqttClientFailoverSendConnect(client);
+	}
+	else if ( EINPROGRESS != errno )
+	{
+		printf("MqttClient: Error in connecting standby broker %s:%d, errno %d", broker->address, broker->port, errno);
+		MqttClientFailoverCloseStandby(client, true);
+	}
+	else
+	{
+		/* the socket becomes writable once connected */
+	}
+}
+
+/**
+ * @brief	Send the connect packet once the TCP connection to the standby broker is established.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+static void MqttClientFailoverSendConnect(t_MqttClient *client)
+{
+	t_MqttFailover *failover = &client->failover;
+	unsigned char connect_packet_buffer[MAX_CONN_PACK_SIZE] = {0};
+	int len = 0;
+
+	len = MqttClientBuildConnectPacket(client, MqttClientFailoverGetClientId(client, true), connect_packet_buffer, MAX_CONN_PACK_SIZE);
+
+	if ( (len > 0) && (true == MqttClientTransportSendPacketBuffer(failover->fd, connect_packet_buffer, len)) )
+	{
+		/* from now on the socket is only watched for readability */
+		failover->state = MQTT_STANDBY_WAIT_CONNACK;
+		failover->sent_ms = MqttClientTimerNowMs(&client->timers);
+		failover->generation++;
+	}
+	else
+	{
+		MqttClientFailoverCloseStandby(client, true);
+	}
+}
+
+/**
+ * @brief	Close the standby connection and schedule the next one. A failed connection is retried on the next broker
+ * 			of the list, after a delay doubled on every failure in a row.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: failed	: the connection failed, false when it is closed on purpose
+ * @return 	void
+ *
+*/
+static void MqttClientFailoverCloseStandby(t_MqttClient *client, bool failed)
+{
+	t_MqttFailover *failover = &client->failover;
+	uint32_t delay_ms = 0U;
+
+	if ( INVALID_FD != failover->fd )
+	{
+		(void)close(failover->fd);
+		failover->fd = INVALID_FD;
+		failover->generation++;
+	}
+
+	failover->state = MQTT_STANDBY_IDLE;
+	failover->ping_pending = false;
+	failover->rx_len = 0;
+
+	if ( true == failed )
+	{
+		if ( failover->attempts < 32U )
+		{
+			failover->attempts++;
+		}
+		failover->standby = MqttClientFailoverFollowing(failover, failover->standby);
+
+		delay_ms = MQTT_RECONNECT_CAP_MS;
+		if ( (((uint64_t)MQTT_RECONNECT_BASE_MS) << (failover->attempts - 1U)) < MQTT_RECONNECT_CAP_MS )
+		{
+			delay_ms = MQTT_RECONNECT_BASE_MS << (failover->attempts - 1U);
+		}
+	}
+
+	if ( true == failover->warm_standby )
+	{
+		MqttClientTimerStart(&client->timers, &failover->timer, delay_ms, MqttClientFailoverElapsed, client);
+	}
+	else
+	{
+		MqttClientTimerStop(&client->timers, &failover->timer);
+	}
+}
+
+/**
+ * @brief	Handle the complete packets received on the standby connection.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+static void MqttClientFailoverProcessPackets(t_MqttClient *client)
+{
+	t_MqttFailover *failover = &client->failover;
+	int packet_len = 0;
+	unsigned char type = 0U;
+
+	while ( (INVALID_FD != failover->fd) && (failover->rx_len >= 2) )
+	{
+		/* nothing the standby broker is expected to send needs a second length byte */
+		packet_len = 2 + (int)failover->rx[1];
+		if ( (0U != (failover->rx[1] & 0x80U)) || (packet_len > MQTT_STANDBY_RX_SIZE) )
+		{
+			printf("MqttClient: Unexpected packet on standby connection");
+			MqttClientFailoverCloseStandby(client, true);
+			break;
+		}
+
+		if ( packet_len > failover->rx_len )
+		{
+			break;
+		}
+
+		type = (unsigned char)(failover->rx[0] >> 4);
+		if ( STANDBY_CONNACK == type )
+		{
+			if ( (MQTT_STANDBY_WAIT_CONNACK != failover->state) || (4 > packet_len) || (0U != failover->rx[3]) )
+			{
+				printf("MqttClient: Standby connection refused by broker %s", failover->brokers[failover->standby].address);
+				MqttClientFailoverCloseStandby(client, true);
+				break;
+			}
+
+			failover->state = MQTT_STANDBY_READY;
+			failover->attempts = 0U;
+			failover->rtt_ms = (uint32_t)(MqttClientTimerNowMs(&client->timers) - failover->sent_ms);
+			MqttClientTimerStart(&client->timers, &failover->timer, STANDBY_PING_INTERVAL_MS, MqttClientFailoverElapsed, client);
+			printf("MqttClient: Standby connection ready on broker %s:%d, round trip %d ms",
+					failover->brokers[failover->standby].address, failover->brokers[failover->standby].port, failover->rtt_ms);
+
+			/* a session waiting for its own broker may take the standby at once */
+			MqttClientIoPost(client, MQTT_EVT_STANDBY_READY);
+		}
+		else if ( (STANDBY_PINGRESP == type) && (true == failover->ping_pending) )
+		{
+			failover->ping_pending = false;
+			failover->rtt_ms = (uint32_t)(MqttClientTimerNowMs(&client->timers) - failover->sent_ms);
+		}
+		else
+		{
+			/* PUBACK of a mirrored message, the broker of the session reports the result */
+		}
+
+		memmove(failover->rx, &failover->rx[packet_len], (size_t)(failover->rx_len - packet_len));
+		failover->rx_len -= packet_len;
+	}
+}
+
+/**
+ * @brief	Build the broker list of a client context from its configuration and open the standby connection.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientFailoverInit(t_MqttClient *client)
+{
+	t_MqttFailover *failover = &client->failover;
+	const t_MqttClientConfig *config = &client->config;
+	unsigned char idx;
+
+	memset(failover, 0, sizeof(t_MqttFailover));
+	failover->fd = INVALID_FD;
+	failover->state = MQTT_STANDBY_IDLE;
+
+	if ( (config->brokers != NULL) && (config->broker_count != 0U) )
+	{
+		if ( config->broker_count > MQTT_MAX_BROKERS )
+		{
+			printf("MqttClient: Only the first %d brokers of %d are used", MQTT_MAX_BROKERS, config->broker_count);
+		}
+
+		for (idx = 0U; (idx < config->broker_count) && (idx < MQTT_MAX_BROKERS); idx++)
+		{
+			failover->brokers[idx].address = config->brokers[idx].address;
+			failover->brokers[idx].port = (config->brokers[idx].port != 0) ? config->brokers[idx].port : SERVER_PORT;
+		}
+		failover->broker_count = idx;
+	}
+	else
+	{
+		failover->brokers[0].address = config->server_address;
+		failover->brokers[0].port = config->server_port;
+		failover->broker_count = 1U;
+	}
+
+	failover->client_ids[0] = config->client_id;
+	if ( config->standby_client_id != NULL )
+	{
+		failover->client_ids[1] = config->standby_client_id;
+	}
+	else
+	{
+		(void)snprintf(failover->standby_id, sizeof(failover->standby_id), "%s%s", config->client_id, MQTT_STANDBY_ID_SUFFIX);
+		failover->client_ids[1] = failover->standby_id;
+	}
+
+	failover->standby = MqttClientFailoverFollowing(failover, failover->active);
+	failover->warm_standby = ( (0U != config->warm_standby) && (failover->broker_count > 1U) );
+
+	if ( true == failover->warm_standby )
+	{
+		MqttClientTimerStart(&client->timers, &failover->timer, 0U, MqttClientFailoverElapsed, client);
+	}
+	else if ( 0U != config->warm_standby )
+	{
+		printf("MqttClient: Warm standby of client %d needs a second broker", client->handler);
+	}
+	else
+	{
+		/* no standby connection */
+	}
+}
+
+/**
+ * @brief	Get the broker the session connects to.
+ *
+ * @param[in]	: client	: client context
+ * @return 	const t_MqttBroker*
+ *
+*/
+const t_MqttBroker* MqttClientFailoverGetBroker(t_MqttClient *client)
+{
+	return &client->failover.brokers[client->failover.active];
+}
+
+/**
+ * @brief	Get the client id of the session or of the standby connection. They differ so that brokers of a cluster
+ * 			keep both connections, and are swapped when the standby takes over.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: standby	: true for the standby connection
+ * @return 	const char*
+ *
+*/
+const char* MqttClientFailoverGetClientId(t_MqttClient *client, bool standby)
+{
+	t_MqttFailover *failover = &client->failover;
+
+	return failover->client_ids[(true == standby) ? (failover->session_id ^ 1U) : failover->session_id];
+}
+
+/**
+ * @brief	Give up the broker of the session after a failed connection attempt, the next attempt goes to the next
+ * 			broker of the list. A standby connection not ready yet to that broker is dropped.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientFailoverNextBroker(t_MqttClient *client)
+{
+	t_MqttFailover *failover = &client->failover;
+
+	if ( failover->broker_count > 1U )
+	{
+		failover->active = (unsigned char)((failover->active + 1U) % failover->broker_count);
+		printf("MqttClient: Next connection attempt on broker %s:%d", failover->brokers[failover->active].address,
+				failover->brokers[failover->active].port);
+
+		/* two connections with the same client id to one broker would close each other */
+		if ( (true == failover->warm_standby) && (failover->standby == failover->active) )
+		{
+			failover->standby = MqttClientFailoverFollowing(failover, failover->active);
+			MqttClientFailoverCloseStandby(client, false);
+		}
+	}
+}
+
+/**
+ * @brief	Check whether the standby connection can take the session over.
+ *
+ * @param[in]	: client	: client context
+ * @return 	bool
+ * @retval	true	: standby connection accepted by its broker
+ * @retval	false	: no standby connection ready
+ *
+*/
+bool MqttClientFailoverStandbyReady(t_MqttClient *client)
+{
+	return (MQTT_STANDBY_READY == client->failover.state);
+}
+
+/**
+ * @brief	Move the session onto the standby connection, a new standby connection is then opened to the next broker.
+ *
+ * @param[in]	: client	: client context
+ * @return 	bool
+ * @retval	true	: session moved, it goes on at once without connect round trip
+ * @retval	false	: no standby connection ready
+ *
+*/
+bool MqttClientFailoverPromote(t_MqttClient *client)
+{
+	t_MqttFailover *failover = &client->failover;
+	int flags = 0;
+
+	if ( MQTT_STANDBY_READY != failover->state )
+	{
+		return false;
+	}
+
+	printf("MqttClient: Session of client %d moved from broker %s:%d to standby broker %s:%d", client->handler,
+			failover->brokers[failover->active].address, failover->brokers[failover->active].port,
+			failover->brokers[failover->standby].address, failover->brokers[failover->standby].port);
+
+	/* the session writes whole packets on a blocking socket */
+	flags = fcntl(failover->fd, F_GETFL);
+	(void)fcntl(failover->fd, F_SETFL, flags & ~O_NONBLOCK);
+
+	MqttClientAdoptSocket(client, failover->fd, failover->rx, failover->rx_len, failover->rtt_ms);
+
+	/* the standby client id now belongs to the session, the next standby uses the other one */
+	failover->active = failover->standby;
+	failover->session_id ^= 1U;
+
+	failover->fd = INVALID_FD;
+	failover->generation++;
+	failover->attempts = 0U;
+	failover->standby = MqttClientFailoverFollowing(failover, failover->active);
+	MqttClientFailoverCloseStandby(client, false);
+
+	return true;
+}
+
+/**
+ * @brief	Close the standby connection and open it again at once, its uplink changed.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientFailoverRestartStandby(t_MqttClient *client)
+{
+	if ( true == client->failover.warm_standby )
+	{
+		client->failover.attempts = 0U;
+		MqttClientFailoverCloseStandby(client, false);
+	}
+}
+
+/**
+ * @brief	Send a copy of a publish packet to the standby broker if the service is mirrored.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service of the message
+ * @param[in]	: packet		: publish packet sent to the broker of the session
+ * @param[in]	: len			: length of packet
+ * @return 	void
+ *
+*/
+void MqttClientFailoverMirror(t_MqttClient *client, unsigned char service_id, unsigned char *packet, int len)
+{
+	t_MqttFailover *failover = &client->failover;
+	uint32_t mirror_services = __atomic_load_n(&failover->mirror_services, __ATOMIC_RELAXED);
+
+	if ( (MQTT_STANDBY_READY == failover->state) && (service_id < 32U) && (0U != (mirror_services & (1UL << service_id))) )
+	{
+		/* a copy written in part would leave the standby stream out of sync, the connection is opened again */
+		if ( false == MqttClientTransportSendPacketBuffer(failover->fd, packet, len) )
+		{
+			printf("MqttClient: Error in mirroring message of service %d to standby broker", service_id);
+			MqttClientFailoverCloseStandby(client, true);
+		}
+	}
+}
+
+/**
+ * @brief	Select whether the messages of a service are mirrored to the standby broker.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service to configure
+ * @param[in]	: enable		: mirror the messages of the service
+ * @return 	void
+ *
+*/
+void MqttClientFailoverSetMirror(t_MqttClient *client, unsigned char service_id, bool enable)
+{
+	if ( service_id < 32U )
+	{
+		if ( true == enable )
+		{
+			(void)__atomic_or_fetch(&client->failover.mirror_services, (uint32_t)(1UL << service_id), __ATOMIC_RELAXED);
+		}
+		else
+		{
+			(void)__atomic_and_fetch(&client->failover.mirror_services, ~(uint32_t)(1UL << service_id), __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/**
+ * @brief	Progress the standby connection without waiting: finish its TCP connection and read its packets.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientFailoverProcess(t_MqttClient *client)
+{
+	t_MqttFailover *failover = &client->failover;
+	struct sockaddr_in peer;
+	socklen_t len = sizeof(peer);
+	int error = 0;
+	int bytes_received = 0;
+
+	if ( MQTT_STANDBY_CONNECTING == failover->state )
+	{
+		if ( (getsockopt(failover->fd, SOL_SOCKET, SO_ERROR, &error, &len) != SYS_SUCCESS) || (0 != error) )
+		{
+			printf("MqttClient: Error in connecting standby broker %s:%d, errno %d", failover->brokers[failover->standby].address,
+					failover->brokers[failover->standby].port, error);
+			MqttClientFailoverCloseStandby(client, true);
+			return;
+		}
+
+		len = sizeof(peer);
+		if ( getpeername(failover->fd, (struct sockaddr *)&peer, &len) != SYS_SUCCESS )
+		{
+			/* still connecting */
+			return;
+		}
+
+		MqttClientFailoverSendConnect(client);
+	}
+
+	while ( (MQTT_STANDBY_WAIT_CONNACK == failover->state) || (MQTT_STANDBY_READY == failover->state) )
+	{
+		bytes_received = (int)recv(failover->fd, &failover->rx[failover->rx_len], (size_t)(MQTT_STANDBY_RX_SIZE - failover->rx_len), MSG_DONTWAIT);
+
+		if ( bytes_received > 0 )
+		{
+			failover->rx_len += bytes_received;
+			MqttClientFailoverProcessPackets(client);
+		}
+		else
+		{
+			if ( (0 == bytes_received) || ((EAGAIN != errno) && (EWOULDBLOCK != errno) && (EINTR != errno)) )
+			{
+				printf("MqttClient: Standby connection closed by broker %s", failover->brokers[failover->standby].address);
+				MqttClientFailoverCloseStandby(client, true);
+			}
+			break;
+		}
+	}
+}
+
+/**
+ * @brief	Get the socket of the standby connection and the events it has to be watched for.
+ *
+ * @param[in]	: client	: client context
+ * @param[out]	: events	: MQTT_POLL_IN or MQTT_POLL_OUT
+ * @return 	int
+ * @retval	fd, -1 if none
+ *
+*/
+int MqttClientFailoverGetFd(t_MqttClient *client, unsigned short *events)
+{
+	*events = (MQTT_STANDBY_CONNECTING == client->failover.state) ? MQTT_POLL_OUT : MQTT_POLL_IN;
+
+	return client->failover.fd;
+}
+
+/**
+ * @brief	Get the generation of the standby socket, changed each time it is opened, closed or watched for other events.
+ *
+ * @param[in]	: client	: client context
+ * @return 	unsigned int
+ *
+*/
+unsigned int MqttClientFailoverGetGeneration(t_MqttClient *client)
+{
+	return client->failover.generation;
+}
+
+/**
+ * @brief	Close the standby connection for good, it is not opened again.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientFailoverClose(t_MqttClient *client)
+{
+	client->failover.warm_standby = false;
+	MqttClientFailoverCloseStandby(client, false);
+}
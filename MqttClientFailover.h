@@ -0,0 +1,203 @@
+/**************************************************************************//**
+*  @par Language  : C
+*******************************************************************************
+*  @brief       MqttClient broker failover header file.
+*  @author      dr-paradox
+*  @version     1.0.0
+*******************************************************************************
+*  @page 	MqttClientFailover
+*  @ref 	MqttClient "API Reference" header file
+*  @file 	MqttClientFailover.h
+*
+*******************************************************************************/
+
+#ifndef MQTTCLIENT_FAILOVER_H
+#define MQTTCLIENT_FAILOVER_H
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "MqttClient.h"
+#include "MqttClientCfg.h"
+#include "MqttClientTimer.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* Size of the receive buffer of the standby connection, it only gets CONNACK, PINGRESP and PUBACK packets, with
+ * their MQTT 5 properties */
+#define MQTT_STANDBY_RX_SIZE				((int)128)
+
+/* Max length of the client id of the standby connection built from the configured one */
+#define MQTT_STANDBY_ID_SIZE				((int)64)
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* States of the standby connection */
+typedef enum {
+	MQTT_STANDBY_IDLE = 0,				/*no connection, the timer opens the next one*/
+	MQTT_STANDBY_CONNECTING,			/*TCP connection in progress, the socket is watched for writability*/
+	MQTT_STANDBY_WAIT_CONNACK,			/*connect packet sent*/
+	MQTT_STANDBY_READY,					/*session accepted by the broker, kept alive by pings*/
+} t_MqttStandbyState;
+
+/* Ordered broker list of a client context and warm standby connection to the next broker of the list */
+typedef struct {
+	t_MqttBroker		brokers[MQTT_MAX_BROKERS];		/*brokers in order of preference*/
+	unsigned char		broker_count;					/*number of brokers*/
+	unsigned char		active;							/*broker of the session*/
+	bool				warm_standby;					/*a standby connection is kept*/
+	t_MqttStandbyState	state;							/*state of the standby connection*/
+	int					fd;								/*socket of the standby connection, -1 if none*/
+	unsigned int		generation;						/*incremented each time fd or its watched events change*/
+	unsigned char		standby;						/*broker of the standby connection*/
+	unsigned char		attempts;						/*failed standby connections in a row*/
+	uint64_t			sent_ms;						/*transmission of the connect or ping packet in flight*/
+	bool				ping_pending;					/*ping request sent and not answered yet*/
+	uint32_t			rtt_ms;							/*last round trip measured on the standby connection*/
+	unsigned char		rx[MQTT_STANDBY_RX_SIZE];		/*bytes received and not yet processed*/
+	int					rx_len;							/*number of bytes in rx*/
+	t_MqttTimer			timer;							/*opening, CONNACK deadline or ping interval depending on state*/
+	const char			*client_ids[2];					/*client ids used in turn by the session and the standby*/
+	unsigned char		session_id;						/*index of the client id of the session*/
+	char				standby_id[MQTT_STANDBY_ID_SIZE];	/*client id built with MQTT_STANDBY_ID_SUFFIX*/
+	uint32_t			mirror_services;				/*services whose messages are mirrored, bit N for service N*/
+} t_MqttFailover;
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+ * @brief	Build the broker list of a client context from its configuration and open the standby connection.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientFailoverInit(t_MqttClient *client);
+
+/**
+ * @brief	Get the broker the session connects to.
+ *
+ * @param[in]	: client	: client context
+ * @return 	const t_MqttBroker*
+ *
+*/
+const t_MqttBroker* MqttClientFailoverGetBroker(t_MqttClient *client);
+
+/**
+ * @brief	Get the client id of the session or of the standby connection. They differ so that brokers of a cluster
+ * 			keep both connections, and are swapped when the standby takes over.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: standby	: true for the standby connection
+ * @return 	const char*
+ *
+*/
+const char* MqttClientFailoverGetClientId(t_MqttClient *client, bool standby);
+
+/**
+ * @brief	Give up the broker of the session after a failed connection attempt, the next attempt goes to the next
+ * 			broker of the list. A standby connection not ready yet to that broker is dropped.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientFailoverNextBroker(t_MqttClient *client);
+
+/**
+ * @brief	Check whether the standby connection can take the session over.
+ *
+ * @param[in]	: client	: client context
+ * @return 	bool
+ * @retval	true	: standby connection accepted by its broker
+ * @retval	false	: no standby connection ready
+ *
+*/
+bool MqttClientFailoverStandbyReady(t_MqttClient *client);
+
+/**
+ * @brief	Move the session onto the standby connection, a new standby connection is then opened to the next broker.
+ *
+ * @param[in]	: client	: client context
+ * @return 	bool
+ * @retval	true	: session moved, it goes on at once without connect round trip
+ * @retval	false	: no standby connection ready
+ *
+*/
+bool MqttClientFailoverPromote(t_MqttClient *client);
+
+/**
+ * @brief	Close the standby connection and open it again at once, its uplink changed.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientFailoverRestartStandby(t_MqttClient *client);
+
+/**
+ * @brief	Send a copy of a publish packet to the standby broker if the service is mirrored.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service of the message
+ * @param[in]	: packet		: publish packet sent to the broker of the session
+ * @param[in]	: len			: length of packet
+ * @return 	void
+ *
+*/
+void MqttClientFailoverMirror(t_MqttClient *client, unsigned char service_id, unsigned char *packet, int len);
+
+/**
+ * @brief	Select whether the messages of a service are mirrored to the standby broker.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service to configure
+ * @param[in]	: enable		: mirror the messages of the service
+ * @return 	void
+ *
+*/
+void MqttClientFailoverSetMirror(t_MqttClient *client, unsigned char service_id, bool enable);
+
+/**
+ * @brief	Progress the standby connection without waiting: finish its TCP connection and read its packets.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientFailoverProcess(t_MqttClient *client);
+
+/**
+ * @brief	Get the socket of the standby connection and the events it has to be watched for.
+ *
+ * @param[in]	: client	: client context
+ * @param[out]	: events	: MQTT_POLL_IN or MQTT_POLL_OUT
+ * @return 	int
+ * @retval	fd, -1 if none
+ *
+*/
+int MqttClientFailoverGetFd(t_MqttClient *client, unsigned short *events);
+
+/**
+ * @brief	Get the generation of the standby socket, changed each time it is opened, closed or watched for other events.
+ *
+ * @param[in]	: client	: client context
+ * @return 	unsigned int
+ *
+*/
+unsigned int MqttClientFailoverGetGeneration(t_MqttClient *client);
+
+/**
+ * @brief	Close the standby connection for good, it is not opened again.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientFailoverClose(t_MqttClient *client);
+
+/* -------------------------------- Routines -------------------------------- */
+
+#endif /* MQTTCLIENT_FAILOVER_H */
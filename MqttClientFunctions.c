@@ -24,16 +24,19 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <time.h>
+#include <limits.h>
 #include <sys/ioctl.h>
 #include <net/if.h>
-#include "MqttClientFunctions.h"
+#include <linux/sockios.h>
+#include "MqttClientContext.h"
 
 /* -------------------------------- Defines --------------------------------- */
 
-/* Timer running intervals */
-#define MODEM_REQ_TIME_INTERVAL		((unsigned char)10)
-#define KEEP_ALIVE_TIME_INTERVAL	((unsigned char)20)
-#define PING_REQ_TIME_INTERVAL		((unsigned char)10)
+/* Timer running intervals in milli seconds */
+#define MODEM_REQ_TIME_INTERVAL		((uint32_t)10000)
+#define KEEP_ALIVE_TIME_INTERVAL	((uint32_t)20000)
+#define PING_REQ_TIME_INTERVAL		((uint32_t)10000)
 
 /* Invalid socket descriptor */
 #define INVALID_SOCKET				((int)-1)
@@ -46,13 +49,7 @@
 									WILL_OPTIONS_INIT, {NULL, {0, NULL}}, {NULL, {0, NULL}} }
 
 /* Mqtt publish packet initializer */
-#define PUBLISH_OPTIONS_INIT		{{(unsigned char)0}, {NULL, {0, NULL}}, (unsigned char)0, NULL, (unsigned char)0}
-
-/* Max connect packet size */
-#define MAX_CONN_PACK_SIZE			((unsigned short)512)
-
-/* Max connect packet size */
-#define MAX_PING_PACK_SIZE			((unsigned short)2)
+#define PUBLISH_OPTIONS_INIT		{{(unsigned char)0}, {NULL, {0, NULL}}, (unsigned char)0, NULL, (unsigned char)0, MQTT_PROTOCOL_VERSION, 0U}
 
 /* Max connect packet size */
 #define MAX_DISCONN_PACK_SIZE		((unsigned short)2)
@@ -72,9 +69,15 @@
 /* Max connect packet size */
 #define MAX_PUBACK_PACK_SIZE		((unsigned char)4)
 
+/* Max number of bytes encoding the remaining length */
+#define MAX_REM_LEN_BYTES			((int)4)
+
 /* Connect packet header byte : bit 4 set to 1*/
 #define CONNECT_HEADER_BYTE			((unsigned char)0x10)
 
+/* MQTT 5 Message Expiry Interval property identifier */
+#define MESSAGE_EXPIRY_PROPERTY		((unsigned char)0x02)
+
 /* Connect packet creation error */
 #define BUFFER_TOO_SHORT			((unsigned char)0)
 
@@ -173,6 +176,8 @@ typedef struct
 	unsigned short packet_id;
 	unsigned char* payload;
 	unsigned short payload_len;
+	unsigned char mqtt_version;			/* MQTT_V_5 publishes carry properties */
+	uint32_t expiry_interval;			/* Message Expiry Interval property in seconds, 0 if the message never expires */
 
 }t_mqtt_publish_packet_options;
 
@@ -197,39 +202,10 @@ typedef enum
 
 /* ---------------------------- Global Variables ---------------------------- */
 
-/* List to hold data related to each associated service such as retry count, json, size, cbk func */
-t_PendingRequest ServiceRequestList[SERVICE_LAST] = {{0, {0}, 0, NULL}};
-
-/* Request to cancel current ongoing transmission */
-bool cancel_request = false;
 
 /* profile currently in use */
 unsigned char profile = ((unsigned char)0);
 
-/* flag to store modem connection status */
-static bool modem_connected = false;
-/* flag to store profile start status */
-static bool profile_started = false;
-/* flag to store ip status */
-static bool ip_obtained = false;
-/* variable to store timer run duration */
-static unsigned char timer_interval = ZERO;
-/* flag to store timer request status */
-static bool timer_start = false;
-/* flag to store timer elapsed status */
-static bool timer_elapsed = false;
-/* flag to store client connection status */
-static bool client_connected = false;
-/* index of current service id under process */
-static unsigned char service_idx = ((unsigned char)SERVICE_LAST);
-/* index of current service id under process */
-static unsigned char pub_req_status = FAILURE;
-/**
- *  socket descriptor : This simple low-level implementation assumes a single connection for a single thread.
- *   Thus, a static variable is used for that connection.
-*/
-static int socket_desc = INVALID_SOCKET;
-
 /* --------------------------- Routine prototypes --------------------------- */
 /**
  * @brief	Session result handler function.
@@ -254,26 +230,57 @@ static int socket_desc = INVALID_SOCKET;
 //[TODO: modem func disabled]static void SessionStateHandlerFunction(unsigned char profile_id, ModemDataMng_conn_state_t session_state, void* contextPtr);
 
 /**
- * @brief	Set timer interval value.
+ * @brief	Timer wheel callback, set the elapsed flag of a FSM timer.
  *
- * @param[in]	: req_timer_interval	: timer interval value to be set
+ * @param[in]	: arg	: elapsed flag of the timer
  * @return 		void
  *
 */
-static void MqttClientSetTimerInterval(unsigned char req_timer_interval);
+static void MqttClientTimerElapsed(void *arg);
 
 /**
- * @brief	Set timer interval value.
+ * @brief	Timer wheel callback, the connection stayed up long enough: the next loss is retried at once.
  *
- * @param	void
- * @return 	void
+ * @param[in]	: arg	: session of the client
+ * @return 		void
+ *
+*/
+static void MqttClientStableElapsed(void *arg);
+
+/**
+ * @brief	Timer wheel callback, the send budget is checked again: sample the kernel queue of the socket and set the
+ * 			elapsed flag of the timer.
+ *
+ * @param[in]	: arg	: client context
+ * @return 		void
  *
 */
-static void MqttClientSetStartTimer(void);
+static void MqttClientSendBudgetElapsed(void *arg);
+
+/**
+ * @brief	Draw the delay before the next connection attempt, uniformly up to the bound of the attempt.
+ *
+ * @param[in]	: session	: session of the client
+ * @return 		uint32_t
+ * @retval		delay in milli seconds
+ *
+*/
+static uint32_t MqttClientBackoffDelayMs(t_MqttSession *session);
+
+/**
+ * @brief	Feed a round trip sample to the estimator and derive the PUBACK timeout from it (RFC 6298).
+ *
+ * @param[in]	: session	: session of the client
+ * @param[in]	: sample_ms	: measured round trip
+ * @return 		void
+ *
+*/
+static void MqttClientRttSample(t_MqttSession *session, uint32_t sample_ms);
 
 /**
  * @brief	Create a socket and connect to desired host on specified port.
  *
+ * @param[in]	: client	: client context
  * @param[in]	: addr	: host address
  * @param[in]	: port	: port
  * @return 		int
@@ -281,24 +288,93 @@ static void MqttClientSetStartTimer(void);
  * @retval 		<0: failure
  *
 */
-static int MqttClientTransportOpen(char *addr, int port);
+static int MqttClientTransportOpen(t_MqttClient *client, const char *addr, int port);
 
 /**
-* @brief	send a packet over socket
+* @brief	Set the options of a busy polling client on a new socket: SO_BUSY_POLL and TCP_NODELAY.
 *
-* @param[in]	: socket	: socket descriptor
-* @param[in]	: buf		: packet buffer to be sent over network
-* @param[in]	: buflen	: length of packet buffer to be sent
-* @return 		int
-* @reval		0 : Success
-* @retval		!0: failure
+* @param[in]	: sock	: socket descriptor
+* @return 		void
+*
+*/
+static void MqttClientTransportSetLowLatency(int sock);
+
+/**
+* @brief	Let the kernel detect a dead connection to the broker as the MQTT keep alive does: TCP keepalive probes
+* 			once the connection stayed idle for a keep alive interval. Unacknowledged data is bounded by
+* 			MqttClientTransportSetUserTimeout().
+*
+* @param[in]	: sock	: socket descriptor
+* @return 		void
+*
+*/
+static void MqttClientTransportSetKeepAlive(int sock);
+
+/**
+* @brief	Close the connection when data stays unacknowledged past the PINGRESP deadline, PUBACK timeout plus
+* 			MQTT_PINGRESP_MARGIN_MS (TCP_USER_TIMEOUT). Set again as the round trip estimate moves.
+*
+* @param[in]	: session	: protocol state of the client context
+* @return 		void
+*
+*/
+static void MqttClientTransportSetUserTimeout(t_MqttSession *session);
+
+/**
+* @brief	Read the kernel state of the broker socket: TCP round trip, unacknowledged and unsent bytes.
+*
+* @param[in]	: client	: client context
+* @return 		void
+*
+*/
+static void MqttClientTransportSampleLink(t_MqttClient *client);
+
+/**
+* @brief	Adjust the send budget, additive increase while the path shows no queueing delay, multiplicative
+* 			decrease otherwise.
+*
+* @param[in]	: session	: protocol state of the client context
+* @param[in]	: congested	: queueing delay measured or PUBACK timed out
+* @return 		void
+*
+*/
+static void MqttClientSendBudgetUpdate(t_MqttSession *session, bool congested);
+
+/**
+* @brief	Forget the kernel view of the previous connection, the send budget starts again from its minimum.
+*
+* @param[in]	: session	: protocol state of the client context
+* @return 		void
+*
+*/
+static void MqttClientSendBudgetReset(t_MqttSession *session);
+
+/**
+* @brief	Count a packet written to the socket in the kernel queue sampled last, the queue only drains until the next
+* 			sample.
+*
+* @param[in]	: session	: protocol state of the client context
+* @param[in]	: len		: length of the packet written
+* @return 		void
 *
 */
-static int MqttClientTransportSendPacketBuffer(int sock, unsigned char* buf, int buflen);
+static void MqttClientSendBudgetWritten(t_MqttSession *session, int len);
+
+/**
+* @brief	Get the most urgent service with a request without ordering key to publish, the active request first. The
+* 			spool and the ordered window hold back for it, the send budget is then left to this request.
+*
+* @param[in]	: client	: client context
+* @return 		unsigned char
+* @retval		SERVICE_LAST	: no request to publish
+*
+*/
+static unsigned char MqttClientUrgentService(t_MqttClient *client);
 
 /**
 * @brief	receive a packet over socket
 *
+* @param[in]	: client	: client context
 * @param[in]	: buf	: packet buffer to be sent over network
 * @param[in]	: count	: bytes to read
 * @return 		int
@@ -306,35 +382,49 @@ static int MqttClientTransportSendPacketBuffer(int sock, unsigned char* buf, int
 * @retval		!0: failure
 *
 */
-static int MqttClientTransportReceivePacketBuffer(unsigned char* buf, int byte_count);
+static int MqttClientTransportReceivePacketBuffer(t_MqttClient *client, unsigned char* buf, int byte_count);
+
+/**
+* @brief	Handle a complete packet received from the broker.
+*
+* @param[in]	: client	: client context
+* @param[in]	: header	: fixed header byte
+* @param[in]	: payload	: variable header and payload
+* @param[in]	: rem_len	: length of payload
+* @return		void
+*/
+static void MqttClientProcessPacket(t_MqttClient *client, t_mqtt_header_byte header, unsigned char *payload, int rem_len);
 
 /**
  * @brief	sets connect packet options structure with defined options in configuration file.
  *
+ * @param[in]	: client	: client context
+ * @param[in]	: client_id	: client id of the connection
  * @param[in]	: options	:  pointer to connect packet options structure to set
  * @return 		void
  *
 */
-static void MqttClientSetConnectPacketOptions(t_mqtt_connect_packet_options *options);
+static void MqttClientSetConnectPacketOptions(t_MqttClient *client, const char *client_id, t_mqtt_connect_packet_options *options);
+
+/**
+ * @brief	Get the Message Expiry Interval of a request: the seconds left to live rounded up, 0 if it never expires.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: req		: request to publish
+ * @return 	uint32_t
+ *
+*/
+static uint32_t MqttClientExpiryInterval(t_MqttClient *client, t_PendingRequest *req);
 
 /**
  * @brief	sets publish packet options structure with defined options in configuration file.
  *
+ * @param[in]	: client	: client context
  * @param[in]	: options	:  pointer to connect packet options structure to set
  * @return 		void
  *
 */
-static void MqttClientSetPublishPacketOptions(t_mqtt_publish_packet_options *options);
-
-/**
-* @brief	Serializes ping packet into supplied buffer.
-*
-* @param[out]	: buf	: the buffer into which the ping packet will be serialized
-* @return		int
-* @retval 		serialized length
-* @retval 		0 as error
- */
-static int MqttClientCreatePingPacket(unsigned char* buf);
+static void MqttClientSetPublishPacketOptions(t_MqttClient *client, t_mqtt_publish_packet_options *options);
 
 /**
 * @brief	Serializes disconnect packet into supplied buffer.
@@ -468,32 +558,122 @@ static void MqttClientMqttStringWrite(unsigned char** buff_index_ptr, t_mqtt_str
 /* -------------------------------- Routines -------------------------------- */
 
 /**
- * @brief	Set timer interval value.
+ * @brief	Timer wheel callback, set the elapsed flag of a FSM timer.
  *
- * @param[in]	: req_timer_interval	: timer interval value to be set
+ * @param[in]	: arg	: elapsed flag of the timer
  * @return 		void
  *
 */
-static void MqttClientSetTimerInterval(unsigned char req_timer_interval)
+static void MqttClientTimerElapsed(void *arg)
 {
-	timer_interval = req_timer_interval;
+	*(bool *)arg = true;
 }
 
 /**
- * @brief	Set timer interval value.
+ * @brief	Timer wheel callback, the connection stayed up long enough: the next loss is retried at once.
  *
- * @param	void
- * @return 	void
+ * @param[in]	: arg	: session of the client
+ * @return 		void
+ *
+*/
+static void MqttClientStableElapsed(void *arg)
+{
+	((t_MqttSession *)arg)->reconnect_attempts = 0U;
+}
+
+/**
+ * @brief	Timer wheel callback, the send budget is checked again: sample the kernel queue of the socket and set the
+ * 			elapsed flag of the timer.
+ *
+ * @param[in]	: arg	: client context
+ * @return 		void
+ *
+*/
+static void MqttClientSendBudgetElapsed(void *arg)
+{
+	t_MqttClient *client = (t_MqttClient *)arg;
+
+	if ( client->session.socket_desc != INVALID_SOCKET )
+	{
+		MqttClientTransportSampleLink(client);
+	}
+	client->session.timer_elapsed[SEND_BUDGET] = true;
+}
+
+/**
+ * @brief	Draw the delay before the next connection attempt, uniformly up to the bound of the attempt.
+ *
+ * @param[in]	: session	: session of the client
+ * @return 		uint32_t
+ * @retval		delay in milli seconds
+ *
+*/
+static uint32_t MqttClientBackoffDelayMs(t_MqttSession *session)
+{
+	uint32_t bound = MQTT_RECONNECT_CAP_MS;
+	uint32_t delay_ms = 0U;
+	unsigned char doublings = 0U;
+
+	if ( session->reconnect_attempts != 0U )
+	{
+		/* the bound stops doubling once it reached the cap */
+		doublings = (unsigned char)(session->reconnect_attempts - 1U);
+		if ( (doublings < 32U) && ((((uint64_t)MQTT_RECONNECT_BASE_MS) << doublings) < MQTT_RECONNECT_CAP_MS) )
+		{
+			bound = MQTT_RECONNECT_BASE_MS << doublings;
+		}
+
+		/* xorshift32, only used to spread the clients, not for security */
+		session->jitter_state ^= session->jitter_state << 13;
+		session->jitter_state ^= session->jitter_state >> 17;
+		session->jitter_state ^= session->jitter_state << 5;
+
+		delay_ms = session->jitter_state % (bound + 1U);
+	}
+
+	return delay_ms;
+}
+
+/**
+ * @brief	Feed a round trip sample to the estimator and derive the PUBACK timeout from it (RFC 6298).
+ *
+ * @param[in]	: session	: session of the client
+ * @param[in]	: sample_ms	: measured round trip
+ * @return 		void
  *
 */
-static void MqttClientSetStartTimer(void)
+static void MqttClientRttSample(t_MqttSession *session, uint32_t sample_ms)
 {
-	timer_start = true;
+	t_MqttRtt *rtt = &session->rtt;
+	uint32_t deviation = 0U;
+	uint32_t rto_ms = 0U;
+
+	if ( false == rtt->valid )
+	{
+		rtt->srtt_ms = sample_ms;
+		rtt->rttvar_ms = sample_ms / 2U;
+		rtt->valid = true;
+	}
+	else
+	{
+		deviation = (rtt->srtt_ms > sample_ms) ? (rtt->srtt_ms - sample_ms) : (sample_ms - rtt->srtt_ms);
+		rtt->rttvar_ms = ((3U * rtt->rttvar_ms) + deviation) / 4U;
+		rtt->srtt_ms = ((7U * rtt->srtt_ms) + sample_ms) / 8U;
+	}
+
+	/* a new measure also ends the doubling of the timeout by the retransmissions */
+	rto_ms = rtt->srtt_ms + MAX(1U, 4U * rtt->rttvar_ms);
+	rtt->rto_ms = MIN(MAX(rto_ms, MQTT_RTO_MIN_MS), MQTT_RTO_MAX_MS);
+
+	printf("MqttClient: Round trip %d ms, smoothed %d ms, variation %d ms, PUBACK timeout %d ms", sample_ms, rtt->srtt_ms, rtt->rttvar_ms, rtt->rto_ms);
+
+	MqttClientTransportSetUserTimeout(session);
 }
 
 /**
  * @brief	Create a socket and connect to desired host on specified port.
  *
+ * @param[in]	: client	: client context
  * @param[in]	: addr	: host address
  * @param[in]	: port	: port
  * @return 		int
@@ -501,17 +681,25 @@ static void MqttClientSetStartTimer(void)
  * @retval 		<0: failure
  *
 */
-static int MqttClientTransportOpen(char *addr, int port)
+static int MqttClientTransportOpen(t_MqttClient *client, const char *addr, int port)
 {
+		t_MqttSession *session = &client->session;
 		struct sockaddr_in address;
 		int ret_code = -1;
 		sa_family_t family = AF_INET;
 
 		struct addrinfo *result = NULL;
 		struct addrinfo hints = {0, AF_UNSPEC, SOCK_STREAM, IPPROTO_TCP, 0, NULL, NULL, NULL};
-		static struct timeval tv;
+		struct timeval tv;
+
+		/* this attempt takes the uplink as it is now */
+		session->uplink_changed = false;
 
-		socket_desc = INVALID_SOCKET;
+		/* a previous connection is never reused, don't leak its socket */
+		if (session->socket_desc != INVALID_SOCKET)
+		{
+			MqttClientTransportClose(client);
+		}
 
 		if ((ret_code = getaddrinfo(addr, NULL, &hints, &result)) == SYS_SUCCESS)
 		{
@@ -539,34 +727,39 @@ static int MqttClientTransportOpen(char *addr, int port)
 				address.sin_addr = ((struct sockaddr_in*)(result->ai_addr))->sin_addr;
 
 				/* Create socket for ipv4 addr over tcp connection */
-				socket_desc = socket(AF_INET, SOCK_STREAM, 0);
+				session->socket_desc = socket(AF_INET, SOCK_STREAM, 0);
 
-				if (socket_desc != INVALID_SOCKET)
+				if (session->socket_desc != INVALID_SOCKET)
 				{
-					ret_code = connect(socket_desc, (struct sockaddr*)&address, sizeof(address));
+					ret_code = connect(session->socket_desc, (struct sockaddr*)&address, sizeof(address));
 
 					if(ret_code != INVALID_SOCKET)
 					{
 						tv.tv_sec = 1;  /* 1 second Timeout */
 						tv.tv_usec = 0;
-						setsockopt(socket_desc, SOL_SOCKET, SO_RCVTIMEO, (char *)&tv,sizeof(struct timeval));
-						printf("MqttClient: TCP connection over socket: %d successful", socket_desc);
+						setsockopt(session->socket_desc, SOL_SOCKET, SO_RCVTIMEO, (char *)&tv,sizeof(struct timeval));
+						MqttClientTransportConfigure(client, session->socket_desc);
+						MqttClientNetlinkBind(client, session->socket_desc);
+						MqttClientSendBudgetReset(session);
+						MqttClientTransportSetUserTimeout(session);
+						printf("MqttClient: TCP connection over socket: %d successful", session->socket_desc);
 					}
 					else
 					{
-						socket_desc = INVALID_SOCKET;
-						printf("MqttClient: Error in connecting host with ret code: %d on socket %d",ret_code, socket_desc);
+						printf("MqttClient: Error in connecting host with ret code: %d on socket %d",ret_code, session->socket_desc);
+						(void)close(session->socket_desc);
+						session->socket_desc = INVALID_SOCKET;
 					}
 				}
 				else
 				{
-					socket_desc = INVALID_SOCKET;
-					printf("MqttClient: Error in creating socket returned socket: %d", socket_desc);
+					session->socket_desc = INVALID_SOCKET;
+					printf("MqttClient: Error in creating socket returned socket: %d", session->socket_desc);
 				}
 			}
 			else
 			{
-				socket_desc = INVALID_SOCKET;
+				session->socket_desc = INVALID_SOCKET;
 				printf("MqttClient: Error in getting IPV4 address info of host");
 			}
 
@@ -574,161 +767,500 @@ static int MqttClientTransportOpen(char *addr, int port)
 		}
 		else
 		{
-			socket_desc = INVALID_SOCKET;
+			session->socket_desc = INVALID_SOCKET;
 			printf("MqttClient: Error in getting address info of host");
 		}
 
-		return socket_desc;
+		session->socket_generation++;
+		return session->socket_desc;
 }
 
 /**
-* @brief	send a packet over socket
+* @brief	Set the options of a busy polling client on a new socket: SO_BUSY_POLL and TCP_NODELAY.
 *
-* @param[in]	: socket	: socket descriptor
-* @param[in]	: buf		: packet buffer to be sent over network
-* @param[in]	: buflen	: length of packet buffer to be sent
-* @return 		int
-* @reval		0 : Success
-* @retval		!0: failure
+* @param[in]	: sock	: socket descriptor
+* @return 		void
 *
 */
-static int MqttClientTransportSendPacketBuffer(int sock, unsigned char* buf, int buflen)
+static void MqttClientTransportSetLowLatency(int sock)
 {
-	int rc = 0;
-	rc = write(sock, buf, buflen);
+	int nodelay = 1;
+#ifdef SO_BUSY_POLL
+	int busy_poll_us = MQTT_SO_BUSY_POLL_US;
 
-	if(SUCCESS == rc)
+	/* raising it above net.core.busy_read needs CAP_NET_ADMIN, the spin of the I/O thread works without it */
+	if ( setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_us, sizeof(busy_poll_us)) != SYS_SUCCESS )
 	{
-		printf("MqttClient: Packet sent");
+		printf("MqttClient: SO_BUSY_POLL not set on socket %d, errno %d", sock, errno);
 	}
-	else
+#endif
+
+	if ( setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) != SYS_SUCCESS )
 	{
-		printf("MqttClient: Error in sending packet over socket:%d", sock);
+		printf("MqttClient: TCP_NODELAY not set on socket %d, errno %d", sock, errno);
 	}
-	return rc;
 }
 
 /**
-* @brief	receive a packet over socket
+* @brief	Let the kernel detect a dead connection to the broker as the MQTT keep alive does: TCP keepalive probes
+* 			once the connection stayed idle for a keep alive interval. Unacknowledged data is bounded by
+* 			MqttClientTransportSetUserTimeout().
 *
-* @param[in]	: buf		: packet buffer to be sent over network
-* @param[in]	: count		: bytes to read
-* @return 		int
-* @reval		0 : Success
-* @retval		!0: failure
+* @param[in]	: sock	: socket descriptor
+* @return 		void
 *
 */
-static int MqttClientTransportReceivePacketBuffer(unsigned char* buf, int byte_count)
+static void MqttClientTransportSetKeepAlive(int sock)
 {
-	int bytes_received = 0;
+	int keepalive = 1;
+	int idle_s = (int)KEEP_ALIVE_INTERVAL;
+	int interval_s = MAX((int)KEEP_ALIVE_INTERVAL / MQTT_TCP_KEEPALIVE_PROBES, 1);
+	int probes = MQTT_TCP_KEEPALIVE_PROBES;
 
-	bytes_received = recv(socket_desc, buf, byte_count, 0);
-	printf("MqttClient: received %d bytes count %d\n", bytes_received, byte_count);
-	return bytes_received;
+	if ( setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepalive, sizeof(keepalive)) != SYS_SUCCESS )
+	{
+		printf("MqttClient: SO_KEEPALIVE not set on socket %d, errno %d", sock, errno);
+	}
+
+	(void)setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle_s, sizeof(idle_s));
+	(void)setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &interval_s, sizeof(interval_s));
+	(void)setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
 }
 
 /**
- * @brief	sets connect packet options structure with defined options in config file.
- *
- * @param[in]	: options		:  pointer to connect packet options structure to set
- * @return 		void
- *
+* @brief	Close the connection when data stays unacknowledged past the PINGRESP deadline, PUBACK timeout plus
+* 			MQTT_PINGRESP_MARGIN_MS (TCP_USER_TIMEOUT). Set again as the round trip estimate moves.
+*
+* @param[in]	: session	: protocol state of the client context
+* @return 		void
+*
 */
-static void MqttClientSetConnectPacketOptions(t_mqtt_connect_packet_options *options)
+static void MqttClientTransportSetUserTimeout(t_MqttSession *session)
 {
-	/* Set connect packet options from config file */
-	options->mqtt_version			= MQTT_V_3_1_1;
-	options->client_id.cstring 		= CLIENT_ID;
-	options->keep_alive_interval 	= KEEP_ALIVE_INTERVAL;
-	options->clean_session 			= CLEAN_SESSION_FLAG;
-	options->username.cstring		= USERNAME;
-	options->password.cstring		= PASSWORD;
+#ifdef TCP_USER_TIMEOUT
+	unsigned int user_timeout_ms = session->rtt.rto_ms + MQTT_PINGRESP_MARGIN_MS;
+	unsigned int change_ms = (user_timeout_ms > session->link.user_timeout_ms) ? (user_timeout_ms - session->link.user_timeout_ms) :
+																				  (session->link.user_timeout_ms - user_timeout_ms);
+
+	/* the estimate moves a little on every PUBACK, a system call is only worth an eighth of the timeout */
+	if ( (session->socket_desc == INVALID_SOCKET) || (change_ms <= (session->link.user_timeout_ms / 8U)) )
+	{
+		return;
+	}
+
+	if ( setsockopt(session->socket_desc, IPPROTO_TCP, TCP_USER_TIMEOUT, &user_timeout_ms, sizeof(user_timeout_ms)) == SYS_SUCCESS )
+	{
+		session->link.user_timeout_ms = user_timeout_ms;
+	}
+	else
+	{
+		printf("MqttClient: TCP_USER_TIMEOUT not set on socket %d, errno %d", session->socket_desc, errno);
+	}
+#else
+	(void)session;
+#endif
 }
 
 /**
- * @brief		sets publish packet options structure with defined options in config file.
- *
- * @param[in]	: options		:  pointer to connect packet options structure to set
- * @return 		void
- *
+* @brief	Read the kernel state of the broker socket: TCP round trip, unacknowledged and unsent bytes.
+*
+* @param[in]	: client	: client context
+* @return 		void
+*
 */
-static void MqttClientSetPublishPacketOptions(t_mqtt_publish_packet_options *options)
+static void MqttClientTransportSampleLink(t_MqttClient *client)
 {
-	/* Set connect packet options from config file */
-	options->header_options.bits.dup	= ZERO;
-	options->header_options.bits.qos	= QOS_1;
-	options->header_options.bits.retain	= RETAIN;
-	options->header_options.bits.type	= PUBLISH;
-	options->packet_id					= 1;	/* TODO revisit */
-	options->topic_name.cstring			= TOPIC;
-	options->payload					= ServiceRequestList[service_idx].json;
-	options->payload_len				= ServiceRequestList[service_idx].json_size;
+	t_MqttSession *session = &client->session;
+	t_MqttLink *link = &session->link;
+	struct tcp_info info;
+	socklen_t info_len = sizeof(info);
+	int bytes = 0;
+
+	if ( getsockopt(session->socket_desc, IPPROTO_TCP, TCP_INFO, &info, &info_len) == SYS_SUCCESS )
+	{
+		link->rtt_us = info.tcpi_rtt;
+		link->unacked = info.tcpi_unacked;
+		if ( (0U != info.tcpi_rtt) && (info.tcpi_rtt < link->min_rtt_us) )
+		{
+			link->min_rtt_us = info.tcpi_rtt;
+		}
+	}
+
+	if ( ioctl(session->socket_desc, SIOCOUTQ, &bytes) == SYS_SUCCESS )
+	{
+		link->outq_bytes = bytes;
+	}
+
+	if ( ioctl(session->socket_desc, SIOCOUTQNSD, &bytes) == SYS_SUCCESS )
+	{
+		link->notsent_bytes = bytes;
+	}
 }
 
 /**
-* @brief	Serializes ping packet into supplied buffer.
+* @brief	Adjust the send budget, additive increase while the path shows no queueing delay, multiplicative
+* 			decrease otherwise.
 *
-* @param[out]	: buf	: the buffer into which the ping packet will be serialized
-* @return		int
-* @retval 		serialized length
-* @retval 		0 as error
- */
-static int MqttClientCreatePingPacket(unsigned char* buf)
+* @param[in]	: session	: protocol state of the client context
+* @param[in]	: congested	: queueing delay measured or PUBACK timed out
+* @return 		void
+*
+*/
+static void MqttClientSendBudgetUpdate(t_MqttSession *session, bool congested)
 {
-	/* Ping request packet is Byte 1: 0xC0 Byte 2: 0x00 */
-	buf[0] = PING_HEADER_BYTE;
-	buf[1] = PING_LENGTH_BYTE;
+	t_MqttLink *link = &session->link;
 
-	return MAX_PING_PACK_SIZE;
+	if ( true == congested )
+	{
+		link->send_budget = MAX(link->send_budget / 2U, MQTT_SEND_BUDGET_MIN);
+		printf("MqttClient: Send budget lowered to %d bytes, tcp rtt %d us min %d us outq %d notsent %d",
+				link->send_budget, link->rtt_us, link->min_rtt_us, link->outq_bytes, link->notsent_bytes);
+	}
+	else
+	{
+		link->send_budget = MIN(link->send_budget + MQTT_SEND_BUDGET_STEP, MQTT_SEND_BUDGET_MAX);
+	}
 }
 
 /**
-* @brief	Serializes disconnect packet into supplied buffer.
+* @brief	Forget the kernel view of the previous connection, the send budget starts again from its minimum.
 *
-* @param[out]	: buf	: the buffer into which the disconnect packet will be serialized
-* @return		int
-* @retval 		serialized length
-* @retval 		0 as error
- */
-static int MqttClientCreateDisconnectPacket(unsigned char* buf)
+* @param[in]	: session	: protocol state of the client context
+* @return 		void
+*
+*/
+static void MqttClientSendBudgetReset(t_MqttSession *session)
 {
-	/* Disconnect request packet is Byte 1: 0xE0 Byte 2: 0x00 */
-	buf[0] = DISCONN_HEADER_BYTE;
-	buf[1] = DISCONN_LENGTH_BYTE;
-
-	return MAX_DISCONN_PACK_SIZE;
+	memset(&session->link, 0, sizeof(session->link));
+	session->link.min_rtt_us = UINT32_MAX;
+	session->link.send_budget = MQTT_SEND_BUDGET_MIN;
 }
 
 /**
-* @brief	Serializes the connect options into the buffer.
+* @brief	Count a packet written to the socket in the kernel queue sampled last, the queue only drains until the next
+* 			sample.
 *
-* @param[out]	: buf			: the buffer into which the packet will be serialized
-* @param[in]	: len			: the length in bytes of the supplied buffer
-* @param[in]	: def_options	: the options to be used to build the connect packet
-* @return		int
-* @retval 		serialized length
-* @retval 		0 as error
- */
-static int MqttClientCreateConnectPacket(unsigned char* buf, int buflen, t_mqtt_connect_packet_options* def_options)
+* @param[in]	: session	: protocol state of the client context
+* @param[in]	: len		: length of the packet written
+* @return 		void
+*
+*/
+static void MqttClientSendBudgetWritten(t_MqttSession *session, int len)
 {
-	unsigned char *buff_index = buf;
-	t_mqtt_connect_flags flags = {0};
-	bool buffer_available = false;
-	int len = 0;
-	int serialized_len = BUFFER_TOO_SHORT;
-
-	len = MqttClientCalConnectPacketLength(def_options);
-	buffer_available = MqttClientCheckBufferSize(len, buflen);
-
-	if (true == buffer_available)
-	{
-		/* write header CONNECT_HEADER_BYTE */
-		MqttClientByteWrite(&buff_index, CONNECT_HEADER_BYTE);
+	session->link.outq_bytes += len;
+}
+
+/**
+* @brief	send a packet over socket
+*
+* @param[in]	: socket	: socket descriptor
+* @param[in]	: buf		: packet buffer to be sent over network
+* @param[in]	: buflen	: length of packet buffer to be sent
+* @return 		bool
+* @retval		true	: whole packet written
+* @retval		false	: failure
+*
+*/
+bool MqttClientTransportSendPacketBuffer(int sock, unsigned char* buf, int buflen)
+{
+	int written = 0;
+	int rc = 0;
+
+	/* a blocking send may still return short when interrupted, the rest of the packet follows. A connection
+	 * closed by the broker fails the send instead of raising SIGPIPE in the application */
+	while ( written < buflen )
+	{
+		rc = send(sock, &buf[written], (size_t)(buflen - written), MSG_NOSIGNAL);
+
+		if ( rc > 0 )
+		{
+			written += rc;
+		}
+		else if ( (rc < 0) && (EINTR == errno) )
+		{
+			/* try again */
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	if ( written == buflen )
+	{
+		printf("MqttClient: Packet sent");
+	}
+	else
+	{
+		printf("MqttClient: Error in sending packet over socket:%d, errno %d", sock, errno);
+	}
+	return (written == buflen);
+}
+
+/**
+* @brief	receive a packet over socket
+*
+* @param[in]	: client	: client context
+* @param[in]	: buf		: packet buffer to be sent over network
+* @param[in]	: count		: bytes to read
+* @return 		int
+* @reval		0 : Success
+* @retval		!0: failure
+*
+*/
+static int MqttClientTransportReceivePacketBuffer(t_MqttClient *client, unsigned char* buf, int byte_count)
+{
+	t_MqttSession *session = &client->session;
+	int bytes_received = 0;
+
+	/* never wait here, data is processed as soon as it is available */
+	bytes_received = recv(session->socket_desc, buf, byte_count, MSG_DONTWAIT);
+	if ( bytes_received > 0 )
+	{
+		printf("MqttClient: received %d bytes count %d\n", bytes_received, byte_count);
+	}
+	return bytes_received;
+}
+
+/**
+* @brief	Handle a complete packet received from the broker.
+*
+* @param[in]	: client	: client context
+* @param[in]	: header	: fixed header byte
+* @param[in]	: payload	: variable header and payload
+* @param[in]	: rem_len	: length of payload
+* @return		void
+*/
+static void MqttClientProcessPacket(t_MqttClient *client, t_mqtt_header_byte header, unsigned char *payload, int rem_len)
+{
+	t_MqttSession *session = &client->session;
+
+	/* any packet proves the path to the broker alive, the deadline of a ping in flight is met */
+	session->last_rx_ms = MqttClientTimerNowMs(&client->timers);
+	MqttClientStopTimer(client, PINGRESP_RSP);
+
+	switch (header.bits.type)
+	{
+		case CONNACK:
+			/* MQTT 5 appends properties, not used */
+			if ( 2 <= rem_len )
+			{
+				session->connack_received = true;
+				session->connack_return_code = payload[1];
+				if ( CONNECTION_ACCEPTED != session->connack_return_code )
+				{
+					printf("MqttClient: Mqtt connection refused by host with return: %d", session->connack_return_code);
+				}
+			}
+			else
+			{
+				printf("MqttClient: Incorrect decoded len received: %d", rem_len);
+			}
+			break;
+
+		case PUBACK:
+			/* MQTT 5 may append a reason code and properties, the publish is released whatever the reason */
+			if ( (2 <= rem_len) && ((uint16_t)MqttClientLenRead(payload) >= MQTT_SPOOL_PACKET_ID_BASE) )
+			{
+				/* spooled messages are pipelined, a PUBACK releases one of the window */
+				if ( true == MqttClientSpoolAcked(client, (uint16_t)MqttClientLenRead(payload)) )
+				{
+					MqttClientTransportSampleLink(client);
+					MqttClientSendBudgetUpdate(session, (session->link.rtt_us > (session->link.min_rtt_us + (MQTT_QUEUE_DELAY_MS * 1000U))));
+				}
+			}
+			else if ( (2 <= rem_len) && ((uint16_t)MqttClientLenRead(payload) >= MQTT_ORDERED_PACKET_ID_BASE) )
+			{
+				/* requests with an ordering key are pipelined as well, the next request of the key may follow */
+				if ( true == MqttClientQueueOrderedAcked(client, (uint16_t)MqttClientLenRead(payload)) )
+				{
+					MqttClientTransportSampleLink(client);
+					MqttClientSendBudgetUpdate(session, (session->link.rtt_us > (session->link.min_rtt_us + (MQTT_QUEUE_DELAY_MS * 1000U))));
+				}
+			}
+			else if ( (2 <= rem_len) && (session->packet_id == (uint16_t)MqttClientLenRead(payload)) )
+			{
+				/* the PUBACK of a retransmitted publish may acknowledge any of its copies, it is no round trip sample (Karn) */
+				if ( (false == session->puback_received) && (0U == session->pub_retransmits) )
+				{
+					MqttClientRttSample(session, (uint32_t)(MqttClientTimerNowMs(&client->timers) - session->publish_sent_ms));
+				}
+				if ( false == session->puback_received )
+				{
+					MqttClientTransportSampleLink(client);
+					MqttClientSendBudgetUpdate(session, (session->link.rtt_us > (session->link.min_rtt_us + (MQTT_QUEUE_DELAY_MS * 1000U))));
+				}
+				session->puback_received = true;
+				printf("MqttClient: Mqtt publish ack received for packet id:%d", session->packet_id);
+			}
+			else if ( 2 <= rem_len )
+			{
+				/* late PUBACK of a publish already given up */
+				printf("MqttClient: Mqtt publish ack for packet id:%d ignored", MqttClientLenRead(payload));
+			}
+			else
+			{
+				printf("MqttClient: Incorrect decoded len received: %d", rem_len);
+			}
+			break;
+
+		case PINGRESP:
+			if ( true == session->ping_timed )
+			{
+				session->ping_timed = false;
+				MqttClientRttSample(session, (uint32_t)(MqttClientTimerNowMs(&client->timers) - session->ping_sent_ms));
+			}
+			session->pingresp_received = true;
+
+			/* the next ping is due one ping interval after this response */
+			MqttClientClearStartTimer(client, PING_REQ);
+			printf("MqttClient: Ping response received");
+			break;
+
+		default:
+			printf("MqttClient: Unexpected packet type: %d ignored", header.bits.type);
+			break;
+	}
+}
+
+/**
+ * @brief	sets connect packet options structure with defined options in config file.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: client_id	: client id of the connection
+ * @param[in]	: options		:  pointer to connect packet options structure to set
+ * @return 		void
+ *
+*/
+static void MqttClientSetConnectPacketOptions(t_MqttClient *client, const char *client_id, t_mqtt_connect_packet_options *options)
+{
+	/* Set connect packet options from config file */
+	options->mqtt_version			= MQTT_PROTOCOL_VERSION;
+	options->client_id.cstring 		= (char *)client_id;
+	options->keep_alive_interval 	= KEEP_ALIVE_INTERVAL;
+	options->clean_session 			= CLEAN_SESSION_FLAG;
+	options->username.cstring		= (char *)client->config.username;
+	options->password.cstring		= (char *)client->config.password;
+}
+
+/**
+ * @brief	Get the Message Expiry Interval of a request: the seconds left to live rounded up, 0 if it never expires.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: req		: request to publish
+ * @return 	uint32_t
+ *
+*/
+static uint32_t MqttClientExpiryInterval(t_MqttClient *client, t_PendingRequest *req)
+{
+	uint64_t now_ms = 0U;
+	uint32_t expiry_interval = 0U;
+
+	/* the broker drops the message as well once its time to live elapsed */
+	if ( 0U != req->deadline_ms )
+	{
+		now_ms = MqttClientTimerNowMs(&client->timers);
+		expiry_interval = (req->deadline_ms > now_ms) ? (uint32_t)(((req->deadline_ms - now_ms) + 999U) / 1000U) : 1U;
+	}
+
+	return expiry_interval;
+}
+
+/**
+ * @brief		sets publish packet options structure with defined options in config file.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: options		:  pointer to connect packet options structure to set
+ * @return 		void
+ *
+*/
+static void MqttClientSetPublishPacketOptions(t_MqttClient *client, t_mqtt_publish_packet_options *options)
+{
+	t_MqttSession *session = &client->session;
+
+	/* Set connect packet options from config file, a retransmission keeps the packet id of the first transmission */
+	options->header_options.bits.dup	= (session->pub_retransmits != 0U) ? ONE : ZERO;
+	options->header_options.bits.qos	= QOS_1;
+	options->header_options.bits.retain	= RETAIN;
+	options->header_options.bits.type	= PUBLISH;
+	options->packet_id					= session->packet_id;
+	options->topic_name.cstring			= TOPIC;
+	options->payload					= session->active_request->json;
+	options->payload_len				= session->active_request->json_size;
+	options->expiry_interval			= MqttClientExpiryInterval(client, session->active_request);
+}
+
+/**
+* @brief	Serializes ping packet into supplied buffer.
+*
+* @param[out]	: buf	: the buffer into which the ping packet will be serialized
+* @return		int
+* @retval 		serialized length
+* @retval 		0 as error
+ */
+int MqttClientCreatePingPacket(unsigned char* buf)
+{
+	/* Ping request packet is Byte 1: 0xC0 Byte 2: 0x00 */
+	buf[0] = PING_HEADER_BYTE;
+	buf[1] = PING_LENGTH_BYTE;
+
+	return MAX_PING_PACK_SIZE;
+}
+
+/**
+* @brief	Serializes disconnect packet into supplied buffer.
+*
+* @param[out]	: buf	: the buffer into which the disconnect packet will be serialized
+* @return		int
+* @retval 		serialized length
+* @retval 		0 as error
+ */
+static int MqttClientCreateDisconnectPacket(unsigned char* buf)
+{
+	/* Disconnect request packet is Byte 1: 0xE0 Byte 2: 0x00 */
+	buf[0] = DISCONN_HEADER_BYTE;
+	buf[1] = DISCONN_LENGTH_BYTE;
+
+	return MAX_DISCONN_PACK_SIZE;
+}
+
+/**
+* @brief	Serializes the connect options into the buffer.
+*
+* @param[out]	: buf			: the buffer into which the packet will be serialized
+* @param[in]	: len			: the length in bytes of the supplied buffer
+* @param[in]	: def_options	: the options to be used to build the connect packet
+* @return		int
+* @retval 		serialized length
+* @retval 		0 as error
+ */
+static int MqttClientCreateConnectPacket(unsigned char* buf, int buflen, t_mqtt_connect_packet_options* def_options)
+{
+	unsigned char *buff_index = buf;
+	t_mqtt_connect_flags flags = {0};
+	bool buffer_available = false;
+	int len = 0;
+	int serialized_len = BUFFER_TOO_SHORT;
+
+	len = MqttClientCalConnectPacketLength(def_options);
+	buffer_available = MqttClientCheckBufferSize(len, buflen);
+
+	if (true == buffer_available)
+	{
+		/* write header CONNECT_HEADER_BYTE */
+		MqttClientByteWrite(&buff_index, CONNECT_HEADER_BYTE);
 
 		/* encode and write remaining length byte */
 		buff_index += MqttClientEncodePacketLen(buff_index, len);
 
-		if (def_options->mqtt_version == 4)
+		if (def_options->mqtt_version == MQTT_V_5)
+		{
+			/* write protocol string in length delimited form */
+			MqttClientStringWrite(&buff_index, "MQTT");
+			/* write protocol level byte */
+			MqttClientByteWrite(&buff_index, (char) 5);
+		}
+		else if (def_options->mqtt_version == 4)
 		{
 			/* write protocol string in length delimited form */
 			MqttClientStringWrite(&buff_index, "MQTT");
@@ -760,6 +1292,9 @@ static int MqttClientCreateConnectPacket(unsigned char* buf, int buflen, t_mqtt_
 
 		MqttClientByteWrite(&buff_index, flags.all);
 		MqttClientLenWrite(&buff_index, def_options->keep_alive_interval);
+		/* MQTT 5: no connect property */
+		if (def_options->mqtt_version == MQTT_V_5)
+			MqttClientByteWrite(&buff_index, 0);
 		MqttClientMqttStringWrite(&buff_index, def_options->client_id);
 		if (def_options->will_flag)
 		{
@@ -818,6 +1353,22 @@ static int MqttClientCreatePublishPacket(unsigned char* buf, int buflen, t_mqtt_
 		if (def_options->header_options.bits.qos > ZERO)
 			MqttClientLenWrite(&buff_index, def_options->packet_id);
 
+		/* MQTT 5: write properties, the expiry interval only */
+		if (def_options->mqtt_version == MQTT_V_5)
+		{
+			if (def_options->expiry_interval != 0U)
+			{
+				MqttClientByteWrite(&buff_index, 5);
+				MqttClientByteWrite(&buff_index, MESSAGE_EXPIRY_PROPERTY);
+				MqttClientLenWrite(&buff_index, (int)(def_options->expiry_interval >> 16));
+				MqttClientLenWrite(&buff_index, (int)(def_options->expiry_interval & 0xFFFFU));
+			}
+			else
+			{
+				MqttClientByteWrite(&buff_index, 0);
+			}
+		}
+
 		/* Write payload */
 		memcpy(buff_index, def_options->payload, def_options->payload_len);
 		buff_index += def_options->payload_len;
@@ -850,6 +1401,8 @@ static int MqttClientCalConnectPacketLength(t_mqtt_connect_packet_options* conn_
 		len = 12; /* variable depending on MQTT or MQIsdp */
 	else if (conn_options->mqtt_version == 4)
 		len = 10;
+	else if (conn_options->mqtt_version == MQTT_V_5)
+		len = 11; /* property length */
 
 	len += MqttClientStrLen(conn_options->client_id)+2;
 	if (conn_options->will_flag)
@@ -884,6 +1437,11 @@ static int MqttClientCalPublishPacketLength(t_mqtt_publish_packet_options* def_o
 		/* No packet id requirred */
 	}
 
+	if (def_options->mqtt_version == MQTT_V_5)
+	{
+		len += (def_options->expiry_interval != 0U) ? 6 : 1; /* property length and expiry interval */
+	}
+
 	return len;
 }
 
@@ -1083,18 +1641,49 @@ static void MqttClientMqttStringWrite(unsigned char** buff_index_ptr, t_mqtt_str
 		MqttClientLenWrite(buff_index_ptr, 0);
 }
 
+/**
+ * @brief	Set the protocol state of a new client context: no connection, no request under process.
+ *
+ * @param[in]	: client	: client context
+ * @return 		void
+ *
+*/
+void MqttClientSessionInit(t_MqttClient *client)
+{
+	t_MqttSession *session = &client->session;
+
+	struct timespec ts;
+
+	memset(session, 0, sizeof(t_MqttSession));
+	session->active_request = NULL;
+	session->pub_req_status = FAILURE;
+	session->connack_return_code = ZERO;
+	session->socket_desc = INVALID_SOCKET;
+	session->rtt.rto_ms = MQTT_RTO_INITIAL_MS;
+
+	/* every client of a fleet draws different delays, even when all of them boot at the same time */
+	(void)clock_gettime(CLOCK_REALTIME, &ts);
+	session->jitter_state = (uint32_t)ts.tv_nsec ^ ((uint32_t)getpid() << 16) ^ ((uint32_t)client->handler << 8) ^ (uint32_t)ts.tv_sec;
+	if ( session->jitter_state == 0U )
+	{
+		session->jitter_state = 1U;
+	}
+}
+
 /**
  * @brief	Initializes modem_connected, profile_started and ip_obtained flags on power on reset.
  *
- * @param 		void
+ * @param[in]	: client	: client context
  * @return 		void
  *
 */
-void MqttClientResetFlags(void)
+void MqttClientResetFlags(t_MqttClient *client)
 {
-	modem_connected = false;
-	profile_started = false;
-	ip_obtained = false;
+	t_MqttSession *session = &client->session;
+
+	session->modem_connected = false;
+	session->profile_started = false;
+	session->ip_obtained = false;
 
 	printf("MqttClient: Flags reseted modem_connected, profile_started, ip_obtained");
 }
@@ -1102,45 +1691,74 @@ void MqttClientResetFlags(void)
 /**
  * @brief	Register session result handler, session state handler with ModemDataMng and start default profile.
  *
- * @param 		void
+ * @param[in]	: client	: client context
  * @return 		void
  *
 */
-void MqttClientModemInit(void)
+void MqttClientModemInit(t_MqttClient *client)
 {
+	t_MqttSession *session = &client->session;
+
     printf("MqttClient: MqttClientModemInit()");
 
     /* currently hard coded since in linux no need to explicitly activate modem */
-    modem_connected = true;
+    session->modem_connected = true;
 }
 
 /**
  * @brief	Initializes modem_connected, profile_started and ip_obtained flags on power on reset.
  *
+ * @param[in]	: client	: client context
  * @param[in]	: timer_req		:  timer req type to set timer interval
  * @return 		void
  *
 */
-void MqttClientClearStartTimer(t_timer_req timer_req)
+void MqttClientClearStartTimer(t_MqttClient *client, t_timer_req timer_req)
 {
+	t_MqttSession *session = &client->session;
+	uint64_t idle_ms = 0U;
+	uint32_t interval_ms = 0U;
+
 	switch(timer_req)
 	{
 		case MODEM_REQ:
-			MqttClientSetTimerInterval(MODEM_REQ_TIME_INTERVAL);
-			MqttClientSetStartTimer();
+			session->timer_elapsed[MODEM_REQ] = false;
+			MqttClientTimerStart(&client->timers, &session->fsm_timers[MODEM_REQ], MODEM_REQ_TIME_INTERVAL, MqttClientTimerElapsed, &session->timer_elapsed[MODEM_REQ]);
 			printf("MqttClient: Timer started for MODEM_REQ");
 			break;
 
 		case KEEP_ALIVE:
-			MqttClientSetTimerInterval(KEEP_ALIVE_TIME_INTERVAL);
-			MqttClientSetStartTimer();
+			session->timer_elapsed[KEEP_ALIVE] = false;
+			MqttClientTimerStart(&client->timers, &session->fsm_timers[KEEP_ALIVE], KEEP_ALIVE_TIME_INTERVAL, MqttClientTimerElapsed, &session->timer_elapsed[KEEP_ALIVE]);
 			printf("MqttClient: Timer started for KEEP_ALIVE");
 			break;
 
 		case PING_REQ:
-			MqttClientSetTimerInterval(PING_REQ_TIME_INTERVAL);
-			MqttClientSetStartTimer();
-			printf("MqttClient: Timer started for PING_REQ");
+			/* the ping interval runs from the last packet received, traffic keeps the pings away */
+			idle_ms = MqttClientTimerNowMs(&client->timers) - session->last_rx_ms;
+			interval_ms = (idle_ms < PING_REQ_TIME_INTERVAL) ? (PING_REQ_TIME_INTERVAL - (uint32_t)idle_ms) : PING_REQ_TIME_INTERVAL;
+			session->timer_elapsed[PING_REQ] = false;
+			MqttClientTimerStart(&client->timers, &session->fsm_timers[PING_REQ], interval_ms, MqttClientTimerElapsed, &session->timer_elapsed[PING_REQ]);
+			printf("MqttClient: Timer started for PING_REQ with %d ms", interval_ms);
+			break;
+
+		case PUBACK_RSP:
+			session->timer_elapsed[PUBACK_RSP] = false;
+			MqttClientTimerStart(&client->timers, &session->fsm_timers[PUBACK_RSP], session->rtt.rto_ms, MqttClientTimerElapsed, &session->timer_elapsed[PUBACK_RSP]);
+			printf("MqttClient: Timer started for PUBACK_RSP with %d ms", session->rtt.rto_ms);
+			break;
+
+		case PINGRESP_RSP:
+			session->timer_elapsed[PINGRESP_RSP] = false;
+			MqttClientTimerStart(&client->timers, &session->fsm_timers[PINGRESP_RSP], session->rtt.rto_ms + MQTT_PINGRESP_MARGIN_MS, MqttClientTimerElapsed, &session->timer_elapsed[PINGRESP_RSP]);
+			printf("MqttClient: Timer started for PINGRESP_RSP with %d ms", session->rtt.rto_ms + MQTT_PINGRESP_MARGIN_MS);
+			break;
+
+		case SEND_BUDGET:
+			/* the kernel backlog is checked again every quarter of a round trip */
+			interval_ms = MAX(session->link.rtt_us / 4000U, 1U);
+			session->timer_elapsed[SEND_BUDGET] = false;
+			MqttClientTimerStart(&client->timers, &session->fsm_timers[SEND_BUDGET], interval_ms, MqttClientSendBudgetElapsed, client);
 			break;
 
 		default:
@@ -1152,57 +1770,151 @@ void MqttClientClearStartTimer(t_timer_req timer_req)
 }
 
 /**
- * @brief	check modem connection status by returning modem_connected flag status.
+ * @brief	Stop a timer and clear its elapsed flag, the other timers keep running.
  *
- * @param	: void
- * @return 	bool
- * @retval 	false: modem not connected
- * @retval 	true: modem connected
+ * @param[in]	: client	: client context
+ * @param[in]	: timer_req		: timer req type to stop
+ * @return 		void
  *
 */
-bool MqttClientCheckModemConnection(void)
+void MqttClientStopTimer(t_MqttClient *client, t_timer_req timer_req)
 {
-	return modem_connected;
-}
+	t_MqttSession *session = &client->session;
 
+	if ( timer_req < TIMER_REQ_LAST )
+	{
+		MqttClientTimerStop(&client->timers, &session->fsm_timers[timer_req]);
+		session->timer_elapsed[timer_req] = false;
+	}
+}
 
 /**
- * @brief	check timer elapsed flag status.
+ * @brief	Start the KEEP_ALIVE timer after a connection attempt: it supervises the CONNACK when the connect packet
+ * 			was sent, otherwise it waits the backoff delay before the next attempt.
  *
- * @param	: void
- * @return 	bool
- * @retval 	false: timer running
- * @retval 	true: timer elapsed
+ * @param[in]	: client	: client context
+ * @return 		void
  *
 */
-bool MqttClientCheckTimeToRetry(void)
+void MqttClientStartConnectTimer(t_MqttClient *client)
 {
-	return timer_elapsed;
+	t_MqttSession *session = &client->session;
+
+	if ( session->reconnect_attempts < UCHAR_MAX )
+	{
+		session->reconnect_attempts++;
+	}
+
+	if ( true == session->client_connected )
+	{
+		MqttClientClearStartTimer(client, KEEP_ALIVE);
+	}
+	else
+	{
+		MqttClientStartBackoffTimer(client);
+	}
 }
 
 /**
-* @brief	create and send a Mqtt connect control packet over socket
+ * @brief	Start the KEEP_ALIVE timer with the backoff delay before the next connection attempt. The first attempt
+ * 			after a stable connection is immediate, the next ones wait a random delay up to a bound doubled on every
+ * 			attempt (full jitter), so that clients losing the same broker do not reconnect in lockstep.
+ *
+ * @param[in]	: client	: client context
+ * @return 		void
+ *
+*/
+void MqttClientStartBackoffTimer(t_MqttClient *client)
+{
+	t_MqttSession *session = &client->session;
+	uint32_t delay_ms = MqttClientBackoffDelayMs(session);
+
+	MqttClientTimerStop(&client->timers, &session->stable_timer);
+
+	session->timer_elapsed[KEEP_ALIVE] = false;
+	MqttClientTimerStart(&client->timers, &session->fsm_timers[KEEP_ALIVE], delay_ms, MqttClientTimerElapsed, &session->timer_elapsed[KEEP_ALIVE]);
+	printf("MqttClient: Connection attempt %d in %d ms", session->reconnect_attempts + 1U, delay_ms);
+}
+
+/**
+ * @brief	Start the timer resetting the backoff once the connection stayed up long enough.
+ *
+ * @param[in]	: client	: client context
+ * @return 		void
+ *
+*/
+void MqttClientStartStableTimer(t_MqttClient *client)
+{
+	t_MqttSession *session = &client->session;
+
+	MqttClientTimerStart(&client->timers, &session->stable_timer, MQTT_RECONNECT_STABLE_MS, MqttClientStableElapsed, session);
+}
+
+/**
+ * @brief	check modem connection status by returning modem_connected flag status.
+ *
+ * @param[in]	: client	: client context
+ * @return 	bool
+ * @retval 	false: modem not connected
+ * @retval 	true: modem connected
+ *
+*/
+bool MqttClientCheckModemConnection(t_MqttClient *client)
+{
+	return client->session.modem_connected;
+}
+
+
+/**
+ * @brief	check elapsed flag status of the timer supervising the modem or the broker response.
+ *
+ * @param[in]	: client	: client context
+ * @return 	bool
+ * @retval 	false: timer running
+ * @retval 	true: timer elapsed
+ *
+*/
+bool MqttClientCheckTimeToRetry(t_MqttClient *client)
+{
+	return (client->session.timer_elapsed[MODEM_REQ] || client->session.timer_elapsed[KEEP_ALIVE]);
+}
+
+/**
+* @brief	create and send a Mqtt connect control packet over socket
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return 	void
 *
 */
-void MqttClientSendConnectRequest(void)
+void MqttClientSendConnectRequest(t_MqttClient *client)
 {
+	t_MqttSession *session = &client->session;
+	const t_MqttBroker *broker = NULL;
 	int mysock = 0;
 	bool packet_sent = false;
 	unsigned char connect_packet_buffer[MAX_CONN_PACK_SIZE] = {0};
-	t_mqtt_connect_packet_options mqtt_connect_packet_options = CONNECT_OPTIONS_INIT;
 	int len = 0;
 
-	mysock = MqttClientTransportOpen(SERVER_ADDRESS, SERVER_PORT);
+	/* a broker that took the connection and never accepted the session is not tried again first */
+	if ( (session->socket_desc != INVALID_SOCKET) &&
+		 ((false == session->connack_received) || (CONNECTION_ACCEPTED != session->connack_return_code)) )
+	{
+		MqttClientFailoverNextBroker(client);
+	}
+
+	/* a new session starts, whatever was received on the previous socket is stale */
+	session->connack_received = false;
+	session->rx_len = 0;
+	session->rx_skip = 0;
+
+	broker = MqttClientFailoverGetBroker(client);
+	mysock = MqttClientTransportOpen(client, broker->address, broker->port);
 
 
 	if(mysock >= ZERO)
 	{
-		MqttClientSetConnectPacketOptions(&mqtt_connect_packet_options);
 		/* Create connect packet here ready to be sent since socket connection is successful */
-		len = MqttClientCreateConnectPacket(&connect_packet_buffer[0], MAX_CONN_PACK_SIZE, &mqtt_connect_packet_options);
+		len = MqttClientBuildConnectPacket(client, MqttClientFailoverGetClientId(client, false), &connect_packet_buffer[0], MAX_CONN_PACK_SIZE);
 
 		/*rc = since packet is read then retry is attempted */
 		packet_sent = MqttClientTransportSendPacketBuffer(mysock, connect_packet_buffer, len);
@@ -1210,20 +1922,22 @@ void MqttClientSendConnectRequest(void)
 		if(true == packet_sent)
 		{
 			/* Wait for CONNACK to receive */
+			session->client_connected = true;
 		}
 		else
 		{
 			/* error in sending packet over socket */
-			client_connected = false;
+			session->client_connected = false;
 			printf("MqttClient: Error in sending connect packet");
 		}
 
 	}
 	else
 	{
-		/* error in socket creation and connection */
-		client_connected = false;
+		/* error in socket creation and connection, the next attempt goes to the next broker of the list */
+		session->client_connected = false;
 		printf("MqttClient: Error in sending connect packet socket id:%d", mysock);
+		MqttClientFailoverNextBroker(client);
 	}
 
 }
@@ -1231,83 +1945,49 @@ void MqttClientSendConnectRequest(void)
 /**
 * @brief	check for CONNACK packet received
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	bool
 * @retval	true	: CONNACK packet received client successfully connected
 * 			false	: CONNACK packet not received client not connected
 */
-bool MqttClientCheckMqttConnection(void)
+bool MqttClientCheckMqttConnection(t_MqttClient *client)
 {
-	bool client_connected = false;
-	unsigned char resp_buf[MAX_CONNACK_PACK_SIZE] = {0};
-	t_mqtt_header_byte header = {0};
-	int len = 0;
-	int rem_len = 0;
+	t_MqttSession *session = &client->session;
 
-	len = MqttClientTransportReceivePacketBuffer(resp_buf, ONE_BYTE);
-	header.byte = resp_buf[0];
+	MqttClientReceivePackets(client);
 
-
-	if((len == ONE_BYTE) && (CONNACK == header.bits.type))
-	{
-		len += MqttClientTransportReceivePacketBuffer(&resp_buf[1], ONE_BYTE);
-		MqttClientDecodePacketLen(&resp_buf[1], &rem_len);
-
-		if( 2 == rem_len )
-		{
-			len += MqttClientTransportReceivePacketBuffer(&resp_buf[2], TWO_BYTES);
-			if(FOUR_BYTES == len && CONNECTION_ACCEPTED == resp_buf[3])
-			{
-				client_connected = true;
-			}
-			else
-			{
-				printf("MqttClient: Mqtt connection refused by host with return: %d", resp_buf[3]);
-			}
-		}
-		else
-		{
-			client_connected = false;
-			printf("MqttClient: Incorrect decoded len received: %d", rem_len);
-		}
-	}
-	else
-	{
-		client_connected = false;
-		printf("MqttClient: Incorrect data received with len: %d and packet type: %d",len ,header.bits.type);
-	}
-
-	return client_connected;
+	return (session->connack_received && (CONNECTION_ACCEPTED == session->connack_return_code));
 }
 
 /**
 * @brief	check for data available to be sent
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	bool
 * @retval	true	: data to be sent
 * 			false	: no data to send
 */
-bool MqttClientCheckDataToSend(void)
+bool MqttClientCheckDataToSend(t_MqttClient *client)
 {
+	t_MqttSession *session = &client->session;
 	bool data_present = false;
 
-	/* Check if there is an active request to be send*/
-	for (service_idx = ((unsigned char)0); service_idx < ((unsigned char)SERVICE_LAST); service_idx++)
+	/* Check if there is an active request to be send, it stays the active one until released */
+	if ( session->active_request == NULL )
 	{
-		/* An inactive request will have it's retry counter set to 0*/
-		if ( ServiceRequestList[service_idx].retry_count > 0U )
-		{
-			/*found one*/
-			printf("MqttClient: Found an active request by service %d with %d retry counter", service_idx, ServiceRequestList[service_idx].retry_count);
-			data_present = true;
-			break;
-		}
-		else
-		{
-			/* no data */
-			data_present = false;
-		}
+		session->active_request = MqttClientQueueTakeNext(client);
+	}
+
+	if ( session->active_request != NULL )
+	{
+		/*found one*/
+		printf("MqttClient: Found an active request by service %d with %d retry counter", session->active_request->service_id, session->active_request->retry_count);
+		data_present = true;
+	}
+	else
+	{
+		/* no data */
+		data_present = false;
 	}
 
 	return data_present;
@@ -1316,36 +1996,48 @@ bool MqttClientCheckDataToSend(void)
 /**
 * @brief	check whether timer for ping request is elapsed
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	bool
 * @retval	true	: timer elapsed ping request should be sent
 * 			false	: timer not elapsed ping request should not be sent
 */
-bool MqttClientCheckTimeToPing(void)
+bool MqttClientCheckTimeToPing(t_MqttClient *client)
 {
-	return timer_elapsed;
+	return client->session.timer_elapsed[PING_REQ];
 }
 
 /**
 * @brief	Send ping mqtt control packet over socket
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	void
 */
-void MqttClientSendPingRequest(void)
+void MqttClientSendPingRequest(t_MqttClient *client)
 {
+	t_MqttSession *session = &client->session;
 	bool packet_sent = false;
 	unsigned char ping_packet_buffer[MAX_PING_PACK_SIZE] = {0};
 	int len = 0;
 
+	/* a packet received within the ping interval already proved the connection alive */
+	if ( (MqttClientTimerNowMs(&client->timers) - session->last_rx_ms) < PING_REQ_TIME_INTERVAL )
+	{
+		printf("MqttClient: Ping request suppressed by traffic");
+		return;
+	}
+
 	/* Create ping packet */
 	len = MqttClientCreatePingPacket(&ping_packet_buffer[0]);
+	session->pingresp_received = false;
 
-	packet_sent = MqttClientTransportSendPacketBuffer(socket_desc, ping_packet_buffer, len);
+	packet_sent = MqttClientTransportSendPacketBuffer(session->socket_desc, ping_packet_buffer, len);
 
 	if(true == packet_sent)
 	{
-		/* Do nothing since PingAck is not monitored */
+		/* the response is a round trip sample */
+		session->ping_sent_ms = MqttClientTimerNowMs(&client->timers);
+		session->ping_timed = true;
+		MqttClientClearStartTimer(client, PINGRESP_RSP);
 		printf("MqttClient: Ping request sent");
 	}
 	else
@@ -1356,53 +2048,280 @@ void MqttClientSendPingRequest(void)
 
 }
 
+/**
+* @brief	check whether the kernel holds less than the send budget, a publish may then be written to the socket. The
+* 			kernel queue is the one sampled on the last PUBACK, PUBACK timeout or send budget timer, plus the packets
+* 			written since
+*
+* @param[in]	: client	: client context
+* @return	bool
+* @retval	true	: room in the send budget
+* 			false	: the request stays in the request queue until the kernel sent and got acknowledged its backlog
+*/
+bool MqttClientCheckSendBudget(t_MqttClient *client)
+{
+	t_MqttSession *session = &client->session;
+
+	if ( session->socket_desc == INVALID_SOCKET )
+	{
+		return true;
+	}
+
+	return ((uint32_t)session->link.outq_bytes < session->link.send_budget);
+}
+
+/**
+* @brief	Get the most urgent service with a request without ordering key to publish, the active request first. The
+* 			spool and the ordered window hold back for it, the send budget is then left to this request.
+*
+* @param[in]	: client	: client context
+* @return 		unsigned char
+* @retval		SERVICE_LAST	: no request to publish
+*
+*/
+static unsigned char MqttClientUrgentService(t_MqttClient *client)
+{
+	if ( NULL != client->session.active_request )
+	{
+		return client->session.active_request->service_id;
+	}
+
+	return MqttClientQueuePlainService(client);
+}
+
+/**
+* @brief	check whether a spooled message can be published: connected, room in the send budget and in the window of
+* 			spooled messages in flight, and no request of a more urgent service waiting to be sent
+*
+* @param[in]	: client	: client context
+* @return	bool
+*/
+bool MqttClientCheckSpoolToSend(t_MqttClient *client)
+{
+	t_MqttSpoolRecord record;
+
+	/* the spool yields the send budget, the urgent request is then published before the next spooled message */
+	return ( (client->session.socket_desc != INVALID_SOCKET) && (true == MqttClientCheckSendBudget(client)) &&
+			 (true == MqttClientSpoolNext(client, &record)) && (MqttClientUrgentService(client) >= record.service_id) );
+}
+
+/**
+* @brief	check whether a timer is running
+*
+* @param[in]	: client	: client context
+* @param[in]	: timer_req	: timer req type
+* @return	bool
+*/
+bool MqttClientCheckTimerRunning(t_MqttClient *client, t_timer_req timer_req)
+{
+	return ( (timer_req < TIMER_REQ_LAST) && (true == MqttClientTimerIsRunning(&client->session.fsm_timers[timer_req])) );
+}
+
+/**
+* @brief	check whether the ping request in flight missed its PINGRESP deadline
+*
+* @param[in]	: client	: client context
+* @return	bool
+* @retval	true	: nothing received from the broker within the deadline, the connection is half open
+* 			false	: no ping request in flight or deadline not elapsed
+*/
+bool MqttClientCheckPingRespTimeout(t_MqttClient *client)
+{
+	return client->session.timer_elapsed[PINGRESP_RSP];
+}
+
 /**
 * @brief	Send publish mqtt control packet over socket
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	void
 */
-void MqttClientSendPubRequest(void)
+void MqttClientSendPubRequest(t_MqttClient *client)
 {
+	t_MqttSession *session = &client->session;
 	bool packet_sent = false;
 	unsigned char publish_packet_buffer[MAX_PUBLISH_PACK_SIZE] = {0};
 	t_mqtt_publish_packet_options mqtt_publish_packet_options = PUBLISH_OPTIONS_INIT;
 	int len = 0;
 
-	MqttClientSetPublishPacketOptions(&mqtt_publish_packet_options);
+	/* a new request gets a new packet id, a retry of a request not sent keeps its own */
+	if ( session->packet_id_owner != session->active_request->handle )
+	{
+		session->packet_id_owner = session->active_request->handle;
+		session->packet_id = (session->packet_id == (uint16_t)(MQTT_ORDERED_PACKET_ID_BASE - 1U)) ? 1U : (uint16_t)(session->packet_id + 1U);
+		session->pub_retransmits = 0U;
+	}
+
+	MqttClientSetPublishPacketOptions(client, &mqtt_publish_packet_options);
+	session->puback_received = false;
+	session->publish_sent_ms = MqttClientTimerNowMs(&client->timers);
 
 	/* Create publish packet to be sent over socket */
 	len = MqttClientCreatePublishPacket(&publish_packet_buffer[0], MAX_PUBLISH_PACK_SIZE, &mqtt_publish_packet_options);
 
 	/* will be sent since socket is created */
-	packet_sent = MqttClientTransportSendPacketBuffer(socket_desc, publish_packet_buffer, len);
+	packet_sent = MqttClientTransportSendPacketBuffer(session->socket_desc, publish_packet_buffer, len);
 
 	if(true == packet_sent)
 	{
 		/* Wait for PUBACK to receive */
-		pub_req_status = SUCCESS;
+		session->pub_req_status = SUCCESS;
+		MqttClientSendBudgetWritten(session, len);
 		printf("MqttClient: Publish request sent");
+
+		/* the standby broker gets its copy once, retransmissions only concern the broker in use */
+		if ( 0U == session->pub_retransmits )
+		{
+			MqttClientFailoverMirror(client, session->active_request->service_id, publish_packet_buffer, len);
+		}
 	}
 	else
 	{
 		/* error in sending packet over socket */
-		pub_req_status = FAILURE;
+		session->pub_req_status = FAILURE;
 		printf("MqttClient: Error in publish request ");
 	}
 
 }
 
+/**
+* @brief	Publish spooled messages back to back, without waiting for their PUBACK, until the send budget or the window
+* 			of spooled messages in flight is full, or a request of a more urgent service waits
+*
+* @param[in]	: client	: client context
+* @return	void
+*/
+void MqttClientSendSpooled(t_MqttClient *client)
+{
+	t_MqttSession *session = &client->session;
+	t_MqttSpoolRecord record;
+	unsigned char publish_packet_buffer[MAX_PUBLISH_PACK_SIZE] = {0};
+	t_mqtt_publish_packet_options mqtt_publish_packet_options = PUBLISH_OPTIONS_INIT;
+	unsigned short sent = 0U;
+	int len = 0;
+
+	/* checked before each message, a request of a more urgent service submitted meanwhile stops the burst */
+	while ( (true == MqttClientCheckSpoolToSend(client)) && (true == MqttClientSpoolNext(client, &record)) )
+	{
+		/* a message published before a reconnection or a restart may have reached the broker */
+		mqtt_publish_packet_options.header_options.bits.dup		= (true == record.dup) ? ONE : ZERO;
+		mqtt_publish_packet_options.header_options.bits.qos		= QOS_1;
+		mqtt_publish_packet_options.header_options.bits.retain	= RETAIN;
+		mqtt_publish_packet_options.header_options.bits.type	= PUBLISH;
+		mqtt_publish_packet_options.topic_name.cstring			= TOPIC;
+		mqtt_publish_packet_options.packet_id					= MqttClientSpoolSent(client);
+		mqtt_publish_packet_options.payload						= (unsigned char *)record.payload;
+		mqtt_publish_packet_options.payload_len					= record.length;
+		mqtt_publish_packet_options.expiry_interval				= record.expiry_interval;
+
+		len = MqttClientCreatePublishPacket(&publish_packet_buffer[0], MAX_PUBLISH_PACK_SIZE, &mqtt_publish_packet_options);
+
+		/* the message stays in the window, it is sent again once the failed connection is closed */
+		if ( false == MqttClientTransportSendPacketBuffer(session->socket_desc, publish_packet_buffer, len) )
+		{
+			printf("MqttClient: Error in publishing spooled message");
+			break;
+		}
+		MqttClientSendBudgetWritten(session, len);
+
+		if ( false == record.dup )
+		{
+			MqttClientFailoverMirror(client, record.service_id, publish_packet_buffer, len);
+		}
+		sent++;
+	}
+
+	printf("MqttClient: %d spooled messages published, %d left", sent, MqttClientSpoolDepth(client));
+}
+
+/**
+* @brief	check whether a request with an ordering key can be published: connected, room in the send budget and in
+* 			the window of ordered requests in flight, no request of its key in flight and no request of a more urgent
+* 			service waiting to be sent
+*
+* @param[in]	: client	: client context
+* @return	bool
+*/
+bool MqttClientCheckOrderedToSend(t_MqttClient *client)
+{
+	unsigned char service_id;
+
+	if ( (client->session.socket_desc == INVALID_SOCKET) || (false == MqttClientCheckSendBudget(client)) )
+	{
+		return false;
+	}
+
+	service_id = MqttClientQueueOrderedService(client);
+
+	return ( (service_id < (unsigned char)SERVICE_LAST) && (MqttClientUrgentService(client) >= service_id) );
+}
+
+/**
+* @brief	Publish requests with an ordering key back to back, without waiting for their PUBACK, until the send budget
+* 			or the window of ordered requests in flight is full, or a request of a more urgent service waits. Each key
+* 			has one request in flight at most
+*
+* @param[in]	: client	: client context
+* @return	void
+*/
+void MqttClientSendOrdered(t_MqttClient *client)
+{
+	t_MqttSession *session = &client->session;
+	t_PendingRequest *req = NULL;
+	unsigned char publish_packet_buffer[MAX_PUBLISH_PACK_SIZE] = {0};
+	t_mqtt_publish_packet_options mqtt_publish_packet_options = PUBLISH_OPTIONS_INIT;
+	uint16_t packet_id = 0U;
+	bool dup = false;
+	unsigned short sent = 0U;
+	int len = 0;
+
+	/* checked before each request, a request of a more urgent service submitted meanwhile stops the burst */
+	while ( (true == MqttClientCheckOrderedToSend(client)) && (NULL != (req = MqttClientQueueOrderedTake(client, &packet_id, &dup))) )
+	{
+		/* a request published before a reconnection may have reached the broker */
+		mqtt_publish_packet_options.header_options.bits.dup		= (true == dup) ? ONE : ZERO;
+		mqtt_publish_packet_options.header_options.bits.qos		= QOS_1;
+		mqtt_publish_packet_options.header_options.bits.retain	= RETAIN;
+		mqtt_publish_packet_options.header_options.bits.type	= PUBLISH;
+		mqtt_publish_packet_options.topic_name.cstring			= TOPIC;
+		mqtt_publish_packet_options.packet_id					= packet_id;
+		mqtt_publish_packet_options.payload						= req->json;
+		mqtt_publish_packet_options.payload_len					= req->json_size;
+		mqtt_publish_packet_options.expiry_interval				= MqttClientExpiryInterval(client, req);
+
+		len = MqttClientCreatePublishPacket(&publish_packet_buffer[0], MAX_PUBLISH_PACK_SIZE, &mqtt_publish_packet_options);
+
+		/* the request stays in the window, it is sent again once the failed connection is closed */
+		if ( false == MqttClientTransportSendPacketBuffer(session->socket_desc, publish_packet_buffer, len) )
+		{
+			printf("MqttClient: Error in publishing ordered request");
+			break;
+		}
+		MqttClientSendBudgetWritten(session, len);
+
+		if ( false == dup )
+		{
+			MqttClientFailoverMirror(client, req->service_id, publish_packet_buffer, len);
+		}
+		sent++;
+	}
+
+	printf("MqttClient: %d ordered requests published, %d in flight", sent, MqttClientQueueOrderedInFlight(client));
+}
+
 /**
 * @brief	Decrement retry count associated with currently active service after sending publish request
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	void
 */
-void MqttClientDecrementRetryCount(void)
+void MqttClientDecrementRetryCount(t_MqttClient *client)
 {
-	if ( ServiceRequestList[service_idx].retry_count > 0U)
+	t_MqttSession *session = &client->session;
+
+	if ( (session->active_request != NULL) && (session->active_request->retry_count > 0U) )
 	{
-		ServiceRequestList[service_idx].retry_count--;
+		session->active_request->retry_count--;
 	}
 	else
 	{
@@ -1413,14 +2332,16 @@ void MqttClientDecrementRetryCount(void)
 /**
 * @brief	Increment retry count associated with currently active service after sending publish request
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	void
 */
-void MqttClientIncrementRetryCount(void)
+void MqttClientIncrementRetryCount(t_MqttClient *client)
 {
-	if ( ServiceRequestList[service_idx].retry_count > 0U)
+	t_MqttSession *session = &client->session;
+
+	if ( (session->active_request != NULL) && (session->active_request->retry_count > 0U) )
 	{
-		ServiceRequestList[service_idx].retry_count++;
+		session->active_request->retry_count++;
 	}
 	else
 	{
@@ -1431,182 +2352,250 @@ void MqttClientIncrementRetryCount(void)
 /**
 * @brief	Check whether to cancel current ongoing process of transmission due to cancellation request
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	bool
 * @retval	true	: Cancellation request received
 * @retval	false	: Cancellation request not received
 */
-bool MqttClientCheckRequestToCancel(void)
+bool MqttClientCheckRequestToCancel(t_MqttClient *client)
 {
-	return cancel_request;
+	t_MqttSession *session = &client->session;
+	bool request_to_cancel = false;
+
+	if ( session->active_request != NULL )
+	{
+		request_to_cancel = MqttClientQueueCheckCancel(client, session->active_request);
+	}
+
+	return request_to_cancel;
+}
+
+/**
+* @brief	Check whether the time to live of current ongoing service transmission elapsed
+*
+* @param[in]	: client	: client context
+* @return	bool
+* @retval	true	: request expired, it is not sent again
+* @retval	false	: request still alive or without time to live
+*/
+bool MqttClientCheckRequestExpired(t_MqttClient *client)
+{
+	t_MqttSession *session = &client->session;
+	bool request_expired = false;
+
+	if ( session->active_request != NULL )
+	{
+		request_expired = MqttClientQueueCheckExpired(client, session->active_request);
+	}
+
+	return request_expired;
 }
 
 /**
 * @brief	Check retry count associated with current ongoing service transmission
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	unsigned char
 * @retval	<=3	: retry count associated with current ongoing transmission
 */
-unsigned char MqttClientCheckRetryCount(void)
+unsigned char MqttClientCheckRetryCount(t_MqttClient *client)
 {
-	return ServiceRequestList[service_idx].retry_count;
+	t_MqttSession *session = &client->session;
+	unsigned char retry_count = ZERO;
+
+	if ( session->active_request != NULL )
+	{
+		retry_count = session->active_request->retry_count;
+	}
+
+	return retry_count;
 }
 
 /**
 * @brief	Check retry count associated with current ongoing service transmission
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	unsigned char
 * @retval	SUCCESS	: publish request sent successfully
 * @retval	FAILURE	: publish request sending failed
 */
-unsigned char MqttClientCheckPubReqStatus(void)
+unsigned char MqttClientCheckPubReqStatus(t_MqttClient *client)
 {
-	return pub_req_status;
+	return client->session.pub_req_status;
 }
 
 /**
 * @brief	Clear retry count associated with currently active service transmission
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	void
 */
-void MqttClientClearRetryCount(void)
+void MqttClientClearRetryCount(t_MqttClient *client)
 {
-	unsigned char service_idx;
+	t_MqttSession *session = &client->session;
 
-	for ( service_idx = 0U; service_idx < (unsigned char)SERVICE_LAST; service_idx++ )
-		{
-			/*Notify all demanding services that a canceling request was received*/
-			if ( ServiceRequestList[service_idx].retry_count > 0U )
-			{
-				/*Cancel the service request*/
-				ServiceRequestList[service_idx].retry_count = 0U;
-				printf("MqttClient: Retry count cleared for service: %d", service_idx);
-			}
-			else
-			{
-				/* Do nothing since retry count is already zero */
-			}
-		}
+	/* The request stays owned by its handle until notified, only its retry budget is consumed */
+	if ( session->active_request != NULL )
+	{
+		session->active_request->retry_count = 0U;
+		printf("MqttClient: Retry count cleared for service: %d", session->active_request->service_id);
+	}
+	else
+	{
+		/* Do nothing since no request is under process */
+	}
 }
 
 /**
-* @brief	Notify active service for response
+* @brief	Notify active service for response and release its request
 *
+* @param[in]	: client	: client context
 * @param[in]	: resp	: response to be sent to active service
 * @return		void
 */
-void MqttClientServiceNotify(t_ServerReplyCodes resp)
+void MqttClientServiceNotify(t_MqttClient *client, t_ServerReplyCodes resp)
 {
-	unsigned char service_idx;
+	t_MqttSession *session = &client->session;
+	t_PendingRequest *req = session->active_request;
 
-	for ( service_idx = 0U; service_idx < (unsigned char)SERVICE_LAST; service_idx++ )
-		{
-		/*Notify all demanding services that a canceling request was received*/
-			if ( ServiceRequestList[service_idx].retry_count > 0U )
-			{
-				/*Notify the service about cancellation*/
-				if ( ServiceRequestList[service_idx].cbk != (RxCbk)NULL )
-				{
-					ServiceRequestList[service_idx].cbk(resp);
-					printf("MqttClient: Notified service: %d with resp: %d", service_idx, resp);
-				}
-			}
-		}
+	if ( req != NULL )
+	{
+		/* The next request can be taken from the callback */
+		session->active_request = NULL;
+		MqttClientQueueRelease(client, req, resp);
+	}
+	else
+	{
+		/* Do nothing since no request is under process */
+	}
+}
+
+/**
+* @brief	Notify every service having a pending request and release the requests, durable services keep theirs
+*
+* @param[in]	: client	: client context
+* @param[in]	: resp	: response to be sent to the services
+* @return		void
+*/
+void MqttClientServiceNotifyAll(t_MqttClient *client, t_ServerReplyCodes resp)
+{
+	t_MqttSession *session = &client->session;
+
+	/* requests of durable services wait for the next connection instead */
+	session->active_request = NULL;
+	MqttClientQueueReleaseAll(client, resp, MqttClientSpoolGetDurable(client));
 }
 
 /**
 * @brief	Check for PubAck control packet for previously sent publish request
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	unsigned char
 * @retval	SUCCESS	: pubAck received successfully
 * @retval	FAILURE	: pubAck not received
 */
-unsigned char MqttClientCheckPubAckRspStatus(void)
+unsigned char MqttClientCheckPubAckRspStatus(t_MqttClient *client)
 {
+	t_MqttSession *session = &client->session;
 	unsigned char puback_resp_status = FAILURE;
-	unsigned char resp_buf[MAX_PUBACK_PACK_SIZE] = {0};
-	t_mqtt_header_byte header = {0};
-	int len = 0;
-	int rem_len = 0;
-	int decoded_len = 0;
-
-	len = MqttClientTransportReceivePacketBuffer(resp_buf, ONE_BYTE);
-	header.byte = resp_buf[0];
-
-
-	if((len == ONE_BYTE) && (PUBACK == header.bits.type))
-	{
-		len += MqttClientTransportReceivePacketBuffer(&resp_buf[1], ONE_BYTE);
-		MqttClientDecodePacketLen(&resp_buf[1], &rem_len);
-
-		if( 2 == rem_len )
-		{
-			len += MqttClientTransportReceivePacketBuffer(&resp_buf[2], TWO_BYTES);
 
-			decoded_len = MqttClientLenRead(&resp_buf[2]);
+	MqttClientReceivePackets(client);
 
-			if(FOUR_BYTES == len && 0x01 == decoded_len) /* packet id has to be the one sent in publish */
-			{
-				puback_resp_status = SUCCESS;
-				printf("MqttClient: Mqtt publish ack received successfully");
-			}
-			else
-			{
-				/* LEDBUG(decoded_len as packet id ) */
-				puback_resp_status = SUCCESS;
-				printf("MqttClient: Mqtt publish ack received for packet id:%d",decoded_len);
-			}
-		}
-		else
-		{
-			puback_resp_status = FAILURE;
-			printf("MqttClient: Incorrect decoded len received: %d", rem_len);
-		}
-	}
-	else
+	if ( true == session->puback_received )
 	{
-		puback_resp_status = FAILURE;
-		printf("MqttClient: Incorrect data received with len: %d and packet type: %d",len ,header.bits.type);
+		session->puback_received = false;
+		puback_resp_status = SUCCESS;
+		printf("MqttClient: Mqtt publish ack received successfully");
 	}
 
 	return puback_resp_status;
 }
 
 /**
- * @brief	check timer elapsed flag status.
+ * @brief	check elapsed flag status of the PUBACK timer.
  *
- * @param	: 	void
+ * @param[in]	: client	: client context
  * @return 	bool
  * @retval 	false: timer running
  * @retval 	true: timer elapsed
  *
 */
-bool MqttClientCheckRspTimerStatus(void)
+bool MqttClientCheckRspTimerStatus(t_MqttClient *client)
+{
+	return client->session.timer_elapsed[PUBACK_RSP];
+}
+
+/**
+ * @brief	Publish the request in flight again with the DUP flag once its PUBACK timed out. Held while the kernel still
+ * 			queues the previous copy, the timeout is then kept and the kernel closes the connection at rto + margin.
+ * 			Only the copies sent double the timeout, until a new round trip is measured, and count against
+ * 			MAX_REQ_RETRY_COUNT.
+ *
+ * @param[in]	: client	: client context
+ * @return 		void
+ *
+*/
+void MqttClientRetransmitPubRequest(t_MqttClient *client)
+{
+	t_MqttSession *session = &client->session;
+
+	MqttClientTransportSampleLink(client);
+	MqttClientSendBudgetUpdate(session, true);
+
+	/* TCP still delivers the previous copy, another one would only queue behind it. The timeout is kept: the kernel
+	   closes the connection once its data stays unacknowledged past rto + margin (TCP_USER_TIMEOUT) */
+	if ( session->link.outq_bytes > 0 )
+	{
+		printf("MqttClient: PUBACK of packet id:%d timed out, %d bytes still queued in kernel, retransmission held",
+				session->packet_id, session->link.outq_bytes);
+		return;
+	}
+
+	/* the path drained, the broker or the path is slow: back off with the copy actually written */
+	session->rtt.rto_ms = MIN(session->rtt.rto_ms * 2U, MQTT_RTO_MAX_MS);
+	MqttClientTransportSetUserTimeout(session);
+
+	session->pub_retransmits++;
+	printf("MqttClient: PUBACK of packet id:%d timed out, retransmission %d", session->packet_id, session->pub_retransmits);
+	MqttClientSendPubRequest(client);
+}
+
+/**
+ * @brief	Get the number of retransmissions of the publish in flight.
+ *
+ * @param[in]	: client	: client context
+ * @return 		unsigned char
+ *
+*/
+unsigned char MqttClientCheckRetransmitCount(t_MqttClient *client)
 {
-	return timer_elapsed;
+	return client->session.pub_retransmits;
 }
 
 /**
  * @brief	Send disconnect control packet
  *
- * @param	: void
+ * @param[in]	: client	: client context
  * @return 	void
  *
 */
-void MqttClientDisconnect(void)
+void MqttClientDisconnect(t_MqttClient *client)
 {
+	t_MqttSession *session = &client->session;
 	bool packet_sent = false;
 	unsigned char disconnect_packet_buffer[MAX_DISCONN_PACK_SIZE] = {0};
 	int len = 0;
 
+	/* nothing to tell a broker the connection to which is already closed */
+	if ( session->socket_desc == INVALID_SOCKET )
+	{
+		return;
+	}
+
 	/* Create ping packet */
 	len = MqttClientCreateDisconnectPacket(&disconnect_packet_buffer[0]);
 
-	packet_sent = MqttClientTransportSendPacketBuffer(socket_desc, disconnect_packet_buffer, len);
+	packet_sent = MqttClientTransportSendPacketBuffer(session->socket_desc, disconnect_packet_buffer, len);
 
 	if(true == packet_sent)
 	{
@@ -1622,76 +2611,327 @@ void MqttClientDisconnect(void)
 }
 
 /**
- * @brief	Check whether request to start timer is received or not.
+ * @brief	Check whether any timer is running.
  *
- * @param	: 	void
+ * @param[in]	: client	: client context
  * @return 	bool
- * @retval	: true	: Request to start timer received
- * @retval	: false	: Request to start timer not received
+ * @retval	: true	: at least one timer running
+ * @retval	: false	: no timer running
  *
 */
-bool MqttClientCheckTimerReq(void)
+bool MqttClientCheckTimerReq(t_MqttClient *client)
 {
-	return timer_start;
+	return (MqttClientTimerPending(&client->timers) != 0U);
 }
 
 /**
- * @brief	Get timer interval to check against count
+ * @brief	Advance the timer wheel, an elapsed timer posts MQTT_EVT_TIMER_FIRED.
  *
- * @param	: 	void
- * @return 	unsigned char
- * @retval	: true	: Request to start timer received
- * @retval	: false	: Request to start timer not received
+ * @param[in]	: client	: client context
+ * @return 	void
  *
 */
-unsigned char MqttClientGetTimerInterval(void)
+void MqttClientAdvanceTimers(t_MqttClient *client)
 {
-	return timer_interval;
+	if ( MqttClientTimerAdvance(&client->timers) != 0U )
+	{
+		MqttClientIoPost(client, MQTT_EVT_TIMER_FIRED);
+	}
 }
 
 /**
- * @brief	Set timer elapsed flag to true
+ * @brief	Check whether the connection to the broker was closed.
  *
- * @param	: void
- * @return 	void
+ * @param[in]	: client	: client context
+ * @return 	bool
+ * @retval	: true	: no socket connected to the broker
+ * @retval	: false	: socket connected
  *
 */
-void MqttClientNotifyTimerElapsed(void)
+bool MqttClientCheckLinkDown(t_MqttClient *client)
 {
-	timer_elapsed = true;
+	return (INVALID_SOCKET == client->session.socket_desc);
 }
 
 /**
- * @brief	Clear timer request, set timer start flag to false
+ * @brief	Check whether the uplink changed since the last connection attempt.
  *
- * @param	: void
+ * @param[in]	: client	: client context
+ * @return 	bool
+ * @retval	: true	: address, route or link of the uplink changed, the connection has to be opened again at once
+ * @retval	: false	: no change
+ *
+*/
+bool MqttClientCheckUplinkChanged(t_MqttClient *client)
+{
+	return client->session.uplink_changed;
+}
+
+/**
+ * @brief	Uplink change reported by the watcher: close the stale socket, forget the failed attempts of the old
+ * 			network and post the change to the FSM.
+ *
+ * @param[in]	: client	: client context
  * @return 	void
  *
 */
-void MqttClientClearTimerReq(void)
+void MqttClientUplinkChanged(t_MqttClient *client)
 {
-	timer_start = false;
+	t_MqttSession *session = &client->session;
+
+	/* the new network owes nothing to the failures of the old one, the next attempt is immediate */
+	session->reconnect_attempts = 0U;
+	session->uplink_changed = true;
+
+	if ( session->socket_desc != INVALID_SOCKET )
+	{
+		MqttClientTransportClose(client);
+	}
+
+	/* the standby connection went over the same uplink */
+	MqttClientFailoverRestartStandby(client);
+
+	MqttClientIoPost(client, MQTT_EVT_LINK_DOWN | MQTT_EVT_UPLINK_CHANGED);
 }
 
 /**
 * @brief	Close TCP socket
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return 	void
 *
 */
-void MqttClientTransportClose(void)
+void MqttClientTransportClose(t_MqttClient *client)
 {
+	t_MqttSession *session = &client->session;
+
 	/* Sends FIN packet over TCP to indicate shutting down further sends */
-	(void)shutdown(socket_desc, SHUT_WR);
+	(void)shutdown(session->socket_desc, SHUT_WR);
 
 	/* receive any pending data in TCP buffer */
-	(void)recv(socket_desc, NULL, (size_t)0, 0);
+	(void)recv(session->socket_desc, NULL, (size_t)0, 0);
 
 	/* Destroy socket */
-	(void)close(socket_desc);
+	(void)close(session->socket_desc);
 
 	/* socket destroyed */
-	socket_desc = INVALID_SOCKET;
+	session->socket_desc = INVALID_SOCKET;
+	session->socket_generation++;
+	session->client_connected = false;
+
+	/* a ping of the closed connection has nothing to wait for, spooled messages and ordered requests it did not
+	 * acknowledge are sent again */
+	MqttClientStopTimer(client, PINGRESP_RSP);
+	session->ping_timed = false;
+	MqttClientSpoolRewind(client);
+	MqttClientQueueOrderedRewind(client);
 	printf("MqttClient: Socket connection closed");
 }
+
+/**
+* @brief	Read the bytes available on the socket without waiting and process every complete packet
+*
+* @param[in]	: client	: client context
+* @return 	void
+*
+*/
+void MqttClientReceivePackets(t_MqttClient *client)
+{
+	t_MqttSession *session = &client->session;
+	t_mqtt_header_byte header = {0};
+	int bytes_received = 0;
+	int len_bytes = 0;
+	int rem_len = 0;
+	int packet_len = 0;
+	bool complete = true;
+
+	while ( (session->socket_desc != INVALID_SOCKET) && (session->rx_len < MAX_RX_BUFFER_SIZE) )
+	{
+		bytes_received = MqttClientTransportReceivePacketBuffer(client, &session->rx_buffer[session->rx_len], MAX_RX_BUFFER_SIZE - session->rx_len);
+
+		if ( bytes_received > 0 )
+		{
+			session->rx_len += bytes_received;
+		}
+		else
+		{
+			if ( 0 == bytes_received )
+			{
+				/* peer closed the connection, the socket would stay readable forever */
+				printf("MqttClient: Connection closed by host");
+				MqttClientTransportClose(client);
+				MqttClientIoPost(client, MQTT_EVT_LINK_DOWN);
+			}
+			break;
+		}
+
+		/* drop the part of an oversized packet that was not processed */
+		if ( session->rx_skip > 0 )
+		{
+			packet_len = MIN(session->rx_skip, session->rx_len);
+			memmove(session->rx_buffer, &session->rx_buffer[packet_len], session->rx_len - packet_len);
+			session->rx_len -= packet_len;
+			session->rx_skip -= packet_len;
+		}
+
+		complete = true;
+		while ( (true == complete) && (session->rx_len >= TWO_BYTES) )
+		{
+			/* remaining length is complete once a byte without continuation bit is found */
+			complete = false;
+			for (len_bytes = 1; (len_bytes <= MAX_REM_LEN_BYTES) && (len_bytes < session->rx_len); len_bytes++)
+			{
+				if ( 0 == (session->rx_buffer[len_bytes] & 0x80) )
+				{
+					complete = true;
+					break;
+				}
+			}
+
+			if ( true == complete )
+			{
+				MqttClientDecodePacketLen(&session->rx_buffer[1], &rem_len);
+				packet_len = ONE_BYTE + len_bytes + rem_len;
+
+				if ( packet_len > MAX_RX_BUFFER_SIZE )
+				{
+					printf("MqttClient: Incoming packet of %d bytes skipped", packet_len);
+					session->rx_skip = packet_len - session->rx_len;
+					session->rx_len = 0;
+				}
+				else if ( packet_len <= session->rx_len )
+				{
+					header.byte = session->rx_buffer[0];
+					MqttClientProcessPacket(client, header, &session->rx_buffer[ONE_BYTE + len_bytes], rem_len);
+					memmove(session->rx_buffer, &session->rx_buffer[packet_len], session->rx_len - packet_len);
+					session->rx_len -= packet_len;
+				}
+				else
+				{
+					/* wait for the rest of the packet */
+					complete = false;
+				}
+			}
+		}
+	}
+}
+
+/**
+* @brief	Set the options of a new broker socket: keep alive, unsent data kept by the kernel and, for a busy
+* 			polling client, low latency.
+*
+* @param[in]	: client	: client context
+* @param[in]	: sock		: socket descriptor
+* @return 	void
+*
+*/
+void MqttClientTransportConfigure(t_MqttClient *client, int sock)
+{
+	int lowat = MQTT_TCP_NOTSENT_LOWAT;
+
+	MqttClientTransportSetKeepAlive(sock);
+
+	/* the backlog waits in the request queue where urgent requests can overtake it, not in the kernel */
+	(void)setsockopt(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+
+	/* busy polling client: the kernel polls the device on reads and small packets leave at once */
+	if ( 0U != __atomic_load_n(&client->io.spin_budget_us, __ATOMIC_RELAXED) )
+	{
+		MqttClientTransportSetLowLatency(sock);
+	}
+}
+
+/**
+* @brief	Serializes the connect packet of a connection of the client into the buffer.
+*
+* @param[in]	: client	: client context
+* @param[in]	: client_id	: client id of the connection
+* @param[out]	: buf		: the buffer into which the packet will be serialized
+* @param[in]	: buflen	: the length in bytes of the supplied buffer
+* @return	int
+* @retval	serialized length
+* @retval	0 as error
+*
+*/
+int MqttClientBuildConnectPacket(t_MqttClient *client, const char *client_id, unsigned char *buf, int buflen)
+{
+	t_mqtt_connect_packet_options mqtt_connect_packet_options = CONNECT_OPTIONS_INIT;
+
+	MqttClientSetConnectPacketOptions(client, client_id, &mqtt_connect_packet_options);
+
+	return MqttClientCreateConnectPacket(buf, buflen, &mqtt_connect_packet_options);
+}
+
+/**
+* @brief	Move the session onto a connection already accepted by a broker: the previous socket is closed and the
+* 			session goes on at once, without connect round trip. The round trip measured on the new connection
+* 			gives the first PUBACK timeout.
+*
+* @param[in]	: client	: client context
+* @param[in]	: sock		: socket the CONNACK was received on
+* @param[in]	: rx		: bytes received on sock and not processed yet
+* @param[in]	: rx_len	: number of bytes in rx
+* @param[in]	: rtt_ms	: round trip measured on sock, 0 if none
+* @return 	void
+*
+*/
+void MqttClientAdoptSocket(t_MqttClient *client, int sock, const unsigned char *rx, int rx_len, uint32_t rtt_ms)
+{
+	t_MqttSession *session = &client->session;
+
+	if ( session->socket_desc != INVALID_SOCKET )
+	{
+		MqttClientTransportClose(client);
+	}
+
+	session->socket_desc = sock;
+	session->socket_generation++;
+	session->client_connected = true;
+	session->connack_received = true;
+	session->connack_return_code = CONNECTION_ACCEPTED;
+	session->uplink_changed = false;
+
+	session->rx_len = MIN(rx_len, MAX_RX_BUFFER_SIZE);
+	session->rx_skip = 0;
+	memcpy(session->rx_buffer, rx, (size_t)session->rx_len);
+
+	/* the publish in flight is a first transmission for the new broker */
+	session->pub_retransmits = 0U;
+	session->last_rx_ms = MqttClientTimerNowMs(&client->timers);
+
+	memset(&session->rtt, 0, sizeof(session->rtt));
+	session->rtt.rto_ms = MQTT_RTO_INITIAL_MS;
+	if ( rtt_ms != 0U )
+	{
+		MqttClientRttSample(session, rtt_ms);
+	}
+
+	MqttClientNetlinkBind(client, sock);
+	MqttClientSendBudgetReset(session);
+	MqttClientTransportSetUserTimeout(session);
+}
+
+/**
+* @brief	Get the socket connected to the broker
+*
+* @param[in]	: client	: client context
+* @return 	int
+* @retval	socket descriptor, -1 when not connected
+*
+*/
+int MqttClientGetSocket(t_MqttClient *client)
+{
+	return client->session.socket_desc;
+}
+
+/**
+* @brief	Get the generation of the broker socket, changed each time the socket is opened or closed
+*
+* @param[in]	: client	: client context
+* @return 	unsigned int
+*
+*/
+unsigned int MqttClientGetSocketGeneration(t_MqttClient *client)
+{
+	return client->session.socket_generation;
+}
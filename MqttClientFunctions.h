@@ -24,6 +24,8 @@
 
 #include "MqttClient.h"
 #include "MqttClientCfg.h"
+#include "MqttClientQueue.h"
+#include "MqttClientTimer.h"
 
 #ifdef EXT_MODEM
 /* Modem connections */
@@ -43,280 +45,596 @@
 #define SUCCESS									((unsigned char)1)
 #define FAILURE									((unsigned char)0)
 
+/* Max connect packet size */
+#define MAX_CONN_PACK_SIZE						((unsigned short)512)
+
+/* Max ping packet size */
+#define MAX_PING_PACK_SIZE						((unsigned short)2)
+
+/* Size of the receive buffer, larger incoming packets are skipped */
+#define MAX_RX_BUFFER_SIZE						((int)512)
+
 /* ------------------------------- Data Types ------------------------------- */
 
 /* different types of power on reset actions */
 typedef enum {
 	MODEM_REQ = 0,
 	KEEP_ALIVE = 1,
-	PING_REQ = 2
+	PING_REQ = 2,
+	PUBACK_RSP = 3,
+	PINGRESP_RSP = 4,
+	SEND_BUDGET = 5,
+	TIMER_REQ_LAST/* <--- Do not remove this!!!*/
 }t_timer_req;
 
+/* Round trip time estimator of a client context, fed by PINGREQ/PINGRESP and PUBLISH/PUBACK pairs as TCP does */
 typedef struct {
+	uint32_t			srtt_ms;							/*smoothed round trip time*/
+	uint32_t			rttvar_ms;							/*round trip time variation*/
+	uint32_t			rto_ms;								/*timeout of the next PUBACK*/
+	bool				valid;								/*at least one round trip measured*/
+} t_MqttRtt;
 
-	unsigned char 	retry_count;					/*Counter for retry request*/
-	unsigned char	json[SERVER_COM_JSON_MAX_SIZE];	/*buffer for json received from services*/
-	uint16_t 		json_size;						/*the size of Json*/
-	RxCbk cbk;		/*Store the pointer to a function provided by the services. This function is called by ServerCom
-	 	 	 	 	 * after a request in order to notify the service about the result */
-} t_PendingRequest;
-
-/* ---------------------------- Global Variables ---------------------------- */
+/* Kernel view of the connection to the broker and send budget of a client context */
+typedef struct {
+	uint32_t			rtt_us;								/*smoothed round trip time measured by TCP*/
+	uint32_t			min_rtt_us;							/*lowest TCP round trip time seen, the path without queueing delay*/
+	uint32_t			unacked;							/*segments sent and not acknowledged*/
+	int					outq_bytes;							/*bytes written and not acknowledged (SIOCOUTQ), plus the packets written since the sample*/
+	int					notsent_bytes;						/*bytes written and not sent yet (SIOCOUTQNSD)*/
+	uint32_t			send_budget;						/*outq_bytes above which publishes wait in the request queue*/
+	unsigned int		user_timeout_ms;					/*TCP_USER_TIMEOUT of the socket, 0 until set*/
+} t_MqttLink;
+
+/* Protocol state of a client context: modem, broker session and receive buffer */
+typedef struct {
+	bool				modem_connected;					/*flag to store modem connection status*/
+	bool				profile_started;					/*flag to store profile start status*/
+	bool				ip_obtained;						/*flag to store ip status*/
+	t_MqttTimer			fsm_timers[TIMER_REQ_LAST];			/*timers of the FSM, one per timer req type, running independently*/
+	bool				timer_elapsed[TIMER_REQ_LAST];		/*flags to store timer elapsed status, one per timer req type*/
+	bool				client_connected;					/*flag to store client connection status*/
+	t_PendingRequest	*active_request;					/*request currently under process, taken from the request queue*/
+	unsigned char		pub_req_status;						/*status of the last publish request*/
+	unsigned char		rx_buffer[MAX_RX_BUFFER_SIZE];		/*bytes received and not yet processed*/
+	int					rx_len;								/*number of bytes in rx_buffer*/
+	int					rx_skip;							/*bytes of an oversized incoming packet still to be skipped*/
+	bool				connack_received;					/*flag to store CONNACK reception*/
+	unsigned char		connack_return_code;				/*return code of the CONNACK*/
+	bool				puback_received;					/*flag to store PUBACK reception since last publish*/
+	bool				pingresp_received;					/*flag to store PINGRESP reception since last ping request*/
+	unsigned int		socket_generation;					/*incremented each time socket_desc changes, tells event loops to watch the new socket*/
+	int					socket_desc;						/*socket connected to the broker*/
+	t_MqttRtt			rtt;								/*round trip time estimator*/
+	uint16_t			packet_id;							/*packet id of the publish in flight*/
+	t_MqttRequestHandle	packet_id_owner;					/*request packet_id was given to*/
+	unsigned char		pub_retransmits;					/*retransmissions of the publish in flight*/
+	uint64_t			publish_sent_ms;					/*first transmission of the publish in flight*/
+	uint64_t			ping_sent_ms;						/*transmission of the ping request in flight*/
+	bool				ping_timed;							/*a ping request is in flight, its response is a round trip sample*/
+	uint64_t			last_rx_ms;							/*reception of the last packet from the broker*/
+	t_MqttLink			link;								/*kernel queue of the socket and send budget*/
+	bool				uplink_changed;						/*uplink changed since the last connection attempt*/
+	unsigned char		reconnect_attempts;					/*connection attempts since the last stable connection*/
+	uint32_t			jitter_state;						/*state of the generator of the backoff delays*/
+	t_MqttTimer			stable_timer;						/*elapses once the connection stayed up MQTT_RECONNECT_STABLE_MS*/
+} t_MqttSession;
 
-/* List to hold data related to each associated service such as retry count, json, size, cbk func */
-extern t_PendingRequest ServiceRequestList[SERVICE_LAST];
 
-/* Request to cancel current ongoing transmission */
-extern bool cancel_request;
+/* ---------------------------- Global Variables ---------------------------- */
 
 /* profile currently in use */
 extern unsigned char profile;
 
 /* --------------------------- Routine prototypes --------------------------- */
 
+/**
+ * @brief	Set the protocol state of a new client context: no connection, no request under process.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientSessionInit(t_MqttClient *client);
+
 /**
  * @brief	Initializes modem_connected, profile_started and ip_obtained flags on power on reset.
  *
- * @param 	void
+ * @param[in]	: client	: client context
  * @return 	void
  *
 */
-void MqttClientResetFlags(void);
+void MqttClientResetFlags(t_MqttClient *client);
 
 /**
  * @brief	Register session result handler, session state handler with ModemDataMng and start default profile.
  *
- * @param 	void
+ * @param[in]	: client	: client context
  * @return 	void
  *
 */
-void MqttClientModemInit(void);
+void MqttClientModemInit(t_MqttClient *client);
 
 /**
  * @brief	Initializes modem_connected, profile_started and ip_obtained flags on power on reset.
  *
+ * @param[in]	: client	: client context
  * @param[in]	: timer_req		: timer req type to set timer interval
  * @return 		void
  *
 */
-void MqttClientClearStartTimer(t_timer_req timer_req);
+void MqttClientClearStartTimer(t_MqttClient *client, t_timer_req timer_req);
+
+/**
+ * @brief	Stop a timer and clear its elapsed flag, the other timers keep running.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: timer_req		: timer req type to stop
+ * @return 		void
+ *
+*/
+void MqttClientStopTimer(t_MqttClient *client, t_timer_req timer_req);
+
+/**
+ * @brief	Publish the request in flight again with the DUP flag once its PUBACK timed out. Held while the kernel still
+ * 			queues the previous copy, the timeout is then kept and the kernel closes the connection at rto + margin.
+ * 			Only the copies sent double the timeout, until a new round trip is measured, and count against
+ * 			MAX_REQ_RETRY_COUNT.
+ *
+ * @param[in]	: client	: client context
+ * @return 		void
+ *
+*/
+void MqttClientRetransmitPubRequest(t_MqttClient *client);
+
+/**
+ * @brief	Get the number of retransmissions of the publish in flight.
+ *
+ * @param[in]	: client	: client context
+ * @return 		unsigned char
+ *
+*/
+unsigned char MqttClientCheckRetransmitCount(t_MqttClient *client);
+
+/**
+ * @brief	Start the KEEP_ALIVE timer after a connection attempt: it supervises the CONNACK when the connect packet
+ * 			was sent, otherwise it waits the backoff delay before the next attempt.
+ *
+ * @param[in]	: client	: client context
+ * @return 		void
+ *
+*/
+void MqttClientStartConnectTimer(t_MqttClient *client);
+
+/**
+ * @brief	Start the KEEP_ALIVE timer with the backoff delay before the next connection attempt. The first attempt
+ * 			after a stable connection is immediate, the next ones wait a random delay up to a bound doubled on every
+ * 			attempt (full jitter), so that clients losing the same broker do not reconnect in lockstep.
+ *
+ * @param[in]	: client	: client context
+ * @return 		void
+ *
+*/
+void MqttClientStartBackoffTimer(t_MqttClient *client);
+
+/**
+ * @brief	Start the timer resetting the backoff once the connection stayed up long enough.
+ *
+ * @param[in]	: client	: client context
+ * @return 		void
+ *
+*/
+void MqttClientStartStableTimer(t_MqttClient *client);
 
 /**
- * @brief	Check whether request to start timer is received or not.
+ * @brief	Check whether any timer is running.
  *
- * @param	: void
+ * @param[in]	: client	: client context
  * @return 	bool
- * @retval	: TRUE	: Request to start timer received
- * @retval	: false	: Request to start timer not received
+ * @retval	: TRUE	: at least one timer running
+ * @retval	: false	: no timer running
  *
 */
-bool MqttClientCheckTimerReq(void);
+bool MqttClientCheckTimerReq(t_MqttClient *client);
 
 /**
- * @brief	Clear timer request, set timer start flag to false
+ * @brief	Advance the timer wheel, an elapsed timer posts MQTT_EVT_TIMER_FIRED.
  *
- * @param	: void
+ * @param[in]	: client	: client context
  * @return 	void
  *
 */
-void MqttClientClearTimerReq(void);
+void MqttClientAdvanceTimers(t_MqttClient *client);
+
+/**
+ * @brief	Check whether the connection to the broker was closed.
+ *
+ * @param[in]	: client	: client context
+ * @return 	bool
+ * @retval	: true	: no socket connected to the broker
+ * @retval	: false	: socket connected
+ *
+*/
+bool MqttClientCheckLinkDown(t_MqttClient *client);
 
 /**
- * @brief	Get timer interval to check against count
+ * @brief	Check whether the uplink changed since the last connection attempt.
  *
- * @param	: void
- * @return 	unsigned char
- * @retval	: TRUE	: Request to start timer received
- * @retval	: false	: Request to start timer not received
+ * @param[in]	: client	: client context
+ * @return 	bool
+ * @retval	: true	: address, route or link of the uplink changed, the connection has to be opened again at once
+ * @retval	: false	: no change
  *
 */
-unsigned char MqttClientGetTimerInterval(void);
+bool MqttClientCheckUplinkChanged(t_MqttClient *client);
 
 /**
- * @brief	Set timer elapsed flag to TRUE
+ * @brief	Uplink change reported by the watcher: close the stale socket, forget the failed attempts of the old
+ * 			network and post the change to the FSM.
  *
- * @param	: void
+ * @param[in]	: client	: client context
  * @return 	void
  *
 */
-void MqttClientNotifyTimerElapsed(void);
+void MqttClientUplinkChanged(t_MqttClient *client);
 
 /**
  * @brief	check modem connection status by returning modem_connected flag status.
  *
- * @param	: void
+ * @param[in]	: client	: client context
  * @return 	bool
  * @retval 	false: modem not connected
  * @retval 	TRUE: modem connected
  *
 */
-bool MqttClientCheckModemConnection(void);
+bool MqttClientCheckModemConnection(t_MqttClient *client);
 
 /**
  * @brief	check timer elapsed flag status.
  *
- * @param	: 	void
+ * @param[in]	: client	: client context
  * @return 	bool
  * @retval 	false: timer running
  * @retval 	TRUE: timer elapsed
  *
 */
-bool MqttClientCheckTimeToRetry(void);
+bool MqttClientCheckTimeToRetry(t_MqttClient *client);
 
 /**
  * @brief	create and send a Mqtt connect control packet over socket
  *
- * @param	: void
+ * @param[in]	: client	: client context
  * @return 	void
  *
 */
-void MqttClientSendConnectRequest(void);
+void MqttClientSendConnectRequest(t_MqttClient *client);
 
 /**
 * @brief	check for CONNACK packet received
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	bool
 * @retval	TRUE	: CONNACK packet received client successfully connected
 * 			false	: CONNACK packet not received client not connected
 */
-bool MqttClientCheckMqttConnection(void);
+bool MqttClientCheckMqttConnection(t_MqttClient *client);
 
 /**
 * @brief	check for data available to be sent
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	bool
 * @retval	TRUE	: data to be sent
 * 			false	: no data to send
 */
-bool MqttClientCheckDataToSend(void);
+bool MqttClientCheckDataToSend(t_MqttClient *client);
 
 /**
 * @brief	check whether timer for ping request is elapsed
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	bool
 * @retval	TRUE	: timer elapsed ping request should be sent
 * 			false	: timer not elapsed ping request should not be sent
 */
-bool MqttClientCheckTimeToPing(void);
+bool MqttClientCheckTimeToPing(t_MqttClient *client);
 
 /**
-* @brief	Send ping mqtt control packet over socket
+* @brief	Send ping mqtt control packet over socket, unless a packet received within the ping interval already
+* 			proved the connection alive
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	void
 */
-void MqttClientSendPingRequest(void);
+void MqttClientSendPingRequest(t_MqttClient *client);
+
+/**
+* @brief	check whether the kernel holds less than the send budget, a publish may then be written to the socket. The
+* 			kernel queue is the one sampled on the last PUBACK, PUBACK timeout or send budget timer, plus the packets
+* 			written since
+*
+* @param[in]	: client	: client context
+* @return	bool
+* @retval	true	: room in the send budget
+* 			false	: the request stays in the request queue until the kernel sent and got acknowledged its backlog
+*/
+bool MqttClientCheckSendBudget(t_MqttClient *client);
+
+/**
+* @brief	check whether a timer is running
+*
+* @param[in]	: client	: client context
+* @param[in]	: timer_req	: timer req type
+* @return	bool
+*/
+bool MqttClientCheckTimerRunning(t_MqttClient *client, t_timer_req timer_req);
+
+/**
+* @brief	check whether the ping request in flight missed its PINGRESP deadline
+*
+* @param[in]	: client	: client context
+* @return	bool
+* @retval	true	: nothing received from the broker within the deadline, the connection is half open
+* 			false	: no ping request in flight or deadline not elapsed
+*/
+bool MqttClientCheckPingRespTimeout(t_MqttClient *client);
 
 /**
 * @brief	Send publish mqtt control packet over socket
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	void
 */
-void MqttClientSendPubRequest(void);
+void MqttClientSendPubRequest(t_MqttClient *client);
 
 /**
 * @brief	Decrement retry count associated with currently active service after sending publish request
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	void
 */
-void MqttClientDecrementRetryCount(void);
+void MqttClientDecrementRetryCount(t_MqttClient *client);
 
 /**
 * @brief	Increment retry count associated with currently active service after sending publish request
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	void
 */
-void MqttClientIncrementRetryCount(void);
+void MqttClientIncrementRetryCount(t_MqttClient *client);
 
 /**
 * @brief	Check wether to cancel current ongoing process of transmission due to cancellation request
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	bool
-* @retval	TRUE	: Cancellation request received
+* @retval	TRUE	: Cancellation request received for the active request
 * @retval	false	: Cancellation request not received
 */
-bool MqttClientCheckRequestToCancel(void);
+bool MqttClientCheckRequestToCancel(t_MqttClient *client);
+
+/**
+* @brief	Check whether the time to live of current ongoing service transmission elapsed
+*
+* @param[in]	: client	: client context
+* @return	bool
+* @retval	true	: request expired, it is not sent again
+* @retval	false	: request still alive or without time to live
+*/
+bool MqttClientCheckRequestExpired(t_MqttClient *client);
 
 /**
 * @brief	Check retry count associated with current ongoing service transmission
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	unsigned char
 * @retval	retry_count	: retry count associated with current ongoing transmission
 */
-unsigned char MqttClientCheckRetryCount(void);
+unsigned char MqttClientCheckRetryCount(t_MqttClient *client);
 
 /**
 * @brief	Check retry count associated with current ongoing service transmission
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	unsigned char
 * @retval	SUCCESS	: publish request sent successfully
 * @retval	FAILURE	: publish request sending failed
 */
-unsigned char MqttClientCheckPubReqStatus(void);
+unsigned char MqttClientCheckPubReqStatus(t_MqttClient *client);
 
 /**
 * @brief	Clear retry count associated with currently active service transmission
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	void
 */
-void MqttClientClearRetryCount(void);
+void MqttClientClearRetryCount(t_MqttClient *client);
 
 /**
-* @brief	Notify active service for response
+* @brief	Notify active service for response and release its request
 *
+* @param[in]	: client	: client context
 * @param[in]	: resp	: response to be sent to active service
 * @return	void
 */
-void MqttClientServiceNotify(t_ServerReplyCodes resp);
+void MqttClientServiceNotify(t_MqttClient *client, t_ServerReplyCodes resp);
+
+/**
+* @brief	check whether a spooled message can be published: connected, room in the send budget and in the window of
+* 			spooled messages in flight, and no request of a more urgent service waiting to be sent
+*
+* @param[in]	: client	: client context
+* @return	bool
+*/
+bool MqttClientCheckSpoolToSend(t_MqttClient *client);
+
+/**
+* @brief	Publish spooled messages back to back, without waiting for their PUBACK, until the send budget or the window
+* 			of spooled messages in flight is full, or a request of a more urgent service waits
+*
+* @param[in]	: client	: client context
+* @return	void
+*/
+void MqttClientSendSpooled(t_MqttClient *client);
+
+/**
+* @brief	check whether a request with an ordering key can be published: connected, room in the send budget and in
+* 			the window of ordered requests in flight, no request of its key in flight and no request of a more urgent
+* 			service waiting to be sent
+*
+* @param[in]	: client	: client context
+* @return	bool
+*/
+bool MqttClientCheckOrderedToSend(t_MqttClient *client);
+
+/**
+* @brief	Publish requests with an ordering key back to back, without waiting for their PUBACK, until the send budget
+* 			or the window of ordered requests in flight is full, or a request of a more urgent service waits. Each key
+* 			has one request in flight at most
+*
+* @param[in]	: client	: client context
+* @return	void
+*/
+void MqttClientSendOrdered(t_MqttClient *client);
+
+/**
+* @brief	Notify every service having a pending request and release the requests, durable services keep theirs
+*
+* @param[in]	: client	: client context
+* @param[in]	: resp	: response to be sent to the services
+* @return	void
+*/
+void MqttClientServiceNotifyAll(t_MqttClient *client, t_ServerReplyCodes resp);
 
 /**
 * @brief	Check for PubAck control packet for previously sent publish request
 *
-* @param	: void
+* @param[in]	: client	: client context
 * @return	unsigned char
 * @retval	SUCCESS	: pubAck received successfully
 * @retval	FAILURE	: pubAck not received
 */
-unsigned char MqttClientCheckPubAckRspStatus(void);
+unsigned char MqttClientCheckPubAckRspStatus(t_MqttClient *client);
 
 /**
  * @brief	check timer elapsed flag status.
  *
- * @param	: 	void
+ * @param[in]	: client	: client context
  * @return 	bool
  * @retval 	false: timer running
  * @retval 	TRUE: timer elapsed
  *
 */
-bool MqttClientCheckRspTimerStatus(void);
+bool MqttClientCheckRspTimerStatus(t_MqttClient *client);
 
 /**
  * @brief	Send disconnect control packet
  *
- * @param	: void
+ * @param[in]	: client	: client context
  * @return 	void
  *
 */
-void MqttClientDisconnect(void);
+void MqttClientDisconnect(t_MqttClient *client);
 
 /**
 * @brief	Close TCP socket
 *
-* @param	: void
+* @param[in]	: client	: client context
+* @return 	void
+*
+*/
+void MqttClientTransportClose(t_MqttClient *client);
+
+/**
+* @brief	Read the bytes available on the socket without waiting and process every complete packet
+*
+* @param[in]	: client	: client context
+* @return 	void
+*
+*/
+void MqttClientReceivePackets(t_MqttClient *client);
+
+/**
+* @brief	send a packet over socket
+*
+* @param[in]	: sock		: socket descriptor
+* @param[in]	: buf		: packet buffer to be sent over network
+* @param[in]	: buflen	: length of packet buffer to be sent
+* @return 	bool
+* @retval	true	: whole packet written
+* @retval	false	: failure
+*
+*/
+bool MqttClientTransportSendPacketBuffer(int sock, unsigned char* buf, int buflen);
+
+/**
+* @brief	Set the options of a new broker socket: keep alive, unsent data kept by the kernel and, for a busy
+* 			polling client, low latency.
+*
+* @param[in]	: client	: client context
+* @param[in]	: sock		: socket descriptor
+* @return 	void
+*
+*/
+void MqttClientTransportConfigure(t_MqttClient *client, int sock);
+
+/**
+* @brief	Serializes ping packet into supplied buffer.
+*
+* @param[out]	: buf	: the buffer into which the ping packet will be serialized, MAX_PING_PACK_SIZE bytes
+* @return	int
+* @retval	serialized length
+*
+*/
+int MqttClientCreatePingPacket(unsigned char* buf);
+
+/**
+* @brief	Serializes the connect packet of a connection of the client into the buffer.
+*
+* @param[in]	: client	: client context
+* @param[in]	: client_id	: client id of the connection
+* @param[out]	: buf		: the buffer into which the packet will be serialized
+* @param[in]	: buflen	: the length in bytes of the supplied buffer
+* @return	int
+* @retval	serialized length
+* @retval	0 as error
+*
+*/
+int MqttClientBuildConnectPacket(t_MqttClient *client, const char *client_id, unsigned char *buf, int buflen);
+
+/**
+* @brief	Move the session onto a connection already accepted by a broker: the previous socket is closed and the
+* 			session goes on at once, without connect round trip. The round trip measured on the new connection
+* 			gives the first PUBACK timeout.
+*
+* @param[in]	: client	: client context
+* @param[in]	: sock		: socket the CONNACK was received on
+* @param[in]	: rx		: bytes received on sock and not processed yet
+* @param[in]	: rx_len	: number of bytes in rx
+* @param[in]	: rtt_ms	: round trip measured on sock, 0 if none
 * @return 	void
 *
 */
-void MqttClientTransportClose(void);
+void MqttClientAdoptSocket(t_MqttClient *client, int sock, const unsigned char *rx, int rx_len, uint32_t rtt_ms);
+
+/**
+* @brief	Get the socket connected to the broker
+*
+* @param[in]	: client	: client context
+* @return 	int
+* @retval	socket descriptor, -1 when not connected
+*
+*/
+int MqttClientGetSocket(t_MqttClient *client);
+
+/**
+* @brief	Get the generation of the broker socket, changed each time the socket is opened or closed
+*
+* @param[in]	: client	: client context
+* @return 	unsigned int
+*
+*/
+unsigned int MqttClientGetSocketGeneration(t_MqttClient *client);
 /* -------------------------------- Routines -------------------------------- */
 
 #endif /* MQTTCLIENTH2_FUNCTIONS_H */
@@ -0,0 +1,520 @@
+/**************************************************************************//**
+*  @par Language: C
+*******************************************************************************
+*  @par 	Project:
+*  @brief   MqttClient I/O event loop implementation
+*  @author  dr-paradox
+*  @version 1.0.0
+*******************************************************************************
+*  @ref 	MqttClient "API Reference"
+*  @file 	MqttClientIo.c
+*******************************************************************************/
+
+/* -------------------------------- Includes -------------------------------- */
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <time.h>
+#include "MqttClientContext.h"
+#include "MqttClientMng.h"
+#include "MqttClientTimerMng.h"
+#include "MqttClientShard.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* Invalid file descriptor */
+#define INVALID_FD					((int)-1)
+
+/* Max number of events returned by one epoll_wait() */
+#define MAX_IO_EVENTS				((int)4)
+
+/* Clock conversions */
+#define US_PER_SEC					((uint64_t)1000000)
+#define NS_PER_US					((uint64_t)1000)
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* ---------------------------- Global Variables ---------------------------- */
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+* @brief	Run the FSM until no more event is pending, so a request goes from submission to the wire in one wake up.
+*
+* @param[in]	: client	: client context
+* @return		void
+*/
+static void MqttClientIoRunFsm(t_MqttClient *client);
+
+/**
+* @brief	Read the monotonic clock.
+*
+* @return	uint64_t
+* @retval	current time in micro seconds
+*/
+static uint64_t MqttClientIoNowUs(void);
+
+/**
+* @brief	Busy poll: check the pending events, the timers and the fds without sleeping until something is
+* 			ready or the spin budget is spent.
+*
+* @param[in]	: client	: client context
+* @param[in]	: epoll_fd	: epoll set of the I/O thread
+* @param[out]	: events	: events of the ready fds
+* @param[in]	: budget_us	: spin budget
+* @return		int
+* @retval		number of ready fds
+*/
+static int MqttClientIoSpin(t_MqttClient *client, int epoll_fd, struct epoll_event *events, unsigned int budget_us);
+
+/**
+* @brief	I/O thread: waits on the wake up eventfd, the broker socket, the uplink watcher, the standby connection and
+* 			the next timer cycle.
+*
+* @param[in]	: arg	: client context
+* @return		void*
+*/
+static void* MqttClientIoThread(void *arg);
+
+/* -------------------------------- Routines -------------------------------- */
+
+/**
+* @brief	Run the FSM until no more event is pending, so a request goes from submission to the wire in one wake up.
+*
+* @param[in]	: client	: client context
+* @return		void
+*/
+static void MqttClientIoRunFsm(t_MqttClient *client)
+{
+	unsigned char steps = 0U;
+
+	/* each transition posts the entry of its destination state, the FSM settles when none is taken */
+	while ( (__atomic_load_n(&client->io.fsm_events, __ATOMIC_ACQUIRE) != 0U) && (steps < MQTT_IO_MAX_FSM_STEPS) )
+	{
+		MqttClientH2Mng_Task(client->handler);
+		steps++;
+	}
+}
+
+/**
+* @brief	Read the monotonic clock.
+*
+* @return	uint64_t
+* @retval	current time in micro seconds
+*/
+static uint64_t MqttClientIoNowUs(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * US_PER_SEC) + ((uint64_t)ts.tv_nsec / NS_PER_US);
+}
+
+/**
+* @brief	Busy poll: check the pending events, the timers and the fds without sleeping until something is
+* 			ready or the spin budget is spent.
+*
+* @param[in]	: client	: client context
+* @param[in]	: epoll_fd	: epoll set of the I/O thread
+* @param[out]	: events	: events of the ready fds
+* @param[in]	: budget_us	: spin budget
+* @return		int
+* @retval		number of ready fds
+*/
+static int MqttClientIoSpin(t_MqttClient *client, int epoll_fd, struct epoll_event *events, unsigned int budget_us)
+{
+	uint64_t deadline_us = MqttClientIoNowUs() + budget_us;
+	int ready = 0;
+
+	/* submissions posted from now on are seen by the spin, they skip the eventfd */
+	__atomic_store_n(&client->io.spinning, true, __ATOMIC_SEQ_CST);
+
+	do
+	{
+		ready = epoll_wait(epoll_fd, events, MAX_IO_EVENTS, 0);
+	} while ( (0 == ready) && (0U == __atomic_load_n(&client->io.fsm_events, __ATOMIC_SEQ_CST)) &&
+			  (0 != MqttClientTimerNextTimeoutMs(&client->timers)) && (MqttClientIoNowUs() < deadline_us) );
+
+	/* a submission racing with the end of the spin either sees the flag cleared and writes the eventfd, or its
+	 * event is seen by MqttClientIoNextTimeoutMs() before sleeping */
+	__atomic_store_n(&client->io.spinning, false, __ATOMIC_SEQ_CST);
+
+	return (ready > 0) ? ready : 0;
+}
+
+/**
+* @brief	I/O thread: waits on the wake up eventfd, the broker socket, the uplink watcher, the standby connection and
+* 			the next timer cycle.
+*
+* @param[in]	: arg	: client context
+* @return		void*
+*/
+static void* MqttClientIoThread(void *arg)
+{
+	struct epoll_event event = {0};
+	struct epoll_event events[MAX_IO_EVENTS];
+	int epoll_fd = INVALID_FD;
+	int watched_socket = INVALID_FD;
+	unsigned int watched_generation = 0U;
+	int watched_standby = INVALID_FD;
+	unsigned int watched_standby_generation = 0U;
+	unsigned short standby_events = 0U;
+	bool socket_changed = false;
+	bool standby_changed = false;
+	int ready = 0;
+	int idx;
+	unsigned int budget_us = 0U;
+	t_MqttClient *client = (t_MqttClient *)arg;
+	cpu_set_t cpus;
+
+	/* a pinned thread keeps the context in the caches of its core */
+	if ( MQTT_NO_CPU != client->io.cpu )
+	{
+		CPU_ZERO(&cpus);
+		CPU_SET(client->io.cpu, &cpus);
+		if ( pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0 )
+		{
+			printf("MqttClient: Error in pinning I/O thread of client %d to cpu %d", client->handler, client->io.cpu);
+		}
+	}
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+	event.events = EPOLLIN;
+	event.data.fd = client->io.wake_fd;
+	(void)epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client->io.wake_fd, &event);
+
+	if ( INVALID_FD != MqttClientNetlinkGetFd(client) )
+	{
+		event.events = EPOLLIN;
+		event.data.fd = MqttClientNetlinkGetFd(client);
+		(void)epoll_ctl(epoll_fd, EPOLL_CTL_ADD, MqttClientNetlinkGetFd(client), &event);
+	}
+
+	while ( false == __atomic_load_n(&client->io.stopping, __ATOMIC_ACQUIRE) )
+	{
+		/* the sockets change on every reconnection, a closed socket left the epoll set by itself. A promoted standby
+		 * socket keeps its fd and a new socket may reuse a closed one, so both are removed before being added back */
+		standby_changed = (watched_standby_generation != MqttClientFailoverGetGeneration(client));
+		socket_changed = (watched_generation != MqttClientGetSocketGeneration(client));
+
+		if ( (true == standby_changed) && (INVALID_FD != watched_standby) )
+		{
+			(void)epoll_ctl(epoll_fd, EPOLL_CTL_DEL, watched_standby, NULL);
+		}
+
+		if ( (true == socket_changed) && (INVALID_FD != watched_socket) )
+		{
+			(void)epoll_ctl(epoll_fd, EPOLL_CTL_DEL, watched_socket, NULL);
+		}
+
+		if ( true == socket_changed )
+		{
+			watched_socket = MqttClientGetSocket(client);
+			watched_generation = MqttClientGetSocketGeneration(client);
+
+			if ( INVALID_FD != watched_socket )
+			{
+				event.events = EPOLLIN;
+				event.data.fd = watched_socket;
+				(void)epoll_ctl(epoll_fd, EPOLL_CTL_ADD, watched_socket, &event);
+			}
+		}
+
+		if ( true == standby_changed )
+		{
+			watched_standby = MqttClientFailoverGetFd(client, &standby_events);
+			watched_standby_generation = MqttClientFailoverGetGeneration(client);
+
+			if ( INVALID_FD != watched_standby )
+			{
+				event.events = (MQTT_POLL_OUT == standby_events) ? EPOLLOUT : EPOLLIN;
+				event.data.fd = watched_standby;
+				(void)epoll_ctl(epoll_fd, EPOLL_CTL_ADD, watched_standby, &event);
+			}
+		}
+
+		/* in busy poll mode the thread only sleeps once the spin budget is spent without any activity */
+		ready = 0;
+		budget_us = __atomic_load_n(&client->io.spin_budget_us, __ATOMIC_RELAXED);
+		if ( 0U != budget_us )
+		{
+			ready = MqttClientIoSpin(client, epoll_fd, events, budget_us);
+		}
+
+		if ( 0 == ready )
+		{
+			ready = epoll_wait(epoll_fd, events, MAX_IO_EVENTS, MqttClientIoNextTimeoutMs(client));
+		}
+
+		/* the wake up eventfd carries no event of its own, submissions are posted before it is written */
+		for (idx = 0; idx < ready; idx++)
+		{
+			if ( events[idx].data.fd == watched_socket )
+			{
+				MqttClientIoPost(client, MQTT_EVT_BYTES_READABLE);
+			}
+			else if ( events[idx].data.fd == MqttClientNetlinkGetFd(client) )
+			{
+				MqttClientNetlinkProcess(client);
+			}
+			else if ( events[idx].data.fd == watched_standby )
+			{
+				MqttClientFailoverProcess(client);
+			}
+			else
+			{
+				/* wake up eventfd */
+			}
+		}
+
+		MqttClientIoProcess(client);
+	}
+
+	(void)close(epoll_fd);
+
+	return NULL;
+}
+
+/**
+ * @brief	Create the wake up eventfd of a client context.
+ *
+ * @param[in]	: client	: client context
+ * @return 	bool
+ * @retval	true	: event loop resources created
+ * @retval	false	: error in creating the eventfd
+ *
+*/
+bool MqttClientIoInit(t_MqttClient *client)
+{
+	client->io.cpu = MQTT_NO_CPU;
+	client->io.self_driven = false;
+	client->io.spin_budget_us = MQTT_BUSY_POLL_BUDGET_US;
+	client->io.spinning = false;
+	client->io.stopping = false;
+	client->io.wake_fd = eventfd(0U, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	return (INVALID_FD != client->io.wake_fd);
+}
+
+/**
+ * @brief	Start the I/O thread running the event loop.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: cpu		: cpu the thread is pinned to, MQTT_NO_CPU to let it run anywhere
+ * @return 	bool
+ * @retval	true	: I/O thread running
+ * @retval	false	: error in starting the thread
+ *
+*/
+bool MqttClientIoStart(t_MqttClient *client, int cpu)
+{
+	bool started = false;
+
+	if ( true == MqttClientIoInit(client) )
+	{
+		client->io.cpu = cpu;
+		client->io.self_driven = true;
+	}
+
+	if ( (true == client->io.self_driven) && (pthread_create(&client->io.io_thread, NULL, MqttClientIoThread, client) == 0) )
+	{
+		started = true;
+		printf("MqttClient: I/O thread started for client %d", client->handler);
+	}
+	else
+	{
+		client->io.self_driven = false;
+		printf("MqttClient: Error in starting I/O thread for client %d", client->handler);
+	}
+
+	return started;
+}
+
+/**
+ * @brief	Stop and join the I/O thread if one runs, then close the wake up eventfd.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientIoStop(t_MqttClient *client)
+{
+	uint64_t signal = 1U;
+
+	if ( true == client->io.self_driven )
+	{
+		__atomic_store_n(&client->io.stopping, true, __ATOMIC_RELEASE);
+		(void)write(client->io.wake_fd, &signal, sizeof(signal));
+		(void)pthread_join(client->io.io_thread, NULL);
+		client->io.self_driven = false;
+		printf("MqttClient: I/O thread stopped for client %d", client->handler);
+	}
+
+	if ( INVALID_FD != client->io.wake_fd )
+	{
+		(void)close(client->io.wake_fd);
+		client->io.wake_fd = INVALID_FD;
+	}
+}
+
+/**
+ * @brief	Get the fds watched by the event loop: the wake up eventfd, the broker socket when connected, the uplink watcher
+ * 			and the standby connection when opened.
+ *
+ * @param[in]	: client	: client context
+ * @param[out]	: fds	: array receiving the fds
+ * @param[in]	: max	: size of fds array
+ * @return 		unsigned char
+ * @retval		number of fds reported
+ *
+*/
+unsigned char MqttClientIoGetFds(t_MqttClient *client, t_MqttPollFd *fds, unsigned char max)
+{
+	unsigned char count = 0U;
+	int socket_fd = MqttClientGetSocket(client);
+	unsigned short standby_events = 0U;
+	int standby_fd = MqttClientFailoverGetFd(client, &standby_events);
+
+	if ( (INVALID_FD != client->io.wake_fd) && (count < max) )
+	{
+		fds[count].fd = client->io.wake_fd;
+		fds[count].events = MQTT_POLL_IN;
+		count++;
+	}
+
+	if ( (INVALID_FD != socket_fd) && (count < max) )
+	{
+		fds[count].fd = socket_fd;
+		fds[count].events = MQTT_POLL_IN;
+		count++;
+	}
+
+	if ( (INVALID_FD != MqttClientNetlinkGetFd(client)) && (count < max) )
+	{
+		fds[count].fd = MqttClientNetlinkGetFd(client);
+		fds[count].events = MQTT_POLL_IN;
+		count++;
+	}
+
+	if ( (INVALID_FD != standby_fd) && (count < max) )
+	{
+		fds[count].fd = standby_fd;
+		fds[count].events = standby_events;
+		count++;
+	}
+
+	return count;
+}
+
+/**
+ * @brief	Post events from another thread and wake the event loop up, called when a request is submitted or canceled.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: events	: MQTT_EVT_xxx to post
+ * @return 	void
+ *
+*/
+void MqttClientIoWake(t_MqttClient *client, unsigned int events)
+{
+	uint64_t signal = 1U;
+
+	MqttClientIoPost(client, events);
+
+	/* a spinning I/O thread sees the event without any system call */
+	if ( (INVALID_FD != client->io.wake_fd) && (false == __atomic_load_n(&client->io.spinning, __ATOMIC_SEQ_CST)) )
+	{
+		(void)write(client->io.wake_fd, &signal, sizeof(signal));
+	}
+}
+
+/**
+ * @brief	Post events from the thread running the FSM, the event loop is not woken up.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: events	: MQTT_EVT_xxx to post
+ * @return 	void
+ *
+*/
+void MqttClientIoPost(t_MqttClient *client, unsigned int events)
+{
+	(void)__atomic_or_fetch(&client->io.fsm_events, events, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief	Take every pending event, called by the FSM.
+ *
+ * @param[in]	: client	: client context
+ * @return 	unsigned int
+ * @retval	MQTT_EVT_xxx pending, 0 if none
+ *
+*/
+unsigned int MqttClientIoTakeEvents(t_MqttClient *client)
+{
+	return __atomic_exchange_n(&client->io.fsm_events, 0U, __ATOMIC_ACQ_REL);
+}
+
+/**
+ * @brief	Process pending events: take the requests handed off by other threads, run the FSM until it settles
+ * 			and the timer wheel up to the current time.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientIoProcess(t_MqttClient *client)
+{
+	uint64_t signal = 0U;
+
+	if ( INVALID_FD != client->io.wake_fd )
+	{
+		(void)read(client->io.wake_fd, &signal, sizeof(signal));
+	}
+
+	MqttClientShardDrain(client);
+
+	/* requests past their time to live are gone before the FSM takes the next one */
+	MqttClientQueueExpire(client);
+
+	MqttClientIoRunFsm(client);
+
+	/* timers started by the FSM are armed on the wheel before it is advanced, an elapsed one posts its event */
+	MqttClientH2TimerMng_Task(client->handler);
+
+	MqttClientIoRunFsm(client);
+}
+
+/**
+ * @brief	Get the time until the event loop has to run even without any fd event.
+ *
+ * @param[in]	: client	: client context
+ * @return 	int
+ * @retval	timeout in milli seconds, 0 when events are pending
+ * @retval	-1	: no timer running, only an fd event can wake the event loop up
+ *
+*/
+int MqttClientIoNextTimeoutMs(t_MqttClient *client)
+{
+	int timeout_ms = 0;
+	int deadline_ms = -1;
+
+	/* an idle client only wakes up for its next timer deadline or the next request to expire */
+	if ( 0U == __atomic_load_n(&client->io.fsm_events, __ATOMIC_SEQ_CST) )
+	{
+		timeout_ms = MqttClientTimerNextTimeoutMs(&client->timers);
+		deadline_ms = MqttClientQueueNextDeadlineMs(client);
+
+		if ( (deadline_ms >= 0) && ((timeout_ms < 0) || (deadline_ms < timeout_ms)) )
+		{
+			timeout_ms = deadline_ms;
+		}
+	}
+
+	return timeout_ms;
+}
@@ -0,0 +1,154 @@
+/**************************************************************************//**
+*  @par Language  : C
+*******************************************************************************
+*  @brief       MqttClient I/O event loop header file.
+*  @author      dr-paradox
+*  @version     1.0.0
+*******************************************************************************
+*  @page 	MqttClientIo
+*  @ref 	MqttClient "API Reference" header file
+*  @file 	MqttClientIo.h
+*
+*******************************************************************************/
+
+#ifndef MQTTCLIENT_IO_H
+#define MQTTCLIENT_IO_H
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "MqttClient.h"
+#include "MqttClientCfg.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* I/O thread left free to run on any cpu */
+#define MQTT_NO_CPU					((int)-1)
+
+/* Events driving the FSM of a client context, accumulated until the FSM runs */
+#define MQTT_EVT_DATA_SUBMITTED		((unsigned int)0x01)	/*request submitted or canceled*/
+#define MQTT_EVT_BYTES_READABLE		((unsigned int)0x02)	/*data received from the broker*/
+#define MQTT_EVT_TIMER_FIRED		((unsigned int)0x04)	/*a FSM timer elapsed*/
+#define MQTT_EVT_LINK_DOWN			((unsigned int)0x08)	/*connection closed by the broker*/
+#define MQTT_EVT_STATE_ENTERED		((unsigned int)0x10)	/*transition taken, the new state is evaluated*/
+#define MQTT_EVT_UPLINK_CHANGED		((unsigned int)0x20)	/*address, route or link change of the uplink*/
+#define MQTT_EVT_STANDBY_READY		((unsigned int)0x40)	/*standby connection accepted by its broker*/
+#define MQTT_EVT_ALL				((unsigned int)0x7F)	/*every transition evaluated, used by the periodic task*/
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* Event loop of a client context */
+typedef struct {
+	int			wake_fd;			/*eventfd written on each submission to wake the event loop up*/
+	unsigned int	fsm_events;		/*MQTT_EVT_xxx posted and not yet taken by the FSM*/
+	pthread_t	io_thread;			/*I/O thread of the self driven mode*/
+	int			cpu;				/*cpu the I/O thread is pinned to, MQTT_NO_CPU if none*/
+	bool		self_driven;		/*client driven by its I/O thread, the host event loop API is disabled*/
+	unsigned int	spin_budget_us;	/*busy poll time before sleeping, 0 if disabled*/
+	bool		spinning;			/*I/O thread busy polling, submissions don't need to write wake_fd*/
+	bool		stopping;			/*I/O thread asked to leave its event loop*/
+} t_MqttIo;
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+ * @brief	Create the wake up eventfd of a client context.
+ *
+ * @param[in]	: client	: client context
+ * @return 	bool
+ * @retval	true	: event loop resources created
+ * @retval	false	: error in creating the eventfd
+ *
+*/
+bool MqttClientIoInit(t_MqttClient *client);
+
+/**
+ * @brief	Start the I/O thread running the event loop.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: cpu		: cpu the thread is pinned to, MQTT_NO_CPU to let it run anywhere
+ * @return 	bool
+ * @retval	true	: I/O thread running
+ * @retval	false	: error in starting the thread
+ *
+*/
+bool MqttClientIoStart(t_MqttClient *client, int cpu);
+
+/**
+ * @brief	Stop and join the I/O thread if one runs, then close the wake up eventfd.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientIoStop(t_MqttClient *client);
+
+/**
+ * @brief	Get the fds watched by the event loop: the wake up eventfd, the broker socket when connected and the uplink watcher.
+ *
+ * @param[in]	: client	: client context
+ * @param[out]	: fds	: array receiving the fds
+ * @param[in]	: max	: size of fds array
+ * @return 		unsigned char
+ * @retval		number of fds reported
+ *
+*/
+unsigned char MqttClientIoGetFds(t_MqttClient *client, t_MqttPollFd *fds, unsigned char max);
+
+/**
+ * @brief	Post events from another thread and wake the event loop up, called when a request is submitted or canceled.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: events	: MQTT_EVT_xxx to post
+ * @return 	void
+ *
+*/
+void MqttClientIoWake(t_MqttClient *client, unsigned int events);
+
+/**
+ * @brief	Post events from the thread running the FSM, the event loop is not woken up.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: events	: MQTT_EVT_xxx to post
+ * @return 	void
+ *
+*/
+void MqttClientIoPost(t_MqttClient *client, unsigned int events);
+
+/**
+ * @brief	Take every pending event, called by the FSM.
+ *
+ * @param[in]	: client	: client context
+ * @return 	unsigned int
+ * @retval	MQTT_EVT_xxx pending, 0 if none
+ *
+*/
+unsigned int MqttClientIoTakeEvents(t_MqttClient *client);
+
+/**
+ * @brief	Process pending events: take the requests handed off by other threads, run the FSM until it settles
+ * 			and the timer wheel up to the current time.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientIoProcess(t_MqttClient *client);
+
+/**
+ * @brief	Get the time until the event loop has to run even without any fd event.
+ *
+ * @param[in]	: client	: client context
+ * @return 	int
+ * @retval	timeout in milli seconds, 0 when events are pending
+ * @retval	-1	: no timer running, only an fd event can wake the event loop up
+ *
+*/
+int MqttClientIoNextTimeoutMs(t_MqttClient *client);
+
+/* -------------------------------- Routines -------------------------------- */
+
+#endif /* MQTTCLIENT_IO_H */
@@ -7,27 +7,118 @@
 /*------------------------------------ INCLUDES ------------------------------------*/
 
 #include "MqttClientMng.h"
+#include "MqttClientContext.h"
 
 /*------------------------------------ DEFINES -------------------------------------*/
 
-#define THIS(index) (instance_params[(index)])
+/* The instance lives in the context it drives, next to the rest of its state */
+#define THIS(index) (MqttClientGetContext(index)->mng)
 
 /*------------------------------------ VARIABLES -----------------------------------*/
 
-static t_mqttclienth2mng_instance_struct instance_params[MQTTCLIENTH2MNG_NUMBER_OF_INSTANCES];
-
 /* --------------------------- BEGIN EDITABLE CODE AREA  -------------------------- */
 
+/* Events of the transitions evaluated again whenever a state is entered */
+#define EVT_ENTRY			MQTT_EVT_STATE_ENTERED
+
 /* ---------------------------- END EDITABLE CODE AREA  --------------------------- */
 
 /*--------------------------------- FUNCTION HEADERS -------------------------------*/
 
-static void MqttClientH2Mng0(unsigned char handler);
-static void SendPublishRequest(unsigned char handler);
-static void WaitForData(unsigned char handler);
-static void WaitMqttClientConnect(unsigned char handler);
-static void WaitForPubAck(unsigned char handler);
-static void WaitModemInit(unsigned char handler);
+static bool GuardModemNotConnected(t_MqttClient *client);
+static bool GuardModemConnected(t_MqttClient *client);
+static bool GuardModemRetry(t_MqttClient *client);
+static bool GuardConnectRetry(t_MqttClient *client);
+static bool GuardConnected(t_MqttClient *client);
+static bool GuardTimeToPing(t_MqttClient *client);
+static bool GuardPingRespTimeout(t_MqttClient *client);
+static bool GuardDataToSend(t_MqttClient *client);
+static bool GuardSpoolToSend(t_MqttClient *client);
+static bool GuardOrderedToSend(t_MqttClient *client);
+static bool GuardSendBudgetExhausted(t_MqttClient *client);
+static bool GuardLinkDown(t_MqttClient *client);
+static bool GuardUplinkChanged(t_MqttClient *client);
+static bool GuardCancelPublishRequest(t_MqttClient *client);
+static bool GuardPublishRequestExpired(t_MqttClient *client);
+static bool GuardRetryPublishRequest(t_MqttClient *client);
+static bool GuardPublishRequestSent(t_MqttClient *client);
+static bool GuardPublishRequestFailure(t_MqttClient *client);
+static bool GuardPubAckReceived(t_MqttClient *client);
+static bool GuardPubAckTimeout(t_MqttClient *client);
+static bool GuardPublishExpired(t_MqttClient *client);
+static bool GuardRetransmitPublish(t_MqttClient *client);
+static bool GuardStandbyTakeover(t_MqttClient *client);
+static bool GuardFailover(t_MqttClient *client);
+static bool GuardFailoverPublish(t_MqttClient *client);
+
+static bool StateConnected(t_state_mqttclienth2mng state);
+
+static void ActionPowerOnModemInit(t_MqttClient *client);
+static void ActionModemInit(t_MqttClient *client);
+static void ActionRetryModemInit(t_MqttClient *client);
+static void ActionModemConnected(t_MqttClient *client);
+static void ActionRetryMqttConnectRequest(t_MqttClient *client);
+static void ActionMqttClientConnectionEstablished(t_MqttClient *client);
+static void ActionSendPingRequest(t_MqttClient *client);
+static void ActionHalfOpenReconnect(t_MqttClient *client);
+static void ActionSendSpooled(t_MqttClient *client);
+static void ActionSendOrdered(t_MqttClient *client);
+static void ActionSendPublishRequest(t_MqttClient *client);
+static void ActionWaitSendBudget(t_MqttClient *client);
+static void ActionReconnect(t_MqttClient *client);
+static void ActionReceivePackets(t_MqttClient *client);
+static void ActionCancelPublishRequest(t_MqttClient *client);
+static void ActionRetryPublishRequest(t_MqttClient *client);
+static void ActionWaitForPubAck(t_MqttClient *client);
+static void ActionPublishRequestFailure(t_MqttClient *client);
+static void ActionDataSentNotifyService(t_MqttClient *client);
+static void ActionMqttClientReconnect(t_MqttClient *client);
+static void ActionRetransmitPublish(t_MqttClient *client);
+static void ActionPublishExpired(t_MqttClient *client);
+static void ActionStandbyTakeover(t_MqttClient *client);
+static void ActionFailover(t_MqttClient *client);
+static void ActionFailoverPublish(t_MqttClient *client);
+
+/*-------------------------------- TRANSITION TABLE --------------------------------*/
+
+/* Transitions of every state, evaluated in order, the first one whose event is pending and whose guard holds is taken */
+static const t_mqttclienth2mng_transition transitions[] = {
+	/* state										events														guard							action									next state */
+	{ STATE_0_MQTTCLIENTH2MNG,						MQTT_EVT_ALL,												NULL,							ActionPowerOnModemInit,					STATE_MQTTCLIENTH2MNG_WAITMODEMINIT,			"T1_PowerOnModemInit" },
+
+	{ STATE_MQTTCLIENTH2MNG_WAITMODEMINIT,			EVT_ENTRY | MQTT_EVT_TIMER_FIRED,							GuardModemRetry,				ActionRetryModemInit,					STATE_MQTTCLIENTH2MNG_WAITMODEMINIT,			"T1_RetryModemInit" },
+	{ STATE_MQTTCLIENTH2MNG_WAITMODEMINIT,			EVT_ENTRY | MQTT_EVT_TIMER_FIRED | MQTT_EVT_LINK_DOWN,		GuardModemConnected,			ActionModemConnected,					STATE_MQTTCLIENTH2MNG_WAITMQTTCLIENTCONNECT,	"T2_ModemConnected" },
+
+	{ STATE_MQTTCLIENTH2MNG_WAITMQTTCLIENTCONNECT,	EVT_ENTRY | MQTT_EVT_TIMER_FIRED | MQTT_EVT_LINK_DOWN,		GuardModemNotConnected,			ActionModemInit,						STATE_MQTTCLIENTH2MNG_WAITMODEMINIT,			"T1_RetryModemInit" },
+	{ STATE_MQTTCLIENTH2MNG_WAITMQTTCLIENTCONNECT,	EVT_ENTRY | MQTT_EVT_STANDBY_READY | MQTT_EVT_TIMER_FIRED | MQTT_EVT_LINK_DOWN,	GuardStandbyTakeover,			ActionStandbyTakeover,					STATE_MQTTCLIENTH2MNG_WAITFORDATA,				"T2_StandbyTakeover" },
+	{ STATE_MQTTCLIENTH2MNG_WAITMQTTCLIENTCONNECT,	EVT_ENTRY | MQTT_EVT_TIMER_FIRED,							GuardConnectRetry,				ActionRetryMqttConnectRequest,			STATE_MQTTCLIENTH2MNG_WAITMQTTCLIENTCONNECT,	"T3_RetryMqttConnectRequest" },
+	{ STATE_MQTTCLIENTH2MNG_WAITMQTTCLIENTCONNECT,	EVT_ENTRY | MQTT_EVT_BYTES_READABLE | MQTT_EVT_TIMER_FIRED,	GuardConnected,					ActionMqttClientConnectionEstablished,	STATE_MQTTCLIENTH2MNG_WAITFORDATA,				"T4_MqttClientConnectionEstablished" },
+	{ STATE_MQTTCLIENTH2MNG_WAITMQTTCLIENTCONNECT,	EVT_ENTRY | MQTT_EVT_UPLINK_CHANGED,						GuardUplinkChanged,				ActionReconnect,						STATE_MQTTCLIENTH2MNG_WAITMQTTCLIENTCONNECT,	"T5_UplinkChanged" },
+
+	{ STATE_MQTTCLIENTH2MNG_WAITFORDATA,			EVT_ENTRY | MQTT_EVT_TIMER_FIRED | MQTT_EVT_LINK_DOWN,		GuardModemNotConnected,			ActionModemInit,						STATE_MQTTCLIENTH2MNG_WAITMODEMINIT,			"T1_RetryModemConnection" },
+	{ STATE_MQTTCLIENTH2MNG_WAITFORDATA,			EVT_ENTRY | MQTT_EVT_TIMER_FIRED,							GuardTimeToPing,				ActionSendPingRequest,					STATE_MQTTCLIENTH2MNG_WAITFORDATA,				"T2_SendPingRequest" },
+	{ STATE_MQTTCLIENTH2MNG_WAITFORDATA,			EVT_ENTRY | MQTT_EVT_TIMER_FIRED | MQTT_EVT_LINK_DOWN,		GuardFailover,					ActionFailover,							STATE_MQTTCLIENTH2MNG_WAITFORDATA,				"T3_FailoverToStandby" },
+	{ STATE_MQTTCLIENTH2MNG_WAITFORDATA,			EVT_ENTRY | MQTT_EVT_TIMER_FIRED,							GuardPingRespTimeout,			ActionHalfOpenReconnect,				STATE_MQTTCLIENTH2MNG_WAITMQTTCLIENTCONNECT,	"T4_HalfOpenConnection" },
+	{ STATE_MQTTCLIENTH2MNG_WAITFORDATA,			EVT_ENTRY | MQTT_EVT_DATA_SUBMITTED | MQTT_EVT_TIMER_FIRED | MQTT_EVT_LINK_DOWN,	GuardLinkDown,	ActionReconnect,						STATE_MQTTCLIENTH2MNG_WAITMQTTCLIENTCONNECT,	"T5_BrokerConnectionLost" },
+	{ STATE_MQTTCLIENTH2MNG_WAITFORDATA,			EVT_ENTRY | MQTT_EVT_DATA_SUBMITTED | MQTT_EVT_TIMER_FIRED,	GuardSpoolToSend,				ActionSendSpooled,						STATE_MQTTCLIENTH2MNG_WAITFORDATA,				"T6_SendSpooled" },
+	{ STATE_MQTTCLIENTH2MNG_WAITFORDATA,			EVT_ENTRY | MQTT_EVT_DATA_SUBMITTED | MQTT_EVT_TIMER_FIRED,	GuardOrderedToSend,				ActionSendOrdered,						STATE_MQTTCLIENTH2MNG_WAITFORDATA,				"T7_SendOrdered" },
+	{ STATE_MQTTCLIENTH2MNG_WAITFORDATA,			EVT_ENTRY | MQTT_EVT_DATA_SUBMITTED | MQTT_EVT_TIMER_FIRED,	GuardDataToSend,				ActionSendPublishRequest,				STATE_MQTTCLIENTH2MNG_SENDPUBLISHREQUEST,		"T8_SendPublishRequest" },
+	{ STATE_MQTTCLIENTH2MNG_WAITFORDATA,			EVT_ENTRY | MQTT_EVT_DATA_SUBMITTED | MQTT_EVT_TIMER_FIRED,	GuardSendBudgetExhausted,		ActionWaitSendBudget,					STATE_MQTTCLIENTH2MNG_WAITFORDATA,				"T9_WaitSendBudget" },
+	{ STATE_MQTTCLIENTH2MNG_WAITFORDATA,			MQTT_EVT_BYTES_READABLE,									NULL,							ActionReceivePackets,					STATE_MQTTCLIENTH2MNG_WAITFORDATA,				"T10_ReceivePackets" },
+
+	{ STATE_MQTTCLIENTH2MNG_SENDPUBLISHREQUEST,		EVT_ENTRY | MQTT_EVT_DATA_SUBMITTED | MQTT_EVT_TIMER_FIRED,	GuardCancelPublishRequest,		ActionCancelPublishRequest,				STATE_MQTTCLIENTH2MNG_WAITFORDATA,				"T1_CancelPublishRequest" },
+	{ STATE_MQTTCLIENTH2MNG_SENDPUBLISHREQUEST,		EVT_ENTRY | MQTT_EVT_TIMER_FIRED,							GuardPublishRequestExpired,		ActionPublishExpired,					STATE_MQTTCLIENTH2MNG_WAITFORDATA,				"T2_PublishRequestExpired" },
+	{ STATE_MQTTCLIENTH2MNG_SENDPUBLISHREQUEST,		EVT_ENTRY | MQTT_EVT_TIMER_FIRED,							GuardRetryPublishRequest,		ActionRetryPublishRequest,				STATE_MQTTCLIENTH2MNG_SENDPUBLISHREQUEST,		"T3_RetryPublishRequest" },
+	{ STATE_MQTTCLIENTH2MNG_SENDPUBLISHREQUEST,		EVT_ENTRY,													GuardPublishRequestSent,		ActionWaitForPubAck,					STATE_MQTTCLIENTH2MNG_WAITFORPUBACK,			"T4_WaitForPubAck" },
+	{ STATE_MQTTCLIENTH2MNG_SENDPUBLISHREQUEST,		EVT_ENTRY | MQTT_EVT_TIMER_FIRED,							GuardPublishRequestFailure,		ActionPublishRequestFailure,			STATE_MQTTCLIENTH2MNG_WAITFORDATA,				"T5_PublishRequestFailure" },
+
+	{ STATE_MQTTCLIENTH2MNG_WAITFORPUBACK,			EVT_ENTRY | MQTT_EVT_BYTES_READABLE | MQTT_EVT_TIMER_FIRED,	GuardPubAckReceived,			ActionDataSentNotifyService,			STATE_MQTTCLIENTH2MNG_WAITFORDATA,				"T1_DataSentNotifyService" },
+	{ STATE_MQTTCLIENTH2MNG_WAITFORPUBACK,			MQTT_EVT_TIMER_FIRED | MQTT_EVT_LINK_DOWN,					GuardPublishExpired,			ActionPublishExpired,					STATE_MQTTCLIENTH2MNG_WAITFORDATA,				"T2_PublishExpired" },
+	{ STATE_MQTTCLIENTH2MNG_WAITFORPUBACK,			MQTT_EVT_TIMER_FIRED,										GuardRetransmitPublish,			ActionRetransmitPublish,				STATE_MQTTCLIENTH2MNG_WAITFORPUBACK,			"T3_RetransmitPublish" },
+	{ STATE_MQTTCLIENTH2MNG_WAITFORPUBACK,			MQTT_EVT_TIMER_FIRED | MQTT_EVT_LINK_DOWN,					GuardFailoverPublish,			ActionFailoverPublish,					STATE_MQTTCLIENTH2MNG_WAITFORPUBACK,			"T4_FailoverPublish" },
+	{ STATE_MQTTCLIENTH2MNG_WAITFORPUBACK,			MQTT_EVT_TIMER_FIRED,										GuardPubAckTimeout,				ActionMqttClientReconnect,				STATE_MQTTCLIENTH2MNG_WAITMQTTCLIENTCONNECT,	"T5_MqttClientReconnect" },
+	{ STATE_MQTTCLIENTH2MNG_WAITFORPUBACK,			MQTT_EVT_LINK_DOWN,											GuardLinkDown,					ActionMqttClientReconnect,				STATE_MQTTCLIENTH2MNG_WAITMQTTCLIENTCONNECT,	"T6_BrokerConnectionLost" },
+};
 
 /*---------------------------------- INIT ROUTINES ---------------------------------*/
 
@@ -41,12 +132,13 @@ void MqttClientH2Mng_Init(unsigned char handler)
 {
 	if (handler <  (unsigned char)MQTTCLIENTH2MNG_NUMBER_OF_INSTANCES) {
 /* --------- BEGIN MqttClientH2Mng user instance variables initialization  -------- */
-
+		THIS(handler).client = MqttClientGetContext(handler);
 /* ---------- END MqttClientH2Mng user instance variables initialization  --------- */
 
 		/*-- State variable initialization --*/
 
 		THIS(handler).state_mqttclienth2mng = STATE_0_MQTTCLIENTH2MNG;
+		MqttClientIoPost(THIS(handler).client, EVT_ENTRY);
 
 		/*- TODO: print UART debug traces notifying state change -*/
 
@@ -61,45 +153,70 @@ void MqttClientH2Mng_Init(unsigned char handler)
 /**
  * @name MqttClientH2Mng
  * @author dr-paradox
- * @brief MqttClientH2Mng FSM
+ * @brief MqttClientH2Mng FSM: take the pending events and the first transition of the current state reacting
+ * 		  to one of them whose guard holds. Nothing is evaluated when no event is pending.
  *
  */
 void MqttClientH2Mng_Task(unsigned char handler)
 {
+	unsigned int events = 0U;
+	unsigned int idx;
+	const t_mqttclienth2mng_transition *transition = NULL;
 
 	if (handler <  (unsigned char)MQTTCLIENTH2MNG_NUMBER_OF_INSTANCES) {
 
+		events = MqttClientIoTakeEvents(THIS(handler).client);
+
 		/*-- Check FSM current state --*/
-		switch (THIS(handler).state_mqttclienth2mng){
-		case STATE_0_MQTTCLIENTH2MNG:
-			MqttClientH2Mng0(handler);
-			break;
-		case STATE_MQTTCLIENTH2MNG_SENDPUBLISHREQUEST:
-			SendPublishRequest(handler);
-			break;
-		case STATE_MQTTCLIENTH2MNG_WAITFORDATA:
-			WaitForData(handler);
-			break;
-		case STATE_MQTTCLIENTH2MNG_WAITMQTTCLIENTCONNECT:
-			WaitMqttClientConnect(handler);
-			break;
-		case STATE_MQTTCLIENTH2MNG_WAITFORPUBACK:
-			WaitForPubAck(handler);
-			break;
-		case STATE_MQTTCLIENTH2MNG_WAITMODEMINIT:
-			WaitModemInit(handler);
-			break;
-		case STATE_END_MQTTCLIENTH2MNG:
-			/*State machine is stopped*/
-			THIS(handler).state_mqttclienth2mng = STATE_END_MQTTCLIENTH2MNG;
-			break;
-		default:
-			THIS(handler).state_mqttclienth2mng = STATE_END_MQTTCLIENTH2MNG;
-			break;
+		for (idx = 0U; (events != 0U) && (idx < (sizeof(transitions) / sizeof(transitions[0]))); idx++) {
+
+			transition = &transitions[idx];
+
+			if ( (transition->state == THIS(handler).state_mqttclienth2mng) && ((transition->events & events) != 0U) &&
+				 ((transition->guard == NULL) || (true == transition->guard(THIS(handler).client))) ) {
+
+				/*-- Action of the transition --*/
+
+				transition->action(THIS(handler).client);
+
+				/*-- Requests handed off while connected hold their keys on the shard before it is seen down --*/
+
+				if ( (true == StateConnected(THIS(handler).state_mqttclienth2mng)) && (false == StateConnected(transition->next)) ) {
+					MqttClientShardDrain(THIS(handler).client);
+				}
+
+				/*-- Changing to next state --*/
+
+				THIS(handler).state_mqttclienth2mng = transition->next;
+
+				/*-- Other threads read the connection through the shard, never the state --*/
+
+				MqttClientShardSetUp(THIS(handler).client, StateConnected(transition->next));
+
+				/*-- The transitions of the new state are evaluated at once --*/
+
+				MqttClientIoPost(THIS(handler).client, EVT_ENTRY);
+				break;
+			}
 		}
+
+		/*-- No transition condition accomplished. Stay in same state, the events are consumed --*/
 	}
 }
 
+/**
+ * @name StateConnected
+ * @author dr-paradox
+ * @brief States in which the client is connected to its broker and able to publish
+ *
+ */
+static bool StateConnected(t_state_mqttclienth2mng state)
+{
+	return ( (STATE_MQTTCLIENTH2MNG_WAITFORDATA == state) ||
+			 (STATE_MQTTCLIENTH2MNG_SENDPUBLISHREQUEST == state) ||
+			 (STATE_MQTTCLIENTH2MNG_WAITFORPUBACK == state) );
+}
+
 
 /*------------------------------- GET STATES ROUTINES ------------------------------*/
 
@@ -124,382 +241,635 @@ t_state_mqttclienth2mng MqttClientH2Mng_GetState(unsigned char handler)
 }
 
 
-/*---------------------------------- STATE ROUTINE  --------------------------------*/
+/*---------------------------------- GUARD ROUTINES --------------------------------*/
 
 /**
- * @name MqttClientH2Mng0
+ * @name GuardModemNotConnected
  * @author dr-paradox
- * @brief MqttClientH2Mng first state routine
+ * @brief Modem lost its data connectivity
  *
  */
-static void MqttClientH2Mng0(unsigned char handler)
+static bool GuardModemNotConnected(t_MqttClient *client)
 {
-	/*flags to reset:
-    1. modem_connected
-    2.profile_started
-    3.ip_obtained*/
-
-    /*-- Case where transition T1_PowerOnModemInit is executed --*/
-
-	/*-- Action of the transition --*/
-
-	MqttClientResetFlags();
-    MqttClientModemInit();
-    MqttClientClearStartTimer(MODEM_REQ);
+	return (false == MqttClientCheckModemConnection(client));
+}
 
-	/*-- Changing to next state --*/
+/**
+ * @name GuardModemConnected
+ * @author dr-paradox
+ * @brief Modem started its data connectivity
+ *
+ */
+static bool GuardModemConnected(t_MqttClient *client)
+{
+	return (true == MqttClientCheckModemConnection(client));
+}
 
-	THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_WAITMODEMINIT;
+/**
+ * @name GuardModemRetry
+ * @author dr-paradox
+ * @brief Modem still not connected when its timer elapsed
+ *
+ */
+static bool GuardModemRetry(t_MqttClient *client)
+{
+	return ( (false == MqttClientCheckModemConnection(client)) && (true == MqttClientCheckTimeToRetry(client)) );
+}
 
+/**
+ * @name GuardConnectRetry
+ * @author dr-paradox
+ * @brief No CONNACK received before the timer elapsed
+ *
+ */
+static bool GuardConnectRetry(t_MqttClient *client)
+{
+	return ( (false == MqttClientCheckMqttConnection(client)) && (true == MqttClientCheckTimeToRetry(client)) );
 }
 
 /**
- * @name SendPublishRequest
+ * @name GuardConnected
  * @author dr-paradox
- * @brief Json message to be published to Mqtt broker
+ * @brief CONNACK received, connection accepted
  *
  */
-static void SendPublishRequest(unsigned char handler)
+static bool GuardConnected(t_MqttClient *client)
 {
-	/*-- Code of the current state --*/
+	return (true == MqttClientCheckMqttConnection(client));
+}
 
-	bool request_to_cancel = false;;
-    uint8_t retry_count = ZERO;;
-    uint8_t publish_req_status = FAILURE;;
-    request_to_cancel = MqttClientCheckRequestToCancel();;
-    retry_count = MqttClientCheckRetryCount();;
-    publish_req_status = MqttClientCheckPubReqStatus();;
+/**
+ * @name GuardTimeToPing
+ * @author dr-paradox
+ * @brief Ping timer elapsed while no data is waiting, or while ordered requests wait for their PUBACK: the ping then
+ * 		  detects a half open connection they would wait on forever
+ *
+ */
+static bool GuardTimeToPing(t_MqttClient *client)
+{
+	return ( (true == MqttClientCheckTimeToPing(client)) &&
+			 ((0U == MqttClientQueueDepth(client)) || (0U != MqttClientQueueOrderedInFlight(client))) );
+}
 
-	if ( (true == request_to_cancel) && (FAILURE == publish_req_status) ) {
+/**
+ * @name GuardPingRespTimeout
+ * @author dr-paradox
+ * @brief Nothing received from the broker within the deadline of the ping request
+ *
+ */
+static bool GuardPingRespTimeout(t_MqttClient *client)
+{
+	return (true == MqttClientCheckPingRespTimeout(client));
+}
 
-		/*-- Case where transition T1_CancelPublishRequest is executed --*/
+/**
+ * @name GuardSpoolToSend
+ * @author dr-paradox
+ * @brief Spooled messages are waiting to be published, the kernel has room for them in the send budget and no request of
+ * 		  a more urgent service waits
+ *
+ */
+static bool GuardSpoolToSend(t_MqttClient *client)
+{
+	return (true == MqttClientCheckSpoolToSend(client));
+}
 
-		/*-- Action of the transition --*/
+/**
+ * @name GuardOrderedToSend
+ * @author dr-paradox
+ * @brief A request with an ordering key can be published: no request of its key in flight, room in the window of
+ * 		  ordered requests and in the send budget, and no request of a more urgent service waits
+ *
+ */
+static bool GuardOrderedToSend(t_MqttClient *client)
+{
+	return (true == MqttClientCheckOrderedToSend(client));
+}
 
-		MqttClientClearRetryCount();
-        MqttClientServiceNotify(SERVERCOM_CANCELED);
+/**
+ * @name GuardDataToSend
+ * @author dr-paradox
+ * @brief A request is waiting to be published and the kernel has room for it in the send budget. The budget is
+ * 		  checked first, the request is not taken from its queue while a more urgent one may still overtake it
+ *
+ */
+static bool GuardDataToSend(t_MqttClient *client)
+{
+	return ( (true == MqttClientCheckSendBudget(client)) && (true == MqttClientCheckDataToSend(client)) );
+}
 
-		/*-- Entry of destination state --*/
+/**
+ * @name GuardSendBudgetExhausted
+ * @author dr-paradox
+ * @brief Requests are queued or spooled but the kernel holds the whole send budget, and nothing checks it again yet
+ *
+ */
+static bool GuardSendBudgetExhausted(t_MqttClient *client)
+{
+	return ( ((0U != MqttClientQueueDepth(client)) || (0U != MqttClientSpoolDepth(client))) && (false == MqttClientCheckTimerRunning(client, SEND_BUDGET)) &&
+			 (false == MqttClientCheckSendBudget(client)) );
+}
 
-		MqttClientClearStartTimer(PING_REQ);;
+/**
+ * @name GuardLinkDown
+ * @author dr-paradox
+ * @brief Connection closed by the broker
+ *
+ */
+static bool GuardLinkDown(t_MqttClient *client)
+{
+	return (true == MqttClientCheckLinkDown(client));
+}
 
-		/*-- Changing to next state --*/
+/**
+ * @name GuardUplinkChanged
+ * @author dr-paradox
+ * @brief The uplink changed and closed the connection or brought the network back, no need to wait for the
+ * 		  timers before connecting again
+ *
+ */
+static bool GuardUplinkChanged(t_MqttClient *client)
+{
+	return ( (true == MqttClientCheckUplinkChanged(client)) && (true == MqttClientCheckLinkDown(client)) );
+}
 
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_WAITFORDATA;
+/**
+ * @name GuardCancelPublishRequest
+ * @author dr-paradox
+ * @brief Active request canceled before it was sent
+ *
+ */
+static bool GuardCancelPublishRequest(t_MqttClient *client)
+{
+	return ( (true == MqttClientCheckRequestToCancel(client)) && (FAILURE == MqttClientCheckPubReqStatus(client)) );
+}
 
-	}
+/**
+ * @name GuardPublishRequestExpired
+ * @author dr-paradox
+ * @brief Active request not sent and its time to live elapsed, it is not retried
+ *
+ */
+static bool GuardPublishRequestExpired(t_MqttClient *client)
+{
+	return ( (FAILURE == MqttClientCheckPubReqStatus(client)) && (true == MqttClientCheckRequestExpired(client)) );
+}
 
+/**
+ * @name GuardRetryPublishRequest
+ * @author dr-paradox
+ * @brief Publish request not sent, retries left
+ *
+ */
+static bool GuardRetryPublishRequest(t_MqttClient *client)
+{
 	/*MAX_REQ_RETRY_COUNT = ((uint8_t)3)*/
-	else if ( (retry_count < MAX_REQ_RETRY_COUNT) && (FAILURE == publish_req_status) && (false == request_to_cancel) ) {
-
-		/*-- Case where transition T2_RetryPublishRequest is executed --*/
-
-		/*-- Action of the transition --*/
-
-		MqttClientSendPubRequest();
-        MqttClientIncrementRetryCount();
-
-		/*-- Changing to next state --*/
-
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_SENDPUBLISHREQUEST;
-
-	}
-
-	else if ( SUCCESS== publish_req_status  ) {
-
-		/*-- Case where transition T3_WaitForPubAck is executed --*/
-
-		/*-- Action of the transition --*/
-
-		MqttClientClearRetryCount();
-        MqttClientClearStartTimer(KEEP_ALIVE);
-
-		/*-- Changing to next state --*/
-
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_WAITFORPUBACK;
-
-	}
-
-	else if ( (retry_count >= MAX_REQ_RETRY_COUNT) && (FAILURE == publish_req_status) ) {
-
-		/*-- Case where transition T4_PublishRequestFailure is executed --*/
-
-		/*-- Action of the transition --*/
-
-		MqttClientClearRetryCount();
-        MqttClientServiceNotify(SERVERCOM_ERROR);
-
-		/*-- Entry of destination state --*/
-
-		MqttClientClearStartTimer(PING_REQ);;
-
-		/*-- Changing to next state --*/
-
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_WAITFORDATA;
-
-	}
-
-	else {
-
-		/*-- No transition condition accomplished. Stay in same state --*/
-
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_SENDPUBLISHREQUEST;
-	}
+	return ( (MqttClientCheckRetryCount(client) < MAX_REQ_RETRY_COUNT) && (FAILURE == MqttClientCheckPubReqStatus(client)) &&
+			 (false == MqttClientCheckRequestToCancel(client)) );
 }
 
 /**
- * @name WaitForData
+ * @name GuardPublishRequestSent
  * @author dr-paradox
- * @brief Write brief explanation here
+ * @brief Publish request sent
  *
  */
-static void WaitForData(unsigned char handler)
+static bool GuardPublishRequestSent(t_MqttClient *client)
 {
-	/*-- Code of the current state --*/
-
-	bool modem_is_connected = false;;
-    bool data_is_available = false;;
-    bool time_to_ping = false;;
-    modem_is_connected = MqttClientCheckModemConnection();;
-    data_is_available = MqttClientCheckDataToSend();;
-    time_to_ping = MqttClientCheckTimeToPing();;
-
-    if ( false == modem_is_connected ) {
-
-		/*-- Case where transition T1_RetryModemConnection is executed --*/
-
-		/*-- Action of the transition --*/
-
-    	MqttClientModemInit();
-
-		/*-- Changing to next state --*/
-
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_WAITMODEMINIT;
-
-	}
-
-    else if ( (true == time_to_ping) && (false == data_is_available) ) {
-
-		/*-- Case where transition T2_SendPingRequest is executed --*/
-
-		/*-- Action of the transition --*/
-
-		MqttClientSendPingRequest();
-
-		/*-- Entry of destination state --*/
-
-		MqttClientClearStartTimer(PING_REQ);;
-
-		/*-- Changing to next state --*/
-
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_WAITFORDATA;
-
-	}
-
-	else if ( true == data_is_available ) {
-
-		/*-- Case where transition T3_SendPublishRequest is executed --*/
-
-		/*-- Action of the transition --*/
-
-		MqttClientSendPubRequest();
-        MqttClientDecrementRetryCount();
-
-		/*-- Changing to next state --*/
-
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_SENDPUBLISHREQUEST;
-
-	}
-
-	else {
-
-		/*-- No transition condition accomplished. Stay in same state --*/
-
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_WAITFORDATA;
-	}
+	return (SUCCESS == MqttClientCheckPubReqStatus(client));
 }
 
 /**
- * @name WaitMqttClientConnect
+ * @name GuardPublishRequestFailure
  * @author dr-paradox
- * @brief Wait till Mqtt client connects to Mqtt broker
+ * @brief Publish request not sent, no retry left
  *
  */
-static void WaitMqttClientConnect(unsigned char handler)
+static bool GuardPublishRequestFailure(t_MqttClient *client)
 {
-	/*-- Code of the current state --*/
-
-	bool modem_is_connected = false;;
-    bool mqtt_client_is_connected = false;;
-    bool time_to_retry = false;;
-    modem_is_connected = MqttClientCheckModemConnection();;
-    mqtt_client_is_connected = MqttClientCheckMqttConnection();;
-    time_to_retry  = MqttClientCheckTimeToRetry();;
-
-    if ( false == modem_is_connected ) {
-
-		/*-- Case where transition T1_RetryModemInit is executed --*/
-
-		/*-- Action of the transition --*/
-
-    	MqttClientModemInit();
-    	MqttClientClearStartTimer(MODEM_REQ);
-
-		/*-- Changing to next state --*/
-
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_WAITMODEMINIT;
-
-	}
-
-    else if ( (false == mqtt_client_is_connected) && (true == time_to_retry)  ) {
-
-		/*-- Case where transition T2_RetryMqttConnectRequest is executed --*/
-
-		/*-- Action of the transition --*/
-
-		MqttClientClearRetryCount();
-        MqttClientServiceNotify(SERVERCOM_TIMEOUT);
-        MqttClientSendConnectRequest();
-        MqttClientClearStartTimer(KEEP_ALIVE);
-
-		/*-- Changing to next state --*/
-
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_WAITMQTTCLIENTCONNECT;
-
-	}
-
-	else if ( true == mqtt_client_is_connected  ) {
+	return ( (MqttClientCheckRetryCount(client) >= MAX_REQ_RETRY_COUNT) && (FAILURE == MqttClientCheckPubReqStatus(client)) );
+}
 
-		/*-- Case where transition T3_MqttClientConnectionEstablished is executed --*/
+/**
+ * @name GuardPubAckReceived
+ * @author dr-paradox
+ * @brief PUBACK received for the active request
+ *
+ */
+static bool GuardPubAckReceived(t_MqttClient *client)
+{
+	return (SUCCESS == MqttClientCheckPubAckRspStatus(client));
+}
 
-		/*-- Entry of destination state --*/
+/**
+ * @name GuardPubAckTimeout
+ * @author dr-paradox
+ * @brief No PUBACK received before the timer elapsed and every retransmission done, PUBACK was checked by the first transition
+ *
+ */
+static bool GuardPubAckTimeout(t_MqttClient *client)
+{
+	return ( (true == MqttClientCheckRspTimerStatus(client)) && (MqttClientCheckRetransmitCount(client) >= MAX_REQ_RETRY_COUNT) );
+}
 
-		MqttClientClearStartTimer(PING_REQ);;
+/**
+ * @name GuardPublishExpired
+ * @author dr-paradox
+ * @brief No PUBACK received before the timer elapsed or connection lost, and the time to live of the request in flight
+ * 		  elapsed: it is neither retransmitted nor kept for the next connection
+ *
+ */
+static bool GuardPublishExpired(t_MqttClient *client)
+{
+	return ( ((true == MqttClientCheckRspTimerStatus(client)) || (true == MqttClientCheckLinkDown(client))) &&
+			 (true == MqttClientCheckRequestExpired(client)) );
+}
 
-		/*-- Changing to next state --*/
+/**
+ * @name GuardRetransmitPublish
+ * @author dr-paradox
+ * @brief No PUBACK received before the timer elapsed, retransmissions left
+ *
+ */
+static bool GuardRetransmitPublish(t_MqttClient *client)
+{
+	return ( (true == MqttClientCheckRspTimerStatus(client)) && (MqttClientCheckRetransmitCount(client) < MAX_REQ_RETRY_COUNT) );
+}
 
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_WAITFORDATA;
+/**
+ * @name GuardStandbyTakeover
+ * @author dr-paradox
+ * @brief The broker of the session could not be reached or sent no CONNACK in time while the standby connection is
+ * 		  accepted, it takes over instead of a new attempt
+ *
+ */
+static bool GuardStandbyTakeover(t_MqttClient *client)
+{
+	return ( (true == MqttClientFailoverStandbyReady(client)) && (false == MqttClientCheckMqttConnection(client)) &&
+			 ((true == MqttClientCheckLinkDown(client)) || (true == MqttClientCheckTimeToRetry(client))) );
+}
 
-	}
+/**
+ * @name GuardFailover
+ * @author dr-paradox
+ * @brief Connection lost or half open while the standby connection is accepted
+ *
+ */
+static bool GuardFailover(t_MqttClient *client)
+{
+	return ( (true == MqttClientFailoverStandbyReady(client)) &&
+			 ((true == MqttClientCheckLinkDown(client)) || (true == MqttClientCheckPingRespTimeout(client))) );
+}
 
-	else {
+/**
+ * @name GuardFailoverPublish
+ * @author dr-paradox
+ * @brief Connection lost or every retransmission of the publish in flight done while the standby connection is accepted
+ *
+ */
+static bool GuardFailoverPublish(t_MqttClient *client)
+{
+	return ( (true == MqttClientFailoverStandbyReady(client)) &&
+			 ((true == MqttClientCheckLinkDown(client)) || (true == GuardPubAckTimeout(client))) );
+}
 
-		/*-- No transition condition accomplished. Stay in same state --*/
+/*--------------------------------- ACTION ROUTINES --------------------------------*/
 
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_WAITMQTTCLIENTCONNECT;
-	}
+/**
+ * @name ActionPowerOnModemInit
+ * @author dr-paradox
+ * @brief Reset modem_connected, profile_started and ip_obtained flags and start the modem
+ *
+ */
+static void ActionPowerOnModemInit(t_MqttClient *client)
+{
+	MqttClientResetFlags(client);
+	MqttClientModemInit(client);
+	MqttClientClearStartTimer(client, MODEM_REQ);
 }
 
 /**
- * @name WaitForPubAck
+ * @name ActionModemInit
  * @author dr-paradox
- * @brief Write brief explanation here
+ * @brief Start the modem again
  *
  */
-static void WaitForPubAck(unsigned char handler)
+static void ActionModemInit(t_MqttClient *client)
 {
-	/*-- Code of the current state --*/
+	MqttClientModemInit(client);
+	MqttClientClearStartTimer(client, MODEM_REQ);
+}
 
-	uint8_t puback_rsp_status = FAILURE;;
-    bool timer_expired = false;;
-    puback_rsp_status = MqttClientCheckPubAckRspStatus();;
-    timer_expired = MqttClientCheckRspTimerStatus();;
+/**
+ * @name ActionRetryModemInit
+ * @author dr-paradox
+ * @brief Fail the pending requests and start the modem again
+ *
+ */
+static void ActionRetryModemInit(t_MqttClient *client)
+{
+	MqttClientServiceNotifyAll(client, SERVERCOM_TIMEOUT);
+	MqttClientModemInit(client);
+	MqttClientClearStartTimer(client, MODEM_REQ);
+}
 
-	if ( SUCCESS == puback_rsp_status ) {
+/**
+ * @name ActionModemConnected
+ * @author dr-paradox
+ * @brief Connect to the broker
+ *
+ */
+static void ActionModemConnected(t_MqttClient *client)
+{
+	MqttClientStopTimer(client, MODEM_REQ);
+	MqttClientSendConnectRequest(client);
+	MqttClientStartConnectTimer(client);
+}
 
-		/*-- Case where transition T1_DataSentNotifyService is executed --*/
+/**
+ * @name ActionRetryMqttConnectRequest
+ * @author dr-paradox
+ * @brief Fail the pending requests and connect to the broker again
+ *
+ */
+static void ActionRetryMqttConnectRequest(t_MqttClient *client)
+{
+	MqttClientServiceNotifyAll(client, SERVERCOM_TIMEOUT);
+	MqttClientSendConnectRequest(client);
+	MqttClientStartConnectTimer(client);
+}
 
-		/*-- Action of the transition --*/
+/**
+ * @name ActionMqttClientConnectionEstablished
+ * @author dr-paradox
+ * @brief Stop the CONNACK timer and start the ping timer
+ *
+ */
+static void ActionMqttClientConnectionEstablished(t_MqttClient *client)
+{
+	MqttClientStopTimer(client, KEEP_ALIVE);
+	MqttClientStartStableTimer(client);
 
-		MqttClientServiceNotify(SERVERCOM_OK);
+	/*-- Entry of destination state --*/
 
-		/*-- Entry of destination state --*/
+	MqttClientClearStartTimer(client, PING_REQ);
+}
 
-		MqttClientClearStartTimer(PING_REQ);;
+/**
+ * @name ActionSendPingRequest
+ * @author dr-paradox
+ * @brief Send a ping request and start the ping timer again
+ *
+ */
+static void ActionSendPingRequest(t_MqttClient *client)
+{
+	MqttClientSendPingRequest(client);
 
-		/*-- Changing to next state --*/
+	/*-- Entry of destination state --*/
 
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_WAITFORDATA;
+	MqttClientClearStartTimer(client, PING_REQ);
+}
 
-	}
+/**
+ * @name ActionHalfOpenReconnect
+ * @author dr-paradox
+ * @brief Close the connection the broker stopped answering on and connect again
+ *
+ */
+static void ActionHalfOpenReconnect(t_MqttClient *client)
+{
+	MqttClientStopTimer(client, PING_REQ);
+	MqttClientTransportClose(client);
+	MqttClientSendConnectRequest(client);
+	MqttClientStartConnectTimer(client);
+}
 
-	else if ( (puback_rsp_status != SUCCESS) && (true == timer_expired) ) {
+/**
+ * @name ActionWaitSendBudget
+ * @author dr-paradox
+ * @brief Check the kernel backlog again after a fraction of the round trip
+ *
+ */
+static void ActionWaitSendBudget(t_MqttClient *client)
+{
+	MqttClientClearStartTimer(client, SEND_BUDGET);
+}
 
-		/*-- Case where transition T2_MqttClientReconnect is executed --*/
+/**
+ * @name ActionSendSpooled
+ * @author dr-paradox
+ * @brief Publish spooled messages up to the send budget, their PUBACKs are read in WAITFORDATA
+ *
+ */
+static void ActionSendSpooled(t_MqttClient *client)
+{
+	MqttClientSendSpooled(client);
+}
 
-		/*-- Action of the transition --*/
+/**
+ * @name ActionSendOrdered
+ * @author dr-paradox
+ * @brief Publish requests with an ordering key up to the send budget, their PUBACKs are read in WAITFORDATA
+ *
+ */
+static void ActionSendOrdered(t_MqttClient *client)
+{
+	MqttClientSendOrdered(client);
+}
 
-		MqttClientServiceNotify(SERVERCOM_ERROR);
-        MqttClientDisconnect();
-        MqttClientClearStartTimer(KEEP_ALIVE);
+/**
+ * @name ActionSendPublishRequest
+ * @author dr-paradox
+ * @brief Publish the active request
+ *
+ */
+static void ActionSendPublishRequest(t_MqttClient *client)
+{
+	MqttClientSendPubRequest(client);
+	MqttClientDecrementRetryCount(client);
+}
 
-		/*-- Changing to next state --*/
+/**
+ * @name ActionReconnect
+ * @author dr-paradox
+ * @brief Connect to the broker again after the connection was closed
+ *
+ */
+static void ActionReconnect(t_MqttClient *client)
+{
+	MqttClientSendConnectRequest(client);
+	MqttClientStartConnectTimer(client);
+}
 
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_WAITMQTTCLIENTCONNECT;
+/**
+ * @name ActionReceivePackets
+ * @author dr-paradox
+ * @brief Process the packets received while idle, the socket would stay readable otherwise
+ *
+ */
+static void ActionReceivePackets(t_MqttClient *client)
+{
+	MqttClientReceivePackets(client);
+}
 
-	}
+/**
+ * @name ActionCancelPublishRequest
+ * @author dr-paradox
+ * @brief Notify the service of the canceled request
+ *
+ */
+static void ActionCancelPublishRequest(t_MqttClient *client)
+{
+	MqttClientClearRetryCount(client);
+	MqttClientServiceNotify(client, SERVERCOM_CANCELED);
 
-	else {
+	/*-- Entry of destination state --*/
 
-		/*-- No transition condition accomplished. Stay in same state --*/
+	MqttClientClearStartTimer(client, PING_REQ);
+}
 
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_WAITFORPUBACK;
-	}
+/**
+ * @name ActionRetryPublishRequest
+ * @author dr-paradox
+ * @brief Publish the active request again
+ *
+ */
+static void ActionRetryPublishRequest(t_MqttClient *client)
+{
+	MqttClientSendPubRequest(client);
+	MqttClientIncrementRetryCount(client);
 }
 
 /**
- * @name WaitModemInit
+ * @name ActionWaitForPubAck
  * @author dr-paradox
- * @brief Wait for ModemDataMng to start data connectivity.
+ * @brief Start the PUBACK timer
  *
  */
-static void WaitModemInit(unsigned char handler)
+static void ActionWaitForPubAck(t_MqttClient *client)
 {
-	/*-- Code of the current state --*/
+	MqttClientClearRetryCount(client);
+	MqttClientClearStartTimer(client, PUBACK_RSP);
+}
 
-	bool modem_is_connected = false;;
-    bool time_to_retry = false;;
-    modem_is_connected = MqttClientCheckModemConnection();;
-    time_to_retry  = MqttClientCheckTimeToRetry();;
+/**
+ * @name ActionPublishRequestFailure
+ * @author dr-paradox
+ * @brief Notify the service of the failed request
+ *
+ */
+static void ActionPublishRequestFailure(t_MqttClient *client)
+{
+	MqttClientClearRetryCount(client);
+	MqttClientServiceNotify(client, SERVERCOM_ERROR);
 
-	if ( (false == modem_is_connected) && (true == time_to_retry)  ) {
+	/*-- Entry of destination state --*/
 
-		/*-- Case where transition T1_RetryModemInit is executed --*/
+	MqttClientClearStartTimer(client, PING_REQ);
+}
 
-		/*-- Action of the transition --*/
+/**
+ * @name ActionDataSentNotifyService
+ * @author dr-paradox
+ * @brief Notify the service of the acknowledged request
+ *
+ */
+static void ActionDataSentNotifyService(t_MqttClient *client)
+{
+	MqttClientServiceNotify(client, SERVERCOM_OK);
+	MqttClientStopTimer(client, PUBACK_RSP);
 
-		MqttClientClearRetryCount();
-        MqttClientServiceNotify(SERVERCOM_TIMEOUT);
-        MqttClientModemInit();
-        MqttClientClearStartTimer(MODEM_REQ);
+	/*-- Entry of destination state --*/
 
-		/*-- Changing to next state --*/
+	MqttClientClearStartTimer(client, PING_REQ);
+}
 
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_WAITMODEMINIT;
+/**
+ * @name ActionMqttClientReconnect
+ * @author dr-paradox
+ * @brief Notify the service of the unacknowledged request and reconnect
+ *
+ */
+static void ActionMqttClientReconnect(t_MqttClient *client)
+{
+	MqttClientStopTimer(client, PUBACK_RSP);
+	MqttClientServiceNotify(client, SERVERCOM_ERROR);
+	MqttClientDisconnect(client);
+	MqttClientStartBackoffTimer(client);
+}
 
-	}
+/**
+ * @name ActionRetransmitPublish
+ * @author dr-paradox
+ * @brief Publish the unacknowledged request again with the DUP flag and wait for its PUBACK again
+ *
+ */
+static void ActionRetransmitPublish(t_MqttClient *client)
+{
+	MqttClientRetransmitPubRequest(client);
+	MqttClientClearStartTimer(client, PUBACK_RSP);
+}
 
-	else if ( true == modem_is_connected ) {
+/**
+ * @name ActionPublishExpired
+ * @author dr-paradox
+ * @brief Notify the service of the expired request, the link is spent on the next one
+ *
+ */
+static void ActionPublishExpired(t_MqttClient *client)
+{
+	MqttClientStopTimer(client, PUBACK_RSP);
+	MqttClientClearRetryCount(client);
+	MqttClientServiceNotify(client, SERVERCOM_EXPIRED);
 
-		/*-- Case where transition T2_ModemConnected is executed --*/
+	/*-- Entry of destination state --*/
 
-		/*-- Action of the transition --*/
+	MqttClientClearStartTimer(client, PING_REQ);
+}
 
-		MqttClientSendConnectRequest();
-        MqttClientClearStartTimer(KEEP_ALIVE);
+/**
+ * @name ActionStandbyTakeover
+ * @author dr-paradox
+ * @brief Move the session onto the standby connection, the connect timer is no longer needed
+ *
+ */
+static void ActionStandbyTakeover(t_MqttClient *client)
+{
+	(void)MqttClientFailoverPromote(client);
+	MqttClientStopTimer(client, KEEP_ALIVE);
+	MqttClientStartStableTimer(client);
 
-		/*-- Changing to next state --*/
+	/*-- Entry of destination state --*/
 
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_WAITMQTTCLIENTCONNECT;
+	MqttClientClearStartTimer(client, PING_REQ);
+}
 
-	}
+/**
+ * @name ActionFailover
+ * @author dr-paradox
+ * @brief Move the session onto the standby connection
+ *
+ */
+static void ActionFailover(t_MqttClient *client)
+{
+	(void)MqttClientFailoverPromote(client);
 
-	else {
+	/*-- Entry of destination state --*/
 
-		/*-- No transition condition accomplished. Stay in same state --*/
+	MqttClientClearStartTimer(client, PING_REQ);
+}
 
-		THIS(handler).state_mqttclienth2mng = STATE_MQTTCLIENTH2MNG_WAITMODEMINIT;
-	}
+/**
+ * @name ActionFailoverPublish
+ * @author dr-paradox
+ * @brief Move the session onto the standby connection and publish the request in flight there
+ *
+ */
+static void ActionFailoverPublish(t_MqttClient *client)
+{
+	(void)MqttClientFailoverPromote(client);
+	MqttClientSendPubRequest(client);
+	MqttClientClearStartTimer(client, PUBACK_RSP);
 }
 
 /*------------------------------- TERMINATE ROUTINES -------------------------------*/
@@ -517,9 +887,9 @@ void MqttClientH2Mng_Terminate(unsigned char handler)
 	if (handler <  (unsigned char)MQTTCLIENTH2MNG_NUMBER_OF_INSTANCES) {
 
 		THIS(handler).state_mqttclienth2mng = STATE_END_MQTTCLIENTH2MNG;
+		MqttClientShardSetUp(THIS(handler).client, false);
 /* --------------------------- BEGIN TERMINATE ACTIONS  --------------------------- */
-		(void)MqttClientTransportClose();
+		(void)MqttClientTransportClose(THIS(handler).client);
 /* ---------------------------- END TERMINATE ACTIONS  ---------------------------- */
 	}
 }
-
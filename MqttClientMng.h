@@ -8,14 +8,15 @@
 #define _MQTTCLIENTMNG_H
 
 /* ------------------- BEGIN PERSISTENT NUMBER OF FSM INSTANCES  ------------------ */
-#define MQTTCLIENTH2MNG_NUMBER_OF_INSTANCES 1u
+#define MQTTCLIENTH2MNG_NUMBER_OF_INSTANCES MQTT_MAX_CLIENTS
 /* -------------------- END PERSISTENT NUMBER OF FSM INSTANCES  ------------------- */
 
 /*------------------------------------ INCLUDES ------------------------------------*/
 
 /* -------------------------- BEGIN USER MANUAL INCLUDES  ------------------------- */
 
-#include "MqttClientFunctions.h"
+#include <stdbool.h>
+#include "MqttClient.h"
 
 /* --------------------------- END USER MANUAL INCLUDES  -------------------------- */
 
@@ -34,10 +35,26 @@ typedef enum {
 typedef struct {
 	t_state_mqttclienth2mng state_mqttclienth2mng;
 /* --------------------------- BEGIN INSTANCE VARIABLES  -------------------------- */
-
+	t_MqttClient *client;	/*client context driven by the instance*/
 /* ---------------------------- END INSTANCE VARIABLES  --------------------------- */
 } t_mqttclienth2mng_instance_struct;
 
+/* Guard of a transition, NULL when the transition is taken on any of its events */
+typedef bool (*t_mqttclienth2mng_guard)(t_MqttClient *client);
+
+/* Action of a transition, including the entry actions of the destination state */
+typedef void (*t_mqttclienth2mng_action)(t_MqttClient *client);
+
+/* Transition of the FSM, only evaluated when one of its events is pending */
+typedef struct {
+	t_state_mqttclienth2mng		state;		/*source state*/
+	unsigned int				events;		/*MQTT_EVT_xxx the transition reacts to*/
+	t_mqttclienth2mng_guard		guard;		/*condition to take the transition*/
+	t_mqttclienth2mng_action	action;		/*action of the transition*/
+	t_state_mqttclienth2mng		next;		/*destination state*/
+	const char					*name;		/*name of the transition in the FSM model*/
+} t_mqttclienth2mng_transition;
+
 /* ------------------------------- BEGIN USER CODE  ------------------------------- */
 
 /* -------------------------------- END USER CODE  -------------------------------- */
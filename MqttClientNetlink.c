@@ -0,0 +1,384 @@
+/**************************************************************************//**
+*  @par Language: C
+*******************************************************************************
+*  @par 	Project:
+*  @brief   MqttClient uplink monitoring implementation
+*  @author  dr-paradox
+*  @version 1.0.0
+*******************************************************************************
+*  @ref 	MqttClient "API Reference"
+*  @file 	MqttClientNetlink.c
+*******************************************************************************/
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <ifaddrs.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include "MqttClientNetlink.h"
+#include "MqttClientContext.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* Invalid file descriptor */
+#define INVALID_FD					((int)-1)
+
+/* Size of the receive buffer, a dump of a busy routing table comes in several reads */
+#define NETLINK_BUFFER_SIZE			((int)8192)
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* ---------------------------- Global Variables ---------------------------- */
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+ * @brief	Tell whether a link notification concerns the connection: the uplink went down while connected,
+ * 			or came up while disconnected.
+ *
+ * @param[in]	: netlink	: uplink watcher
+ * @param[in]	: nlh		: notification
+ * @param[in]	: connected	: socket connected to the broker
+ * @return 	bool
+ *
+*/
+static bool MqttClientNetlinkLinkChanged(const t_MqttNetlink *netlink, const struct nlmsghdr *nlh, bool connected);
+
+/**
+ * @brief	Tell whether an address notification concerns the connection: the local address of the socket was
+ * 			removed, or the uplink got another address (the modem attached again).
+ *
+ * @param[in]	: netlink	: uplink watcher
+ * @param[in]	: nlh		: notification
+ * @param[in]	: connected	: socket connected to the broker
+ * @return 	bool
+ *
+*/
+static bool MqttClientNetlinkAddrChanged(const t_MqttNetlink *netlink, const struct nlmsghdr *nlh, bool connected);
+
+/**
+ * @brief	Tell whether a route notification concerns the connection: the default route of the uplink was
+ * 			removed while connected, or one was added while disconnected.
+ *
+ * @param[in]	: netlink	: uplink watcher
+ * @param[in]	: nlh		: notification
+ * @param[in]	: connected	: socket connected to the broker
+ * @return 	bool
+ *
+*/
+static bool MqttClientNetlinkRouteChanged(const t_MqttNetlink *netlink, const struct nlmsghdr *nlh, bool connected);
+
+/* -------------------------------- Routines -------------------------------- */
+
+/**
+ * @brief	Tell whether a link notification concerns the connection: the uplink went down while connected,
+ * 			or came up while disconnected.
+ *
+ * @param[in]	: netlink	: uplink watcher
+ * @param[in]	: nlh		: notification
+ * @param[in]	: connected	: socket connected to the broker
+ * @return 	bool
+ *
+*/
+static bool MqttClientNetlinkLinkChanged(const t_MqttNetlink *netlink, const struct nlmsghdr *nlh, bool connected)
+{
+	const struct ifinfomsg *ifi = (const struct ifinfomsg *)NLMSG_DATA(nlh);
+	bool running = ( (RTM_NEWLINK == nlh->nlmsg_type) && (0U != (ifi->ifi_flags & IFF_RUNNING)) );
+	bool changed = false;
+
+	/* while the uplink is unknown any interface coming up may bring the broker back */
+	if ( (0 != netlink->uplink_ifindex) && (ifi->ifi_index != netlink->uplink_ifindex) )
+	{
+		changed = false;
+	}
+	else if ( (true == connected) && (false == running) )
+	{
+		printf("MqttClient: Uplink %d down", ifi->ifi_index);
+		changed = true;
+	}
+	else if ( (false == connected) && (true == running) )
+	{
+		printf("MqttClient: Uplink %d up", ifi->ifi_index);
+		changed = true;
+	}
+	else
+	{
+		changed = false;
+	}
+
+	return changed;
+}
+
+/**
+ * @brief	Tell whether an address notification concerns the connection: the local address of the socket was
+ * 			removed, or the uplink got another address (the modem attached again).
+ *
+ * @param[in]	: netlink	: uplink watcher
+ * @param[in]	: nlh		: notification
+ * @param[in]	: connected	: socket connected to the broker
+ * @return 	bool
+ *
+*/
+static bool MqttClientNetlinkAddrChanged(const t_MqttNetlink *netlink, const struct nlmsghdr *nlh, bool connected)
+{
+	const struct ifaddrmsg *ifa = (const struct ifaddrmsg *)NLMSG_DATA(nlh);
+	const struct rtattr *rta = IFA_RTA(ifa);
+	int rta_len = (int)IFA_PAYLOAD(nlh);
+	struct in_addr addr = {0};
+	bool changed = false;
+
+	for (; RTA_OK(rta, rta_len); rta = RTA_NEXT(rta, rta_len))
+	{
+		/* the local address of a point to point link is IFA_LOCAL, IFA_ADDRESS is the peer one */
+		if ( (IFA_LOCAL == rta->rta_type) || ((IFA_ADDRESS == rta->rta_type) && (0U == addr.s_addr)) )
+		{
+			memcpy(&addr, RTA_DATA(rta), sizeof(addr));
+		}
+	}
+
+	if ( (AF_INET != ifa->ifa_family) || ((0 != netlink->uplink_ifindex) && ((int)ifa->ifa_index != netlink->uplink_ifindex)) )
+	{
+		changed = false;
+	}
+	else if ( false == connected )
+	{
+		changed = (RTM_NEWADDR == nlh->nlmsg_type);
+	}
+	else if ( RTM_DELADDR == nlh->nlmsg_type )
+	{
+		changed = (addr.s_addr == netlink->local_addr);
+	}
+	else
+	{
+		changed = (addr.s_addr != netlink->local_addr);
+	}
+
+	if ( true == changed )
+	{
+		printf("MqttClient: Uplink %d address %s %s", ifa->ifa_index, (RTM_NEWADDR == nlh->nlmsg_type) ? "added" : "removed",
+				inet_ntoa(addr));
+	}
+
+	return changed;
+}
+
+/**
+ * @brief	Tell whether a route notification concerns the connection: the default route of the uplink was
+ * 			removed while connected, or one was added while disconnected.
+ *
+ * @param[in]	: netlink	: uplink watcher
+ * @param[in]	: nlh		: notification
+ * @param[in]	: connected	: socket connected to the broker
+ * @return 	bool
+ *
+*/
+static bool MqttClientNetlinkRouteChanged(const t_MqttNetlink *netlink, const struct nlmsghdr *nlh, bool connected)
+{
+	const struct rtmsg *rtm = (const struct rtmsg *)NLMSG_DATA(nlh);
+	const struct rtattr *rta = RTM_RTA(rtm);
+	int rta_len = (int)RTM_PAYLOAD(nlh);
+	int oif = 0;
+	bool changed = false;
+
+	for (; RTA_OK(rta, rta_len); rta = RTA_NEXT(rta, rta_len))
+	{
+		if ( RTA_OIF == rta->rta_type )
+		{
+			memcpy(&oif, RTA_DATA(rta), sizeof(oif));
+		}
+	}
+
+	/* only the default route of the main table decides how the broker is reached */
+	if ( (AF_INET != rtm->rtm_family) || (RT_TABLE_MAIN != rtm->rtm_table) || (0U != rtm->rtm_dst_len) ||
+		 ((0 != netlink->uplink_ifindex) && (oif != netlink->uplink_ifindex)) )
+	{
+		changed = false;
+	}
+	else
+	{
+		changed = (connected == (RTM_DELROUTE == nlh->nlmsg_type));
+	}
+
+	if ( true == changed )
+	{
+		printf("MqttClient: Default route of uplink %d %s", oif, (RTM_NEWROUTE == nlh->nlmsg_type) ? "added" : "removed");
+	}
+
+	return changed;
+}
+
+/**
+ * @brief	Open the rtnetlink socket of a client context.
+ *
+ * @param[in]	: client	: client context
+ * @return 	bool
+ * @retval	true	: uplink watched
+ * @retval	false	: error in opening the socket, changes are only seen by the timers
+ *
+*/
+bool MqttClientNetlinkInit(t_MqttClient *client)
+{
+	t_MqttNetlink *netlink = &client->netlink;
+	struct sockaddr_nl local;
+
+	netlink->uplink_ifindex = 0;
+	netlink->local_addr = 0U;
+	netlink->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+
+	if ( INVALID_FD != netlink->fd )
+	{
+		memset(&local, 0, sizeof(local));
+		local.nl_family = AF_NETLINK;
+		local.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV4_ROUTE;
+
+		if ( bind(netlink->fd, (struct sockaddr *)&local, sizeof(local)) != 0 )
+		{
+			(void)close(netlink->fd);
+			netlink->fd = INVALID_FD;
+		}
+	}
+
+	if ( INVALID_FD == netlink->fd )
+	{
+		printf("MqttClient: Error in opening rtnetlink socket, uplink changes are not watched");
+	}
+
+	return (INVALID_FD != netlink->fd);
+}
+
+/**
+ * @brief	Record the uplink of a new broker connection: the configured interface, or the one owning the local
+ * 			address of the socket.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: sock		: socket connected to the broker
+ * @return 	void
+ *
+*/
+void MqttClientNetlinkBind(t_MqttClient *client, int sock)
+{
+	t_MqttNetlink *netlink = &client->netlink;
+	struct sockaddr_in local;
+	socklen_t local_len = sizeof(local);
+	struct ifaddrs *ifaddr = NULL;
+	struct ifaddrs *ifa = NULL;
+
+	if ( getsockname(sock, (struct sockaddr *)&local, &local_len) == 0 )
+	{
+		netlink->local_addr = local.sin_addr.s_addr;
+	}
+
+	if ( '\0' != client->config.uplink_interface[0] )
+	{
+		netlink->uplink_ifindex = (int)if_nametoindex(client->config.uplink_interface);
+	}
+	else if ( getifaddrs(&ifaddr) == 0 )
+	{
+		for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next)
+		{
+			if ( (ifa->ifa_addr != NULL) && (AF_INET == ifa->ifa_addr->sa_family) &&
+				 (((struct sockaddr_in *)ifa->ifa_addr)->sin_addr.s_addr == netlink->local_addr) )
+			{
+				netlink->uplink_ifindex = (int)if_nametoindex(ifa->ifa_name);
+				break;
+			}
+		}
+		freeifaddrs(ifaddr);
+	}
+
+	printf("MqttClient: Uplink of client %d is interface %d, local address %s", client->handler, netlink->uplink_ifindex,
+			inet_ntoa(local.sin_addr));
+}
+
+/**
+ * @brief	Read the pending notifications without waiting. A change making the broker socket stale, or bringing
+ * 			the uplink back while disconnected, is reported to the FSM at once.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientNetlinkProcess(t_MqttClient *client)
+{
+	t_MqttNetlink *netlink = &client->netlink;
+	unsigned char buffer[NETLINK_BUFFER_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+	const struct nlmsghdr *nlh = NULL;
+	int len = 0;
+	bool connected = (INVALID_FD != MqttClientGetSocket(client));
+	bool changed = false;
+
+	if ( INVALID_FD == netlink->fd )
+	{
+		return;
+	}
+
+	while ( (len = (int)recv(netlink->fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0 )
+	{
+		for (nlh = (const struct nlmsghdr *)buffer; NLMSG_OK(nlh, (unsigned int)len); nlh = NLMSG_NEXT(nlh, len))
+		{
+			switch (nlh->nlmsg_type)
+			{
+				case RTM_NEWLINK:
+				case RTM_DELLINK:
+					changed = (true == MqttClientNetlinkLinkChanged(netlink, nlh, connected)) || changed;
+					break;
+
+				case RTM_NEWADDR:
+				case RTM_DELADDR:
+					changed = (true == MqttClientNetlinkAddrChanged(netlink, nlh, connected)) || changed;
+					break;
+
+				case RTM_NEWROUTE:
+				case RTM_DELROUTE:
+					changed = (true == MqttClientNetlinkRouteChanged(netlink, nlh, connected)) || changed;
+					break;
+
+				default:
+					/* Do nothing */
+					break;
+			}
+		}
+	}
+
+	if ( true == changed )
+	{
+		MqttClientUplinkChanged(client);
+	}
+}
+
+/**
+ * @brief	Get the rtnetlink socket watched by the event loop.
+ *
+ * @param[in]	: client	: client context
+ * @return 	int
+ * @retval	fd, -1 if none
+ *
+*/
+int MqttClientNetlinkGetFd(t_MqttClient *client)
+{
+	return client->netlink.fd;
+}
+
+/**
+ * @brief	Close the rtnetlink socket of a client context.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientNetlinkClose(t_MqttClient *client)
+{
+	if ( INVALID_FD != client->netlink.fd )
+	{
+		(void)close(client->netlink.fd);
+		client->netlink.fd = INVALID_FD;
+	}
+}
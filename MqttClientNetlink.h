@@ -0,0 +1,92 @@
+/**************************************************************************//**
+*  @par Language  : C
+*******************************************************************************
+*  @brief       MqttClient uplink monitoring header file.
+*  @author      dr-paradox
+*  @version     1.0.0
+*******************************************************************************
+*  @page 	MqttClientNetlink
+*  @ref 	MqttClient "API Reference" header file
+*  @file 	MqttClientNetlink.h
+*
+*******************************************************************************/
+
+#ifndef MQTTCLIENT_NETLINK_H
+#define MQTTCLIENT_NETLINK_H
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "MqttClient.h"
+#include "MqttClientCfg.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* Uplink watcher of a client context: rtnetlink notifications of the interface reaching the broker */
+typedef struct
+{
+	int				fd;					/*rtnetlink socket subscribed to link, ipv4 address and ipv4 route changes*/
+	int				uplink_ifindex;		/*interface reaching the broker, 0 while unknown*/
+	uint32_t		local_addr;			/*local address of the broker socket, network byte order*/
+} t_MqttNetlink;
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+ * @brief	Open the rtnetlink socket of a client context.
+ *
+ * @param[in]	: client	: client context
+ * @return 	bool
+ * @retval	true	: uplink watched
+ * @retval	false	: error in opening the socket, changes are only seen by the timers
+ *
+*/
+bool MqttClientNetlinkInit(t_MqttClient *client);
+
+/**
+ * @brief	Record the uplink of a new broker connection: the configured interface, or the one owning the local
+ * 			address of the socket.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: sock		: socket connected to the broker
+ * @return 	void
+ *
+*/
+void MqttClientNetlinkBind(t_MqttClient *client, int sock);
+
+/**
+ * @brief	Read the pending notifications without waiting. A change making the broker socket stale, or bringing
+ * 			the uplink back while disconnected, is reported to the FSM at once.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientNetlinkProcess(t_MqttClient *client);
+
+/**
+ * @brief	Get the rtnetlink socket watched by the event loop.
+ *
+ * @param[in]	: client	: client context
+ * @return 	int
+ * @retval	fd, -1 if none
+ *
+*/
+int MqttClientNetlinkGetFd(t_MqttClient *client);
+
+/**
+ * @brief	Close the rtnetlink socket of a client context.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientNetlinkClose(t_MqttClient *client);
+
+/* -------------------------------- Routines -------------------------------- */
+
+#endif /* MQTTCLIENT_NETLINK_H */
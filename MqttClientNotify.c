@@ -0,0 +1,784 @@
+/**************************************************************************//**
+*  @par Language: C
+*******************************************************************************
+*  @par 	Project:
+*  @brief   MqttClient service notification implementation
+*  @author  dr-paradox
+*  @version 1.0.0
+*******************************************************************************
+*  @ref 	MqttClient "API Reference"
+*  @file 	MqttClientNotify.c
+*******************************************************************************/
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "MqttClientContext.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* Index mask of the completion queue */
+#define CQ_MASK						((unsigned int)(MQTT_COMPLETION_QUEUE_SIZE - 1u))
+
+/* Invalid file descriptor */
+#define INVALID_FD					((int)-1)
+
+/* Conversions of clock_gettime() values to micro seconds */
+#define US_PER_SEC					((uint64_t)1000000)
+#define NS_PER_US					((uint64_t)1000)
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* ---------------------------- Global Variables ---------------------------- */
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+* @brief	Append a completion to the completion queue.
+*
+* @param[in]	: notifier		: notifier of the client
+* @param[in]	: completion	: completion to be queued
+* @return		bool
+* @retval		true			: completion queued
+* @retval		false			: queue full
+*/
+static bool MqttClientNotifyPush(t_MqttNotifier *notifier, const t_MqttCompletion *completion);
+
+/**
+* @brief	Remove the oldest completion from the completion queue.
+*
+* @param[in]	: notifier		: notifier of the client
+* @param[out]	: completion	: completion removed
+* @return		bool
+* @retval		true			: completion removed
+* @retval		false			: queue empty
+*/
+static bool MqttClientNotifyPop(t_MqttNotifier *notifier, t_MqttCompletion *completion);
+
+/**
+* @brief	Append a completion to the overflow list of the completion queue.
+*
+* @param[in]	: notifier		: notifier of the client
+* @param[in]	: completion	: completion to be queued
+* @return		bool
+* @retval		true			: completion queued
+* @retval		false			: no memory left
+*/
+static bool MqttClientNotifyOverflowPush(t_MqttNotifier *notifier, const t_MqttCompletion *completion);
+
+/**
+* @brief	Remove the oldest completion from the overflow list of the completion queue.
+*
+* @param[in]	: notifier		: notifier of the client
+* @param[out]	: completion	: completion removed
+* @return		bool
+* @retval		true			: completion removed
+* @retval		false			: list empty
+*/
+static bool MqttClientNotifyOverflowPop(t_MqttNotifier *notifier, t_MqttCompletion *completion);
+
+/**
+* @brief	Start the workers of the callback executor.
+*
+* @param[in]	: notifier	: notifier of the client
+* @return	bool
+* @retval	true	: workers running
+* @retval	false	: error in starting the workers
+*/
+static bool MqttClientNotifyStartExecutor(t_MqttNotifier *notifier);
+
+/**
+* @brief	Queue a callback to the worker of the service without waiting, in the overflow list of the worker when its
+* 			queue is full.
+*
+* @param[in]	: notifier		: notifier of the client
+* @param[in]	: completion	: completion to be delivered
+* @param[in]	: service_id	: service owning the request
+* @return		bool
+* @retval		true			: callback queued
+* @retval		false			: queue of the service full and no memory left for the overflow list
+*/
+static bool MqttClientNotifyPostJob(t_MqttNotifier *notifier, const t_MqttCompletion *completion, unsigned char service_id);
+
+/**
+* @brief	Worker thread of the callback executor, runs and times the callbacks.
+*
+* @param[in]	: arg	: t_ExecutorWorker of the thread
+* @return		void*
+*/
+static void* MqttClientNotifyWorker(void *arg);
+
+/**
+* @brief	Read the monotonic clock.
+*
+* @param	: void
+* @return	uint64_t
+* @retval	current time in micro seconds
+*/
+static uint64_t MqttClientNotifyNowUs(void);
+
+/* -------------------------------- Routines -------------------------------- */
+
+/**
+* @brief	Append a completion to the completion queue.
+*
+* @param[in]	: notifier		: notifier of the client
+* @param[in]	: completion	: completion to be queued
+* @return		bool
+* @retval		true			: completion queued
+* @retval		false			: queue full
+*/
+static bool MqttClientNotifyPush(t_MqttNotifier *notifier, const t_MqttCompletion *completion)
+{
+	t_CompletionCell *cell = NULL;
+	unsigned int pos = __atomic_load_n(&notifier->enqueue_pos, __ATOMIC_RELAXED);
+	unsigned int seq = 0U;
+	int diff = 0;
+	bool queued = false;
+
+	for (;;)
+	{
+		cell = &notifier->completion_cells[pos & CQ_MASK];
+		seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+		diff = (int)(seq - pos);
+
+		if ( 0 == diff )
+		{
+			/* cell free, claim it */
+			if ( __atomic_compare_exchange_n(&notifier->enqueue_pos, &pos, pos + 1u, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+			{
+				queued = true;
+				break;
+			}
+		}
+		else if ( diff < 0 )
+		{
+			/* cell still holds a completion not harvested */
+			break;
+		}
+		else
+		{
+			pos = __atomic_load_n(&notifier->enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	if ( true == queued )
+	{
+		cell->completion = *completion;
+		__atomic_store_n(&cell->sequence, pos + 1u, __ATOMIC_RELEASE);
+	}
+
+	return queued;
+}
+
+/**
+* @brief	Remove the oldest completion from the completion queue.
+*
+* @param[in]	: notifier		: notifier of the client
+* @param[out]	: completion	: completion removed
+* @return		bool
+* @retval		true			: completion removed
+* @retval		false			: queue empty
+*/
+static bool MqttClientNotifyPop(t_MqttNotifier *notifier, t_MqttCompletion *completion)
+{
+	t_CompletionCell *cell = NULL;
+	unsigned int pos = __atomic_load_n(&notifier->dequeue_pos, __ATOMIC_RELAXED);
+	unsigned int seq = 0U;
+	int diff = 0;
+	bool removed = false;
+
+	for (;;)
+	{
+		cell = &notifier->completion_cells[pos & CQ_MASK];
+		seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+		diff = (int)(seq - (pos + 1u));
+
+		if ( 0 == diff )
+		{
+			if ( __atomic_compare_exchange_n(&notifier->dequeue_pos, &pos, pos + 1u, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+			{
+				removed = true;
+				break;
+			}
+		}
+		else if ( diff < 0 )
+		{
+			/* nothing queued */
+			break;
+		}
+		else
+		{
+			pos = __atomic_load_n(&notifier->dequeue_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	if ( true == removed )
+	{
+		*completion = cell->completion;
+		__atomic_store_n(&cell->sequence, pos + CQ_MASK + 1u, __ATOMIC_RELEASE);
+	}
+
+	return removed;
+}
+
+/**
+* @brief	Append a completion to the overflow list of the completion queue.
+*
+* @param[in]	: notifier		: notifier of the client
+* @param[in]	: completion	: completion to be queued
+* @return		bool
+* @retval		true			: completion queued
+* @retval		false			: no memory left
+*/
+static bool MqttClientNotifyOverflowPush(t_MqttNotifier *notifier, const t_MqttCompletion *completion)
+{
+	t_CompletionOverflow *entry = (t_CompletionOverflow *)malloc(sizeof(t_CompletionOverflow));
+
+	if ( entry != NULL )
+	{
+		entry->next = NULL;
+		entry->completion = *completion;
+
+		pthread_mutex_lock(&notifier->overflow_lock);
+		if ( NULL == notifier->overflow_tail )
+		{
+			notifier->overflow_head = entry;
+		}
+		else
+		{
+			notifier->overflow_tail->next = entry;
+		}
+		notifier->overflow_tail = entry;
+		__atomic_add_fetch(&notifier->overflow_count, 1U, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&notifier->overflow_lock);
+	}
+
+	return (entry != NULL);
+}
+
+/**
+* @brief	Remove the oldest completion from the overflow list of the completion queue.
+*
+* @param[in]	: notifier		: notifier of the client
+* @param[out]	: completion	: completion removed
+* @return		bool
+* @retval		true			: completion removed
+* @retval		false			: list empty
+*/
+static bool MqttClientNotifyOverflowPop(t_MqttNotifier *notifier, t_MqttCompletion *completion)
+{
+	t_CompletionOverflow *entry = NULL;
+
+	if ( 0U != __atomic_load_n(&notifier->overflow_count, __ATOMIC_ACQUIRE) )
+	{
+		pthread_mutex_lock(&notifier->overflow_lock);
+		entry = notifier->overflow_head;
+		if ( entry != NULL )
+		{
+			notifier->overflow_head = entry->next;
+			if ( NULL == notifier->overflow_head )
+			{
+				notifier->overflow_tail = NULL;
+			}
+			__atomic_sub_fetch(&notifier->overflow_count, 1U, __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&notifier->overflow_lock);
+	}
+
+	if ( entry != NULL )
+	{
+		*completion = entry->completion;
+		free(entry);
+	}
+
+	return (entry != NULL);
+}
+
+/**
+* @brief	Read the monotonic clock.
+*
+* @param	: void
+* @return	uint64_t
+* @retval	current time in micro seconds
+*/
+static uint64_t MqttClientNotifyNowUs(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * US_PER_SEC) + ((uint64_t)ts.tv_nsec / NS_PER_US);
+}
+
+/**
+* @brief	Start the workers of the callback executor.
+*
+* @param[in]	: notifier	: notifier of the client
+* @return	bool
+* @retval	true	: workers running
+* @retval	false	: error in starting the workers
+*/
+static bool MqttClientNotifyStartExecutor(t_MqttNotifier *notifier)
+{
+	unsigned char idx;
+	unsigned char started;
+
+	for (idx = 0U; (false == notifier->executor_started) && (idx < (unsigned char)SERVICE_LAST); idx++)
+	{
+		notifier->workers[idx].notifier = notifier;
+		notifier->workers[idx].head = 0U;
+		notifier->workers[idx].count = 0U;
+		notifier->workers[idx].overflow_head = NULL;
+		notifier->workers[idx].overflow_tail = NULL;
+		notifier->workers[idx].overflows = 0U;
+		notifier->workers[idx].stopping = false;
+		(void)pthread_mutex_init(&notifier->workers[idx].lock, NULL);
+		(void)pthread_cond_init(&notifier->workers[idx].not_empty, NULL);
+
+		if ( pthread_create(&notifier->workers[idx].thread, NULL, MqttClientNotifyWorker, &notifier->workers[idx]) != 0 )
+		{
+			printf("MqttClient: Error in starting callback executor worker %d", idx);
+
+			/* the workers already started are stopped, a later start initializes them all again */
+			for (started = 0U; started < idx; started++)
+			{
+				pthread_mutex_lock(&notifier->workers[started].lock);
+				notifier->workers[started].stopping = true;
+				pthread_cond_signal(&notifier->workers[started].not_empty);
+				pthread_mutex_unlock(&notifier->workers[started].lock);
+				(void)pthread_join(notifier->workers[started].thread, NULL);
+			}
+			for (started = 0U; started <= idx; started++)
+			{
+				(void)pthread_cond_destroy(&notifier->workers[started].not_empty);
+				(void)pthread_mutex_destroy(&notifier->workers[started].lock);
+			}
+			break;
+		}
+
+		if ( (idx + 1u) == (unsigned char)SERVICE_LAST )
+		{
+			notifier->executor_started = true;
+		}
+	}
+
+	return notifier->executor_started;
+}
+
+/**
+* @brief	Queue a callback to the worker of the service without waiting, in the overflow list of the worker when its
+* 			queue is full.
+*
+* @param[in]	: notifier		: notifier of the client
+* @param[in]	: completion	: completion to be delivered
+* @param[in]	: service_id	: service owning the request
+* @return		bool
+* @retval		true			: callback queued
+* @retval		false			: queue of the service full and no memory left for the overflow list
+*/
+static bool MqttClientNotifyPostJob(t_MqttNotifier *notifier, const t_MqttCompletion *completion, unsigned char service_id)
+{
+	/* each service has its own worker: its callbacks keep their order and a slow one only delays its own service */
+	t_ExecutorWorker *worker = &notifier->workers[service_id];
+	t_ExecutorJob *job = NULL;
+	t_ExecutorOverflow *entry = NULL;
+	bool queued = true;
+
+	pthread_mutex_lock(&worker->lock);
+
+	/* once callbacks wait in the overflow list the next ones queue behind them, keeping their order */
+	if ( (worker->count < MQTT_EXECUTOR_QUEUE_SIZE) && (NULL == worker->overflow_head) )
+	{
+		job = &worker->jobs[(worker->head + worker->count) % MQTT_EXECUTOR_QUEUE_SIZE];
+		job->completion = *completion;
+		job->service_id = service_id;
+		worker->count++;
+	}
+	else
+	{
+		/* the protocol engine never waits for a slow consumer */
+		entry = (t_ExecutorOverflow *)malloc(sizeof(t_ExecutorOverflow));
+		if ( entry != NULL )
+		{
+			entry->next = NULL;
+			entry->job.completion = *completion;
+			entry->job.service_id = service_id;
+			if ( NULL == worker->overflow_tail )
+			{
+				worker->overflow_head = entry;
+			}
+			else
+			{
+				worker->overflow_tail->next = entry;
+			}
+			worker->overflow_tail = entry;
+			worker->overflows++;
+		}
+		queued = (entry != NULL);
+	}
+
+	if ( true == queued )
+	{
+		pthread_cond_signal(&worker->not_empty);
+	}
+
+	pthread_mutex_unlock(&worker->lock);
+
+	return queued;
+}
+
+/**
+* @brief	Worker thread of the callback executor, runs and times the callbacks.
+*
+* @param[in]	: arg	: t_ExecutorWorker of the thread
+* @return		void*
+*/
+static void* MqttClientNotifyWorker(void *arg)
+{
+	t_ExecutorWorker *worker = (t_ExecutorWorker *)arg;
+	t_ExecutorOverflow *entry = NULL;
+	t_ExecutorJob job;
+	SlowCbkNotify notify_slow = (SlowCbkNotify)NULL;
+	uint64_t start_us = 0U;
+	unsigned int duration_us = 0U;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&worker->lock);
+
+		while ( (0U == worker->count) && (NULL == worker->overflow_head) && (false == worker->stopping) )
+		{
+			pthread_cond_wait(&worker->not_empty, &worker->lock);
+		}
+
+		/* the overflow list only holds callbacks newer than the ones of the queue */
+		entry = NULL;
+		if ( 0U != worker->count )
+		{
+			job = worker->jobs[worker->head];
+			worker->head = (unsigned short)((worker->head + 1u) % MQTT_EXECUTOR_QUEUE_SIZE);
+			worker->count--;
+		}
+		else if ( NULL != worker->overflow_head )
+		{
+			entry = worker->overflow_head;
+			worker->overflow_head = entry->next;
+			if ( NULL == worker->overflow_head )
+			{
+				worker->overflow_tail = NULL;
+			}
+			job = entry->job;
+		}
+		else
+		{
+			pthread_mutex_unlock(&worker->lock);
+			break;
+		}
+
+		pthread_mutex_unlock(&worker->lock);
+		free(entry);
+
+		start_us = MqttClientNotifyNowUs();
+		job.completion.cbk(job.completion.handle, job.completion.server_response, job.completion.user_ctx);
+		duration_us = (unsigned int)(MqttClientNotifyNowUs() - start_us);
+
+		if ( duration_us > MQTT_CALLBACK_BUDGET_US )
+		{
+			printf("MqttClient: Callback of service %d handle %u took %u us, budget %u us",
+					job.service_id, job.completion.handle, duration_us, MQTT_CALLBACK_BUDGET_US);
+
+			notify_slow = __atomic_load_n(&worker->notifier->slow_cbk, __ATOMIC_ACQUIRE);
+			if ( notify_slow != (SlowCbkNotify)NULL )
+			{
+				notify_slow(job.service_id, job.completion.handle, duration_us);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief	Set the notifier of a new client context to the default notification mode.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientNotifyInit(t_MqttClient *client)
+{
+	t_MqttNotifier *notifier = &client->notifier;
+
+	notifier->mode = MQTT_NOTIFY_INLINE;
+	notifier->completion_fd = INVALID_FD;
+	notifier->completion_overflows = 0U;
+	notifier->enqueue_pos = 0U;
+	notifier->dequeue_pos = 0U;
+	(void)pthread_mutex_init(&notifier->overflow_lock, NULL);
+	notifier->overflow_head = NULL;
+	notifier->overflow_tail = NULL;
+	notifier->overflow_count = 0U;
+	notifier->executor_started = false;
+	notifier->slow_cbk = (SlowCbkNotify)NULL;
+
+	if ( MQTT_NOTIFY_INLINE != MQTT_DEFAULT_NOTIFY_MODE )
+	{
+		MqttClientNotifySetMode(client, MQTT_DEFAULT_NOTIFY_MODE);
+	}
+}
+
+/**
+ * @brief	Select how request results are delivered.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: mode	: notification mode
+ * @return 		void
+ *
+*/
+void MqttClientNotifySetMode(t_MqttClient *client, t_MqttNotifyMode mode)
+{
+	t_MqttNotifier *notifier = &client->notifier;
+	unsigned int idx;
+
+	if ( (MQTT_NOTIFY_COMPLETION_QUEUE == mode) && (INVALID_FD == notifier->completion_fd) )
+	{
+		for (idx = 0U; idx < MQTT_COMPLETION_QUEUE_SIZE; idx++)
+		{
+			notifier->completion_cells[idx].sequence = idx;
+		}
+		__atomic_store_n(&notifier->enqueue_pos, 0U, __ATOMIC_RELAXED);
+		__atomic_store_n(&notifier->dequeue_pos, 0U, __ATOMIC_RELAXED);
+
+		notifier->completion_fd = eventfd(0U, EFD_NONBLOCK | EFD_CLOEXEC);
+		if ( notifier->completion_fd < 0 )
+		{
+			/* keep delivering inline rather than losing results */
+			printf("MqttClient: Error in creating completion eventfd, staying in inline mode");
+			mode = MQTT_NOTIFY_INLINE;
+			notifier->completion_fd = INVALID_FD;
+		}
+	}
+
+	if ( (MQTT_NOTIFY_EXECUTOR == mode) && (false == MqttClientNotifyStartExecutor(notifier)) )
+	{
+		printf("MqttClient: Error in starting callback executor, staying in inline mode");
+		mode = MQTT_NOTIFY_INLINE;
+	}
+
+	__atomic_store_n(&notifier->mode, mode, __ATOMIC_RELEASE);
+	printf("MqttClient: Notification mode set to %d", mode);
+}
+
+/**
+ * @brief	Set the callback notified about callbacks exceeding their budget.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: cbk	: slow callback notification, NULL to disable
+ * @return 		void
+ *
+*/
+void MqttClientNotifySetSlowCbk(t_MqttClient *client, SlowCbkNotify cbk)
+{
+	__atomic_store_n(&client->notifier.slow_cbk, cbk, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief	Deliver the result of a request according to the notification mode.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: cbk			: callback given on submission
+ * @param[in]	: handle		: handle of the request
+ * @param[in]	: resp			: response to be sent to the service
+ * @param[in]	: user_ctx		: user context pointer given on submission
+ * @param[in]	: service_id	: service owning the request
+ * @return 		void
+ *
+*/
+void MqttClientNotifyDispatch(t_MqttClient *client, RxCbk cbk, t_MqttRequestHandle handle, t_ServerReplyCodes resp, void *user_ctx, unsigned char service_id)
+{
+	t_MqttNotifier *notifier = &client->notifier;
+	t_MqttCompletion completion = {cbk, handle, user_ctx, (unsigned char)resp};
+	uint64_t signal = 1U;
+
+	switch (__atomic_load_n(&notifier->mode, __ATOMIC_ACQUIRE))
+	{
+		case MQTT_NOTIFY_COMPLETION_QUEUE:
+			/* once completions wait in the overflow list the next ones queue behind them, keeping their order */
+			if ( (0U == __atomic_load_n(&notifier->overflow_count, __ATOMIC_ACQUIRE)) &&
+				 (true == MqttClientNotifyPush(notifier, &completion)) )
+			{
+				(void)write(notifier->completion_fd, &signal, sizeof(signal));
+			}
+			else if ( true == MqttClientNotifyOverflowPush(notifier, &completion) )
+			{
+				__atomic_add_fetch(&notifier->completion_overflows, 1U, __ATOMIC_RELAXED);
+				(void)write(notifier->completion_fd, &signal, sizeof(signal));
+			}
+			else if ( cbk != (RxCbk)NULL )
+			{
+				/* no memory to keep it, deliver inline rather than losing the result */
+				printf("MqttClient: Completion queue full, result %d of handle %u delivered inline", resp, handle);
+				cbk(handle, (unsigned char)resp, user_ctx);
+			}
+			else
+			{
+				/* nobody to notify */
+			}
+			break;
+
+		case MQTT_NOTIFY_EXECUTOR:
+			if ( (cbk != (RxCbk)NULL) && (false == MqttClientNotifyPostJob(notifier, &completion, service_id)) )
+			{
+				/* no memory to keep it, deliver inline rather than losing the result */
+				printf("MqttClient: Callback executor queue of service %d full, result %d of handle %u delivered inline", service_id, resp, handle);
+				cbk(handle, (unsigned char)resp, user_ctx);
+			}
+			break;
+
+		case MQTT_NOTIFY_INLINE:
+		default:
+			if ( cbk != (RxCbk)NULL )
+			{
+				cbk(handle, (unsigned char)resp, user_ctx);
+			}
+			break;
+	}
+
+	printf("MqttClient: Notified service: %d handle: %u with resp: %d", service_id, handle, resp);
+}
+
+/**
+ * @brief	Get the eventfd signalled when completions are queued.
+ *
+ * @param[in]	: client	: client context
+ * @return 	int
+ * @retval	<0	: completion queue mode not enabled
+ *
+*/
+int MqttClientNotifyGetFd(t_MqttClient *client)
+{
+	return client->notifier.completion_fd;
+}
+
+/**
+ * @brief	Harvest queued completions.
+ *
+ * @param[in]	: client	: client context
+ * @param[out]	: completions	: array receiving the completions
+ * @param[in]	: max			: size of completions array
+ * @return 		unsigned short
+ * @retval		number of completions harvested
+ *
+*/
+unsigned short MqttClientNotifyHarvest(t_MqttClient *client, t_MqttCompletion *completions, unsigned short max)
+{
+	t_MqttNotifier *notifier = &client->notifier;
+	unsigned short harvested = 0U;
+	uint64_t signal = 0U;
+
+	if ( INVALID_FD != notifier->completion_fd )
+	{
+		/* Reset the eventfd before draining: a completion queued afterwards signals it again */
+		(void)read(notifier->completion_fd, &signal, sizeof(signal));
+
+		while ( (harvested < max) && (true == MqttClientNotifyPop(notifier, &completions[harvested])) )
+		{
+			harvested++;
+		}
+
+		/* the overflow list only holds completions newer than the ones of the queue */
+		while ( (harvested < max) && (true == MqttClientNotifyOverflowPop(notifier, &completions[harvested])) )
+		{
+			harvested++;
+		}
+
+		/* Completions left behind must keep the fd readable */
+		if ( harvested == max )
+		{
+			signal = 1U;
+			(void)write(notifier->completion_fd, &signal, sizeof(signal));
+		}
+	}
+
+	return harvested;
+}
+
+/**
+ * @brief	Get the number of completions that did not fit in the completion queue and waited in its overflow list.
+ *
+ * @param[in]	: client	: client context
+ * @return 	unsigned int
+ *
+*/
+unsigned int MqttClientNotifyGetOverflows(t_MqttClient *client)
+{
+	return __atomic_load_n(&client->notifier.completion_overflows, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief	Get the number of callbacks of a service that did not fit in its callback executor queue and waited in its
+ * 			overflow list.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service id
+ * @return 	unsigned int
+ *
+*/
+unsigned int MqttClientNotifyGetExecutorOverflows(t_MqttClient *client, unsigned char service_id)
+{
+	t_ExecutorWorker *worker = &client->notifier.workers[service_id];
+	unsigned int overflows = 0U;
+
+	if ( true == client->notifier.executor_started )
+	{
+		pthread_mutex_lock(&worker->lock);
+		overflows = worker->overflows;
+		pthread_mutex_unlock(&worker->lock);
+	}
+
+	return overflows;
+}
+
+/**
+ * @brief	Stop the executor workers once they ran the callbacks queued, close the completion eventfd and release the
+ * 			completions not harvested.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientNotifyClose(t_MqttClient *client)
+{
+	t_MqttNotifier *notifier = &client->notifier;
+	t_MqttCompletion completion;
+	unsigned char idx;
+
+	__atomic_store_n(&notifier->mode, MQTT_NOTIFY_INLINE, __ATOMIC_RELEASE);
+
+	for (idx = 0U; (true == notifier->executor_started) && (idx < (unsigned char)SERVICE_LAST); idx++)
+	{
+		pthread_mutex_lock(&notifier->workers[idx].lock);
+		notifier->workers[idx].stopping = true;
+		pthread_cond_signal(&notifier->workers[idx].not_empty);
+		pthread_mutex_unlock(&notifier->workers[idx].lock);
+		(void)pthread_join(notifier->workers[idx].thread, NULL);
+	}
+	notifier->executor_started = false;
+
+	while ( true == MqttClientNotifyOverflowPop(notifier, &completion) )
+	{
+		/* the entry is freed by the pop */
+	}
+
+	if ( INVALID_FD != notifier->completion_fd )
+	{
+		(void)close(notifier->completion_fd);
+		notifier->completion_fd = INVALID_FD;
+	}
+}
@@ -0,0 +1,195 @@
+/**************************************************************************//**
+*  @par Language  : C
+*******************************************************************************
+*  @brief       MqttClient service notification header file.
+*  @author      dr-paradox
+*  @version     1.0.0
+*******************************************************************************
+*  @page 	MqttClientNotify
+*  @ref 	MqttClient "API Reference" header file
+*  @file 	MqttClientNotify.h
+*
+*******************************************************************************/
+
+#ifndef MQTTCLIENT_NOTIFY_H
+#define MQTTCLIENT_NOTIFY_H
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "MqttClient.h"
+#include "MqttClientCfg.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* Cell of the completion queue, sequence tells whether the cell is free or holds a completion */
+typedef struct
+{
+	unsigned int		sequence;
+	t_MqttCompletion	completion;
+} t_CompletionCell;
+
+/* Completion waiting in the overflow list while the completion queue is full */
+typedef struct s_CompletionOverflow
+{
+	struct s_CompletionOverflow	*next;
+	t_MqttCompletion			completion;
+} t_CompletionOverflow;
+
+/* Callback waiting to be run by a worker of the callback executor */
+typedef struct
+{
+	t_MqttCompletion	completion;
+	unsigned char		service_id;
+} t_ExecutorJob;
+
+/* Callback waiting in the overflow list of a worker while its queue is full */
+typedef struct s_ExecutorOverflow
+{
+	struct s_ExecutorOverflow	*next;
+	t_ExecutorJob				job;
+} t_ExecutorOverflow;
+
+/* Worker of the callback executor, runs the callbacks of its service in submission order */
+typedef struct
+{
+	pthread_t				thread;
+	pthread_mutex_t			lock;
+	pthread_cond_t			not_empty;
+	t_ExecutorJob			jobs[MQTT_EXECUTOR_QUEUE_SIZE];
+	unsigned short			head;
+	unsigned short			count;
+	/* Callbacks arriving while the queue is full wait here in order, run after the queue */
+	t_ExecutorOverflow		*overflow_head;
+	t_ExecutorOverflow		*overflow_tail;
+	unsigned int			overflows;		/* callbacks that did not fit in the queue */
+	bool					stopping;		/* worker leaves once its queue and overflow list are empty */
+	struct s_MqttNotifier	*notifier;		/* notifier owning the worker */
+} __attribute__((aligned(MQTT_CACHE_LINE_SIZE))) t_ExecutorWorker;
+
+/* Result delivery of a client context */
+typedef struct s_MqttNotifier
+{
+	t_MqttNotifyMode	mode;											/* notification mode in use */
+	int					completion_fd;									/* eventfd signalled on each queued completion */
+	unsigned int		completion_overflows;							/* completions that did not fit in the queue */
+	/* Bounded multi producer queue: completions are queued by the protocol engine and by submitting threads,
+	 * producer and consumer positions are kept on different cache lines */
+	t_CompletionCell	completion_cells[MQTT_COMPLETION_QUEUE_SIZE];
+	unsigned int		enqueue_pos __attribute__((aligned(MQTT_CACHE_LINE_SIZE)));
+	unsigned int		dequeue_pos __attribute__((aligned(MQTT_CACHE_LINE_SIZE)));
+	/* Completions arriving while the queue is full wait here in order, harvested after the queue */
+	pthread_mutex_t		overflow_lock __attribute__((aligned(MQTT_CACHE_LINE_SIZE)));
+	t_CompletionOverflow	*overflow_head;
+	t_CompletionOverflow	*overflow_tail;
+	unsigned int		overflow_count;									/* completions waiting in the overflow list */
+	t_ExecutorWorker	workers[SERVICE_LAST];							/* worker of each service in the callback executor */
+	bool				executor_started;								/* executor workers running */
+	SlowCbkNotify		slow_cbk;										/* slow callback notification */
+} t_MqttNotifier;
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+ * @brief	Set the notifier of a new client context to the default notification mode.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientNotifyInit(t_MqttClient *client);
+
+/**
+ * @brief	Select how request results are delivered.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: mode	: notification mode
+ * @return 		void
+ *
+*/
+void MqttClientNotifySetMode(t_MqttClient *client, t_MqttNotifyMode mode);
+
+/**
+ * @brief	Set the callback notified about callbacks exceeding their budget.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: cbk	: slow callback notification, NULL to disable
+ * @return 		void
+ *
+*/
+void MqttClientNotifySetSlowCbk(t_MqttClient *client, SlowCbkNotify cbk);
+
+/**
+ * @brief	Deliver the result of a request according to the notification mode.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: cbk			: callback given on submission
+ * @param[in]	: handle		: handle of the request
+ * @param[in]	: resp			: response to be sent to the service
+ * @param[in]	: user_ctx		: user context pointer given on submission
+ * @param[in]	: service_id	: service owning the request
+ * @return 		void
+ *
+*/
+void MqttClientNotifyDispatch(t_MqttClient *client, RxCbk cbk, t_MqttRequestHandle handle, t_ServerReplyCodes resp, void *user_ctx, unsigned char service_id);
+
+/**
+ * @brief	Get the eventfd signalled when completions are queued.
+ *
+ * @param[in]	: client	: client context
+ * @return 	int
+ * @retval	<0	: completion queue mode not enabled
+ *
+*/
+int MqttClientNotifyGetFd(t_MqttClient *client);
+
+/**
+ * @brief	Harvest queued completions.
+ *
+ * @param[in]	: client	: client context
+ * @param[out]	: completions	: array receiving the completions
+ * @param[in]	: max			: size of completions array
+ * @return 		unsigned short
+ * @retval		number of completions harvested
+ *
+*/
+unsigned short MqttClientNotifyHarvest(t_MqttClient *client, t_MqttCompletion *completions, unsigned short max);
+
+/**
+ * @brief	Get the number of completions that did not fit in the completion queue and waited in its overflow list.
+ *
+ * @param[in]	: client	: client context
+ * @return 	unsigned int
+ *
+*/
+unsigned int MqttClientNotifyGetOverflows(t_MqttClient *client);
+
+/**
+ * @brief	Get the number of callbacks of a service that did not fit in its callback executor queue and waited in its
+ * 			overflow list.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service id
+ * @return 	unsigned int
+ *
+*/
+unsigned int MqttClientNotifyGetExecutorOverflows(t_MqttClient *client, unsigned char service_id);
+
+/**
+ * @brief	Stop the executor workers once they ran the callbacks queued, close the completion eventfd and release the
+ * 			completions not harvested.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientNotifyClose(t_MqttClient *client);
+
+/* -------------------------------- Routines -------------------------------- */
+
+#endif /* MQTTCLIENT_NOTIFY_H */
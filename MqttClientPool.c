@@ -0,0 +1,314 @@
+/**************************************************************************//**
+*  @par Language: C
+*******************************************************************************
+*  @par 	Project:
+*  @brief   MqttClient connection pool implementation
+*  @author  dr-paradox
+*  @version 1.0.0
+*******************************************************************************
+*  @ref 	MqttClient "API Reference"
+*  @file 	MqttClientPool.c
+*******************************************************************************/
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "MqttClientPool.h"
+#include "MqttClientContext.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* Bucket of the pool routing keys of a key hash */
+#define ROUTE_BUCKET(hash)			((unsigned short)((hash) & (uint32_t)(MQTT_POOL_ROUTE_BUCKETS - 1u)))
+
+/* FNV-1a 32 bit parameters */
+#define FNV_OFFSET_BASIS			((uint32_t)2166136261u)
+#define FNV_PRIME					((uint32_t)16777619u)
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* ---------------------------- Global Variables ---------------------------- */
+
+/* Connection pools */
+static t_MqttClientPool pool_instances[MQTT_MAX_POOLS];
+/* Protects the allocation of pool_instances */
+static pthread_mutex_t pools_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+* @brief	Hash a routing key.
+*
+* @param[in]	: key		: routing key
+* @param[in]	: key_len	: length of key
+* @return		uint32_t
+*/
+static uint32_t MqttClientPoolHashKey(const unsigned char *key, unsigned short key_len);
+
+/**
+* @brief	Position of a point of a member on the ring. It only depends on the member index and the point
+* 			index, so the points of the other members never move.
+*
+* @param[in]	: member	: index of the member
+* @param[in]	: vnode		: index of the point of the member
+* @return		uint32_t
+*/
+static uint32_t MqttClientPoolHashPoint(unsigned char member, unsigned short vnode);
+
+/**
+* @brief	qsort() comparison of two ring points by hash.
+*
+* @param[in]	: a	: first point
+* @param[in]	: b	: second point
+* @return		int
+*/
+static int MqttClientPoolComparePoints(const void *a, const void *b);
+
+/**
+* @brief	Check whether a member is connected to its broker and able to take requests.
+*
+* @param[in]	: member	: client context
+* @return		bool
+*/
+static bool MqttClientPoolMemberUp(t_MqttClient *member);
+
+/**
+* @brief	Check whether a member holds requests of a routing bucket: queued or in flight, or spooled records not
+* 			acknowledged yet.
+*
+* @param[in]	: member		: client context
+* @param[in]	: route			: routing bucket
+* @return		bool
+*/
+static bool MqttClientPoolMemberHolds(t_MqttClient *member, unsigned short route);
+
+/* -------------------------------- Routines -------------------------------- */
+
+/**
+* @brief	Hash a routing key.
+*
+* @param[in]	: key		: routing key
+* @param[in]	: key_len	: length of key
+* @return		uint32_t
+*/
+static uint32_t MqttClientPoolHashKey(const unsigned char *key, unsigned short key_len)
+{
+	uint32_t hash = FNV_OFFSET_BASIS;
+	unsigned short idx;
+
+	for (idx = 0U; idx < key_len; idx++)
+	{
+		hash ^= key[idx];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+/**
+* @brief	Position of a point of a member on the ring. It only depends on the member index and the point
+* 			index, so the points of the other members never move.
+*
+* @param[in]	: member	: index of the member
+* @param[in]	: vnode		: index of the point of the member
+* @return		uint32_t
+*/
+static uint32_t MqttClientPoolHashPoint(unsigned char member, unsigned short vnode)
+{
+	/* murmur3 finalizer, spreads the consecutive ids over the whole ring */
+	uint32_t hash = ((uint32_t)member << 16) | vnode;
+
+	hash ^= hash >> 16;
+	hash *= 0x85EBCA6Bu;
+	hash ^= hash >> 13;
+	hash *= 0xC2B2AE35u;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+/**
+* @brief	qsort() comparison of two ring points by hash.
+*
+* @param[in]	: a	: first point
+* @param[in]	: b	: second point
+* @return		int
+*/
+static int MqttClientPoolComparePoints(const void *a, const void *b)
+{
+	const t_PoolRingPoint *point_a = (const t_PoolRingPoint *)a;
+	const t_PoolRingPoint *point_b = (const t_PoolRingPoint *)b;
+	int result = 0;
+
+	if ( point_a->hash < point_b->hash )
+	{
+		result = -1;
+	}
+	else if ( point_a->hash > point_b->hash )
+	{
+		result = 1;
+	}
+	else
+	{
+		/* equal hashes are ordered by member so that every pool sorts them the same way */
+		result = (int)point_a->member - (int)point_b->member;
+	}
+
+	return result;
+}
+
+/**
+* @brief	Check whether a member is connected to its broker and able to take requests.
+*
+* @param[in]	: member	: client context
+* @return		bool
+*/
+static bool MqttClientPoolMemberUp(t_MqttClient *member)
+{
+	return ( 0U != MqttClient_IsConnected(member) );
+}
+
+/**
+* @brief	Check whether a member holds requests of a routing bucket: queued or in flight, or spooled records not
+* 			acknowledged yet.
+*
+* @param[in]	: member		: client context
+* @param[in]	: route			: routing bucket
+* @return		bool
+*/
+static bool MqttClientPoolMemberHolds(t_MqttClient *member, unsigned short route)
+{
+	return ( (true == MqttClientQueueRouteHeld(member, route)) || (true == MqttClientSpoolRouteHeld(member, route)) );
+}
+
+/**
+ * @brief	Create a pool of client contexts and build its hashing ring.
+ *
+ * @param[in]	: members	: client contexts of the pool
+ * @param[in]	: count		: number of members, at most MQTT_MAX_CLIENTS
+ * @return 		t_MqttClientPool*
+ * @retval		NULL	: MQTT_MAX_POOLS pools already created
+ *
+*/
+t_MqttClientPool* MqttClientPoolCreate(t_MqttClient * const *members, unsigned char count)
+{
+	t_MqttClientPool *pool = NULL;
+	unsigned char idx;
+	unsigned short vnode;
+
+	pthread_mutex_lock(&pools_lock);
+
+	for (idx = 0U; idx < MQTT_MAX_POOLS; idx++)
+	{
+		if ( false == pool_instances[idx].in_use )
+		{
+			pool = &pool_instances[idx];
+			pool->in_use = true;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&pools_lock);
+
+	if ( pool != NULL )
+	{
+		pool->member_count = count;
+		pool->ring_size = 0U;
+
+		for (idx = 0U; idx < count; idx++)
+		{
+			pool->members[idx] = members[idx];
+
+			for (vnode = 0U; vnode < MQTT_POOL_VNODES; vnode++)
+			{
+				pool->ring[pool->ring_size].hash = MqttClientPoolHashPoint(idx, vnode);
+				pool->ring[pool->ring_size].member = idx;
+				pool->ring_size++;
+			}
+		}
+
+		qsort(pool->ring, pool->ring_size, sizeof(t_PoolRingPoint), MqttClientPoolComparePoints);
+
+		printf("MqttClient: Pool created with %d members and %d ring points", count, pool->ring_size);
+	}
+
+	return pool;
+}
+
+/**
+ * @brief	Get the member owning a key: the member still holding requests of the key, so that they keep their order,
+ * 			otherwise the owner of the first point following the key hash on the ring, skipping the members not
+ * 			connected to their broker.
+ *
+ * @param[in]	: pool			: connection pool
+ * @param[in]	: key			: routing key
+ * @param[in]	: key_len		: length of key
+ * @param[out]	: route			: routing bucket of the key, to be held by MqttClientQueueRouteHold(), may be NULL
+ * @return 		t_MqttClient*
+ *
+*/
+t_MqttClient* MqttClientPoolRoute(t_MqttClientPool *pool, const unsigned char *key, unsigned short key_len, unsigned short *route)
+{
+	uint32_t hash = MqttClientPoolHashKey(key, key_len);
+	unsigned short bucket = ROUTE_BUCKET(hash);
+	unsigned short low = 0U;
+	unsigned short high = pool->ring_size;
+	unsigned short mid = 0U;
+	unsigned short step;
+	unsigned short pos;
+	unsigned char idx;
+	t_MqttClient *held = NULL;
+	t_MqttClient *owner = NULL;
+	t_MqttClient *member = NULL;
+
+	if ( route != NULL )
+	{
+		*route = bucket;
+	}
+
+	/* a key moves only once the member it was given to released its requests, whether it is connected or not */
+	for (idx = 0U; (NULL == held) && (idx < pool->member_count); idx++)
+	{
+		if ( true == MqttClientPoolMemberHolds(pool->members[idx], bucket) )
+		{
+			held = pool->members[idx];
+		}
+	}
+
+	/* first point at or after the hash, the ring wraps around after its last point */
+	while ( (NULL == held) && (low < high) )
+	{
+		mid = (unsigned short)((low + high) / 2u);
+		if ( pool->ring[mid].hash < hash )
+		{
+			low = (unsigned short)(mid + 1u);
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+
+	/* the keys of a member down move to the following points only, the keys of the others stay in place */
+	for (step = 0U; (NULL == held) && (step < pool->ring_size); step++)
+	{
+		pos = (unsigned short)((low + step) % pool->ring_size);
+		member = pool->members[pool->ring[pos].member];
+
+		if ( owner == NULL )
+		{
+			owner = member;
+		}
+
+		if ( true == MqttClientPoolMemberUp(member) )
+		{
+			owner = member;
+			break;
+		}
+	}
+
+	/* with no member connected the request waits in the queue of the natural owner */
+	return (held != NULL) ? held : owner;
+}
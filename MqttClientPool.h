@@ -0,0 +1,76 @@
+/**************************************************************************//**
+*  @par Language  : C
+*******************************************************************************
+*  @brief       MqttClient connection pool header file.
+*  @author      dr-paradox
+*  @version     1.0.0
+*******************************************************************************
+*  @page 	MqttClientPool
+*  @ref 	MqttClient "API Reference" header file
+*  @file 	MqttClientPool.h
+*
+*******************************************************************************/
+
+#ifndef MQTTCLIENT_POOL_H
+#define MQTTCLIENT_POOL_H
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "MqttClient.h"
+#include "MqttClientCfg.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* Number of points of the consistent hashing ring of a pool */
+#define MQTT_POOL_RING_SIZE		((unsigned short)(MQTT_MAX_CLIENTS * MQTT_POOL_VNODES))
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* Point of the consistent hashing ring, owned by a member */
+typedef struct {
+	uint32_t		hash;			/*position on the ring*/
+	unsigned char	member;			/*index of the owning member*/
+} t_PoolRingPoint;
+
+/* Connection pool */
+struct s_MqttClientPool {
+	t_MqttClient	*members[MQTT_MAX_CLIENTS];			/*client contexts of the pool*/
+	unsigned char	member_count;						/*number of members*/
+	t_PoolRingPoint	ring[MQTT_POOL_RING_SIZE];			/*points of every member, sorted by hash*/
+	unsigned short	ring_size;							/*number of points in ring*/
+	bool			in_use;								/*pool handed out by MqttClientPoolCreate()*/
+};
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+ * @brief	Create a pool of client contexts and build its hashing ring.
+ *
+ * @param[in]	: members	: client contexts of the pool
+ * @param[in]	: count		: number of members, at most MQTT_MAX_CLIENTS
+ * @return 		t_MqttClientPool*
+ * @retval		NULL	: MQTT_MAX_POOLS pools already created
+ *
+*/
+t_MqttClientPool* MqttClientPoolCreate(t_MqttClient * const *members, unsigned char count);
+
+/**
+ * @brief	Get the member owning a key: the member still holding requests of the key, so that they keep their order,
+ * 			otherwise the owner of the first point following the key hash on the ring, skipping the members not
+ * 			connected to their broker.
+ *
+ * @param[in]	: pool			: connection pool
+ * @param[in]	: key			: routing key
+ * @param[in]	: key_len		: length of key
+ * @param[out]	: route			: routing bucket of the key, to be held by MqttClientQueueRouteHold(), may be NULL
+ * @return 		t_MqttClient*
+ *
+*/
+t_MqttClient* MqttClientPoolRoute(t_MqttClientPool *pool, const unsigned char *key, unsigned short key_len, unsigned short *route);
+
+/* -------------------------------- Routines -------------------------------- */
+
+#endif /* MQTTCLIENT_POOL_H */
@@ -0,0 +1,1700 @@
+/**************************************************************************//**
+*  @par Language: C
+*******************************************************************************
+*  @par 	Project:
+*  @brief   MqttClient request queue implementation
+*  @author  dr-paradox
+*  @version 1.0.0
+*******************************************************************************
+*  @ref 	MqttClient "API Reference"
+*  @file 	MqttClientQueue.c
+*******************************************************************************/
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+#include "MqttClientQueue.h"
+#include "MqttClientContext.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* Mask extracting the pool index from a request handle */
+#define HANDLE_INDEX_MASK			((unsigned int)((1u << MQTT_HANDLE_INDEX_BITS) - 1u))
+
+/* No watermark crossed */
+#define WATERMARK_NONE				((int)-1)
+
+/* The high watermark has to be reachable and the low one below it, or the watermark callback never fires */
+_Static_assert(MQTT_QUEUE_HIGH_WATERMARK <= MQTT_QUEUE_CAPACITY, "MQTT_QUEUE_HIGH_WATERMARK above the queue capacity");
+_Static_assert(MQTT_QUEUE_LOW_WATERMARK < MQTT_QUEUE_HIGH_WATERMARK, "MQTT_QUEUE_LOW_WATERMARK not below MQTT_QUEUE_HIGH_WATERMARK");
+
+/* Every routing bucket has its bit in the masks of the held buckets */
+_Static_assert(MQTT_POOL_ROUTE_BUCKETS <= 64U, "MQTT_POOL_ROUTE_BUCKETS above the bits of the held bucket masks");
+
+/* Request not belonging to a combined batch */
+#define NO_BATCH					((unsigned char)0)
+
+/* FNV-1a 32 bit parameters */
+#define FNV_OFFSET_BASIS			((uint32_t)2166136261u)
+#define FNV_PRIME					((uint32_t)16777619u)
+
+/* Bucket of the coalescing index of a key hash */
+#define COALESCE_BUCKET(hash)		((hash) & (uint32_t)(MQTT_COALESCE_BUCKETS - 1u))
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* Notification collected under lock and delivered once the lock is released */
+typedef struct
+{
+	RxCbk				cbk;
+	t_MqttRequestHandle	handle;
+	void				*user_ctx;
+	t_ServerReplyCodes	resp;
+	unsigned char		service_id;
+} t_QueueNotification;
+
+/* ---------------------------- Global Variables ---------------------------- */
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+* @brief	Move the request at a position of the deadline heap up or down to its place. Called under lock.
+*
+* @param[in]	: queue	: request queue of the client
+* @param[in]	: pos	: position in the deadline heap
+* @return		void
+*/
+static void MqttClientQueueDeadlineSift(t_MqttQueue *queue, unsigned short pos);
+
+/**
+* @brief	Add a request with a deadline to the deadline heap. Called under lock.
+*
+* @param[in]	: queue	: request queue of the client
+* @param[in]	: idx	: index in pool
+* @return		void
+*/
+static void MqttClientQueueDeadlineInsert(t_MqttQueue *queue, unsigned char idx);
+
+/**
+* @brief	Remove a request from the deadline heap. Called under lock.
+*
+* @param[in]	: queue	: request queue of the client
+* @param[in]	: idx	: index in pool
+* @return		void
+*/
+static void MqttClientQueueDeadlineRemove(t_MqttQueue *queue, unsigned char idx);
+
+/**
+* @brief	Hash a coalescing or ordering key of a service.
+*
+* @param[in]	: service_id	: service of the key
+* @param[in]	: key			: coalescing or ordering key
+* @param[in]	: key_len		: length of key
+* @return		uint32_t
+*/
+static uint32_t MqttClientQueueHashKey(unsigned char service_id, const unsigned char *key, unsigned short key_len);
+
+/**
+* @brief	Find the queued request of a coalescing key not taken by the FSM yet. Called under lock.
+*
+* @param[in]	: queue			: request queue of the client
+* @param[in]	: service_id	: service of the key
+* @param[in]	: key			: coalescing key
+* @param[in]	: key_len		: length of key
+* @param[in]	: hash			: value returned by MqttClientQueueHashKey()
+* @return		unsigned short
+* @retval		index in pool
+* @retval		MQTT_NO_REQUEST	: no such request
+*/
+static unsigned short MqttClientQueueFindKey(t_MqttQueue *queue, unsigned char service_id, const unsigned char *key,
+												unsigned short key_len, uint32_t hash);
+
+/**
+* @brief	Remove a request from the coalescing index. Called under lock.
+*
+* @param[in]	: queue	: request queue of the client
+* @param[in]	: idx	: index in pool
+* @return		void
+*/
+static void MqttClientQueueUnlinkKey(t_MqttQueue *queue, unsigned char idx);
+
+/**
+* @brief	Remove a request from the window of requests with an ordering key in flight. Called under lock.
+*
+* @param[in]	: queue	: request queue of the client
+* @param[in]	: idx	: index in pool
+* @return		void
+*/
+static void MqttClientQueueOrderedRemove(t_MqttQueue *queue, unsigned char idx);
+
+/**
+* @brief	Find the oldest queued request with an ordering key whose key has no request in flight. Called under lock.
+*
+* @param[in]	: queue	: request queue of the client
+* @return		unsigned short
+* @retval		index in pool
+* @retval		MQTT_NO_REQUEST	: no such request
+*/
+static unsigned short MqttClientQueueOrderedFind(t_MqttQueue *queue);
+
+/**
+* @brief	Remove the request at a position of a service queue, later requests are shifted. Called under lock.
+* 			The request of a combined batch is only notified with its last request.
+*
+* @param[in]	: queue	: request queue of the client
+* @param[in]	: sq	: service queue
+* @param[in]	: pos	: position from head
+* @param[in]	: resp	: response of the request
+* @param[out]	: notif	: notification data of the removed request
+* @return		void
+*/
+static void MqttClientQueueRemoveAt(t_MqttQueue *queue, t_ServiceQueue *sq, unsigned short pos, t_ServerReplyCodes resp, t_QueueNotification *notif);
+
+/**
+* @brief	Drop the oldest request of a service not yet taken by the FSM. Called under lock.
+*
+* @param[in]	: queue	: request queue of the client
+* @param[in]	: sq	: service queue
+* @param[out]	: notif	: notification data of the dropped request
+* @return		bool
+* @retval		true	: a request was dropped
+* @retval		false	: nothing could be dropped
+*/
+static bool MqttClientQueueDropOldest(t_MqttQueue *queue, t_ServiceQueue *sq, t_QueueNotification *notif);
+
+/**
+* @brief	Check whether the queue depth crossed a watermark since last call. Called under lock.
+*
+* @param[in]	: queue	: request queue of the client
+* @return	int
+* @retval	WATERMARK_NONE	: no watermark crossed
+* @retval	1				: high watermark crossed
+* @retval	0				: low watermark crossed
+*/
+static int MqttClientQueueWatermarkEdge(t_MqttQueue *queue);
+
+/**
+* @brief	Deliver a notification collected under lock.
+*
+* @param[in]	: client	: client context
+* @param[in]	: notif	: notification data
+* @return		void
+*/
+static void MqttClientQueueNotify(t_MqttClient *client, t_QueueNotification *notif);
+
+/**
+* @brief	Deliver a watermark notification.
+*
+* @param[in]	: queue	: request queue of the client
+* @param[in]	: edge	: value returned by MqttClientQueueWatermarkEdge()
+* @param[in]	: depth	: queue depth
+* @return		void
+*/
+static void MqttClientQueueNotifyWatermark(t_MqttQueue *queue, int edge, unsigned short depth);
+
+/**
+* @brief	Count a request in or out of a bucket of the pool routing keys. The bucket is marked held in route_mask while
+* 			its count is not zero, the mask is only written when the count leaves or comes back to zero.
+*
+* @param[in]	: queue	: request queue of the client
+* @param[in]	: route	: routing bucket, MQTT_NO_ROUTE for none
+* @param[in]	: add	: request added, released otherwise
+* @return		void
+*/
+static void MqttClientQueueCountRoute(t_MqttQueue *queue, unsigned short route, bool add);
+
+/* -------------------------------- Routines -------------------------------- */
+
+/**
+* @brief	Move the request at a position of the deadline heap up or down to its place. Called under lock.
+*
+* @param[in]	: queue	: request queue of the client
+* @param[in]	: pos	: position in the deadline heap
+* @return		void
+*/
+static void MqttClientQueueDeadlineSift(t_MqttQueue *queue, unsigned short pos)
+{
+	unsigned char idx = queue->deadlines[pos];
+	uint64_t deadline_ms = queue->pool[idx].deadline_ms;
+	unsigned short parent;
+	unsigned short child;
+
+	/* up while earlier than its parent */
+	while ( pos > 0U )
+	{
+		parent = (unsigned short)((pos - 1u) / 2u);
+		if ( queue->pool[queue->deadlines[parent]].deadline_ms <= deadline_ms )
+		{
+			break;
+		}
+		queue->deadlines[pos] = queue->deadlines[parent];
+		queue->pool[queue->deadlines[pos]].deadline_pos = pos;
+		pos = parent;
+	}
+
+	/* down while later than its earliest child */
+	for (child = (unsigned short)((2u * pos) + 1u); child < queue->deadline_count; child = (unsigned short)((2u * pos) + 1u))
+	{
+		if ( ((child + 1u) < queue->deadline_count) &&
+			 (queue->pool[queue->deadlines[child + 1u]].deadline_ms < queue->pool[queue->deadlines[child]].deadline_ms) )
+		{
+			child++;
+		}
+		if ( queue->pool[queue->deadlines[child]].deadline_ms >= deadline_ms )
+		{
+			break;
+		}
+		queue->deadlines[pos] = queue->deadlines[child];
+		queue->pool[queue->deadlines[pos]].deadline_pos = pos;
+		pos = child;
+	}
+
+	queue->deadlines[pos] = idx;
+	queue->pool[idx].deadline_pos = pos;
+}
+
+/**
+* @brief	Add a request with a deadline to the deadline heap. Called under lock.
+*
+* @param[in]	: queue	: request queue of the client
+* @param[in]	: idx	: index in pool
+* @return		void
+*/
+static void MqttClientQueueDeadlineInsert(t_MqttQueue *queue, unsigned char idx)
+{
+	queue->deadlines[queue->deadline_count] = idx;
+	queue->deadline_count++;
+	MqttClientQueueDeadlineSift(queue, (unsigned short)(queue->deadline_count - 1u));
+}
+
+/**
+* @brief	Remove a request from the deadline heap. Called under lock.
+*
+* @param[in]	: queue	: request queue of the client
+* @param[in]	: idx	: index in pool
+* @return		void
+*/
+static void MqttClientQueueDeadlineRemove(t_MqttQueue *queue, unsigned char idx)
+{
+	unsigned short pos = queue->pool[idx].deadline_pos;
+
+	queue->pool[idx].deadline_pos = MQTT_NO_DEADLINE;
+	queue->deadline_count--;
+
+	/* the last request of the heap takes the freed position */
+	if ( pos != queue->deadline_count )
+	{
+		queue->deadlines[pos] = queue->deadlines[queue->deadline_count];
+		MqttClientQueueDeadlineSift(queue, pos);
+	}
+}
+
+/**
+* @brief	Hash a coalescing or ordering key of a service.
+*
+* @param[in]	: service_id	: service of the key
+* @param[in]	: key			: coalescing or ordering key
+* @param[in]	: key_len		: length of key
+* @return		uint32_t
+*/
+static uint32_t MqttClientQueueHashKey(unsigned char service_id, const unsigned char *key, unsigned short key_len)
+{
+	uint32_t hash = FNV_OFFSET_BASIS;
+	unsigned short idx;
+
+	hash ^= service_id;
+	hash *= FNV_PRIME;
+	for (idx = 0U; idx < key_len; idx++)
+	{
+		hash ^= key[idx];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+/**
+* @brief	Find the queued request of a coalescing key not taken by the FSM yet. Called under lock.
+*
+* @param[in]	: queue			: request queue of the client
+* @param[in]	: service_id	: service of the key
+* @param[in]	: key			: coalescing key
+* @param[in]	: key_len		: length of key
+* @param[in]	: hash			: value returned by MqttClientQueueHashKey()
+* @return		unsigned short
+* @retval		index in pool
+* @retval		MQTT_NO_REQUEST	: no such request
+*/
+static unsigned short MqttClientQueueFindKey(t_MqttQueue *queue, unsigned char service_id, const unsigned char *key,
+												unsigned short key_len, uint32_t hash)
+{
+	unsigned short idx = queue->coalesce_index[COALESCE_BUCKET(hash)];
+
+	/* a request in flight keeps its value, the new one is queued behind it */
+	while ( (MQTT_NO_REQUEST != idx) &&
+			((queue->pool[idx].key_hash != hash) || (queue->pool[idx].service_id != service_id) ||
+			 (queue->pool[idx].key_len != key_len) || (true == queue->pool[idx].in_flight) ||
+			 (0 != memcmp(queue->pool[idx].key, key, key_len))) )
+	{
+		idx = queue->pool[idx].key_next;
+	}
+
+	return idx;
+}
+
+/**
+* @brief	Remove a request from the coalescing index. Called under lock.
+*
+* @param[in]	: queue	: request queue of the client
+* @param[in]	: idx	: index in pool
+* @return		void
+*/
+static void MqttClientQueueUnlinkKey(t_MqttQueue *queue, unsigned char idx)
+{
+	unsigned short *link = &queue->coalesce_index[COALESCE_BUCKET(queue->pool[idx].key_hash)];
+
+	while ( (MQTT_NO_REQUEST != *link) && (*link != idx) )
+	{
+		link = &queue->pool[*link].key_next;
+	}
+
+	if ( MQTT_NO_REQUEST != *link )
+	{
+		*link = queue->pool[idx].key_next;
+	}
+	queue->pool[idx].key_len = 0U;
+	queue->pool[idx].key_next = MQTT_NO_REQUEST;
+}
+
+/**
+* @brief	Remove a request from the window of requests with an ordering key in flight. Called under lock.
+*
+* @param[in]	: queue	: request queue of the client
+* @param[in]	: idx	: index in pool
+* @return		void
+*/
+static void MqttClientQueueOrderedRemove(t_MqttQueue *queue, unsigned char idx)
+{
+	unsigned short slot;
+
+	for (slot = 0U; (slot < queue->ordered_count) && (queue->ordered[slot].idx != idx); slot++)
+	{
+	}
+
+	/* close the gap so the window stays in publication order */
+	if ( slot < queue->ordered_count )
+	{
+		for (; (slot + 1u) < queue->ordered_count; slot++)
+		{
+			queue->ordered[slot] = queue->ordered[slot + 1u];
+		}
+		queue->ordered_count--;
+	}
+}
+
+/**
+* @brief	Find the oldest queued request with an ordering key whose key has no request in flight. Called under lock.
+*
+* @param[in]	: queue	: request queue of the client
+* @return		unsigned short
+* @retval		index in pool
+* @retval		MQTT_NO_REQUEST	: no such request
+*/
+static unsigned short MqttClientQueueOrderedFind(t_MqttQueue *queue)
+{
+	t_ServiceQueue *sq = NULL;
+	unsigned short service_id;
+	unsigned short pos;
+	unsigned short slot;
+	unsigned char idx;
+
+	for (service_id = 0U; service_id < (unsigned short)SERVICE_LAST; service_id++)
+	{
+		sq = &queue->service_queues[service_id];
+
+		for (pos = 0U; pos < sq->count; pos++)
+		{
+			idx = sq->slots[(sq->head + pos) % MQTT_SERVICE_QUEUE_DEPTH];
+
+			if ( (true == queue->pool[idx].ordered) && (false == queue->pool[idx].in_flight) )
+			{
+				/* keys are told apart by their hash only, a collision just publishes two keys one after the other */
+				for (slot = 0U; (slot < queue->ordered_count) &&
+								(queue->pool[queue->ordered[slot].idx].order_hash != queue->pool[idx].order_hash); slot++)
+				{
+				}
+
+				if ( slot == queue->ordered_count )
+				{
+					return idx;
+				}
+			}
+		}
+	}
+
+	return MQTT_NO_REQUEST;
+}
+
+/**
+* @brief	Remove the request at a position of a service queue, later requests are shifted. Called under lock.
+* 			The request of a combined batch is only notified with its last request.
+*
+* @param[in]	: queue	: request queue of the client
+* @param[in]	: sq	: service queue
+* @param[in]	: pos	: position from head
+* @param[in]	: resp	: response of the request
+* @param[out]	: notif	: notification data of the removed request
+* @return		void
+*/
+static void MqttClientQueueRemoveAt(t_MqttQueue *queue, t_ServiceQueue *sq, unsigned short pos, t_ServerReplyCodes resp, t_QueueNotification *notif)
+{
+	unsigned char idx = sq->slots[(sq->head + pos) % MQTT_SERVICE_QUEUE_DEPTH];
+	t_BatchGroup *group = NULL;
+	unsigned short i;
+
+	notif->service_id = queue->pool[idx].service_id;
+
+	if ( NO_BATCH == queue->pool[idx].batch )
+	{
+		notif->cbk = queue->pool[idx].cbk;
+		notif->handle = queue->pool[idx].handle;
+		notif->user_ctx = queue->pool[idx].user_ctx;
+		notif->resp = resp;
+	}
+	else
+	{
+		group = &queue->batches[queue->pool[idx].batch - 1u];
+		group->remaining--;
+
+		/* the batch reports its first failure */
+		if ( (SERVERCOM_OK == group->resp) && (SERVERCOM_OK != resp) )
+		{
+			group->resp = resp;
+		}
+
+		if ( 0U == group->remaining )
+		{
+			notif->cbk = group->cbk;
+			notif->handle = group->handle;
+			notif->user_ctx = group->user_ctx;
+			notif->resp = group->resp;
+		}
+	}
+
+	/* close the gap so the queue stays ordered */
+	for (i = pos; (i + 1u) < sq->count; i++)
+	{
+		sq->slots[(sq->head + i) % MQTT_SERVICE_QUEUE_DEPTH] = sq->slots[(sq->head + i + 1u) % MQTT_SERVICE_QUEUE_DEPTH];
+	}
+	sq->count--;
+
+	if ( MQTT_NO_DEADLINE != queue->pool[idx].deadline_pos )
+	{
+		MqttClientQueueDeadlineRemove(queue, idx);
+	}
+
+	if ( 0U != queue->pool[idx].key_len )
+	{
+		MqttClientQueueUnlinkKey(queue, idx);
+	}
+
+	if ( true == queue->pool[idx].ordered )
+	{
+		MqttClientQueueOrderedRemove(queue, idx);
+	}
+
+	MqttClientQueueCountRoute(queue, queue->pool[idx].route, false);
+
+	queue->pool[idx].handle = MQTT_INVALID_REQUEST_HANDLE;
+	queue->pool[idx].deadline_ms = 0U;
+	queue->pool[idx].retry_count = 0U;
+	queue->pool[idx].cancel = false;
+	queue->pool[idx].in_flight = false;
+	queue->pool[idx].batch = NO_BATCH;
+	queue->pool[idx].ordered = false;
+	queue->free_list[queue->free_count++] = idx;
+}
+
+/**
+* @brief	Drop the oldest request of a service not yet taken by the FSM. Called under lock.
+*
+* @param[in]	: queue	: request queue of the client
+* @param[in]	: sq	: service queue
+* @param[out]	: notif	: notification data of the dropped request
+* @return		bool
+* @retval		true	: a request was dropped
+* @retval		false	: nothing could be dropped
+*/
+static bool MqttClientQueueDropOldest(t_MqttQueue *queue, t_ServiceQueue *sq, t_QueueNotification *notif)
+{
+	bool dropped = false;
+	unsigned short pos;
+
+	for (pos = 0U; pos < sq->count; pos++)
+	{
+		if ( false == queue->pool[sq->slots[(sq->head + pos) % MQTT_SERVICE_QUEUE_DEPTH]].in_flight )
+		{
+			MqttClientQueueRemoveAt(queue, sq, pos, SERVERCOM_DROPPED, notif);
+			dropped = true;
+			break;
+		}
+	}
+
+	return dropped;
+}
+
+/**
+* @brief	Check whether the queue depth crossed a watermark since last call. Called under lock.
+*
+* @param[in]	: queue	: request queue of the client
+* @return	int
+* @retval	WATERMARK_NONE	: no watermark crossed
+* @retval	1				: high watermark crossed
+* @retval	0				: low watermark crossed
+*/
+static int MqttClientQueueWatermarkEdge(t_MqttQueue *queue)
+{
+	unsigned short depth = (unsigned short)(MQTT_REQ_POOL_SIZE - queue->free_count);
+	int edge = WATERMARK_NONE;
+
+	if ( (false == queue->saturated) && (depth >= MQTT_QUEUE_HIGH_WATERMARK) )
+	{
+		queue->saturated = true;
+		edge = 1;
+	}
+	else if ( (true == queue->saturated) && (depth <= MQTT_QUEUE_LOW_WATERMARK) )
+	{
+		queue->saturated = false;
+		edge = 0;
+	}
+	else
+	{
+		/* no watermark crossed */
+	}
+
+	return edge;
+}
+
+/**
+* @brief	Deliver a notification collected under lock.
+*
+* @param[in]	: client	: client context
+* @param[in]	: notif	: notification data
+* @return		void
+*/
+static void MqttClientQueueNotify(t_MqttClient *client, t_QueueNotification *notif)
+{
+	if ( notif->cbk != (RxCbk)NULL )
+	{
+		MqttClientNotifyDispatch(client, notif->cbk, notif->handle, notif->resp, notif->user_ctx, notif->service_id);
+	}
+}
+
+/**
+* @brief	Deliver a watermark notification.
+*
+* @param[in]	: queue	: request queue of the client
+* @param[in]	: edge	: value returned by MqttClientQueueWatermarkEdge()
+* @param[in]	: depth	: queue depth
+* @return		void
+*/
+static void MqttClientQueueNotifyWatermark(t_MqttQueue *queue, int edge, unsigned short depth)
+{
+	WatermarkCbk cbk = queue->watermark_cbk;
+
+	if ( edge != WATERMARK_NONE )
+	{
+		printf("MqttClient: Queue %s watermark crossed with depth %d", (edge == 1) ? "high" : "low", depth);
+
+		if ( cbk != (WatermarkCbk)NULL )
+		{
+			cbk((unsigned char)edge, depth);
+		}
+	}
+}
+
+/**
+* @brief	Count a request in or out of a bucket of the pool routing keys. The bucket is marked held in route_mask while
+* 			its count is not zero, the mask is only written when the count leaves or comes back to zero.
+*
+* @param[in]	: queue	: request queue of the client
+* @param[in]	: route	: routing bucket, MQTT_NO_ROUTE for none
+* @param[in]	: add	: request added, released otherwise
+* @return		void
+*/
+static void MqttClientQueueCountRoute(t_MqttQueue *queue, unsigned short route, bool add)
+{
+	uint64_t bit = 0U;
+
+	if ( MQTT_NO_ROUTE == route )
+	{
+		return;
+	}
+
+	bit = (uint64_t)1U << route;
+	if ( true == add )
+	{
+		if ( 1U == __atomic_add_fetch(&queue->route_held[route], 1U, __ATOMIC_ACQ_REL) )
+		{
+			(void)__atomic_fetch_or(&queue->route_mask, bit, __ATOMIC_RELEASE);
+		}
+	}
+	else if ( 0U == __atomic_sub_fetch(&queue->route_held[route], 1U, __ATOMIC_ACQ_REL) )
+	{
+		/* holds and releases come from any thread: a hold taken meanwhile marks the bucket again */
+		(void)__atomic_fetch_and(&queue->route_mask, ~bit, __ATOMIC_RELEASE);
+		if ( 0U != __atomic_load_n(&queue->route_held[route], __ATOMIC_ACQUIRE) )
+		{
+			(void)__atomic_fetch_or(&queue->route_mask, bit, __ATOMIC_RELEASE);
+		}
+	}
+	else
+	{
+		/* the bucket stays held */
+	}
+}
+
+/**
+ * @brief	Create the lock of the queue, release every request and reset the shedding policies.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientQueueInit(t_MqttClient *client)
+{
+	t_MqttQueue *queue = &client->queue;
+	unsigned short idx;
+
+	/* the context is not shared yet, the queue is set up without locking */
+	(void)pthread_mutex_init(&queue->lock, NULL);
+
+	memset(queue->service_queues, 0, sizeof(queue->service_queues));
+	memset(queue->batches, 0, sizeof(queue->batches));
+	for (idx = 0U; idx < (unsigned short)SERVICE_LAST; idx++)
+	{
+		queue->service_queues[idx].policy = MQTT_DEFAULT_SHED_POLICY;
+		queue->service_queues[idx].keep_one_in = 1U;
+	}
+
+	/* lowest indexes are handed out first */
+	for (idx = 0U; idx < MQTT_REQ_POOL_SIZE; idx++)
+	{
+		queue->pool[idx].handle = MQTT_INVALID_REQUEST_HANDLE;
+		queue->pool[idx].retry_count = 0U;
+		queue->pool[idx].batch = NO_BATCH;
+		queue->pool[idx].deadline_ms = 0U;
+		queue->pool[idx].deadline_pos = MQTT_NO_DEADLINE;
+		queue->pool[idx].key_len = 0U;
+		queue->pool[idx].key_next = MQTT_NO_REQUEST;
+		queue->pool[idx].ordered = false;
+		queue->pool[idx].route = MQTT_NO_ROUTE;
+		queue->free_list[idx] = (unsigned char)(MQTT_REQ_POOL_SIZE - 1u - idx);
+	}
+	queue->free_count = MQTT_REQ_POOL_SIZE;
+	queue->deadline_count = 0U;
+	memset(queue->route_held, 0, sizeof(queue->route_held));
+	queue->route_mask = 0U;
+	for (idx = 0U; idx < MQTT_COALESCE_BUCKETS; idx++)
+	{
+		queue->coalesce_index[idx] = MQTT_NO_REQUEST;
+	}
+	queue->ordered_count = 0U;
+	queue->ordered_packet_id = (uint16_t)(MQTT_SPOOL_PACKET_ID_BASE - 1U);
+	queue->request_sequence = 0U;
+	queue->saturated = false;
+	queue->watermark_cbk = (WatermarkCbk)NULL;
+}
+
+/**
+ * @brief	Queue a request of a service. A message with a coalescing key replaces the queued request of the same key
+ * 			not taken by the FSM yet, which is notified SERVERCOM_SUPERSEDED, even when there is no room.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: msg			: message to be sent, already validated
+ * @param[in]	: service_id	: service id of calling service
+ * @param[in]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @param[in]	: shed			: apply the shedding policy of the service when there is no room
+ * @param[in]	: route			: pool routing bucket held for the request by MqttClientQueueRouteHold(), MQTT_NO_ROUTE if none
+ * @param[out]	: handle		: handle of the queued request
+ * @return 		t_MqttSubmitStatus
+ * @retval		MQTT_SUBMIT_OK			: request queued, the bucket is released with the request
+ * @retval		MQTT_SUBMIT_WOULD_BLOCK	: no room and shed is false
+ * @retval		MQTT_SUBMIT_DROPPED		: request shed by the policy of the service
+ *
+*/
+t_MqttSubmitStatus MqttClientQueueSubmit(t_MqttClient *client, const t_MqttMessage *msg, unsigned char service_id,
+											RxCbk cbk, void *user_ctx, bool shed, unsigned short route, t_MqttRequestHandle *handle)
+{
+	t_MqttQueue *queue = &client->queue;
+	t_MqttSubmitStatus status = MQTT_SUBMIT_OK;
+	t_ServiceQueue *sq = &queue->service_queues[service_id];
+	t_QueueNotification dropped = {(RxCbk)NULL, MQTT_INVALID_REQUEST_HANDLE, NULL, SERVERCOM_OK, 0U};
+	bool room = false;
+	unsigned char idx = 0U;
+	unsigned short replaced = MQTT_NO_REQUEST;
+	unsigned short depth = 0U;
+	int edge = WATERMARK_NONE;
+	uint64_t deadline_ms = (msg->ttl_ms != 0U) ? (MqttClientTimerNowMs(&client->timers) + msg->ttl_ms) : 0U;
+	uint32_t hash = (msg->key_len != 0U) ? MqttClientQueueHashKey(service_id, msg->key, msg->key_len) : 0U;
+	uint32_t order_hash = (msg->order_key_len != 0U) ? MqttClientQueueHashKey(service_id, msg->order_key, msg->order_key_len) : 0U;
+
+	pthread_mutex_lock(&queue->lock);
+
+	/* the newer value of a key takes the place of the older one in the queue, it costs no room */
+	if ( msg->key_len != 0U )
+	{
+		replaced = MqttClientQueueFindKey(queue, service_id, msg->key, msg->key_len, hash);
+	}
+
+	if ( MQTT_NO_REQUEST != replaced )
+	{
+		idx = (unsigned char)replaced;
+		dropped.cbk = queue->pool[idx].cbk;
+		dropped.handle = queue->pool[idx].handle;
+		dropped.user_ctx = queue->pool[idx].user_ctx;
+		dropped.resp = SERVERCOM_SUPERSEDED;
+		dropped.service_id = service_id;
+
+		if ( MQTT_NO_DEADLINE != queue->pool[idx].deadline_pos )
+		{
+			MqttClientQueueDeadlineRemove(queue, idx);
+		}
+
+		/* the replaced request gives its routing bucket back, the new value holds its own */
+		MqttClientQueueCountRoute(queue, queue->pool[idx].route, false);
+	}
+	else
+	{
+		room = (queue->free_count > 0U) && (sq->count < MQTT_SERVICE_QUEUE_DEPTH);
+
+		if ( (true == shed) && (true == queue->saturated) && (MQTT_SHED_KEEP_ONE_IN_N == sq->policy) )
+		{
+			/* while the link is saturated only the Nth submission of the service is kept */
+			sq->shed_count++;
+			if ( sq->shed_count >= sq->keep_one_in )
+			{
+				sq->shed_count = 0U;
+			}
+			else
+			{
+				status = MQTT_SUBMIT_DROPPED;
+			}
+		}
+
+		if ( (MQTT_SUBMIT_OK == status) && (false == room) )
+		{
+			if ( false == shed )
+			{
+				status = MQTT_SUBMIT_WOULD_BLOCK;
+			}
+			else if ( (MQTT_SHED_DROP_OLDEST == sq->policy) && (true == MqttClientQueueDropOldest(queue, sq, &dropped)) )
+			{
+				/* room made by dropping the oldest request of the same service */
+			}
+			else
+			{
+				status = MQTT_SUBMIT_DROPPED;
+			}
+		}
+
+		if ( MQTT_SUBMIT_OK == status )
+		{
+			idx = queue->free_list[--queue->free_count];
+
+			sq->slots[(sq->head + sq->count) % MQTT_SERVICE_QUEUE_DEPTH] = idx;
+			sq->count++;
+
+			queue->pool[idx].key_len = msg->key_len;
+			queue->pool[idx].key_next = MQTT_NO_REQUEST;
+			if ( msg->key_len != 0U )
+			{
+				memcpy(queue->pool[idx].key, msg->key, msg->key_len);
+				queue->pool[idx].key_hash = hash;
+				queue->pool[idx].key_next = queue->coalesce_index[COALESCE_BUCKET(hash)];
+				queue->coalesce_index[COALESCE_BUCKET(hash)] = idx;
+			}
+		}
+	}
+
+	if ( MQTT_SUBMIT_OK == status )
+	{
+		/*Build a handle unique among the outstanding requests, 0 is reserved for invalid handle*/
+		do
+		{
+			queue->request_sequence++;
+			*handle = (queue->request_sequence << MQTT_HANDLE_INDEX_BITS) | idx;
+		} while ( *handle == MQTT_INVALID_REQUEST_HANDLE );
+
+		memcpy(queue->pool[idx].json, msg->json, msg->size);
+		queue->pool[idx].json_size = msg->size;
+		queue->pool[idx].cbk = cbk;
+		queue->pool[idx].user_ctx = user_ctx;
+		queue->pool[idx].service_id = service_id;
+		queue->pool[idx].cancel = false;
+		queue->pool[idx].in_flight = false;
+		queue->pool[idx].batch = NO_BATCH;
+		queue->pool[idx].retry_count = MAX_REQ_RETRY_COUNT;
+		queue->pool[idx].handle = *handle;
+		queue->pool[idx].ordered = (msg->order_key_len != 0U);
+		queue->pool[idx].order_hash = order_hash;
+		queue->pool[idx].route = route;
+		queue->pool[idx].deadline_ms = deadline_ms;
+		if ( deadline_ms != 0U )
+		{
+			MqttClientQueueDeadlineInsert(queue, idx);
+		}
+	}
+
+	edge = MqttClientQueueWatermarkEdge(queue);
+	depth = (unsigned short)(MQTT_REQ_POOL_SIZE - queue->free_count);
+
+	pthread_mutex_unlock(&queue->lock);
+
+	if ( MQTT_NO_REQUEST != replaced )
+	{
+		printf("MqttClient: Queued value of service %d replaced by a newer one of its key", service_id);
+	}
+
+	MqttClientQueueNotify(client, &dropped);
+	MqttClientQueueNotifyWatermark(queue, edge, depth);
+
+	return status;
+}
+
+/**
+ * @brief	Queue a batch of requests of a service. Room for the whole batch is reserved at once,
+ * 			either every message is queued or none.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: msgs			: messages to be sent, already validated
+ * @param[in]	: count			: number of messages
+ * @param[in]	: service_id	: service id of calling service
+ * @param[in]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @param[in]	: combined		: notify cbk once for the whole batch
+ * @param[out]	: handles		: handles of the queued requests, count entries
+ * @return 		t_MqttSubmitStatus
+ * @retval		MQTT_SUBMIT_OK			: batch queued
+ * @retval		MQTT_SUBMIT_WOULD_BLOCK	: no room for the whole batch
+ *
+*/
+t_MqttSubmitStatus MqttClientQueueSubmitBatch(t_MqttClient *client, const t_MqttMessage *msgs, unsigned short count, unsigned char service_id,
+												RxCbk cbk, void *user_ctx, bool combined, t_MqttRequestHandle *handles)
+{
+	t_MqttQueue *queue = &client->queue;
+	t_MqttSubmitStatus status = MQTT_SUBMIT_WOULD_BLOCK;
+	t_ServiceQueue *sq = &queue->service_queues[service_id];
+	unsigned char batch = NO_BATCH;
+	unsigned char idx = 0U;
+	unsigned short group;
+	unsigned short msg;
+	unsigned short depth = 0U;
+	int edge = WATERMARK_NONE;
+	uint64_t now_ms = MqttClientTimerNowMs(&client->timers);
+
+	pthread_mutex_lock(&queue->lock);
+
+	if ( (queue->free_count >= count) && ((MQTT_SERVICE_QUEUE_DEPTH - sq->count) >= count) )
+	{
+		status = MQTT_SUBMIT_OK;
+
+		if ( true == combined )
+		{
+			/* a free group always exists since there are at least as many groups as requests */
+			for (group = 0U; group < MQTT_REQ_POOL_SIZE; group++)
+			{
+				if ( 0U == queue->batches[group].remaining )
+				{
+					queue->batches[group].cbk = cbk;
+					queue->batches[group].user_ctx = user_ctx;
+					queue->batches[group].remaining = count;
+					queue->batches[group].resp = SERVERCOM_OK;
+					batch = (unsigned char)(group + 1u);
+					break;
+				}
+			}
+		}
+
+		for (msg = 0U; msg < count; msg++)
+		{
+			idx = queue->free_list[--queue->free_count];
+
+			do
+			{
+				queue->request_sequence++;
+				handles[msg] = (queue->request_sequence << MQTT_HANDLE_INDEX_BITS) | idx;
+			} while ( handles[msg] == MQTT_INVALID_REQUEST_HANDLE );
+
+			memcpy(queue->pool[idx].json, msgs[msg].json, msgs[msg].size);
+			queue->pool[idx].json_size = msgs[msg].size;
+			queue->pool[idx].cbk = cbk;
+			queue->pool[idx].user_ctx = user_ctx;
+			queue->pool[idx].service_id = service_id;
+			queue->pool[idx].cancel = false;
+			queue->pool[idx].in_flight = false;
+			queue->pool[idx].batch = batch;
+			queue->pool[idx].retry_count = MAX_REQ_RETRY_COUNT;
+			queue->pool[idx].handle = handles[msg];
+			queue->pool[idx].key_len = 0U;
+			queue->pool[idx].key_next = MQTT_NO_REQUEST;
+			queue->pool[idx].ordered = (msgs[msg].order_key_len != 0U);
+			queue->pool[idx].order_hash = (msgs[msg].order_key_len != 0U) ?
+											MqttClientQueueHashKey(service_id, msgs[msg].order_key, msgs[msg].order_key_len) : 0U;
+			queue->pool[idx].route = MQTT_NO_ROUTE;
+			queue->pool[idx].deadline_ms = (msgs[msg].ttl_ms != 0U) ? (now_ms + msgs[msg].ttl_ms) : 0U;
+			if ( queue->pool[idx].deadline_ms != 0U )
+			{
+				MqttClientQueueDeadlineInsert(queue, idx);
+			}
+
+			sq->slots[(sq->head + sq->count) % MQTT_SERVICE_QUEUE_DEPTH] = idx;
+			sq->count++;
+		}
+
+		if ( NO_BATCH != batch )
+		{
+			queue->batches[batch - 1u].handle = handles[0];
+		}
+	}
+
+	edge = MqttClientQueueWatermarkEdge(queue);
+	depth = (unsigned short)(MQTT_REQ_POOL_SIZE - queue->free_count);
+
+	pthread_mutex_unlock(&queue->lock);
+
+	MqttClientQueueNotifyWatermark(queue, edge, depth);
+
+	return status;
+}
+
+/**
+ * @brief	Hold a bucket of the pool routing keys for a request about to be given to the client, before it is queued.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: route		: routing bucket, MQTT_NO_ROUTE for none
+ * @return 	void
+ *
+*/
+void MqttClientQueueRouteHold(t_MqttClient *client, unsigned short route)
+{
+	MqttClientQueueCountRoute(&client->queue, route, true);
+}
+
+/**
+ * @brief	Release a bucket of the pool routing keys held for a request, once it is released or was not queued.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: route		: routing bucket, MQTT_NO_ROUTE for none
+ * @return 	void
+ *
+*/
+void MqttClientQueueRouteRelease(t_MqttClient *client, unsigned short route)
+{
+	MqttClientQueueCountRoute(&client->queue, route, false);
+}
+
+/**
+ * @brief	Check whether the client holds requests of a bucket of the pool routing keys. Only the mask of the held
+ * 			buckets is read, the counters written on each request stay in the cache of the client.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: route		: routing bucket
+ * @return 	bool
+ *
+*/
+bool MqttClientQueueRouteHeld(t_MqttClient *client, unsigned short route)
+{
+	return (0U != (__atomic_load_n(&client->queue.route_mask, __ATOMIC_ACQUIRE) & ((uint64_t)1U << route)));
+}
+
+/**
+ * @brief	Set the shedding policy of a service.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: service_id	: service id to configure
+ * @param[in]	: policy		: shedding policy
+ * @param[in]	: keep_one_in	: N for MQTT_SHED_KEEP_ONE_IN_N
+ * @return 		void
+ *
+*/
+void MqttClientQueueSetPolicy(t_MqttClient *client, unsigned char service_id, t_MqttShedPolicy policy, unsigned short keep_one_in)
+{
+	t_MqttQueue *queue = &client->queue;
+	pthread_mutex_lock(&queue->lock);
+
+	queue->service_queues[service_id].policy = policy;
+	queue->service_queues[service_id].keep_one_in = (keep_one_in > 0U) ? keep_one_in : 1U;
+	queue->service_queues[service_id].shed_count = 0U;
+
+	pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * @brief	Set the watermark notification callback.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: cbk	: watermark callback, NULL to disable
+ * @return 		void
+ *
+*/
+void MqttClientQueueSetWatermarkCbk(t_MqttClient *client, WatermarkCbk cbk)
+{
+	t_MqttQueue *queue = &client->queue;
+	pthread_mutex_lock(&queue->lock);
+	queue->watermark_cbk = cbk;
+	pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * @brief	Cancel a request. A queued request is released and notified at once, a request taken
+ * 			by the FSM is only flagged and released by the FSM.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: handle	: handle of the request
+ * @return 		bool
+ * @retval		true	: request found
+ * @retval		false	: no pending request with this handle
+ *
+*/
+bool MqttClientQueueCancel(t_MqttClient *client, t_MqttRequestHandle handle)
+{
+	t_MqttQueue *queue = &client->queue;
+	t_QueueNotification canceled = {(RxCbk)NULL, MQTT_INVALID_REQUEST_HANDLE, NULL, SERVERCOM_OK, 0U};
+	unsigned int idx = handle & HANDLE_INDEX_MASK;
+	t_ServiceQueue *sq = NULL;
+	bool found = false;
+	unsigned short pos;
+	unsigned short depth = 0U;
+	int edge = WATERMARK_NONE;
+
+	pthread_mutex_lock(&queue->lock);
+
+	if ( (handle != MQTT_INVALID_REQUEST_HANDLE) && (idx < MQTT_REQ_POOL_SIZE) && (queue->pool[idx].handle == handle) )
+	{
+		found = true;
+
+		if ( true == queue->pool[idx].in_flight )
+		{
+			queue->pool[idx].cancel = true;
+		}
+		else
+		{
+			sq = &queue->service_queues[queue->pool[idx].service_id];
+			for (pos = 0U; pos < sq->count; pos++)
+			{
+				if ( sq->slots[(sq->head + pos) % MQTT_SERVICE_QUEUE_DEPTH] == idx )
+				{
+					MqttClientQueueRemoveAt(queue, sq, pos, SERVERCOM_CANCELED, &canceled);
+					break;
+				}
+			}
+		}
+	}
+
+	edge = MqttClientQueueWatermarkEdge(queue);
+	depth = (unsigned short)(MQTT_REQ_POOL_SIZE - queue->free_count);
+
+	pthread_mutex_unlock(&queue->lock);
+
+	MqttClientQueueNotify(client, &canceled);
+	MqttClientQueueNotifyWatermark(queue, edge, depth);
+
+	return found;
+}
+
+/**
+ * @brief	Get the most urgent service, the lowest service id, with a request without ordering key waiting to be sent.
+ *
+ * @param[in]	: client	: client context
+ * @return 	unsigned char
+ * @retval	SERVICE_LAST	: no request waiting
+ *
+*/
+unsigned char MqttClientQueuePlainService(t_MqttClient *client)
+{
+	t_MqttQueue *queue = &client->queue;
+	t_ServiceQueue *sq = NULL;
+	unsigned char service_id = (unsigned char)SERVICE_LAST;
+	unsigned short id;
+	unsigned short pos;
+
+	pthread_mutex_lock(&queue->lock);
+
+	for (id = 0U; ((unsigned char)SERVICE_LAST == service_id) && (id < (unsigned short)SERVICE_LAST); id++)
+	{
+		sq = &queue->service_queues[id];
+
+		for (pos = 0U; pos < sq->count; pos++)
+		{
+			if ( (false == queue->pool[sq->slots[(sq->head + pos) % MQTT_SERVICE_QUEUE_DEPTH]].ordered) &&
+				 (false == queue->pool[sq->slots[(sq->head + pos) % MQTT_SERVICE_QUEUE_DEPTH]].in_flight) )
+			{
+				service_id = (unsigned char)id;
+				break;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&queue->lock);
+
+	return service_id;
+}
+
+/**
+ * @brief	Take the next request without ordering key to be sent, services are served by ascending service id.
+ * 			The request stays in its queue, marked in flight, until released.
+ *
+ * @param[in]	: client	: client context
+ * @return 	t_PendingRequest*
+ * @retval	NULL	: no request queued
+ *
+*/
+t_PendingRequest* MqttClientQueueTakeNext(t_MqttClient *client)
+{
+	t_MqttQueue *queue = &client->queue;
+	t_PendingRequest *req = NULL;
+	t_ServiceQueue *sq = NULL;
+	unsigned short service_id;
+	unsigned short pos;
+
+	pthread_mutex_lock(&queue->lock);
+
+	/* requests with an ordering key are published through the ordered window */
+	for (service_id = 0U; (NULL == req) && (service_id < (unsigned short)SERVICE_LAST); service_id++)
+	{
+		sq = &queue->service_queues[service_id];
+
+		for (pos = 0U; pos < sq->count; pos++)
+		{
+			if ( (false == queue->pool[sq->slots[(sq->head + pos) % MQTT_SERVICE_QUEUE_DEPTH]].ordered) &&
+				 (false == queue->pool[sq->slots[(sq->head + pos) % MQTT_SERVICE_QUEUE_DEPTH]].in_flight) )
+			{
+				req = &queue->pool[sq->slots[(sq->head + pos) % MQTT_SERVICE_QUEUE_DEPTH]];
+				req->in_flight = true;
+				break;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&queue->lock);
+
+	return req;
+}
+
+/**
+ * @brief	Check whether cancellation was requested for a request taken by the FSM.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: req	: request taken by MqttClientQueueTakeNext()
+ * @return 		bool
+ *
+*/
+bool MqttClientQueueCheckCancel(t_MqttClient *client, t_PendingRequest *req)
+{
+	t_MqttQueue *queue = &client->queue;
+	bool cancel = false;
+
+	pthread_mutex_lock(&queue->lock);
+	cancel = req->cancel;
+	pthread_mutex_unlock(&queue->lock);
+
+	return cancel;
+}
+
+/**
+ * @brief	Check whether the time to live of a request taken by the FSM elapsed.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: req	: request taken by MqttClientQueueTakeNext()
+ * @return 		bool
+ *
+*/
+bool MqttClientQueueCheckExpired(t_MqttClient *client, t_PendingRequest *req)
+{
+	t_MqttQueue *queue = &client->queue;
+	uint64_t deadline_ms = 0U;
+
+	pthread_mutex_lock(&queue->lock);
+	deadline_ms = req->deadline_ms;
+	pthread_mutex_unlock(&queue->lock);
+
+	return ( (deadline_ms != 0U) && (MqttClientTimerNowMs(&client->timers) >= deadline_ms) );
+}
+
+/**
+ * @brief	Release the queued requests whose time to live elapsed and notify them SERVERCOM_EXPIRED. A request taken
+ * 			by the FSM is left to the FSM, which stops retransmitting it.
+ *
+ * @param[in]	: client	: client context
+ * @return 		void
+ *
+*/
+void MqttClientQueueExpire(t_MqttClient *client)
+{
+	t_MqttQueue *queue = &client->queue;
+	t_QueueNotification expired[MQTT_REQ_POOL_SIZE];
+	unsigned short expired_count = 0U;
+	uint64_t now_ms = MqttClientTimerNowMs(&client->timers);
+	t_ServiceQueue *sq = NULL;
+	unsigned char idx;
+	unsigned short pos;
+	unsigned short depth = 0U;
+	int edge = WATERMARK_NONE;
+
+	pthread_mutex_lock(&queue->lock);
+
+	/* earliest deadline first, the heap is left with requests still alive only */
+	while ( (queue->deadline_count > 0U) && (queue->pool[queue->deadlines[0]].deadline_ms <= now_ms) )
+	{
+		idx = queue->deadlines[0];
+		sq = &queue->service_queues[queue->pool[idx].service_id];
+
+		for (pos = 0U; pos < sq->count; pos++)
+		{
+			if ( sq->slots[(sq->head + pos) % MQTT_SERVICE_QUEUE_DEPTH] == idx )
+			{
+				break;
+			}
+		}
+
+		if ( (false == queue->pool[idx].in_flight) && (pos < sq->count) )
+		{
+			expired[expired_count].cbk = (RxCbk)NULL;
+			MqttClientQueueRemoveAt(queue, sq, pos, SERVERCOM_EXPIRED, &expired[expired_count]);
+			expired_count++;
+		}
+		else
+		{
+			/* the FSM checks the deadline of its request itself */
+			MqttClientQueueDeadlineRemove(queue, idx);
+		}
+	}
+
+	edge = MqttClientQueueWatermarkEdge(queue);
+	depth = (unsigned short)(MQTT_REQ_POOL_SIZE - queue->free_count);
+
+	pthread_mutex_unlock(&queue->lock);
+
+	for (pos = 0U; pos < expired_count; pos++)
+	{
+		MqttClientQueueNotify(client, &expired[pos]);
+	}
+	MqttClientQueueNotifyWatermark(queue, edge, depth);
+}
+
+/**
+ * @brief	Get the time until the next request expires.
+ *
+ * @param[in]	: client	: client context
+ * @return 	int
+ * @retval	timeout in milli seconds
+ * @retval	-1	: no request with a deadline
+ *
+*/
+int MqttClientQueueNextDeadlineMs(t_MqttClient *client)
+{
+	t_MqttQueue *queue = &client->queue;
+	uint64_t deadline_ms = 0U;
+	uint64_t now_ms = 0U;
+	int timeout_ms = -1;
+
+	pthread_mutex_lock(&queue->lock);
+	if ( queue->deadline_count > 0U )
+	{
+		deadline_ms = queue->pool[queue->deadlines[0]].deadline_ms;
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	if ( deadline_ms != 0U )
+	{
+		now_ms = MqttClientTimerNowMs(&client->timers);
+
+		if ( deadline_ms <= now_ms )
+		{
+			timeout_ms = 0;
+		}
+		else if ( (deadline_ms - now_ms) > (uint64_t)INT_MAX )
+		{
+			timeout_ms = INT_MAX;
+		}
+		else
+		{
+			timeout_ms = (int)(deadline_ms - now_ms);
+		}
+	}
+
+	return timeout_ms;
+}
+
+/**
+ * @brief	Notify the owner of a request and release it.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: req	: request taken by MqttClientQueueTakeNext()
+ * @param[in]	: resp	: response to be sent to the service
+ * @return 		void
+ *
+*/
+void MqttClientQueueRelease(t_MqttClient *client, t_PendingRequest *req, t_ServerReplyCodes resp)
+{
+	t_MqttQueue *queue = &client->queue;
+	t_QueueNotification released = {(RxCbk)NULL, MQTT_INVALID_REQUEST_HANDLE, NULL, SERVERCOM_OK, 0U};
+	t_ServiceQueue *sq = &queue->service_queues[req->service_id];
+	unsigned short pos;
+	unsigned short depth = 0U;
+	int edge = WATERMARK_NONE;
+
+	pthread_mutex_lock(&queue->lock);
+
+	for (pos = 0U; pos < sq->count; pos++)
+	{
+		if ( &queue->pool[sq->slots[(sq->head + pos) % MQTT_SERVICE_QUEUE_DEPTH]] == req )
+		{
+			MqttClientQueueRemoveAt(queue, sq, pos, resp, &released);
+			break;
+		}
+	}
+
+	edge = MqttClientQueueWatermarkEdge(queue);
+	depth = (unsigned short)(MQTT_REQ_POOL_SIZE - queue->free_count);
+
+	pthread_mutex_unlock(&queue->lock);
+
+	MqttClientQueueNotify(client, &released);
+	MqttClientQueueNotifyWatermark(queue, edge, depth);
+}
+
+/**
+ * @brief	Notify the owners of every queued request and release them, except the requests of the services kept.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: resp	: response to be sent to the services
+ * @param[in]	: keep_services	: services whose requests stay queued, bit N for service N
+ * @return 		void
+ *
+*/
+void MqttClientQueueReleaseAll(t_MqttClient *client, t_ServerReplyCodes resp, uint32_t keep_services)
+{
+	t_MqttQueue *queue = &client->queue;
+	t_QueueNotification released[MQTT_REQ_POOL_SIZE];
+	unsigned short released_count = 0U;
+	unsigned short service_id;
+	unsigned short idx;
+	unsigned short depth = 0U;
+	int edge = WATERMARK_NONE;
+
+	pthread_mutex_lock(&queue->lock);
+
+	for (service_id = 0U; service_id < (unsigned short)SERVICE_LAST; service_id++)
+	{
+		while ( (0U == (keep_services & (1UL << service_id))) && (queue->service_queues[service_id].count > 0U) )
+		{
+			released[released_count].cbk = (RxCbk)NULL;
+			MqttClientQueueRemoveAt(queue, &queue->service_queues[service_id], 0U, resp, &released[released_count]);
+			released_count++;
+		}
+	}
+
+	/* the FSM lets the requests it took go, a kept one expires or is canceled like any queued request */
+	for (idx = 0U; idx < MQTT_REQ_POOL_SIZE; idx++)
+	{
+		if ( (MQTT_INVALID_REQUEST_HANDLE != queue->pool[idx].handle) && (true == queue->pool[idx].in_flight) )
+		{
+			if ( true == queue->pool[idx].ordered )
+			{
+				MqttClientQueueOrderedRemove(queue, (unsigned char)idx);
+			}
+			queue->pool[idx].in_flight = false;
+			if ( (0U != queue->pool[idx].deadline_ms) && (MQTT_NO_DEADLINE == queue->pool[idx].deadline_pos) )
+			{
+				MqttClientQueueDeadlineInsert(queue, (unsigned char)idx);
+			}
+		}
+	}
+
+	edge = MqttClientQueueWatermarkEdge(queue);
+	depth = (unsigned short)(MQTT_REQ_POOL_SIZE - queue->free_count);
+
+	pthread_mutex_unlock(&queue->lock);
+
+	for (idx = 0U; idx < released_count; idx++)
+	{
+		MqttClientQueueNotify(client, &released[idx]);
+	}
+	MqttClientQueueNotifyWatermark(queue, edge, depth);
+}
+
+/**
+ * @brief	Get the service of the next request with an ordering key to publish: a request of the window to publish
+ * 			again on the new connection, or, with room in the window, a queued request whose key has no request in
+ * 			flight.
+ *
+ * @param[in]	: client	: client context
+ * @return 		unsigned char
+ * @retval		SERVICE_LAST	: nothing to publish
+ *
+*/
+unsigned char MqttClientQueueOrderedService(t_MqttClient *client)
+{
+	t_MqttQueue *queue = &client->queue;
+	unsigned char service_id = (unsigned char)SERVICE_LAST;
+	unsigned short slot;
+	unsigned short idx;
+
+	pthread_mutex_lock(&queue->lock);
+
+	for (slot = 0U; ((unsigned char)SERVICE_LAST == service_id) && (slot < queue->ordered_count); slot++)
+	{
+		if ( false == queue->ordered[slot].sent )
+		{
+			service_id = queue->pool[queue->ordered[slot].idx].service_id;
+		}
+	}
+
+	if ( ((unsigned char)SERVICE_LAST == service_id) && (queue->ordered_count < MQTT_ORDERED_WINDOW) )
+	{
+		idx = MqttClientQueueOrderedFind(queue);
+		if ( MQTT_NO_REQUEST != idx )
+		{
+			service_id = queue->pool[idx].service_id;
+		}
+	}
+
+	pthread_mutex_unlock(&queue->lock);
+
+	return service_id;
+}
+
+/**
+ * @brief	Take the next request with an ordering key to publish and record its publication. Requests of the window
+ * 			canceled or expired before being published again are released on the way. Otherwise services are served
+ * 			by ascending service id and each key by submission order, a key with a request in flight is skipped.
+ *
+ * @param[in]	: client	: client context
+ * @param[out]	: packet_id	: packet id to publish the request with
+ * @param[out]	: dup		: the request was published before
+ * @return 	t_PendingRequest*
+ * @retval	NULL	: nothing to publish
+ *
+*/
+t_PendingRequest* MqttClientQueueOrderedTake(t_MqttClient *client, uint16_t *packet_id, bool *dup)
+{
+	t_MqttQueue *queue = &client->queue;
+	t_QueueNotification released[MQTT_ORDERED_WINDOW];
+	unsigned short released_count = 0U;
+	uint64_t now_ms = MqttClientTimerNowMs(&client->timers);
+	t_OrderedInflight *entry = NULL;
+	t_PendingRequest *req = NULL;
+	t_ServiceQueue *sq = NULL;
+	unsigned short slot = 0U;
+	unsigned short pos;
+	unsigned short idx;
+	unsigned short depth = 0U;
+	int edge = WATERMARK_NONE;
+
+	pthread_mutex_lock(&queue->lock);
+
+	/* the requests of the window go first, no later request of their key may overtake them */
+	while ( (NULL == entry) && (slot < queue->ordered_count) )
+	{
+		req = &queue->pool[queue->ordered[slot].idx];
+
+		if ( true == queue->ordered[slot].sent )
+		{
+			slot++;
+		}
+		else if ( (true == req->cancel) || ((0U != req->deadline_ms) && (now_ms >= req->deadline_ms)) )
+		{
+			/* the next entry moves into this slot */
+			sq = &queue->service_queues[req->service_id];
+			for (pos = 0U; (pos < sq->count) && (&queue->pool[sq->slots[(sq->head + pos) % MQTT_SERVICE_QUEUE_DEPTH]] != req); pos++)
+			{
+			}
+			released[released_count].cbk = (RxCbk)NULL;
+			MqttClientQueueRemoveAt(queue, sq, pos, (true == req->cancel) ? SERVERCOM_CANCELED : SERVERCOM_EXPIRED, &released[released_count]);
+			released_count++;
+		}
+		else
+		{
+			entry = &queue->ordered[slot];
+		}
+	}
+
+	if ( (NULL == entry) && (queue->ordered_count < MQTT_ORDERED_WINDOW) )
+	{
+		idx = MqttClientQueueOrderedFind(queue);
+
+		if ( MQTT_NO_REQUEST != idx )
+		{
+			queue->ordered_packet_id = (queue->ordered_packet_id >= (uint16_t)(MQTT_SPOOL_PACKET_ID_BASE - 1U)) ?
+										MQTT_ORDERED_PACKET_ID_BASE : (uint16_t)(queue->ordered_packet_id + 1U);
+
+			entry = &queue->ordered[queue->ordered_count++];
+			entry->idx = (unsigned char)idx;
+			entry->packet_id = queue->ordered_packet_id;
+			entry->dup = false;
+			queue->pool[idx].in_flight = true;
+		}
+	}
+
+	req = NULL;
+	if ( NULL != entry )
+	{
+		req = &queue->pool[entry->idx];
+		*packet_id = entry->packet_id;
+		*dup = entry->dup;
+		entry->sent = true;
+		entry->dup = true;
+	}
+
+	edge = MqttClientQueueWatermarkEdge(queue);
+	depth = (unsigned short)(MQTT_REQ_POOL_SIZE - queue->free_count);
+
+	pthread_mutex_unlock(&queue->lock);
+
+	for (pos = 0U; pos < released_count; pos++)
+	{
+		MqttClientQueueNotify(client, &released[pos]);
+	}
+	MqttClientQueueNotifyWatermark(queue, edge, depth);
+
+	return req;
+}
+
+/**
+ * @brief	Release the request of the window acknowledged by a PUBACK, the next request of its key may follow.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: packet_id	: packet id of the PUBACK
+ * @return 		bool
+ * @retval		true	: request released
+ * @retval		false	: no request of the window with this packet id
+ *
+*/
+bool MqttClientQueueOrderedAcked(t_MqttClient *client, uint16_t packet_id)
+{
+	t_MqttQueue *queue = &client->queue;
+	t_QueueNotification released = {(RxCbk)NULL, MQTT_INVALID_REQUEST_HANDLE, NULL, SERVERCOM_OK, 0U};
+	t_ServiceQueue *sq = NULL;
+	unsigned char idx = 0U;
+	bool found = false;
+	unsigned short slot;
+	unsigned short pos;
+	unsigned short depth = 0U;
+	int edge = WATERMARK_NONE;
+
+	pthread_mutex_lock(&queue->lock);
+
+	for (slot = 0U; slot < queue->ordered_count; slot++)
+	{
+		if ( queue->ordered[slot].packet_id == packet_id )
+		{
+			idx = queue->ordered[slot].idx;
+			sq = &queue->service_queues[queue->pool[idx].service_id];
+			for (pos = 0U; pos < sq->count; pos++)
+			{
+				if ( sq->slots[(sq->head + pos) % MQTT_SERVICE_QUEUE_DEPTH] == idx )
+				{
+					MqttClientQueueRemoveAt(queue, sq, pos, SERVERCOM_OK, &released);
+					found = true;
+					break;
+				}
+			}
+			break;
+		}
+	}
+
+	edge = MqttClientQueueWatermarkEdge(queue);
+	depth = (unsigned short)(MQTT_REQ_POOL_SIZE - queue->free_count);
+
+	pthread_mutex_unlock(&queue->lock);
+
+	MqttClientQueueNotify(client, &released);
+	MqttClientQueueNotifyWatermark(queue, edge, depth);
+
+	return found;
+}
+
+/**
+ * @brief	Connection closed: the requests of the window are published again, as duplicates, on the next connection
+ * 			before any later request of their key.
+ *
+ * @param[in]	: client	: client context
+ * @return 		void
+ *
+*/
+void MqttClientQueueOrderedRewind(t_MqttClient *client)
+{
+	t_MqttQueue *queue = &client->queue;
+	unsigned short slot;
+
+	pthread_mutex_lock(&queue->lock);
+	for (slot = 0U; slot < queue->ordered_count; slot++)
+	{
+		queue->ordered[slot].sent = false;
+	}
+	pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * @brief	Get the number of requests with an ordering key in flight.
+ *
+ * @param[in]	: client	: client context
+ * @return 	unsigned short
+ *
+*/
+unsigned short MqttClientQueueOrderedInFlight(t_MqttClient *client)
+{
+	t_MqttQueue *queue = &client->queue;
+	unsigned short count = 0U;
+
+	pthread_mutex_lock(&queue->lock);
+	count = queue->ordered_count;
+	pthread_mutex_unlock(&queue->lock);
+
+	return count;
+}
+
+/**
+ * @brief	Get the number of queued requests.
+ *
+ * @param[in]	: client	: client context
+ * @return 	unsigned short
+ *
+*/
+unsigned short MqttClientQueueDepth(t_MqttClient *client)
+{
+	t_MqttQueue *queue = &client->queue;
+	unsigned short depth = 0U;
+
+	pthread_mutex_lock(&queue->lock);
+	depth = (unsigned short)(MQTT_REQ_POOL_SIZE - queue->free_count);
+	pthread_mutex_unlock(&queue->lock);
+
+	return depth;
+}
+
+/**
+ * @brief	Get the number of queued requests of a service.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service id
+ * @return 	unsigned short
+ *
+*/
+unsigned short MqttClientQueueServiceDepth(t_MqttClient *client, unsigned char service_id)
+{
+	t_MqttQueue *queue = &client->queue;
+	unsigned short depth = 0U;
+
+	pthread_mutex_lock(&queue->lock);
+	depth = queue->service_queues[service_id].count;
+	pthread_mutex_unlock(&queue->lock);
+
+	return depth;
+}
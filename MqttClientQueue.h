@@ -0,0 +1,400 @@
+/**************************************************************************//**
+*  @par Language  : C
+*******************************************************************************
+*  @brief       MqttClient request queue header file.
+*  @author      dr-paradox
+*  @version     1.0.0
+*******************************************************************************
+*  @page 	MqttClientQueue
+*  @ref 	MqttClient "API Reference" header file
+*  @file 	MqttClientQueue.h
+*
+*******************************************************************************/
+
+#ifndef MQTTCLIENT_QUEUE_H
+#define MQTTCLIENT_QUEUE_H
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "MqttClient.h"
+#include "MqttClientCfg.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* Position of a request not in the deadline heap */
+#define MQTT_NO_DEADLINE				((unsigned short)0xFFFF)
+
+/* End of a chain of the coalescing index */
+#define MQTT_NO_REQUEST					((unsigned short)0xFFFF)
+
+/* Request not routed by a pool */
+#define MQTT_NO_ROUTE					((unsigned short)0xFFFF)
+
+/* Packet ids of requests with an ordering key, between the ids of the request in flight and of spooled messages */
+#define MQTT_ORDERED_PACKET_ID_BASE		((uint16_t)0x4000)
+
+/* ------------------------------- Data Types ------------------------------- */
+
+typedef struct {
+
+	unsigned char 	retry_count;					/*Counter for retry request*/
+	unsigned char	json[SERVER_COM_JSON_MAX_SIZE];	/*buffer for json received from services*/
+	uint16_t 		json_size;						/*the size of Json*/
+	RxCbk cbk;		/*Store the pointer to a function provided by the services. This function is called by ServerCom
+	 	 	 	 	 * after a request in order to notify the service about the result */
+	void			*user_ctx;						/*user context pointer passed back to cbk*/
+	t_MqttRequestHandle handle;						/*handle of the request, MQTT_INVALID_REQUEST_HANDLE when slot is free*/
+	unsigned char	service_id;						/*service owning the request*/
+	bool			cancel;							/*cancellation requested for this request only*/
+	bool			in_flight;						/*request taken by the FSM, it can't be shed anymore*/
+	unsigned char	batch;							/*combined batch of the request, index + 1, 0 if none*/
+	uint64_t		deadline_ms;					/*time the request expires at, 0 if it never expires*/
+	unsigned short	deadline_pos;					/*position in the deadline heap, MQTT_NO_DEADLINE if not in it*/
+	unsigned char	key[MQTT_COALESCE_KEY_SIZE];	/*coalescing key*/
+	unsigned short	key_len;						/*length of key, 0 if the request is not coalesced*/
+	uint32_t		key_hash;						/*hash of the service id and key*/
+	unsigned short	key_next;						/*next request of the same bucket of the coalescing index*/
+	bool			ordered;						/*request with an ordering key, published through the ordered window*/
+	uint32_t		order_hash;						/*hash of the service id and ordering key*/
+	unsigned short	route;							/*bucket of the pool routing key, MQTT_NO_ROUTE if not routed by a pool*/
+} t_PendingRequest;
+
+/* Requests of a single service, oldest first starting from head */
+typedef struct
+{
+	unsigned char		slots[MQTT_SERVICE_QUEUE_DEPTH];	/* indexes in pool */
+	unsigned short		head;								/* position of the oldest request */
+	unsigned short		count;								/* number of queued requests */
+	t_MqttShedPolicy	policy;								/* shedding policy of the service */
+	unsigned short		keep_one_in;						/* N of MQTT_SHED_KEEP_ONE_IN_N */
+	unsigned short		shed_count;							/* submissions seen while saturated */
+} t_ServiceQueue;
+
+/* Batch submitted with a single combined completion */
+typedef struct
+{
+	RxCbk				cbk;				/* callback notified once every request of the batch is released */
+	t_MqttRequestHandle	handle;				/* handle of the first request, notified as batch handle */
+	void				*user_ctx;
+	unsigned short		remaining;			/* requests of the batch not yet released, 0 when group is free */
+	t_ServerReplyCodes	resp;				/* SERVERCOM_OK or first failure of the batch */
+} t_BatchGroup;
+
+/* Request with an ordering key published ahead of its PUBACK */
+typedef struct
+{
+	unsigned char		idx;				/* index in pool */
+	uint16_t			packet_id;			/* packet id the request is published with, kept by its duplicates */
+	bool				sent;				/* published on the current connection */
+	bool				dup;				/* published before, the next publication is a duplicate */
+} t_OrderedInflight;
+
+/* Request queue of a client context */
+typedef struct
+{
+	pthread_mutex_t		lock;								/* protects the pool and the queues, submissions may come from any thread */
+	t_PendingRequest	pool[MQTT_REQ_POOL_SIZE];			/* storage of every queued request */
+	unsigned char		free_list[MQTT_REQ_POOL_SIZE];		/* stack of free indexes in pool */
+	unsigned short		free_count;							/* number of free indexes in free_list */
+	t_ServiceQueue		service_queues[SERVICE_LAST];		/* queue of each service */
+	t_BatchGroup		batches[MQTT_REQ_POOL_SIZE];		/* combined batches, a request refers to its group by index + 1 */
+	unsigned int		request_sequence;					/* sequence number used to build unique request handles */
+	unsigned char		deadlines[MQTT_REQ_POOL_SIZE];		/* min heap of the indexes in pool of the requests with a deadline */
+	unsigned short		deadline_count;						/* number of requests in deadlines */
+	unsigned short		coalesce_index[MQTT_COALESCE_BUCKETS];	/* first request of each bucket of the coalescing keys */
+	t_OrderedInflight	ordered[MQTT_ORDERED_WINDOW];		/* requests with an ordering key in flight, in publication order */
+	unsigned short		ordered_count;						/* number of requests in ordered */
+	uint16_t			ordered_packet_id;					/* packet id of the last request added to ordered */
+	bool				saturated;							/* high watermark notified */
+	WatermarkCbk		watermark_cbk;						/* watermark notification callback */
+	/* Buckets of the pool routing keys held, bit N for bucket N, read without lock by the routing of any thread. Only
+	 * written when a bucket gets held or released, apart from the counters written on each request */
+	uint64_t			route_mask __attribute__((aligned(MQTT_CACHE_LINE_SIZE)));
+	/* Requests held of each bucket of the pool routing keys */
+	unsigned int		route_held[MQTT_POOL_ROUTE_BUCKETS] __attribute__((aligned(MQTT_CACHE_LINE_SIZE)));
+} t_MqttQueue;
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+ * @brief	Create the lock of the queue, release every request and reset the shedding policies.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientQueueInit(t_MqttClient *client);
+
+/**
+ * @brief	Queue a request of a service. A message with a coalescing key replaces the queued request of the same key
+ * 			not taken by the FSM yet, which is notified SERVERCOM_SUPERSEDED, even when there is no room.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: msg			: message to be sent, already validated
+ * @param[in]	: service_id	: service id of calling service
+ * @param[in]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @param[in]	: shed			: apply the shedding policy of the service when there is no room
+ * @param[in]	: route			: pool routing bucket held for the request by MqttClientQueueRouteHold(), MQTT_NO_ROUTE if none
+ * @param[out]	: handle		: handle of the queued request
+ * @return 		t_MqttSubmitStatus
+ * @retval		MQTT_SUBMIT_OK			: request queued, the bucket is released with the request
+ * @retval		MQTT_SUBMIT_WOULD_BLOCK	: no room and shed is false
+ * @retval		MQTT_SUBMIT_DROPPED		: request shed by the policy of the service
+ *
+*/
+t_MqttSubmitStatus MqttClientQueueSubmit(t_MqttClient *client, const t_MqttMessage *msg, unsigned char service_id,
+											RxCbk cbk, void *user_ctx, bool shed, unsigned short route, t_MqttRequestHandle *handle);
+
+/**
+ * @brief	Hold a bucket of the pool routing keys for a request about to be given to the client, before it is queued.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: route		: routing bucket, MQTT_NO_ROUTE for none
+ * @return 	void
+ *
+*/
+void MqttClientQueueRouteHold(t_MqttClient *client, unsigned short route);
+
+/**
+ * @brief	Release a bucket of the pool routing keys held for a request, once it is released or was not queued.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: route		: routing bucket, MQTT_NO_ROUTE for none
+ * @return 	void
+ *
+*/
+void MqttClientQueueRouteRelease(t_MqttClient *client, unsigned short route);
+
+/**
+ * @brief	Check whether the client holds requests of a bucket of the pool routing keys.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: route		: routing bucket
+ * @return 	bool
+ *
+*/
+bool MqttClientQueueRouteHeld(t_MqttClient *client, unsigned short route);
+
+/**
+ * @brief	Queue a batch of requests of a service. Room for the whole batch is reserved at once,
+ * 			either every message is queued or none.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: msgs			: messages to be sent, already validated
+ * @param[in]	: count			: number of messages
+ * @param[in]	: service_id	: service id of calling service
+ * @param[in]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @param[in]	: combined		: notify cbk once for the whole batch
+ * @param[out]	: handles		: handles of the queued requests, count entries
+ * @return 		t_MqttSubmitStatus
+ * @retval		MQTT_SUBMIT_OK			: batch queued
+ * @retval		MQTT_SUBMIT_WOULD_BLOCK	: no room for the whole batch
+ *
+*/
+t_MqttSubmitStatus MqttClientQueueSubmitBatch(t_MqttClient *client, const t_MqttMessage *msgs, unsigned short count, unsigned char service_id,
+												RxCbk cbk, void *user_ctx, bool combined, t_MqttRequestHandle *handles);
+
+/**
+ * @brief	Set the shedding policy of a service.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: service_id	: service id to configure
+ * @param[in]	: policy		: shedding policy
+ * @param[in]	: keep_one_in	: N for MQTT_SHED_KEEP_ONE_IN_N
+ * @return 		void
+ *
+*/
+void MqttClientQueueSetPolicy(t_MqttClient *client, unsigned char service_id, t_MqttShedPolicy policy, unsigned short keep_one_in);
+
+/**
+ * @brief	Set the watermark notification callback.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: cbk	: watermark callback, NULL to disable
+ * @return 		void
+ *
+*/
+void MqttClientQueueSetWatermarkCbk(t_MqttClient *client, WatermarkCbk cbk);
+
+/**
+ * @brief	Cancel a request. A queued request is released and notified at once, a request taken
+ * 			by the FSM is only flagged and released by the FSM.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: handle	: handle of the request
+ * @return 		bool
+ * @retval		true	: request found
+ * @retval		false	: no pending request with this handle
+ *
+*/
+bool MqttClientQueueCancel(t_MqttClient *client, t_MqttRequestHandle handle);
+
+/**
+ * @brief	Get the most urgent service, the lowest service id, with a request without ordering key waiting to be sent.
+ *
+ * @param[in]	: client	: client context
+ * @return 	unsigned char
+ * @retval	SERVICE_LAST	: no request waiting
+ *
+*/
+unsigned char MqttClientQueuePlainService(t_MqttClient *client);
+
+/**
+ * @brief	Take the next request without ordering key to be sent, services are served by ascending service id.
+ * 			The request stays in its queue, marked in flight, until released.
+ *
+ * @param[in]	: client	: client context
+ * @return 	t_PendingRequest*
+ * @retval	NULL	: no request queued
+ *
+*/
+t_PendingRequest* MqttClientQueueTakeNext(t_MqttClient *client);
+
+/**
+ * @brief	Check whether cancellation was requested for a request taken by the FSM.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: req	: request taken by MqttClientQueueTakeNext()
+ * @return 		bool
+ *
+*/
+bool MqttClientQueueCheckCancel(t_MqttClient *client, t_PendingRequest *req);
+
+/**
+ * @brief	Check whether the time to live of a request taken by the FSM elapsed.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: req	: request taken by MqttClientQueueTakeNext()
+ * @return 		bool
+ *
+*/
+bool MqttClientQueueCheckExpired(t_MqttClient *client, t_PendingRequest *req);
+
+/**
+ * @brief	Release the queued requests whose time to live elapsed and notify them SERVERCOM_EXPIRED. A request taken
+ * 			by the FSM is left to the FSM, which stops retransmitting it.
+ *
+ * @param[in]	: client	: client context
+ * @return 		void
+ *
+*/
+void MqttClientQueueExpire(t_MqttClient *client);
+
+/**
+ * @brief	Get the time until the next request expires.
+ *
+ * @param[in]	: client	: client context
+ * @return 	int
+ * @retval	timeout in milli seconds
+ * @retval	-1	: no request with a deadline
+ *
+*/
+int MqttClientQueueNextDeadlineMs(t_MqttClient *client);
+
+/**
+ * @brief	Notify the owner of a request and release it.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: req	: request taken by MqttClientQueueTakeNext()
+ * @param[in]	: resp	: response to be sent to the service
+ * @return 		void
+ *
+*/
+void MqttClientQueueRelease(t_MqttClient *client, t_PendingRequest *req, t_ServerReplyCodes resp);
+
+/**
+ * @brief	Notify the owners of every queued request and release them, except the requests of the services kept.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: resp	: response to be sent to the services
+ * @param[in]	: keep_services	: services whose requests stay queued, bit N for service N
+ * @return 		void
+ *
+*/
+void MqttClientQueueReleaseAll(t_MqttClient *client, t_ServerReplyCodes resp, uint32_t keep_services);
+
+/**
+ * @brief	Get the service of the next request with an ordering key to publish: a request of the window to publish
+ * 			again on the new connection, or, with room in the window, a queued request whose key has no request in
+ * 			flight.
+ *
+ * @param[in]	: client	: client context
+ * @return 		unsigned char
+ * @retval		SERVICE_LAST	: nothing to publish
+ *
+*/
+unsigned char MqttClientQueueOrderedService(t_MqttClient *client);
+
+/**
+ * @brief	Take the next request with an ordering key to publish and record its publication. Requests of the window
+ * 			canceled or expired before being published again are released on the way. Otherwise services are served
+ * 			by ascending service id and each key by submission order, a key with a request in flight is skipped.
+ *
+ * @param[in]	: client	: client context
+ * @param[out]	: packet_id	: packet id to publish the request with
+ * @param[out]	: dup		: the request was published before
+ * @return 	t_PendingRequest*
+ * @retval	NULL	: nothing to publish
+ *
+*/
+t_PendingRequest* MqttClientQueueOrderedTake(t_MqttClient *client, uint16_t *packet_id, bool *dup);
+
+/**
+ * @brief	Release the request of the window acknowledged by a PUBACK, the next request of its key may follow.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: packet_id	: packet id of the PUBACK
+ * @return 		bool
+ * @retval		true	: request released
+ * @retval		false	: no request of the window with this packet id
+ *
+*/
+bool MqttClientQueueOrderedAcked(t_MqttClient *client, uint16_t packet_id);
+
+/**
+ * @brief	Connection closed: the requests of the window are published again, as duplicates, on the next connection
+ * 			before any later request of their key.
+ *
+ * @param[in]	: client	: client context
+ * @return 		void
+ *
+*/
+void MqttClientQueueOrderedRewind(t_MqttClient *client);
+
+/**
+ * @brief	Get the number of requests with an ordering key in flight.
+ *
+ * @param[in]	: client	: client context
+ * @return 	unsigned short
+ *
+*/
+unsigned short MqttClientQueueOrderedInFlight(t_MqttClient *client);
+
+/**
+ * @brief	Get the number of queued requests.
+ *
+ * @param[in]	: client	: client context
+ * @return 	unsigned short
+ *
+*/
+unsigned short MqttClientQueueDepth(t_MqttClient *client);
+
+/**
+ * @brief	Get the number of queued requests of a service.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service id
+ * @return 	unsigned short
+ *
+*/
+unsigned short MqttClientQueueServiceDepth(t_MqttClient *client, unsigned char service_id);
+
+/* -------------------------------- Routines -------------------------------- */
+
+#endif /* MQTTCLIENT_QUEUE_H */
@@ -0,0 +1,196 @@
+/**************************************************************************//**
+*  @par Language: C
+*******************************************************************************
+*  @par 	Project:
+*  @brief   MqttClient shard handoff implementation
+*  @author  dr-paradox
+*  @version 1.0.0
+*******************************************************************************
+*  @ref 	MqttClient "API Reference"
+*  @file 	MqttClientShard.c
+*******************************************************************************/
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <string.h>
+#include <stdio.h>
+#include "MqttClientShard.h"
+#include "MqttClientContext.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* Mask of a position in the handoff */
+#define HANDOFF_MASK				(MQTT_SHARD_HANDOFF_SIZE - 1u)
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* ---------------------------- Global Variables ---------------------------- */
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/* -------------------------------- Routines -------------------------------- */
+
+/**
+ * @brief	Mark every cell of the handoff as free.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientShardInit(t_MqttClient *client)
+{
+	t_MqttShard *shard = &client->shard;
+	unsigned int idx;
+
+	for (idx = 0U; idx < MQTT_SHARD_HANDOFF_SIZE; idx++)
+	{
+		shard->cells[idx].sequence = idx;
+	}
+	__atomic_store_n(&shard->enqueue_pos, 0U, __ATOMIC_RELAXED);
+	__atomic_store_n(&shard->dequeue_pos, 0U, __ATOMIC_RELAXED);
+	__atomic_store_n(&shard->up, false, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief	Publish whether the shard is connected to its broker, called by the FSM of the shard only.
+ *
+ * @param[in]	: client	: client context of the shard
+ * @param[in]	: up		: connected to the broker
+ * @return 	void
+ *
+*/
+void MqttClientShardSetUp(t_MqttClient *client, bool up)
+{
+	__atomic_store_n(&client->shard.up, up, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief	Check from any thread whether the shard is connected to its broker.
+ *
+ * @param[in]	: client	: client context of the shard
+ * @return 	bool
+ *
+*/
+bool MqttClientShardIsUp(t_MqttClient *client)
+{
+	return __atomic_load_n(&client->shard.up, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief	Hand a request off to the I/O thread of a shard, without taking any lock.
+ *
+ * @param[in]	: client		: client context of the shard
+ * @param[in]	: json			: json message to be sent, copied
+ * @param[in]	: size			: size of json message to be sent
+ * @param[in]	: service_id	: service id of calling service
+ * @param[in]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @param[in]	: route			: pool routing bucket of the request, held by the shard once drained
+ * @return 		bool
+ * @retval		true	: request handed off
+ * @retval		false	: handoff full
+ *
+*/
+bool MqttClientShardPush(t_MqttClient *client, const unsigned char *json, unsigned short size, unsigned char service_id,
+							RxCbk cbk, void *user_ctx, unsigned short route)
+{
+	t_MqttShard *shard = &client->shard;
+	t_HandoffCell *cell = NULL;
+	unsigned int pos = __atomic_load_n(&shard->enqueue_pos, __ATOMIC_RELAXED);
+	unsigned int seq = 0U;
+	int diff = 0;
+	bool queued = false;
+
+	for (;;)
+	{
+		cell = &shard->cells[pos & HANDOFF_MASK];
+		seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+		diff = (int)(seq - pos);
+
+		if ( 0 == diff )
+		{
+			/* cell free, claim it */
+			if ( __atomic_compare_exchange_n(&shard->enqueue_pos, &pos, pos + 1u, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+			{
+				queued = true;
+				break;
+			}
+		}
+		else if ( diff < 0 )
+		{
+			/* cell still holds a request not taken by the I/O thread */
+			break;
+		}
+		else
+		{
+			pos = __atomic_load_n(&shard->enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	if ( true == queued )
+	{
+		memcpy(cell->json, json, size);
+		cell->size = size;
+		cell->service_id = service_id;
+		cell->cbk = cbk;
+		cell->user_ctx = user_ctx;
+		cell->route = route;
+		__atomic_store_n(&cell->sequence, pos + 1u, __ATOMIC_RELEASE);
+	}
+
+	return queued;
+}
+
+/**
+ * @brief	Move the handed off requests to the queue of the client, called by the I/O thread only.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientShardDrain(t_MqttClient *client)
+{
+	t_MqttShard *shard = &client->shard;
+	t_HandoffCell *cell = NULL;
+	t_MqttRequestHandle handle = MQTT_INVALID_REQUEST_HANDLE;
+	t_MqttMessage msg;
+	unsigned int pos = __atomic_load_n(&shard->dequeue_pos, __ATOMIC_RELAXED);
+	unsigned int first = pos;
+
+	/* single consumer, the position is only moved by this thread */
+	for (;;)
+	{
+		cell = &shard->cells[pos & HANDOFF_MASK];
+		if ( __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != (pos + 1u) )
+		{
+			break;
+		}
+
+		/* the queue is only touched by its own I/O thread here, its lock is never contended */
+		msg.json = cell->json;
+		msg.size = cell->size;
+		msg.ttl_ms = 0U;
+		msg.key = NULL;
+		msg.key_len = 0U;
+		msg.order_key = NULL;
+		msg.order_key_len = 0U;
+
+		/* the bucket is held by the thread owning the queue, the submitting thread never writes to the shard */
+		MqttClientQueueRouteHold(client, cell->route);
+		if ( MQTT_SUBMIT_OK != MqttClientSubmit(client, &msg, 1U, cell->service_id, cell->cbk, cell->user_ctx, true, false,
+												  cell->route, &handle) )
+		{
+			printf("MqttClient: Request of service %d shed by overload policy", cell->service_id);
+			MqttClientNotifyDispatch(client, cell->cbk, MQTT_INVALID_REQUEST_HANDLE, SERVERCOM_DROPPED, cell->user_ctx, cell->service_id);
+		}
+
+		__atomic_store_n(&cell->sequence, pos + HANDOFF_MASK + 1u, __ATOMIC_RELEASE);
+		pos++;
+		__atomic_store_n(&shard->dequeue_pos, pos, __ATOMIC_RELAXED);
+	}
+
+	if ( pos != first )
+	{
+		MqttClientIoPost(client, MQTT_EVT_DATA_SUBMITTED);
+	}
+}
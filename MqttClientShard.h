@@ -0,0 +1,110 @@
+/**************************************************************************//**
+*  @par Language  : C
+*******************************************************************************
+*  @brief       MqttClient shard handoff header file.
+*  @author      dr-paradox
+*  @version     1.0.0
+*******************************************************************************
+*  @page 	MqttClientShard
+*  @ref 	MqttClient "API Reference" header file
+*  @file 	MqttClientShard.h
+*
+*******************************************************************************/
+
+#ifndef MQTTCLIENT_SHARD_H
+#define MQTTCLIENT_SHARD_H
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "MqttClient.h"
+#include "MqttClientCfg.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* Cell of the handoff, sequence tells whether the cell is free or holds a request */
+typedef struct
+{
+	unsigned int	sequence;
+	unsigned char	json[SERVER_COM_JSON_MAX_SIZE];		/*copy of the message, the caller buffer is released at once*/
+	unsigned short	size;
+	unsigned char	service_id;
+	RxCbk			cbk;
+	void			*user_ctx;
+	unsigned short	route;									/*pool routing bucket of the request, held once drained*/
+} t_HandoffCell;
+
+/* Lock free handoff of a shard: requests are pushed by any thread and only taken by the I/O thread of the shard,
+ * producer and consumer positions are kept on different cache lines */
+typedef struct
+{
+	t_HandoffCell	cells[MQTT_SHARD_HANDOFF_SIZE];
+	unsigned int	enqueue_pos __attribute__((aligned(MQTT_CACHE_LINE_SIZE)));
+	unsigned int	dequeue_pos __attribute__((aligned(MQTT_CACHE_LINE_SIZE)));
+	bool			up __attribute__((aligned(MQTT_CACHE_LINE_SIZE)));	/*connected to the broker, written by the FSM of the shard only*/
+} t_MqttShard;
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+ * @brief	Mark every cell of the handoff as free.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientShardInit(t_MqttClient *client);
+
+/**
+ * @brief	Hand a request off to the I/O thread of a shard, without taking any lock.
+ *
+ * @param[in]	: client		: client context of the shard
+ * @param[in]	: json			: json message to be sent, copied
+ * @param[in]	: size			: size of json message to be sent
+ * @param[in]	: service_id	: service id of calling service
+ * @param[in]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @param[in]	: route			: pool routing bucket of the request, held by the shard once drained
+ * @return 		bool
+ * @retval		true	: request handed off
+ * @retval		false	: handoff full
+ *
+*/
+bool MqttClientShardPush(t_MqttClient *client, const unsigned char *json, unsigned short size, unsigned char service_id,
+							RxCbk cbk, void *user_ctx, unsigned short route);
+
+/**
+ * @brief	Publish whether the shard is connected to its broker, called by the FSM of the shard only.
+ *
+ * @param[in]	: client	: client context of the shard
+ * @param[in]	: up		: connected to the broker
+ * @return 	void
+ *
+*/
+void MqttClientShardSetUp(t_MqttClient *client, bool up);
+
+/**
+ * @brief	Check from any thread whether the shard is connected to its broker.
+ *
+ * @param[in]	: client	: client context of the shard
+ * @return 	bool
+ *
+*/
+bool MqttClientShardIsUp(t_MqttClient *client);
+
+/**
+ * @brief	Move the handed off requests to the queue of the client, called by the I/O thread only.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientShardDrain(t_MqttClient *client);
+
+/* -------------------------------- Routines -------------------------------- */
+
+#endif /* MQTTCLIENT_SHARD_H */
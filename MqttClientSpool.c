@@ -0,0 +1,1036 @@
+/**************************************************************************//**
+*  @par Language: C
+*******************************************************************************
+*  @par 	Project:
+*  @brief   MqttClient durable spool implementation
+*  @author  dr-paradox
+*  @version 1.0.0
+*******************************************************************************
+*  @ref 	MqttClient "API Reference"
+*  @file 	MqttClientSpool.c
+*******************************************************************************/
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include "MqttClientSpool.h"
+#include "MqttClientContext.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* Invalid file descriptor */
+#define INVALID_FD					((int)-1)
+
+/* First word of a segment file, changed with the layout of the record header */
+#define SPOOL_SEGMENT_MAGIC			((uint32_t)0x5053514EU)
+
+/* Offset of the first record of a segment, after the segment header */
+#define SPOOL_DATA_OFFSET			((uint32_t)sizeof(t_SpoolSegmentHeader))
+
+/* Flags of a record. VALID is written last, a record without it was never completely appended */
+#define SPOOL_RECORD_VALID			((uint8_t)0x01)
+#define SPOOL_RECORD_SENT			((uint8_t)0x02)
+#define SPOOL_RECORD_ACKED			((uint8_t)0x04)
+
+/* Index part of the handles of spooled messages, out of the request pool so they are never found pending */
+#define SPOOL_HANDLE_INDEX			((unsigned int)((1u << MQTT_HANDLE_INDEX_BITS) - 1u))
+
+/* Size taken in a segment by a record of a given payload length, records are kept 8 bytes aligned */
+#define SPOOL_RECORD_SIZE(len)		((uint32_t)(sizeof(t_SpoolRecordHeader) + (((uint32_t)(len) + 7U) & ~7U)))
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* Header of a segment file */
+typedef struct {
+	uint32_t			magic;			/*SPOOL_SEGMENT_MAGIC*/
+	uint32_t			sequence;		/*sequence number of the segment*/
+} t_SpoolSegmentHeader;
+
+/* Header of a record, followed by its payload */
+typedef struct {
+	uint32_t			crc;			/*CRC-32 of the position, length, service id, route, expiry and payload of the record*/
+	uint16_t			length;			/*length of the payload*/
+	uint8_t				service_id;		/*service the message was submitted by*/
+	uint8_t				flags;			/*SPOOL_RECORD_xxx, not covered by crc since updated in place*/
+	uint16_t			route;			/*pool routing bucket of the message, MQTT_NO_ROUTE if not routed by a pool*/
+	uint64_t			expiry_ms;		/*wall clock time the message expires at, 0 if it never expires*/
+} t_SpoolRecordHeader;
+
+/* ---------------------------- Global Variables ---------------------------- */
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+ * @brief	Compute the CRC-32 of a record.
+ *
+ * @param[in]	: sequence	: segment of the record
+ * @param[in]	: offset	: offset of the record in its segment
+ * @param[in]	: header	: record header, length, service id, route and expiry are covered
+ * @param[in]	: payload	: payload of the record
+ * @return 	uint32_t
+ *
+*/
+static uint32_t MqttClientSpoolCrc(uint32_t sequence, uint32_t offset, const t_SpoolRecordHeader *header, const unsigned char *payload);
+
+/**
+ * @brief	Get the wall clock time, spooled messages outlive the process and the monotonic clock with it.
+ *
+ * @return 	uint64_t
+ * @retval	milli seconds since the epoch
+ *
+*/
+static uint64_t MqttClientSpoolWallClockMs(void);
+
+/**
+ * @brief	Get the segment of a sequence number. Called under lock.
+ *
+ * @param[in]	: spool		: spool of the client
+ * @param[in]	: sequence	: sequence number of the segment
+ * @return 	t_MqttSpoolSegment*
+ * @retval	NULL	: segment deleted or not created yet
+ *
+*/
+static t_MqttSpoolSegment* MqttClientSpoolSegment(t_MqttSpool *spool, uint32_t sequence);
+
+/**
+ * @brief	Open and map a segment file, or create it. Called under lock.
+ *
+ * @param[in]	: spool		: spool of the client
+ * @param[in]	: sequence	: sequence number of the segment
+ * @param[in]	: create	: create a new empty segment
+ * @param[out]	: segment	: mapped segment
+ * @return 	bool
+ * @retval	true	: segment mapped
+ * @retval	false	: error in opening, allocating or mapping the file
+ *
+*/
+static bool MqttClientSpoolMapSegment(t_MqttSpool *spool, uint32_t sequence, bool create, t_MqttSpoolSegment *segment);
+
+/**
+ * @brief	Unmap the oldest segment and delete its file. Called under lock.
+ *
+ * @param[in]	: spool	: spool of the client
+ * @return 	void
+ *
+*/
+static void MqttClientSpoolDropSegment(t_MqttSpool *spool);
+
+/**
+ * @brief	Read the records of a recovered segment, the first record not completely appended ends it. Called under lock.
+ *
+ * @param[in]	: spool		: spool of the client
+ * @param[in]	: segment	: recovered segment
+ * @return 	void
+ *
+*/
+static void MqttClientSpoolScan(t_MqttSpool *spool, t_MqttSpoolSegment *segment);
+
+/**
+ * @brief	Delete the oldest segments once every record they hold is acknowledged, every segment once the spool is
+ * 			empty. Called under lock.
+ *
+ * @param[in]	: spool	: spool of the client
+ * @return 	void
+ *
+*/
+static void MqttClientSpoolCompact(t_MqttSpool *spool);
+
+/**
+ * @brief	Count a record in or out of the records pending on its routing bucket. Called under lock.
+ *
+ * @param[in]	: spool		: spool of the client
+ * @param[in]	: route		: routing bucket of the record, MQTT_NO_ROUTE if none
+ * @param[in]	: add		: record added, removed otherwise
+ * @return 	void
+ *
+*/
+static void MqttClientSpoolCountRoute(t_MqttSpool *spool, uint16_t route, bool add);
+
+/* -------------------------------- Routines -------------------------------- */
+
+/**
+ * @brief	Compute the CRC-32 of a record.
+ *
+ * @param[in]	: sequence	: segment of the record
+ * @param[in]	: offset	: offset of the record in its segment
+ * @param[in]	: header	: record header, length, service id, route and expiry are covered
+ * @param[in]	: payload	: payload of the record
+ * @return 	uint32_t
+ *
+*/
+static uint32_t MqttClientSpoolCrc(uint32_t sequence, uint32_t offset, const t_SpoolRecordHeader *header, const unsigned char *payload)
+{
+	unsigned char prefix[21];
+	uint32_t crc = 0xFFFFFFFFU;
+	uint32_t idx;
+	int bit;
+
+	memcpy(&prefix[0], &sequence, sizeof(sequence));
+	memcpy(&prefix[4], &offset, sizeof(offset));
+	memcpy(&prefix[8], &header->length, sizeof(header->length));
+	prefix[10] = header->service_id;
+	memcpy(&prefix[11], &header->route, sizeof(header->route));
+	memcpy(&prefix[13], &header->expiry_ms, sizeof(header->expiry_ms));
+
+	for (idx = 0U; idx < (sizeof(prefix) + header->length); idx++)
+	{
+		crc ^= (idx < sizeof(prefix)) ? prefix[idx] : payload[idx - sizeof(prefix)];
+		for (bit = 0; bit < 8; bit++)
+		{
+			crc = (crc >> 1) ^ (0xEDB88320U & (0U - (crc & 1U)));
+		}
+	}
+
+	return ~crc;
+}
+
+/**
+ * @brief	Get the wall clock time, spooled messages outlive the process and the monotonic clock with it.
+ *
+ * @return 	uint64_t
+ * @retval	milli seconds since the epoch
+ *
+*/
+static uint64_t MqttClientSpoolWallClockMs(void)
+{
+	struct timespec now;
+
+	(void)clock_gettime(CLOCK_REALTIME, &now);
+
+	return ((uint64_t)now.tv_sec * 1000U) + ((uint64_t)now.tv_nsec / 1000000U);
+}
+
+/**
+ * @brief	Get the segment of a sequence number. Called under lock.
+ *
+ * @param[in]	: spool		: spool of the client
+ * @param[in]	: sequence	: sequence number of the segment
+ * @return 	t_MqttSpoolSegment*
+ * @retval	NULL	: segment deleted or not created yet
+ *
+*/
+static t_MqttSpoolSegment* MqttClientSpoolSegment(t_MqttSpool *spool, uint32_t sequence)
+{
+	t_MqttSpoolSegment *segment = NULL;
+	unsigned char idx;
+
+	for (idx = 0U; idx < spool->count; idx++)
+	{
+		if ( spool->segments[(spool->first + idx) % MQTT_SPOOL_MAX_SEGMENTS].sequence == sequence )
+		{
+			segment = &spool->segments[(spool->first + idx) % MQTT_SPOOL_MAX_SEGMENTS];
+			break;
+		}
+	}
+
+	return segment;
+}
+
+/**
+ * @brief	Open and map a segment file, or create it. Called under lock.
+ *
+ * @param[in]	: spool		: spool of the client
+ * @param[in]	: sequence	: sequence number of the segment
+ * @param[in]	: create	: create a new empty segment
+ * @param[out]	: segment	: mapped segment
+ * @return 	bool
+ * @retval	true	: segment mapped
+ * @retval	false	: error in opening, allocating or mapping the file
+ *
+*/
+static bool MqttClientSpoolMapSegment(t_MqttSpool *spool, uint32_t sequence, bool create, t_MqttSpoolSegment *segment)
+{
+	char path[PATH_MAX];
+	struct stat info;
+	t_SpoolSegmentHeader header = {SPOOL_SEGMENT_MAGIC, sequence};
+	void *base = MAP_FAILED;
+
+	(void)snprintf(path, sizeof(path), "%s/%010u.spool", spool->dir, sequence);
+
+	segment->fd = open(path, (true == create) ? (O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC) : (O_RDWR | O_CLOEXEC), 0600);
+	if ( INVALID_FD == segment->fd )
+	{
+		printf("MqttClient: Error in opening spool segment %s, errno %d", path, errno);
+		return false;
+	}
+
+	/* blocks are allocated now, a full disk fails the append instead of faulting on a store to the mapping */
+	if ( true == create )
+	{
+		if ( posix_fallocate(segment->fd, 0, (off_t)MQTT_SPOOL_SEGMENT_SIZE) != 0 )
+		{
+			printf("MqttClient: Error in allocating spool segment %s", path);
+			(void)close(segment->fd);
+			(void)unlink(path);
+			return false;
+		}
+	}
+	else if ( (fstat(segment->fd, &info) != SYS_SUCCESS) || (info.st_size != (off_t)MQTT_SPOOL_SEGMENT_SIZE) )
+	{
+		printf("MqttClient: Spool segment %s ignored, unexpected size", path);
+		(void)close(segment->fd);
+		return false;
+	}
+	else
+	{
+		/* segment of a previous run */
+	}
+
+	base = mmap(NULL, MQTT_SPOOL_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+	if ( MAP_FAILED == base )
+	{
+		printf("MqttClient: Error in mapping spool segment %s, errno %d", path, errno);
+		(void)close(segment->fd);
+		if ( true == create )
+		{
+			(void)unlink(path);
+		}
+		return false;
+	}
+
+	segment->base = (unsigned char *)base;
+	segment->sequence = sequence;
+	segment->end = SPOOL_DATA_OFFSET;
+	segment->unacked = 0U;
+
+	if ( true == create )
+	{
+		memcpy(segment->base, &header, sizeof(header));
+	}
+	else if ( 0 != memcmp(segment->base, &header, sizeof(header)) )
+	{
+		printf("MqttClient: Spool segment %s ignored, bad header", path);
+		(void)munmap(segment->base, MQTT_SPOOL_SEGMENT_SIZE);
+		(void)close(segment->fd);
+		return false;
+	}
+	else
+	{
+		/* records are read by MqttClientSpoolScan() */
+	}
+
+	return true;
+}
+
+/**
+ * @brief	Unmap the oldest segment and delete its file. Called under lock.
+ *
+ * @param[in]	: spool	: spool of the client
+ * @return 	void
+ *
+*/
+static void MqttClientSpoolDropSegment(t_MqttSpool *spool)
+{
+	t_MqttSpoolSegment *segment = &spool->segments[spool->first];
+	char path[PATH_MAX];
+
+	(void)snprintf(path, sizeof(path), "%s/%010u.spool", spool->dir, segment->sequence);
+
+	(void)munmap(segment->base, MQTT_SPOOL_SEGMENT_SIZE);
+	(void)close(segment->fd);
+	(void)unlink(path);
+
+	segment->base = NULL;
+	segment->fd = INVALID_FD;
+	spool->first = (unsigned char)((spool->first + 1U) % MQTT_SPOOL_MAX_SEGMENTS);
+	spool->count--;
+}
+
+/**
+ * @brief	Read the records of a recovered segment, the first record not completely appended ends it. Called under lock.
+ *
+ * @param[in]	: spool		: spool of the client
+ * @param[in]	: segment	: recovered segment
+ * @return 	void
+ *
+*/
+static void MqttClientSpoolScan(t_MqttSpool *spool, t_MqttSpoolSegment *segment)
+{
+	t_SpoolRecordHeader *header = NULL;
+	uint32_t offset = SPOOL_DATA_OFFSET;
+
+	while ( (offset + sizeof(t_SpoolRecordHeader)) <= MQTT_SPOOL_SEGMENT_SIZE )
+	{
+		header = (t_SpoolRecordHeader *)&segment->base[offset];
+
+		if ( (0U == (header->flags & SPOOL_RECORD_VALID)) || (header->length > SERVER_COM_JSON_MAX_SIZE) ||
+			 ((offset + SPOOL_RECORD_SIZE(header->length)) > MQTT_SPOOL_SEGMENT_SIZE) ||
+			 (header->crc != MqttClientSpoolCrc(segment->sequence, offset, header, (const unsigned char *)&header[1])) )
+		{
+			break;
+		}
+
+		/* a record of a service removed since is never published, it is dropped with its segment */
+		if ( (0U == (header->flags & SPOOL_RECORD_ACKED)) && (header->service_id < (uint8_t)SERVICE_LAST) )
+		{
+			segment->unacked++;
+			spool->pending[header->service_id]++;
+			spool->records++;
+			MqttClientSpoolCountRoute(spool, header->route, true);
+		}
+
+		offset += SPOOL_RECORD_SIZE(header->length);
+	}
+
+	segment->end = offset;
+}
+
+/**
+ * @brief	Delete the oldest segments once every record they hold is acknowledged, every segment once the spool is
+ * 			empty. Called under lock.
+ *
+ * @param[in]	: spool	: spool of the client
+ * @return 	void
+ *
+*/
+static void MqttClientSpoolCompact(t_MqttSpool *spool)
+{
+	while ( (spool->count > 1U) && (0U == spool->segments[spool->first].unacked) )
+	{
+		MqttClientSpoolDropSegment(spool);
+	}
+
+	/* the last segment is the one appended to, it goes as well once nothing is left to send */
+	if ( (1U == spool->count) && (0U == spool->records) )
+	{
+		MqttClientSpoolDropSegment(spool);
+	}
+
+	if ( 0U == spool->count )
+	{
+		spool->send.sequence = spool->next_sequence;
+		spool->send.offset = SPOOL_DATA_OFFSET;
+	}
+	else if ( spool->send.sequence < spool->segments[spool->first].sequence )
+	{
+		spool->send.sequence = spool->segments[spool->first].sequence;
+		spool->send.offset = SPOOL_DATA_OFFSET;
+	}
+	else
+	{
+		/* the record to send is in a segment kept */
+	}
+}
+
+/**
+ * @brief	Count a record in or out of the records pending on its routing bucket. Called under lock.
+ *
+ * @param[in]	: spool		: spool of the client
+ * @param[in]	: route		: routing bucket of the record, MQTT_NO_ROUTE if none
+ * @param[in]	: add		: record added, removed otherwise
+ * @return 	void
+ *
+*/
+static void MqttClientSpoolCountRoute(t_MqttSpool *spool, uint16_t route, bool add)
+{
+	/* the mask is read without the lock by the pools routing keys to the client, it changes with the bucket only */
+	if ( route < MQTT_POOL_ROUTE_BUCKETS )
+	{
+		if ( true == add )
+		{
+			spool->route_pending[route]++;
+			if ( 1U == spool->route_pending[route] )
+			{
+				(void)__atomic_fetch_or(&spool->route_mask, (uint64_t)1U << route, __ATOMIC_RELEASE);
+			}
+		}
+		else
+		{
+			spool->route_pending[route]--;
+			if ( 0U == spool->route_pending[route] )
+			{
+				(void)__atomic_fetch_and(&spool->route_mask, ~((uint64_t)1U << route), __ATOMIC_RELEASE);
+			}
+		}
+	}
+}
+
+/**
+ * @brief	Open the spool directory of a client context and recover the records a previous run left unacknowledged.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientSpoolInit(t_MqttClient *client)
+{
+	t_MqttSpool *spool = &client->spool;
+	uint32_t sequences[MQTT_SPOOL_MAX_SEGMENTS];
+	unsigned char found = 0U;
+	unsigned char idx;
+	unsigned char pos;
+	unsigned int sequence = 0U;
+	char suffix[8];
+	DIR *dir = NULL;
+	struct dirent *entry = NULL;
+	t_MqttSpoolSegment *segment = NULL;
+
+	/* the context is not shared yet, the spool is set up without locking */
+	(void)pthread_mutex_init(&spool->lock, NULL);
+
+	spool->enabled = false;
+	spool->dir = client->config.spool_dir;
+	spool->first = 0U;
+	spool->count = 0U;
+	spool->next_sequence = 1U;
+	spool->window_count = 0U;
+	spool->packet_id = (uint16_t)(MQTT_SPOOL_PACKET_ID_BASE - 1U);
+	spool->records = 0U;
+	spool->durable_services = 0U;
+	spool->handle_sequence = 0U;
+	memset(spool->pending, 0, sizeof(spool->pending));
+	memset(spool->route_pending, 0, sizeof(spool->route_pending));
+	spool->route_mask = 0U;
+
+	if ( (NULL == spool->dir) || ('\0' == spool->dir[0]) )
+	{
+		return;
+	}
+
+	if ( (mkdir(spool->dir, 0700) != SYS_SUCCESS) && (EEXIST != errno) )
+	{
+		printf("MqttClient: Error in creating spool directory %s, errno %d", spool->dir, errno);
+		return;
+	}
+
+	dir = opendir(spool->dir);
+	if ( NULL == dir )
+	{
+		printf("MqttClient: Error in opening spool directory %s, errno %d", spool->dir, errno);
+		return;
+	}
+
+	/* the oldest segments are kept in order, there are never more of them than the spool can hold */
+	while ( (entry = readdir(dir)) != NULL )
+	{
+		if ( (2 != sscanf(entry->d_name, "%10u%7s", &sequence, suffix)) || (0 != strcmp(suffix, ".spool")) || (0U == sequence) )
+		{
+			continue;
+		}
+
+		for (pos = found; (pos > 0U) && (sequences[pos - 1U] > sequence); pos--)
+		{
+			if ( pos < MQTT_SPOOL_MAX_SEGMENTS )
+			{
+				sequences[pos] = sequences[pos - 1U];
+			}
+		}
+
+		if ( pos < MQTT_SPOOL_MAX_SEGMENTS )
+		{
+			sequences[pos] = sequence;
+			found = (found < MQTT_SPOOL_MAX_SEGMENTS) ? (unsigned char)(found + 1U) : found;
+		}
+		else
+		{
+			printf("MqttClient: Spool segment %u ignored, more than %d segments", sequence, MQTT_SPOOL_MAX_SEGMENTS);
+		}
+	}
+	(void)closedir(dir);
+
+	for (idx = 0U; idx < found; idx++)
+	{
+		segment = &spool->segments[spool->count];
+		if ( true == MqttClientSpoolMapSegment(spool, sequences[idx], false, segment) )
+		{
+			MqttClientSpoolScan(spool, segment);
+			spool->count++;
+			spool->next_sequence = sequences[idx] + 1U;
+		}
+	}
+
+	spool->send.sequence = (spool->count > 0U) ? spool->segments[0].sequence : spool->next_sequence;
+	spool->send.offset = SPOOL_DATA_OFFSET;
+	spool->enabled = true;
+
+	MqttClientSpoolCompact(spool);
+
+	printf("MqttClient: Spool %s opened, %d messages recovered in %d segments", spool->dir, spool->records, spool->count);
+}
+
+/**
+ * @brief	Select whether the messages of a service are durable.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service to configure
+ * @param[in]	: enable		: messages of the service are durable
+ * @return 	void
+ *
+*/
+void MqttClientSpoolSetDurable(t_MqttClient *client, unsigned char service_id, bool enable)
+{
+	if ( service_id < 32U )
+	{
+		if ( true == enable )
+		{
+			(void)__atomic_or_fetch(&client->spool.durable_services, (uint32_t)(1UL << service_id), __ATOMIC_RELAXED);
+		}
+		else
+		{
+			(void)__atomic_and_fetch(&client->spool.durable_services, ~(uint32_t)(1UL << service_id), __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/**
+ * @brief	Get the durable services, none while the spool is disabled.
+ *
+ * @param[in]	: client	: client context
+ * @return 	uint32_t
+ * @retval	bit N set for service N
+ *
+*/
+uint32_t MqttClientSpoolGetDurable(t_MqttClient *client)
+{
+	return (true == client->spool.enabled) ? __atomic_load_n(&client->spool.durable_services, __ATOMIC_RELAXED) : 0U;
+}
+
+/**
+ * @brief	Check whether a new message of a service has to be spooled: the service is durable and the client is
+ * 			offline, or older messages of the service are still spooled.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service of the message
+ * @param[in]	: online		: client connected to its broker
+ * @return 	bool
+ *
+*/
+bool MqttClientSpoolWanted(t_MqttClient *client, unsigned char service_id, bool online)
+{
+	t_MqttSpool *spool = &client->spool;
+	bool wanted = false;
+
+	if ( 0U != (MqttClientSpoolGetDurable(client) & (1UL << service_id)) )
+	{
+		pthread_mutex_lock(&spool->lock);
+		wanted = ( (false == online) || (0U != spool->pending[service_id]) );
+		pthread_mutex_unlock(&spool->lock);
+	}
+
+	return wanted;
+}
+
+/**
+ * @brief	Append messages of a service to the spool, either every message is spooled or none. The owner is
+ * 			notified SERVERCOM_SPOOLED once the messages are stored.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: msgs			: messages to be spooled, already validated
+ * @param[in]	: count			: number of messages
+ * @param[in]	: service_id	: service id of calling service
+ * @param[in]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @param[in]	: combined		: notify cbk once for the whole batch
+ * @param[in]	: route			: pool routing bucket of the messages, kept pending by their records, MQTT_NO_ROUTE if none
+ * @param[out]	: handles		: handles of the spooled messages, count entries
+ * @return 		t_MqttSubmitStatus
+ * @retval		MQTT_SUBMIT_OK			: messages spooled
+ * @retval		MQTT_SUBMIT_WOULD_BLOCK	: spool disabled or full
+ *
+*/
+t_MqttSubmitStatus MqttClientSpoolSubmit(t_MqttClient *client, const t_MqttMessage *msgs, unsigned short count, unsigned char service_id,
+											RxCbk cbk, void *user_ctx, bool combined, unsigned short route, t_MqttRequestHandle *handles)
+{
+	t_MqttSpool *spool = &client->spool;
+	t_MqttSubmitStatus status = MQTT_SUBMIT_OK;
+	t_MqttSpoolSegment *segment = NULL;
+	t_SpoolRecordHeader *header = NULL;
+	uint32_t room = 0U;
+	uint32_t size = 0U;
+	unsigned char needed = 0U;
+	unsigned char created = 0U;
+	unsigned char target = 0U;
+	unsigned short msg;
+	uintptr_t page = 0U;
+	uint64_t now_ms = MqttClientSpoolWallClockMs();
+
+	if ( false == spool->enabled )
+	{
+		return MQTT_SUBMIT_WOULD_BLOCK;
+	}
+
+	pthread_mutex_lock(&spool->lock);
+
+	/* room for the whole batch is found first: in the last segment, then in new segments up to the disk limit */
+	room = (spool->count > 0U) ? (MQTT_SPOOL_SEGMENT_SIZE - spool->segments[(spool->first + spool->count - 1U) % MQTT_SPOOL_MAX_SEGMENTS].end) : 0U;
+	for (msg = 0U; msg < count; msg++)
+	{
+		size = SPOOL_RECORD_SIZE(msgs[msg].size);
+		if ( size > room )
+		{
+			needed++;
+			room = MQTT_SPOOL_SEGMENT_SIZE - SPOOL_DATA_OFFSET;
+		}
+		room -= size;
+	}
+
+	if ( (spool->count + needed) > MQTT_SPOOL_MAX_SEGMENTS )
+	{
+		status = MQTT_SUBMIT_WOULD_BLOCK;
+	}
+
+	/* the segments are created before any record is written, a failure leaves the spool as it was */
+	for (created = 0U; (MQTT_SUBMIT_OK == status) && (created < needed); created++)
+	{
+		segment = &spool->segments[(spool->first + spool->count + created) % MQTT_SPOOL_MAX_SEGMENTS];
+		if ( false == MqttClientSpoolMapSegment(spool, spool->next_sequence + created, true, segment) )
+		{
+			status = MQTT_SUBMIT_WOULD_BLOCK;
+			while ( created > 0U )
+			{
+				created--;
+				spool->count++;
+				spool->first = (unsigned char)((spool->first + MQTT_SPOOL_MAX_SEGMENTS - 1U) % MQTT_SPOOL_MAX_SEGMENTS);
+				spool->segments[spool->first] = spool->segments[(spool->first + spool->count) % MQTT_SPOOL_MAX_SEGMENTS];
+				MqttClientSpoolDropSegment(spool);
+			}
+			break;
+		}
+	}
+
+	if ( MQTT_SUBMIT_OK == status )
+	{
+		/* the first record goes to the last segment when it fits there */
+		target = (spool->count > 0U) ? (unsigned char)(spool->count - 1U) : 0U;
+		spool->count = (unsigned char)(spool->count + needed);
+		spool->next_sequence += needed;
+
+		for (msg = 0U; msg < count; msg++)
+		{
+			segment = &spool->segments[(spool->first + target) % MQTT_SPOOL_MAX_SEGMENTS];
+			size = SPOOL_RECORD_SIZE(msgs[msg].size);
+			if ( (segment->end + size) > MQTT_SPOOL_SEGMENT_SIZE )
+			{
+				target++;
+				segment = &spool->segments[(spool->first + target) % MQTT_SPOOL_MAX_SEGMENTS];
+			}
+
+			header = (t_SpoolRecordHeader *)&segment->base[segment->end];
+			header->length = msgs[msg].size;
+			header->service_id = service_id;
+			header->route = route;
+			header->expiry_ms = (msgs[msg].ttl_ms != 0U) ? (now_ms + msgs[msg].ttl_ms) : 0U;
+			memcpy(&header[1], msgs[msg].json, msgs[msg].size);
+			header->crc = MqttClientSpoolCrc(segment->sequence, segment->end, header, msgs[msg].json);
+
+			/* a crash before this store leaves a record the recovery does not read */
+			__atomic_store_n(&header->flags, SPOOL_RECORD_VALID, __ATOMIC_RELEASE);
+
+			if ( 0U != MQTT_SPOOL_SYNC )
+			{
+				page = (uintptr_t)header & ~((uintptr_t)sysconf(_SC_PAGESIZE) - 1U);
+				(void)msync((void *)page, ((uintptr_t)header - page) + size, MS_SYNC);
+			}
+
+			segment->end += size;
+			segment->unacked++;
+			spool->pending[service_id]++;
+			spool->records++;
+			MqttClientSpoolCountRoute(spool, route, true);
+
+			do
+			{
+				spool->handle_sequence++;
+				handles[msg] = (spool->handle_sequence << MQTT_HANDLE_INDEX_BITS) | SPOOL_HANDLE_INDEX;
+			} while ( handles[msg] == MQTT_INVALID_REQUEST_HANDLE );
+		}
+	}
+
+	pthread_mutex_unlock(&spool->lock);
+
+	if ( MQTT_SUBMIT_OK == status )
+	{
+		for (msg = 0U; msg < count; msg++)
+		{
+			if ( (false == combined) || (0U == msg) )
+			{
+				MqttClientNotifyDispatch(client, cbk, handles[msg], SERVERCOM_SPOOLED, user_ctx, service_id);
+			}
+		}
+	}
+	else
+	{
+		printf("MqttClient: Spool full, %d messages of service %d not spooled", count, service_id);
+	}
+
+	return status;
+}
+
+/**
+ * @brief	Get the next spooled record to publish. None is returned while the window of records in flight is full,
+ * 			or while older requests of the service of the record still wait in the request queue.
+ *
+ * @param[in]	: client	: client context
+ * @param[out]	: record	: record to publish
+ * @return 	bool
+ * @retval	true	: record to publish
+ * @retval	false	: nothing to publish
+ *
+*/
+bool MqttClientSpoolNext(t_MqttClient *client, t_MqttSpoolRecord *record)
+{
+	t_MqttSpool *spool = &client->spool;
+	t_MqttSpoolSegment *segment = NULL;
+	t_SpoolRecordHeader *header = NULL;
+	bool found = false;
+	unsigned int expired = 0U;
+	uint64_t now_ms = 0U;
+
+	if ( false == spool->enabled )
+	{
+		return false;
+	}
+
+	now_ms = MqttClientSpoolWallClockMs();
+
+	pthread_mutex_lock(&spool->lock);
+
+	while ( (spool->window_count < MQTT_SPOOL_WINDOW) && (0U != spool->records) )
+	{
+		segment = MqttClientSpoolSegment(spool, spool->send.sequence);
+		if ( NULL == segment )
+		{
+			break;
+		}
+
+		/* a segment no longer appended to is followed by the next one */
+		if ( spool->send.offset >= segment->end )
+		{
+			if ( segment == &spool->segments[(spool->first + spool->count - 1U) % MQTT_SPOOL_MAX_SEGMENTS] )
+			{
+				break;
+			}
+			spool->send.sequence = spool->segments[(segment - spool->segments + 1) % MQTT_SPOOL_MAX_SEGMENTS].sequence;
+			spool->send.offset = SPOOL_DATA_OFFSET;
+			continue;
+		}
+
+		header = (t_SpoolRecordHeader *)&segment->base[spool->send.offset];
+		if ( (0U != (header->flags & SPOOL_RECORD_ACKED)) || (header->service_id >= (uint8_t)SERVICE_LAST) )
+		{
+			spool->send.offset += SPOOL_RECORD_SIZE(header->length);
+			continue;
+		}
+
+		/* a stale message is released as if acknowledged, its submitter may be long gone and is not notified */
+		if ( (0U != header->expiry_ms) && (now_ms >= header->expiry_ms) )
+		{
+			header->flags |= SPOOL_RECORD_ACKED;
+			segment->unacked--;
+			spool->pending[header->service_id]--;
+			spool->records--;
+			MqttClientSpoolCountRoute(spool, header->route, false);
+			spool->send.offset += SPOOL_RECORD_SIZE(header->length);
+			expired++;
+			continue;
+		}
+
+		record->payload = (const unsigned char *)&header[1];
+		record->length = header->length;
+		record->service_id = header->service_id;
+		record->dup = (0U != (header->flags & SPOOL_RECORD_SENT));
+		record->expiry_interval = (0U != header->expiry_ms) ? (uint32_t)(((header->expiry_ms - now_ms) + 999U) / 1000U) : 0U;
+		found = true;
+		break;
+	}
+
+	if ( 0U != expired )
+	{
+		MqttClientSpoolCompact(spool);
+	}
+
+	pthread_mutex_unlock(&spool->lock);
+
+	if ( 0U != expired )
+	{
+		printf("MqttClient: %d expired spooled messages dropped", expired);
+	}
+
+	/* the request queue holds older messages of the service, they go first */
+	if ( (true == found) && (0U != MqttClientQueueServiceDepth(client, record->service_id)) )
+	{
+		found = false;
+	}
+
+	return found;
+}
+
+/**
+ * @brief	Record the publication of the record returned by MqttClientSpoolNext(), the next one follows.
+ *
+ * @param[in]	: client	: client context
+ * @return 	uint16_t
+ * @retval	packet id to publish the record with
+ *
+*/
+uint16_t MqttClientSpoolSent(t_MqttClient *client)
+{
+	t_MqttSpool *spool = &client->spool;
+	t_MqttSpoolSegment *segment = NULL;
+	t_SpoolRecordHeader *header = NULL;
+
+	pthread_mutex_lock(&spool->lock);
+
+	spool->packet_id = (spool->packet_id == UINT16_MAX) ? MQTT_SPOOL_PACKET_ID_BASE : (uint16_t)(spool->packet_id + 1U);
+
+	segment = MqttClientSpoolSegment(spool, spool->send.sequence);
+	header = (t_SpoolRecordHeader *)&segment->base[spool->send.offset];
+	header->flags |= SPOOL_RECORD_SENT;
+
+	spool->window[spool->window_count].packet_id = spool->packet_id;
+	spool->window[spool->window_count].position = spool->send;
+	spool->window_count++;
+	spool->send.offset += SPOOL_RECORD_SIZE(header->length);
+
+	pthread_mutex_unlock(&spool->lock);
+
+	return spool->packet_id;
+}
+
+/**
+ * @brief	Release the spooled record acknowledged by a PUBACK, segments left without record to send are deleted.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: packet_id	: packet id of the PUBACK
+ * @return 	bool
+ * @retval	true	: record released
+ * @retval	false	: no spooled record in flight with this packet id
+ *
+*/
+bool MqttClientSpoolAcked(t_MqttClient *client, uint16_t packet_id)
+{
+	t_MqttSpool *spool = &client->spool;
+	t_MqttSpoolSegment *segment = NULL;
+	t_SpoolRecordHeader *header = NULL;
+	bool released = false;
+	unsigned short idx;
+
+	pthread_mutex_lock(&spool->lock);
+
+	for (idx = 0U; idx < spool->window_count; idx++)
+	{
+		if ( spool->window[idx].packet_id == packet_id )
+		{
+			segment = MqttClientSpoolSegment(spool, spool->window[idx].position.sequence);
+			header = (t_SpoolRecordHeader *)&segment->base[spool->window[idx].position.offset];
+			header->flags |= SPOOL_RECORD_ACKED;
+
+			segment->unacked--;
+			spool->pending[header->service_id]--;
+			spool->records--;
+			MqttClientSpoolCountRoute(spool, header->route, false);
+
+			/* the window stays in publication order, the oldest record in flight is the one to publish again first */
+			memmove(&spool->window[idx], &spool->window[idx + 1U], (size_t)(spool->window_count - idx - 1U) * sizeof(t_MqttSpoolInflight));
+			spool->window_count--;
+
+			MqttClientSpoolCompact(spool);
+			released = true;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&spool->lock);
+
+	return released;
+}
+
+/**
+ * @brief	Connection closed: the records in flight are published again on the next connection.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientSpoolRewind(t_MqttClient *client)
+{
+	t_MqttSpool *spool = &client->spool;
+
+	pthread_mutex_lock(&spool->lock);
+
+	if ( spool->window_count > 0U )
+	{
+		printf("MqttClient: %d spooled messages in flight published again on the next connection", spool->window_count);
+		spool->send = spool->window[0].position;
+		spool->window_count = 0U;
+	}
+
+	pthread_mutex_unlock(&spool->lock);
+}
+
+/**
+ * @brief	Get the number of spooled records not acknowledged yet.
+ *
+ * @param[in]	: client	: client context
+ * @return 	unsigned int
+ *
+*/
+unsigned int MqttClientSpoolDepth(t_MqttClient *client)
+{
+	t_MqttSpool *spool = &client->spool;
+	unsigned int records = 0U;
+
+	pthread_mutex_lock(&spool->lock);
+	records = spool->records;
+	pthread_mutex_unlock(&spool->lock);
+
+	return records;
+}
+
+/**
+ * @brief	Check whether spooled records of a pool routing bucket are not acknowledged yet, without locking the spool.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: route		: routing bucket
+ * @return	bool
+ *
+*/
+bool MqttClientSpoolRouteHeld(t_MqttClient *client, unsigned short route)
+{
+	return (0U != (__atomic_load_n(&client->spool.route_mask, __ATOMIC_ACQUIRE) & ((uint64_t)1U << route)));
+}
+
+/**
+ * @brief	Unmap the segments of the spool, their files are kept and recovered by the next MqttClientSpoolInit().
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientSpoolClose(t_MqttClient *client)
+{
+	t_MqttSpool *spool = &client->spool;
+	t_MqttSpoolSegment *segment = NULL;
+
+	pthread_mutex_lock(&spool->lock);
+
+	while ( spool->count > 0U )
+	{
+		segment = &spool->segments[spool->first];
+		(void)munmap(segment->base, MQTT_SPOOL_SEGMENT_SIZE);
+		(void)close(segment->fd);
+		segment->base = NULL;
+		segment->fd = INVALID_FD;
+		spool->first = (unsigned char)((spool->first + 1U) % MQTT_SPOOL_MAX_SEGMENTS);
+		spool->count--;
+	}
+
+	spool->enabled = false;
+	spool->records = 0U;
+	spool->window_count = 0U;
+	memset(spool->route_pending, 0, sizeof(spool->route_pending));
+	__atomic_store_n(&spool->route_mask, 0U, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&spool->lock);
+}
@@ -0,0 +1,226 @@
+/**************************************************************************//**
+*  @par Language  : C
+*******************************************************************************
+*  @brief       MqttClient durable spool header file.
+*  @author      dr-paradox
+*  @version     1.0.0
+*******************************************************************************
+*  @page 	MqttClientSpool
+*  @ref 	MqttClient "API Reference" header file
+*  @file 	MqttClientSpool.h
+*
+*******************************************************************************/
+
+#ifndef MQTTCLIENT_SPOOL_H
+#define MQTTCLIENT_SPOOL_H
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "MqttClient.h"
+#include "MqttClientCfg.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* Packet ids of spooled messages are taken from the upper half, the request in flight and the ordered requests use
+ * the lower one */
+#define MQTT_SPOOL_PACKET_ID_BASE			((uint16_t)0x8000)
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* Position of a record in the spool */
+typedef struct {
+	uint32_t			sequence;						/*segment of the record*/
+	uint32_t			offset;							/*offset of the record header in the segment*/
+} t_MqttSpoolPosition;
+
+/* Segment file of the spool, mapped as a whole */
+typedef struct {
+	int					fd;								/*segment file*/
+	unsigned char		*base;							/*mapping of the segment file*/
+	uint32_t			sequence;						/*sequence number, also the name of the file*/
+	uint32_t			end;							/*offset following the last record*/
+	unsigned int		unacked;						/*records of the segment not acknowledged yet*/
+} t_MqttSpoolSegment;
+
+/* Spooled record published and not acknowledged yet */
+typedef struct {
+	uint16_t			packet_id;						/*packet id the record was published with*/
+	t_MqttSpoolPosition	position;						/*record*/
+} t_MqttSpoolInflight;
+
+/* Spooled record handed to the FSM to be published */
+typedef struct {
+	const unsigned char	*payload;						/*json message, in the mapping of its segment*/
+	uint16_t			length;							/*length of payload*/
+	unsigned char		service_id;						/*service the message was submitted by*/
+	bool				dup;							/*published before, on a previous connection or before a restart*/
+	uint32_t			expiry_interval;				/*seconds left to live, 0 if the message never expires*/
+} t_MqttSpoolRecord;
+
+/* Durable spool of a client context: segmented log of the messages of durable services kept while offline or
+ * while the request queue is full, oldest segment first */
+typedef struct {
+	pthread_mutex_t		lock;							/*appends come from any thread, the FSM publishes and releases records*/
+	bool				enabled;						/*spool directory usable*/
+	const char			*dir;							/*spool directory*/
+	t_MqttSpoolSegment	segments[MQTT_SPOOL_MAX_SEGMENTS];	/*segments, oldest first starting from first*/
+	unsigned char		first;							/*position of the oldest segment*/
+	unsigned char		count;							/*number of segments*/
+	uint32_t			next_sequence;					/*sequence number of the next segment created*/
+	t_MqttSpoolPosition	send;							/*next record to publish*/
+	t_MqttSpoolInflight	window[MQTT_SPOOL_WINDOW];		/*records published and not acknowledged, in publication order*/
+	unsigned short		window_count;					/*number of records in window*/
+	uint16_t			packet_id;						/*packet id of the last record published*/
+	unsigned int		records;						/*records not acknowledged*/
+	unsigned int		pending[SERVICE_LAST];			/*records not acknowledged of each service*/
+	unsigned int		route_pending[MQTT_POOL_ROUTE_BUCKETS];	/*records not acknowledged of each pool routing bucket*/
+	uint64_t			route_mask;						/*pool routing buckets with records not acknowledged, bit N for bucket N*/
+	uint32_t			durable_services;				/*durable services, bit N for service N*/
+	unsigned int		handle_sequence;				/*sequence number used to build the handles of spooled messages*/
+} t_MqttSpool;
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+ * @brief	Open the spool directory of a client context and recover the records a previous run left unacknowledged.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientSpoolInit(t_MqttClient *client);
+
+/**
+ * @brief	Select whether the messages of a service are durable.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service to configure
+ * @param[in]	: enable		: messages of the service are durable
+ * @return 	void
+ *
+*/
+void MqttClientSpoolSetDurable(t_MqttClient *client, unsigned char service_id, bool enable);
+
+/**
+ * @brief	Get the durable services, none while the spool is disabled.
+ *
+ * @param[in]	: client	: client context
+ * @return 	uint32_t
+ * @retval	bit N set for service N
+ *
+*/
+uint32_t MqttClientSpoolGetDurable(t_MqttClient *client);
+
+/**
+ * @brief	Check whether a new message of a service has to be spooled: the service is durable and the client is
+ * 			offline, or older messages of the service are still spooled.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: service_id	: service of the message
+ * @param[in]	: online		: client connected to its broker
+ * @return 	bool
+ *
+*/
+bool MqttClientSpoolWanted(t_MqttClient *client, unsigned char service_id, bool online);
+
+/**
+ * @brief	Append messages of a service to the spool, either every message is spooled or none. The owner is
+ * 			notified SERVERCOM_SPOOLED once the messages are stored.
+ *
+ * @param[in]	: client		: client context
+ * @param[in]	: msgs			: messages to be spooled, already validated
+ * @param[in]	: count			: number of messages
+ * @param[in]	: service_id	: service id of calling service
+ * @param[in]	: cbk			: callback to notify status
+ * @param[in]	: user_ctx		: user context pointer passed back to cbk
+ * @param[in]	: combined		: notify cbk once for the whole batch
+ * @param[in]	: route			: pool routing bucket of the messages, kept pending by their records, MQTT_NO_ROUTE if none
+ * @param[out]	: handles		: handles of the spooled messages, count entries
+ * @return 		t_MqttSubmitStatus
+ * @retval		MQTT_SUBMIT_OK			: messages spooled
+ * @retval		MQTT_SUBMIT_WOULD_BLOCK	: spool disabled or full
+ *
+*/
+t_MqttSubmitStatus MqttClientSpoolSubmit(t_MqttClient *client, const t_MqttMessage *msgs, unsigned short count, unsigned char service_id,
+											RxCbk cbk, void *user_ctx, bool combined, unsigned short route, t_MqttRequestHandle *handles);
+
+/**
+ * @brief	Get the next spooled record to publish. None is returned while the window of records in flight is full,
+ * 			or while older requests of the service of the record still wait in the request queue. Records whose time
+ * 			to live elapsed are dropped on the way.
+ *
+ * @param[in]	: client	: client context
+ * @param[out]	: record	: record to publish
+ * @return 	bool
+ * @retval	true	: record to publish
+ * @retval	false	: nothing to publish
+ *
+*/
+bool MqttClientSpoolNext(t_MqttClient *client, t_MqttSpoolRecord *record);
+
+/**
+ * @brief	Record the publication of the record returned by MqttClientSpoolNext(), the next one follows.
+ *
+ * @param[in]	: client	: client context
+ * @return 	uint16_t
+ * @retval	packet id to publish the record with
+ *
+*/
+uint16_t MqttClientSpoolSent(t_MqttClient *client);
+
+/**
+ * @brief	Release the spooled record acknowledged by a PUBACK, segments left without record to send are deleted.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: packet_id	: packet id of the PUBACK
+ * @return 	bool
+ * @retval	true	: record released
+ * @retval	false	: no spooled record in flight with this packet id
+ *
+*/
+bool MqttClientSpoolAcked(t_MqttClient *client, uint16_t packet_id);
+
+/**
+ * @brief	Connection closed: the records in flight are published again on the next connection.
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientSpoolRewind(t_MqttClient *client);
+
+/**
+ * @brief	Get the number of spooled records not acknowledged yet.
+ *
+ * @param[in]	: client	: client context
+ * @return 	unsigned int
+ *
+*/
+unsigned int MqttClientSpoolDepth(t_MqttClient *client);
+
+/**
+ * @brief	Check whether spooled records of a pool routing bucket are not acknowledged yet, without locking the spool.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: route		: routing bucket
+ * @return	bool
+ *
+*/
+bool MqttClientSpoolRouteHeld(t_MqttClient *client, unsigned short route);
+
+/**
+ * @brief	Unmap the segments of the spool, their files are kept and recovered by the next MqttClientSpoolInit().
+ *
+ * @param[in]	: client	: client context
+ * @return 	void
+ *
+*/
+void MqttClientSpoolClose(t_MqttClient *client);
+
+/* -------------------------------- Routines -------------------------------- */
+
+#endif /* MQTTCLIENT_SPOOL_H */
@@ -0,0 +1,509 @@
+/**************************************************************************//**
+*  @par Language: C
+*******************************************************************************
+*  @par 	Project:
+*  @brief   MqttClient hierarchical timer wheel implementation
+*  @author  dr-paradox
+*  @version 1.0.0
+*******************************************************************************
+*  @ref 	MqttClient "API Reference"
+*  @file 	MqttClientTimer.c
+*******************************************************************************/
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <time.h>
+#include <limits.h>
+#include "MqttClientTimer.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* Slot index bits and mask of a level */
+#define TIMER_SLOT_BITS				((unsigned char)6)
+#define TIMER_SLOTS					((unsigned char)MQTT_TIMER_WHEEL_SLOTS)
+#define TIMER_SLOT_MASK				((uint64_t)TIMER_SLOTS - 1U)
+
+/* Longest delay held by the wheel, longer timers are moved down the wheel until they are due */
+#define TIMER_MAX_DELTA_MS			((((uint64_t)1) << (TIMER_SLOT_BITS * MQTT_TIMER_WHEEL_LEVELS)) - 1U)
+
+/* Returned by MqttClientTimerNextTick() when no timer is running */
+#define TIMER_NO_TICK				((uint64_t)UINT64_MAX)
+
+/* Conversions of clock_gettime() values to milli seconds */
+#define MS_PER_SEC					((uint64_t)1000)
+#define NS_PER_MS					((uint64_t)1000000)
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* ---------------------------- Global Variables ---------------------------- */
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+* @brief	Link a timer in the slot matching its deadline.
+*
+* @param[in]	: wheel	: timer wheel
+* @param[in]	: timer	: timer to link, not linked
+* @return		void
+*/
+static void MqttClientTimerLink(t_MqttTimerWheel *wheel, t_MqttTimer *timer);
+
+/**
+* @brief	Unlink a timer from its slot or from a detached list.
+*
+* @param[in]	: wheel	: timer wheel
+* @param[in]	: timer	: timer to unlink, linked
+* @return		void
+*/
+static void MqttClientTimerUnlink(t_MqttTimerWheel *wheel, t_MqttTimer *timer);
+
+/**
+* @brief	Move every timer of a slot to a list owned by the caller, so that callbacks are free
+* 			to start and stop timers while the list is processed.
+*
+* @param[in]	: level	: wheel level
+* @param[in]	: slot	: slot of the level
+* @param[out]	: list	: head of the detached list
+* @return		void
+*/
+static void MqttClientTimerDetach(t_MqttTimerWheel *wheel, unsigned char level, unsigned char slot, t_MqttTimer **list);
+
+/**
+* @brief	Get the next milli second at which the wheel has something to do: a timer of the first
+* 			level to expire or a slot of an upper level to be moved down.
+*
+* @param[in]	: wheel	: timer wheel
+* @return	uint64_t
+* @retval	TIMER_NO_TICK	: no timer running
+*/
+static uint64_t MqttClientTimerNextTick(t_MqttTimerWheel *wheel);
+
+/**
+* @brief	Process the next milli second of the wheel: move the upper level slots starting at this time down
+* 			the wheel then call the callbacks of the timers expiring.
+*
+* @param[in]	: wheel	: timer wheel
+* @return	unsigned int
+* @retval	number of timers elapsed
+*/
+static unsigned int MqttClientTimerProcessTick(t_MqttTimerWheel *wheel);
+
+/**
+* @brief	Default clock of the wheels: the monotonic clock.
+*
+* @param[in]	: clock_ctx	: unused
+* @return	uint64_t
+* @retval	current time in milli seconds
+*/
+static uint64_t MqttClientTimerMonotonicMs(void *clock_ctx);
+
+/* -------------------------------- Routines -------------------------------- */
+
+/**
+* @brief	Link a timer in the slot matching its deadline.
+*
+* @param[in]	: wheel	: timer wheel
+* @param[in]	: timer	: timer to link, not linked
+* @return		void
+*/
+static void MqttClientTimerLink(t_MqttTimerWheel *wheel, t_MqttTimer *timer)
+{
+	uint64_t target = timer->expires_ms;
+	uint64_t delta = 0U;
+	unsigned char level = 0U;
+	unsigned char slot = 0U;
+
+	/* an overdue timer is processed with the next milli second */
+	if ( target < wheel->now_ms )
+	{
+		target = wheel->now_ms;
+	}
+
+	delta = target - wheel->now_ms;
+	if ( delta > TIMER_MAX_DELTA_MS )
+	{
+		target = wheel->now_ms + TIMER_MAX_DELTA_MS;
+		delta = TIMER_MAX_DELTA_MS;
+	}
+
+	while ( ((level + 1U) < MQTT_TIMER_WHEEL_LEVELS) && (delta >= (((uint64_t)1) << (TIMER_SLOT_BITS * (level + 1U)))) )
+	{
+		level++;
+	}
+
+	slot = (unsigned char)((target >> (TIMER_SLOT_BITS * level)) & TIMER_SLOT_MASK);
+
+	timer->level = level;
+	timer->slot = slot;
+	timer->next = wheel->slots[level][slot];
+	if ( timer->next != NULL )
+	{
+		timer->next->pprev = &timer->next;
+	}
+	wheel->slots[level][slot] = timer;
+	timer->pprev = &wheel->slots[level][slot];
+
+	wheel->occupancy[level] |= ((uint64_t)1) << slot;
+}
+
+/**
+* @brief	Unlink a timer from its slot or from a detached list.
+*
+* @param[in]	: wheel	: timer wheel
+* @param[in]	: timer	: timer to unlink, linked
+* @return		void
+*/
+static void MqttClientTimerUnlink(t_MqttTimerWheel *wheel, t_MqttTimer *timer)
+{
+	*timer->pprev = timer->next;
+	if ( timer->next != NULL )
+	{
+		timer->next->pprev = timer->pprev;
+	}
+
+	timer->next = NULL;
+	timer->pprev = NULL;
+
+	if ( NULL == wheel->slots[timer->level][timer->slot] )
+	{
+		wheel->occupancy[timer->level] &= ~(((uint64_t)1) << timer->slot);
+	}
+}
+
+/**
+* @brief	Move every timer of a slot to a list owned by the caller, so that callbacks are free
+* 			to start and stop timers while the list is processed.
+*
+* @param[in]	: level	: wheel level
+* @param[in]	: slot	: slot of the level
+* @param[out]	: list	: head of the detached list
+* @return		void
+*/
+static void MqttClientTimerDetach(t_MqttTimerWheel *wheel, unsigned char level, unsigned char slot, t_MqttTimer **list)
+{
+	*list = wheel->slots[level][slot];
+	if ( *list != NULL )
+	{
+		(*list)->pprev = list;
+	}
+
+	wheel->slots[level][slot] = NULL;
+	wheel->occupancy[level] &= ~(((uint64_t)1) << slot);
+}
+
+/**
+* @brief	Get the next milli second at which the wheel has something to do: a timer of the first
+* 			level to expire or a slot of an upper level to be moved down.
+*
+* @param[in]	: wheel	: timer wheel
+* @return	uint64_t
+* @retval	TIMER_NO_TICK	: no timer running
+*/
+static uint64_t MqttClientTimerNextTick(t_MqttTimerWheel *wheel)
+{
+	uint64_t next_tick = TIMER_NO_TICK;
+	uint64_t tick = 0U;
+	uint64_t rotated = 0U;
+	unsigned char shift = 0U;
+	unsigned char index = 0U;
+	unsigned char level = 0U;
+	unsigned int offset = 0U;
+
+	for (level = 0U; level < MQTT_TIMER_WHEEL_LEVELS; level++)
+	{
+		if ( wheel->occupancy[level] != 0U )
+		{
+			shift = TIMER_SLOT_BITS * level;
+			index = (unsigned char)((wheel->now_ms >> shift) & TIMER_SLOT_MASK);
+
+			/* rotate the mask so that bit 0 is the current slot of the level */
+			rotated = wheel->occupancy[level];
+			if ( index != 0U )
+			{
+				rotated = (rotated >> index) | (rotated << (TIMER_SLOTS - index));
+			}
+
+			if ( 0U == level )
+			{
+				tick = wheel->now_ms + (uint64_t)__builtin_ctzll(rotated);
+			}
+			else if ( ((rotated & 1U) != 0U) && ((wheel->now_ms & ((((uint64_t)1) << shift) - 1U)) == 0U) )
+			{
+				/* the current slot is moved down when processing the next milli second */
+				tick = wheel->now_ms;
+			}
+			else
+			{
+				/* the current slot, if occupied, is only due after a full turn of the level */
+				rotated &= ~((uint64_t)1);
+				offset = (rotated != 0U) ? (unsigned int)__builtin_ctzll(rotated) : (unsigned int)TIMER_SLOTS;
+				tick = ((wheel->now_ms >> shift) + offset) << shift;
+			}
+
+			if ( tick < next_tick )
+			{
+				next_tick = tick;
+			}
+		}
+	}
+
+	return next_tick;
+}
+
+/**
+* @brief	Process the next milli second of the wheel: move the upper level slots starting at this time down
+* 			the wheel then call the callbacks of the timers expiring.
+*
+* @param[in]	: wheel	: timer wheel
+* @return	unsigned int
+* @retval	number of timers elapsed
+*/
+static unsigned int MqttClientTimerProcessTick(t_MqttTimerWheel *wheel)
+{
+	uint64_t tick = wheel->now_ms;
+	t_MqttTimer *list = NULL;
+	t_MqttTimer *timer = NULL;
+	unsigned char shift = 0U;
+	unsigned char level = 0U;
+	unsigned int elapsed = 0U;
+
+	for (level = 1U; level < MQTT_TIMER_WHEEL_LEVELS; level++)
+	{
+		shift = TIMER_SLOT_BITS * level;
+		if ( (tick & ((((uint64_t)1) << shift) - 1U)) != 0U )
+		{
+			break;
+		}
+
+		MqttClientTimerDetach(wheel, level, (unsigned char)((tick >> shift) & TIMER_SLOT_MASK), &list);
+		while ( list != NULL )
+		{
+			timer = list;
+			MqttClientTimerUnlink(wheel, timer);
+			MqttClientTimerLink(wheel, timer);
+		}
+	}
+
+	/* timers started by the callbacks are due at the earliest with the next milli second */
+	wheel->now_ms = tick + 1U;
+
+	MqttClientTimerDetach(wheel, 0U, (unsigned char)(tick & TIMER_SLOT_MASK), &list);
+	while ( list != NULL )
+	{
+		timer = list;
+		MqttClientTimerUnlink(wheel, timer);
+
+		if ( timer->expires_ms <= tick )
+		{
+			wheel->pending--;
+			elapsed++;
+			timer->cbk(timer->arg);
+		}
+		else
+		{
+			/* deadline beyond the span of the wheel */
+			MqttClientTimerLink(wheel, timer);
+		}
+	}
+
+	return elapsed;
+}
+
+/**
+* @brief	Default clock of the wheels: the monotonic clock.
+*
+* @param[in]	: clock_ctx	: unused
+* @return	uint64_t
+* @retval	current time in milli seconds
+*/
+static uint64_t MqttClientTimerMonotonicMs(void *clock_ctx)
+{
+	struct timespec ts;
+
+	(void)clock_ctx;
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * MS_PER_SEC) + ((uint64_t)ts.tv_nsec / NS_PER_MS);
+}
+
+/**
+ * @brief	Empty the wheel and align it on its clock.
+ *
+ * @param[in]	: wheel		: timer wheel
+ * @param[in]	: clock		: clock read by the wheel, NULL for the monotonic clock
+ * @param[in]	: clock_ctx	: context given to clock
+ * @return 	void
+ *
+*/
+void MqttClientTimerInit(t_MqttTimerWheel *wheel, MqttClockCbk clock, void *clock_ctx)
+{
+	unsigned char level = 0U;
+	unsigned char slot = 0U;
+
+	for (level = 0U; level < MQTT_TIMER_WHEEL_LEVELS; level++)
+	{
+		for (slot = 0U; slot < TIMER_SLOTS; slot++)
+		{
+			wheel->slots[level][slot] = NULL;
+		}
+		wheel->occupancy[level] = 0U;
+	}
+
+	wheel->pending = 0U;
+	wheel->clock = (clock != NULL) ? clock : MqttClientTimerMonotonicMs;
+	wheel->clock_ctx = clock_ctx;
+	wheel->now_ms = MqttClientTimerNowMs(wheel);
+}
+
+/**
+ * @brief	Read the clock of the wheel.
+ *
+ * @param[in]	: wheel	: timer wheel
+ * @return 	uint64_t
+ * @retval	current time in milli seconds
+ *
+*/
+uint64_t MqttClientTimerNowMs(t_MqttTimerWheel *wheel)
+{
+	return wheel->clock(wheel->clock_ctx);
+}
+
+/**
+ * @brief	Start a timer, restart it if already running. O(1).
+ *
+ * @param[in]	: wheel	: timer wheel
+ * @param[in]	: timer			: timer to start
+ * @param[in]	: timeout_ms	: time until expiry in milli seconds
+ * @param[in]	: cbk			: callback called on expiry
+ * @param[in]	: arg			: argument given to cbk
+ * @return 		void
+ *
+*/
+void MqttClientTimerStart(t_MqttTimerWheel *wheel, t_MqttTimer *timer, uint32_t timeout_ms, t_MqttTimerCbk cbk, void *arg)
+{
+	if ( true == MqttClientTimerIsRunning(timer) )
+	{
+		MqttClientTimerUnlink(wheel, timer);
+	}
+	else
+	{
+		wheel->pending++;
+	}
+
+	timer->expires_ms = MqttClientTimerNowMs(wheel) + (uint64_t)timeout_ms;
+	timer->cbk = cbk;
+	timer->arg = arg;
+
+	MqttClientTimerLink(wheel, timer);
+}
+
+/**
+ * @brief	Stop a timer, nothing is done if it is not running. O(1).
+ *
+ * @param[in]	: wheel	: timer wheel
+ * @param[in]	: timer	: timer to stop
+ * @return 		void
+ *
+*/
+void MqttClientTimerStop(t_MqttTimerWheel *wheel, t_MqttTimer *timer)
+{
+	if ( true == MqttClientTimerIsRunning(timer) )
+	{
+		MqttClientTimerUnlink(wheel, timer);
+		wheel->pending--;
+	}
+}
+
+/**
+ * @brief	Check whether a timer is running.
+ *
+ * @param[in]	: timer	: timer to check
+ * @return 		bool
+ *
+*/
+bool MqttClientTimerIsRunning(const t_MqttTimer *timer)
+{
+	return (timer->pprev != NULL);
+}
+
+/**
+ * @brief	Get the number of running timers.
+ *
+ * @param[in]	: wheel	: timer wheel
+ * @return 	unsigned int
+ *
+*/
+unsigned int MqttClientTimerPending(t_MqttTimerWheel *wheel)
+{
+	return wheel->pending;
+}
+
+/**
+ * @brief	Advance the wheel up to the current time and call the callbacks of the elapsed timers.
+ *
+ * @param[in]	: wheel	: timer wheel
+ * @return 	unsigned int
+ * @retval	number of timers elapsed
+ *
+*/
+unsigned int MqttClientTimerAdvance(t_MqttTimerWheel *wheel)
+{
+	uint64_t now_ms = MqttClientTimerNowMs(wheel);
+	uint64_t next_tick = 0U;
+	unsigned int elapsed = 0U;
+
+	while ( wheel->now_ms <= now_ms )
+	{
+		/* idle milli seconds are skipped at once, whatever the time elapsed since the last call */
+		next_tick = (wheel->pending != 0U) ? MqttClientTimerNextTick(wheel) : TIMER_NO_TICK;
+		if ( next_tick > now_ms )
+		{
+			wheel->now_ms = now_ms + 1U;
+		}
+		else
+		{
+			wheel->now_ms = next_tick;
+			elapsed += MqttClientTimerProcessTick(wheel);
+		}
+	}
+
+	return elapsed;
+}
+
+/**
+ * @brief	Get the time until the wheel has to be advanced. It may be earlier than the next expiry
+ * 			when timers have to be moved down the wheel first.
+ *
+ * @param[in]	: wheel	: timer wheel
+ * @return 	int
+ * @retval	timeout in milli seconds
+ * @retval	-1	: no timer running
+ *
+*/
+int MqttClientTimerNextTimeoutMs(t_MqttTimerWheel *wheel)
+{
+	uint64_t now_ms = 0U;
+	uint64_t next_tick = 0U;
+	int timeout_ms = -1;
+
+	if ( wheel->pending != 0U )
+	{
+		now_ms = MqttClientTimerNowMs(wheel);
+		next_tick = MqttClientTimerNextTick(wheel);
+
+		if ( next_tick <= now_ms )
+		{
+			timeout_ms = 0;
+		}
+		else if ( (next_tick - now_ms) > (uint64_t)INT_MAX )
+		{
+			timeout_ms = INT_MAX;
+		}
+		else
+		{
+			timeout_ms = (int)(next_tick - now_ms);
+		}
+	}
+
+	return timeout_ms;
+}
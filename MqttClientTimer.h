@@ -0,0 +1,144 @@
+/**************************************************************************//**
+*  @par Language  : C
+*******************************************************************************
+*  @brief       MqttClient hierarchical timer wheel header file.
+*  @author      dr-paradox
+*  @version     1.0.0
+*******************************************************************************
+*  @page 	MqttClientTimer
+*  @ref 	MqttClient "API Reference" header file
+*  @file 	MqttClientTimer.h
+*
+*******************************************************************************/
+
+#ifndef MQTTCLIENT_TIMER_H
+#define MQTTCLIENT_TIMER_H
+
+/* -------------------------------- Includes -------------------------------- */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "MqttClient.h"
+#include "MqttClientCfg.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* Each level of the timer wheel has 64 slots, so that the occupied slots of a level fit in one 64 bit mask */
+#define MQTT_TIMER_WHEEL_SLOTS		64
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* Callback called by MqttClientTimerAdvance() when a timer elapsed */
+typedef void (*t_MqttTimerCbk)(void *arg);
+
+/* Timer node, embedded in its owner, the wheel holds no storage of its own. A zeroed timer is not running */
+typedef struct s_MqttTimer {
+	struct s_MqttTimer	*next;			/*next timer of the same slot*/
+	struct s_MqttTimer	**pprev;		/*link pointing to this timer, NULL when the timer is not running*/
+	uint64_t			expires_ms;		/*monotonic deadline in milli seconds*/
+	t_MqttTimerCbk		cbk;			/*callback called on expiry*/
+	void				*arg;			/*argument given to cbk*/
+	unsigned char		level;			/*wheel level holding the timer*/
+	unsigned char		slot;			/*slot of the level holding the timer*/
+} t_MqttTimer;
+
+/* Timer wheel, each client context owns one */
+typedef struct {
+	t_MqttTimer			*slots[MQTT_TIMER_WHEEL_LEVELS][MQTT_TIMER_WHEEL_SLOTS];	/*level L slot S holds the timers due in the (S)th unit of 64^L ms*/
+	uint64_t			occupancy[MQTT_TIMER_WHEEL_LEVELS];		/*occupied slots of every level, bit S set when slot S is not empty*/
+	uint64_t			now_ms;									/*next milli second to be processed*/
+	unsigned int		pending;								/*number of running timers*/
+	MqttClockCbk		clock;									/*clock read by the wheel*/
+	void				*clock_ctx;								/*context given to clock*/
+} t_MqttTimerWheel;
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+ * @brief	Empty the wheel and align it on its clock.
+ *
+ * @param[in]	: wheel		: timer wheel
+ * @param[in]	: clock		: clock read by the wheel, NULL for the monotonic clock
+ * @param[in]	: clock_ctx	: context given to clock
+ * @return 	void
+ *
+*/
+void MqttClientTimerInit(t_MqttTimerWheel *wheel, MqttClockCbk clock, void *clock_ctx);
+
+/**
+ * @brief	Read the clock of the wheel.
+ *
+ * @param[in]	: wheel	: timer wheel
+ * @return 	uint64_t
+ * @retval	current time in milli seconds
+ *
+*/
+uint64_t MqttClientTimerNowMs(t_MqttTimerWheel *wheel);
+
+/**
+ * @brief	Start a timer, restart it if already running. O(1).
+ *
+ * @param[in]	: wheel			: timer wheel
+ * @param[in]	: timer			: timer to start
+ * @param[in]	: timeout_ms	: time until expiry in milli seconds
+ * @param[in]	: cbk			: callback called on expiry
+ * @param[in]	: arg			: argument given to cbk
+ * @return 		void
+ *
+*/
+void MqttClientTimerStart(t_MqttTimerWheel *wheel, t_MqttTimer *timer, uint32_t timeout_ms, t_MqttTimerCbk cbk, void *arg);
+
+/**
+ * @brief	Stop a timer, nothing is done if it is not running. O(1).
+ *
+ * @param[in]	: wheel			: timer wheel
+ * @param[in]	: timer	: timer to stop
+ * @return 		void
+ *
+*/
+void MqttClientTimerStop(t_MqttTimerWheel *wheel, t_MqttTimer *timer);
+
+/**
+ * @brief	Check whether a timer is running.
+ *
+ * @param[in]	: timer	: timer to check
+ * @return 		bool
+ *
+*/
+bool MqttClientTimerIsRunning(const t_MqttTimer *timer);
+
+/**
+ * @brief	Get the number of running timers.
+ *
+ * @param[in]	: wheel	: timer wheel
+ * @return 	unsigned int
+ *
+*/
+unsigned int MqttClientTimerPending(t_MqttTimerWheel *wheel);
+
+/**
+ * @brief	Advance the wheel up to the current time and call the callbacks of the elapsed timers.
+ *
+ * @param[in]	: wheel	: timer wheel
+ * @return 	unsigned int
+ * @retval	number of timers elapsed
+ *
+*/
+unsigned int MqttClientTimerAdvance(t_MqttTimerWheel *wheel);
+
+/**
+ * @brief	Get the time until the wheel has to be advanced. It may be earlier than the next expiry
+ * 			when timers have to be moved down the wheel first.
+ *
+ * @param[in]	: wheel	: timer wheel
+ * @return 	int
+ * @retval	timeout in milli seconds
+ * @retval	-1	: no timer running
+ *
+*/
+int MqttClientTimerNextTimeoutMs(t_MqttTimerWheel *wheel);
+
+/* -------------------------------- Routines -------------------------------- */
+
+#endif /* MQTTCLIENT_TIMER_H */
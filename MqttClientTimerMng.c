@@ -7,14 +7,14 @@
 /*------------------------------------ INCLUDES ------------------------------------*/
 
 #include "MqttClientTimerMng.h"
+#include "MqttClientContext.h"
 
 /*------------------------------------ DEFINES -------------------------------------*/
-#define THIS(index) (instance_params[(index)])
+/* The instance lives in the context it drives, next to the rest of its state */
+#define THIS(index) (MqttClientGetContext(index)->timer_mng)
 
 /*------------------------------------ VARIABLES -----------------------------------*/
 
-static t_mqttclienth2timermng_instance_struct instance_params[MQTTCLIENTH2TIMERMNG_NUMBER_OF_INSTANCES];
-
 /* --------------------------- BEGIN EDITABLE CODE AREA  -------------------------- */
 
 /* ---------------------------- END EDITABLE CODE AREA  --------------------------- */
@@ -37,7 +37,7 @@ void MqttClientH2TimerMng_Init(unsigned char handler)
 {
 	if (handler <  (unsigned char)MQTTCLIENTH2TIMERMNG_NUMBER_OF_INSTANCES) {
 /* ------ BEGIN MqttClientH2TimerMng user instance variables initialization  ------ */
-
+		THIS(handler).client = MqttClientGetContext(handler);
 /* ------- END MqttClientH2TimerMng user instance variables initialization  ------- */
 
 		/*-- State variable initialization --*/
@@ -131,24 +131,23 @@ static void MqttClientH2TimerMng0(unsigned char handler)
 /**
  * @name TimerRunning
  * @author dr-paradox
- * @brief Wait for Timer to elapse
+ * @brief Advance the timer wheel while timers are running
  *
  */
 static void TimerRunning(unsigned char handler)
 {
 	/*-- Code of the current state --*/
 
-	uint8_t count = ZERO;;
-    uint8_t timer_interval = ZERO;;
-    timer_interval = MqttClientGetTimerInterval();;
+	bool timers_pending = false;;
+    timers_pending = MqttClientCheckTimerReq(THIS(handler).client);;
 
-	if ( count < timer_interval ) {
+	if ( true == timers_pending ) {
 
-		/*-- Case where transition T1_IncreamentTimerCount is executed --*/
+		/*-- Case where transition T1_AdvanceTimerWheel is executed --*/
 
 		/*-- Action of the transition --*/
 
-		count = count + SERVICE_CYCLE_TIME;
+		MqttClientAdvanceTimers(THIS(handler).client);
 
 		/*-- Changing to next state --*/
 
@@ -156,26 +155,13 @@ static void TimerRunning(unsigned char handler)
 
 	}
 
-	else if ( count >= timer_interval  ) {
-
-		/*-- Case where transition T2_TimerElapsed is executed --*/
-
-		/*-- Action of the transition --*/
+	else {
 
-		MqttClientClearTimerReq();
-        MqttClientNotifyTimerElapsed();
+		/*-- Case where transition T2_NoTimerRunning is executed --*/
 
 		/*-- Changing to next state --*/
 
 		THIS(handler).state_mqttclienth2timermng = STATE_MQTTCLIENTH2TIMERMNG_WAITTIMERSTART;
-
-	}
-
-	else {
-
-		/*-- No transition condition accomplished. Stay in same state --*/
-
-		THIS(handler).state_mqttclienth2timermng = STATE_MQTTCLIENTH2TIMERMNG_TIMERRUNNING;
 	}
 }
 
@@ -190,12 +176,16 @@ static void WaitTimerStart(unsigned char handler)
 	/*-- Code of the current state --*/
 
 	bool start_timer = false;;
-    start_timer = MqttClientCheckTimerReq();;
+    start_timer = MqttClientCheckTimerReq(THIS(handler).client);;
 
 	if ( true == start_timer ) {
 
 		/*-- Case where transition T1_TimerStartReqReceived is executed --*/
 
+		/*-- Action of the transition --*/
+
+		MqttClientAdvanceTimers(THIS(handler).client);
+
 		/*-- Changing to next state --*/
 
 		THIS(handler).state_mqttclienth2timermng = STATE_MQTTCLIENTH2TIMERMNG_TIMERRUNNING;
@@ -226,7 +216,7 @@ void MqttClientH2TimerMng_Terminate(unsigned char handler)
 
 		THIS(handler).state_mqttclienth2timermng = STATE_END_MQTTCLIENTH2TIMERMNG;
 /* --------------------------- BEGIN TERMINATE ACTIONS  --------------------------- */
-		(void)MqttClientTransportClose();
+		(void)MqttClientTransportClose(THIS(handler).client);
 /* ---------------------------- END TERMINATE ACTIONS  ---------------------------- */
 	}
 }
@@ -8,14 +8,15 @@
 #define _MQTTCLIENTTIMERMNG_H
 
 /* ------------------- BEGIN PERSISTENT NUMBER OF FSM INSTANCES  ------------------ */
-#define MQTTCLIENTH2TIMERMNG_NUMBER_OF_INSTANCES 1u
+#define MQTTCLIENTH2TIMERMNG_NUMBER_OF_INSTANCES MQTT_MAX_CLIENTS
 /* -------------------- END PERSISTENT NUMBER OF FSM INSTANCES  ------------------- */
 
 /*------------------------------------ INCLUDES ------------------------------------*/
 
 /* -------------------------- BEGIN USER MANUAL INCLUDES  ------------------------- */
 
-#include "MqttClientFunctions.h"
+#include <stdbool.h>
+#include "MqttClient.h"
 
 /* --------------------------- END USER MANUAL INCLUDES  -------------------------- */
 
@@ -31,7 +32,7 @@ typedef enum {
 typedef struct {
 	t_state_mqttclienth2timermng state_mqttclienth2timermng;
 /* --------------------------- BEGIN INSTANCE VARIABLES  -------------------------- */
-
+	t_MqttClient *client;	/*client context driven by the instance*/
 /* ---------------------------- END INSTANCE VARIABLES  --------------------------- */
 } t_mqttclienth2timermng_instance_struct;
 
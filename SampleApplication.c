@@ -3,22 +3,22 @@
 #include "MqttClient.h"
 
 /* Callback API to receive response from MqttClient */
-void ServerResp(unsigned char server_response);
+void ServerResp(t_MqttRequestHandle handle, unsigned char server_response, void *user_ctx);
 
 unsigned char json_msg[40] = "\"name\":\"John\",\"age\":31,\"city\":\"New York\"";
 
 int main()
 {
 	int count = 0;
-	/*1. Initialize the MqttClient */
-	MqttClient_Init();
+	/*1. Create a client context connected to the broker of MqttClientCfg.h */
+	t_MqttClient *client = MqttClient_Init(NULL);
 
 	/*2. Create a software timer to run the task of MqttClient every 1 Second */
 	while (count < 100000) {
 		sleep(1);
-		MqttClient_Task();
+		MqttClient_Task(client);
 		/*3. Send a dummy string to server in the created task */
-		MqttClient_SendData(json_msg, (unsigned short int)40, SERVICE_REQ_1, ServerResp);
+		(void)MqttClient_SendData(client, json_msg, (unsigned short int)40, SERVICE_REQ_1, ServerResp, NULL);
 
 		count++;
 	}
@@ -27,7 +27,10 @@ int main()
 }
 
 /* Callback API to receive response from MqttClientH2 */
-void ServerResp(unsigned char server_response)
+void ServerResp(t_MqttRequestHandle handle, unsigned char server_response, void *user_ctx)
 {
 	/* A dummy definition */
+	(void)handle;
+	(void)server_response;
+	(void)user_ctx;
 }
@@ -0,0 +1,546 @@
+/**************************************************************************//**
+*  @par Language: C
+*******************************************************************************
+*  @par 	Project:
+*  @brief   Broker and publisher of the uplink change scenario run by UplinkScenario.sh
+*  @author  dr-paradox
+*  @version 1.0.0
+*******************************************************************************
+*  @file 	UplinkScenario.c
+*
+*  Two roles of one program, each run on its side of a veth pair by UplinkScenario.sh:
+*    - broker: accepts any number of connections, answers CONNECT, PUBLISH and PINGREQ, and runs until killed,
+*    - client: a host driven client publishes one message every SCEN_PUBLISH_PERIOD_MS for the given number of
+*      seconds. SIGUSR1 marks the moment the uplink was changed. Each result is timed, the report gives the longest
+*      time without a PUBACK and, for each mark, the time until the first PUBACK that followed it.
+*  The log lines of the library are written to /dev/null, the results to stderr. The client has to be host driven:
+*  MQTT_SELF_DRIVEN_MODE at 0 in MqttClientCfg.h.
+*
+*  Build and run (as root, see UplinkScenario.sh):
+*      gcc -O2 -pthread -o UplinkScenario UplinkScenario.c MqttClient*.c
+*      ./UplinkScenario.sh addr|link|route ./UplinkScenario
+*
+*******************************************************************************/
+
+/* -------------------------------- Includes -------------------------------- */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "MqttClient.h"
+#include "MqttClientCfg.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* Invalid file descriptor */
+#define INVALID_FD					((int)-1)
+
+/* One message is submitted every period */
+#define SCEN_PUBLISH_PERIOD_MS		((uint64_t)100)
+
+/* Connections served at once by the broker */
+#define SCEN_MAX_CONNS				((unsigned short)16)
+
+/* Size of the receive buffer of each connection of the broker */
+#define SCEN_RX_SIZE				((int)2048)
+
+/* Marks of uplink changes recorded by the client */
+#define SCEN_MAX_MARKS				((unsigned int)8)
+
+/* Size of the payload of each message */
+#define SCEN_PAYLOAD_SIZE			((unsigned short)16)
+
+/* MQTT control packet types seen by the broker */
+#define SCEN_CONNECT				((unsigned char)0x10)
+#define SCEN_PUBLISH				((unsigned char)0x30)
+#define SCEN_PINGREQ				((unsigned char)0xC0)
+#define SCEN_DISCONNECT				((unsigned char)0xE0)
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* Connection of the broker */
+typedef struct {
+	int				fd;/*socket of the connection, INVALID_FD when the slot is free*/
+	unsigned char	rx[SCEN_RX_SIZE];/*bytes received and not parsed yet*/
+	int				rx_len;/*number of bytes in rx*/
+} t_ScenConn;
+
+/* Results seen by the client */
+typedef struct {
+	uint64_t		start_ms;/*time the client was created*/
+	uint64_t		last_ok_ms;/*time of the last PUBACK*/
+	uint64_t		longest_gap_ms;/*longest time between two PUBACKs*/
+	uint64_t		gap_start_ms;/*last PUBACK before the longest gap*/
+	uint64_t		mark_ms[SCEN_MAX_MARKS];/*time of each uplink change*/
+	uint64_t		recovered_ms[SCEN_MAX_MARKS];/*time of the first PUBACK after each change, 0 until then*/
+	unsigned int	marks;/*number of changes marked*/
+	unsigned int	acked;/*results SERVERCOM_OK*/
+	unsigned int	failed;/*other results*/
+	unsigned int	rejected;/*submissions refused by the client*/
+} t_ScenResults;
+
+/* ---------------------------- Global Variables ---------------------------- */
+
+/* Uplink changes signalled, recorded by the client on its next turn */
+static volatile sig_atomic_t scen_marks_signalled = 0;
+
+/* Results of the client */
+static t_ScenResults scen_results;
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+ * @brief	Read the monotonic clock.
+ *
+ * @return 	uint64_t
+ * @retval	milli seconds
+ *
+*/
+static uint64_t ScenNowMs(void);
+
+/**
+ * @brief	SIGUSR1 handler: the uplink was changed, the client records the time on its next turn.
+ *
+ * @param[in]	: sig	: signal number
+ * @return 	void
+ *
+*/
+static void ScenMarkSignal(int sig);
+
+/**
+ * @brief	Parse the packets received on a connection of the broker and answer them.
+ *
+ * @param[in]	: conn	: connection of the broker
+ * @return 	bool
+ * @retval	true	: connection still open
+ * @retval	false	: DISCONNECT received, the connection has to be closed
+ *
+*/
+static bool ScenBrokerParse(t_ScenConn *conn);
+
+/**
+ * @brief	Run the broker until killed.
+ *
+ * @param[in]	: address	: address to listen to
+ * @param[in]	: port		: port to listen to
+ * @return 	int
+ * @retval	exit status
+ *
+*/
+static int ScenBroker(const char *address, unsigned short port);
+
+/**
+ * @brief	Result callback of the published messages, times the PUBACKs.
+ *
+ * @param[in]	: handle			: handle of the request
+ * @param[in]	: server_response	: result of the request
+ * @param[in]	: user_ctx			: NULL
+ * @return 	void
+ *
+*/
+static void ScenResp(t_MqttRequestHandle handle, unsigned char server_response, void *user_ctx);
+
+/**
+ * @brief	Publish for a number of seconds and report the results.
+ *
+ * @param[in]	: address	: address of the broker
+ * @param[in]	: port		: port of the broker
+ * @param[in]	: seconds	: duration of the run
+ * @return 	int
+ * @retval	exit status
+ *
+*/
+static int ScenClient(const char *address, unsigned short port, unsigned int seconds);
+
+/* -------------------------------- Routines -------------------------------- */
+
+/**
+ * @brief	Read the monotonic clock.
+ *
+ * @return 	uint64_t
+ * @retval	milli seconds
+ *
+*/
+static uint64_t ScenNowMs(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000ULL) + ((uint64_t)ts.tv_nsec / 1000000ULL);
+}
+
+/**
+ * @brief	SIGUSR1 handler: the uplink was changed, the client records the time on its next turn.
+ *
+ * @param[in]	: sig	: signal number
+ * @return 	void
+ *
+*/
+static void ScenMarkSignal(int sig)
+{
+	(void)sig;
+	scen_marks_signalled++;
+}
+
+/**
+ * @brief	Parse the packets received on a connection of the broker and answer them.
+ *
+ * @param[in]	: conn	: connection of the broker
+ * @return 	bool
+ * @retval	true	: connection still open
+ * @retval	false	: DISCONNECT received, the connection has to be closed
+ *
+*/
+static bool ScenBrokerParse(t_ScenConn *conn)
+{
+	static const unsigned char connack[] = { 0x20, 0x02, 0x00, 0x00 };
+	static const unsigned char pingresp[] = { 0xD0, 0x00 };
+	unsigned char puback[] = { 0x40, 0x02, 0x00, 0x00 };
+	unsigned int remaining = 0U;
+	unsigned int shift = 0U;
+	unsigned int topic_len;
+	int pos = 1;
+	int packet_len;
+
+	while ( conn->rx_len >= 2 )
+	{
+		/* remaining length, 7 bits per byte */
+		remaining = 0U;
+		shift = 0U;
+		for (pos = 1; (pos < conn->rx_len) && (pos <= 4); pos++)
+		{
+			remaining |= (unsigned int)(conn->rx[pos] & 0x7FU) << shift;
+			shift += 7U;
+			if ( 0U == (conn->rx[pos] & 0x80U) )
+			{
+				break;
+			}
+		}
+		if ( (pos >= conn->rx_len) || (pos > 4) )
+		{
+			return true;
+		}
+		packet_len = pos + 1 + (int)remaining;
+		if ( packet_len > conn->rx_len )
+		{
+			return true;
+		}
+
+		switch ( conn->rx[0] & 0xF0U )
+		{
+			case SCEN_CONNECT:
+				(void)send(conn->fd, connack, sizeof(connack), MSG_NOSIGNAL);
+				break;
+
+			case SCEN_PUBLISH:
+				/* QoS 1: topic then packet id */
+				topic_len = ((unsigned int)conn->rx[pos + 1] << 8) | conn->rx[pos + 2];
+				if ( (pos + 4 + (int)topic_len) < packet_len )
+				{
+					puback[2] = conn->rx[pos + 3 + (int)topic_len];
+					puback[3] = conn->rx[pos + 4 + (int)topic_len];
+					(void)send(conn->fd, puback, sizeof(puback), MSG_NOSIGNAL);
+				}
+				break;
+
+			case SCEN_PINGREQ:
+				(void)send(conn->fd, pingresp, sizeof(pingresp), MSG_NOSIGNAL);
+				break;
+
+			case SCEN_DISCONNECT:
+				return false;
+
+			default:
+				break;
+		}
+
+		conn->rx_len -= packet_len;
+		memmove(conn->rx, &conn->rx[packet_len], (size_t)conn->rx_len);
+	}
+
+	return true;
+}
+
+/**
+ * @brief	Run the broker until killed.
+ *
+ * @param[in]	: address	: address to listen to
+ * @param[in]	: port		: port to listen to
+ * @return 	int
+ * @retval	exit status
+ *
+*/
+static int ScenBroker(const char *address, unsigned short port)
+{
+	t_ScenConn conns[SCEN_MAX_CONNS];
+	struct pollfd fds[SCEN_MAX_CONNS + 1U];
+	struct sockaddr_in addr;
+	int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	int one = 1;
+	int fd;
+	int rc;
+	unsigned short idx;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if ( (INVALID_FD == listen_fd) || (1 != inet_pton(AF_INET, address, &addr.sin_addr)) ||
+		 (0 != setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one))) ||
+		 (0 != bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr))) || (0 != listen(listen_fd, (int)SCEN_MAX_CONNS)) )
+	{
+		fprintf(stderr, "UplinkScenario: broker can't listen to %s:%u\n", address, (unsigned int)port);
+		return 1;
+	}
+
+	for (idx = 0U; idx < SCEN_MAX_CONNS; idx++)
+	{
+		conns[idx].fd = INVALID_FD;
+		conns[idx].rx_len = 0;
+	}
+
+	for (;;)
+	{
+		fds[0].fd = listen_fd;
+		fds[0].events = POLLIN;
+		for (idx = 0U; idx < SCEN_MAX_CONNS; idx++)
+		{
+			fds[idx + 1U].fd = conns[idx].fd;
+			fds[idx + 1U].events = POLLIN;
+		}
+
+		if ( poll(fds, SCEN_MAX_CONNS + 1U, -1) <= 0 )
+		{
+			continue;
+		}
+
+		if ( 0 != (fds[0].revents & POLLIN) )
+		{
+			fd = accept(listen_fd, NULL, NULL);
+			for (idx = 0U; (INVALID_FD != fd) && (idx < SCEN_MAX_CONNS) && (INVALID_FD != conns[idx].fd); idx++)
+			{
+			}
+			if ( idx < SCEN_MAX_CONNS )
+			{
+				conns[idx].fd = fd;
+				conns[idx].rx_len = 0;
+			}
+			else if ( INVALID_FD != fd )
+			{
+				(void)close(fd);
+			}
+		}
+
+		for (idx = 0U; idx < SCEN_MAX_CONNS; idx++)
+		{
+			if ( (INVALID_FD == conns[idx].fd) || (0 == fds[idx + 1U].revents) )
+			{
+				continue;
+			}
+
+			rc = (int)recv(conns[idx].fd, &conns[idx].rx[conns[idx].rx_len], (size_t)(SCEN_RX_SIZE - conns[idx].rx_len), 0);
+			if ( rc > 0 )
+			{
+				conns[idx].rx_len += rc;
+			}
+
+			/* a packet larger than the buffer can't be parsed, the connection is dropped with it */
+			if ( (rc <= 0) || (false == ScenBrokerParse(&conns[idx])) || (SCEN_RX_SIZE == conns[idx].rx_len) )
+			{
+				(void)close(conns[idx].fd);
+				conns[idx].fd = INVALID_FD;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief	Result callback of the published messages, times the PUBACKs.
+ *
+ * @param[in]	: handle			: handle of the request
+ * @param[in]	: server_response	: result of the request
+ * @param[in]	: user_ctx			: NULL
+ * @return 	void
+ *
+*/
+static void ScenResp(t_MqttRequestHandle handle, unsigned char server_response, void *user_ctx)
+{
+	uint64_t now_ms = ScenNowMs();
+	unsigned int mark;
+
+	(void)handle;
+	(void)user_ctx;
+
+	if ( SERVERCOM_OK != server_response )
+	{
+		scen_results.failed++;
+		return;
+	}
+
+	scen_results.acked++;
+	if ( (now_ms - scen_results.last_ok_ms) > scen_results.longest_gap_ms )
+	{
+		scen_results.longest_gap_ms = now_ms - scen_results.last_ok_ms;
+		scen_results.gap_start_ms = scen_results.last_ok_ms;
+	}
+	scen_results.last_ok_ms = now_ms;
+
+	for (mark = 0U; mark < scen_results.marks; mark++)
+	{
+		if ( 0U == scen_results.recovered_ms[mark] )
+		{
+			scen_results.recovered_ms[mark] = now_ms;
+		}
+	}
+}
+
+/**
+ * @brief	Publish for a number of seconds and report the results.
+ *
+ * @param[in]	: address	: address of the broker
+ * @param[in]	: port		: port of the broker
+ * @param[in]	: seconds	: duration of the run
+ * @return 	int
+ * @retval	exit status
+ *
+*/
+static int ScenClient(const char *address, unsigned short port, unsigned int seconds)
+{
+	unsigned char payload[SCEN_PAYLOAD_SIZE];
+	t_MqttPollFd client_fds[MQTT_MAX_POLL_FDS];
+	struct pollfd fds[MQTT_MAX_POLL_FDS];
+	t_MqttClientConfig config;
+	t_MqttClient *client = NULL;
+	uint64_t end_ms;
+	uint64_t next_publish_ms;
+	uint64_t now_ms;
+	int timeout_ms;
+	int publish_in_ms;
+	unsigned char count;
+	unsigned char idx;
+	unsigned int mark;
+
+	/* the library logs each packet on stdout, the results go to stderr */
+	if ( NULL == freopen("/dev/null", "w", stdout) )
+	{
+		fprintf(stderr, "UplinkScenario: can't discard stdout\n");
+		return 1;
+	}
+	(void)signal(SIGUSR1, ScenMarkSignal);
+
+	memset(&config, 0, sizeof(config));
+	config.server_address = address;
+	config.server_port = (int)port;
+	config.client_id = "uplink-scenario";
+	client = MqttClient_Init(&config);
+	if ( NULL == client )
+	{
+		fprintf(stderr, "UplinkScenario: no client context\n");
+		return 1;
+	}
+
+	memset(payload, 'x', sizeof(payload));
+	scen_results.start_ms = ScenNowMs();
+	scen_results.last_ok_ms = scen_results.start_ms;
+	next_publish_ms = scen_results.start_ms;
+	end_ms = scen_results.start_ms + ((uint64_t)seconds * 1000ULL);
+
+	for (now_ms = scen_results.start_ms; now_ms < end_ms; now_ms = ScenNowMs())
+	{
+		while ( ((unsigned int)scen_marks_signalled > scen_results.marks) && (scen_results.marks < SCEN_MAX_MARKS) )
+		{
+			scen_results.mark_ms[scen_results.marks++] = now_ms;
+		}
+
+		if ( now_ms >= next_publish_ms )
+		{
+			if ( MQTT_INVALID_REQUEST_HANDLE == MqttClient_SendData(client, payload, SCEN_PAYLOAD_SIZE, SERVICE_REQ_1, ScenResp, NULL) )
+			{
+				scen_results.rejected++;
+			}
+			next_publish_ms += SCEN_PUBLISH_PERIOD_MS;
+		}
+
+		count = MqttClient_GetPollFds(client, client_fds, MQTT_MAX_POLL_FDS);
+		for (idx = 0U; idx < count; idx++)
+		{
+			fds[idx].fd = client_fds[idx].fd;
+			fds[idx].events = (short)(((0U != (client_fds[idx].events & MQTT_POLL_IN)) ? POLLIN : 0) |
+									  ((0U != (client_fds[idx].events & MQTT_POLL_OUT)) ? POLLOUT : 0));
+		}
+
+		/* woken by the next submission at the latest, a signal only cuts the wait short */
+		now_ms = ScenNowMs();
+		publish_in_ms = (next_publish_ms > now_ms) ? (int)(next_publish_ms - now_ms) : 0;
+		timeout_ms = MqttClient_GetTimeoutMs(client);
+		if ( (timeout_ms < 0) || (timeout_ms > publish_in_ms) )
+		{
+			timeout_ms = publish_in_ms;
+		}
+		(void)poll(fds, count, timeout_ms);
+
+		MqttClient_ProcessEvents(client);
+	}
+
+	now_ms = ScenNowMs();
+	if ( (now_ms - scen_results.last_ok_ms) > scen_results.longest_gap_ms )
+	{
+		scen_results.longest_gap_ms = now_ms - scen_results.last_ok_ms;
+		scen_results.gap_start_ms = scen_results.last_ok_ms;
+	}
+
+	fprintf(stderr, "UplinkScenario: %u s publishing to %s:%u every %u ms\n", seconds, address, (unsigned int)port,
+			(unsigned int)SCEN_PUBLISH_PERIOD_MS);
+	fprintf(stderr, "  acknowledged        : %u\n", scen_results.acked);
+	fprintf(stderr, "  failed              : %u\n", scen_results.failed);
+	fprintf(stderr, "  rejected            : %u\n", scen_results.rejected);
+	fprintf(stderr, "  longest gap         : %llu ms, from %llu ms\n", (unsigned long long)scen_results.longest_gap_ms,
+			(unsigned long long)(scen_results.gap_start_ms - scen_results.start_ms));
+	for (mark = 0U; mark < scen_results.marks; mark++)
+	{
+		if ( 0U != scen_results.recovered_ms[mark] )
+		{
+			fprintf(stderr, "  change at %6llu ms  : first PUBACK %llu ms later\n",
+					(unsigned long long)(scen_results.mark_ms[mark] - scen_results.start_ms),
+					(unsigned long long)(scen_results.recovered_ms[mark] - scen_results.mark_ms[mark]));
+		}
+		else
+		{
+			fprintf(stderr, "  change at %6llu ms  : no PUBACK within the %llu ms left\n",
+					(unsigned long long)(scen_results.mark_ms[mark] - scen_results.start_ms),
+					(unsigned long long)(now_ms - scen_results.mark_ms[mark]));
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	if ( (argc == 4) && (0 == strcmp(argv[1], "broker")) )
+	{
+		return ScenBroker(argv[2], (unsigned short)strtoul(argv[3], NULL, 10));
+	}
+
+	if ( (argc == 5) && (0 == strcmp(argv[1], "client")) )
+	{
+		return ScenClient(argv[2], (unsigned short)strtoul(argv[3], NULL, 10), (unsigned int)strtoul(argv[4], NULL, 10));
+	}
+
+	fprintf(stderr, "usage: %s broker <address> <port>\n"
+					"       %s client <broker address> <port> <seconds>\n", argv[0], argv[0]);
+
+	return 1;
+}
@@ -0,0 +1,103 @@
+#!/bin/sh
+#******************************************************************************
+#  @brief   Uplink change scenario: reconnection of the client when its link, address or default route changes
+#  @author  dr-paradox
+#  @version 1.0.0
+#******************************************************************************
+#  @file    UplinkScenario.sh
+#
+#  The client runs in its own network namespace, its uplink is one end of a veth pair. The broker listens on an
+#  address of a dummy interface of the host namespace, reached from the client through its default route over
+#  the veth pair. Without the dummy driver the address goes on the loopback interface:
+#
+#      [ns mqttup] mqv1 10.9.0.2 --- veth --- mqv0 10.9.0.1 [host]  mqd0 (dummy) 10.9.1.1 : broker
+#
+#  Three seconds into the run the uplink of the client is changed:
+#    addr  : the address of mqv1 moves from 10.9.0.2 to 10.9.0.3,
+#    link  : mqv1 goes down for UPLINK_DOWN_S seconds, then comes back,
+#    route : the default route of the namespace is removed for UPLINK_DOWN_S seconds, then comes back.
+#  The client is told the moment the uplink is usable again (SIGUSR1) and reports the time to the first PUBACK
+#  after it, and the longest time without PUBACK of the run.
+#
+#  Needs root and iproute2. Build UplinkScenario.c first, then run:
+#      ./UplinkScenario.sh addr|link|route [./UplinkScenario]
+#  Running it with a build of the library from before the netlink watch gives the reference.
+#
+#******************************************************************************
+
+SCENARIO=$1
+BIN=${2:-./UplinkScenario}
+NS=mqttup
+PORT=18883
+RUN_S=12
+UPLINK_DOWN_S=4
+
+case "$SCENARIO" in
+	addr|link|route) ;;
+	*) echo "usage: $0 addr|link|route [binary]" >&2; exit 1 ;;
+esac
+
+if [ ! -x "$BIN" ]; then
+	echo "UplinkScenario: $BIN not built, see UplinkScenario.c" >&2
+	exit 1
+fi
+
+cleanup()
+{
+	[ -n "$BROKER" ] && kill "$BROKER" 2>/dev/null
+	ip netns del $NS 2>/dev/null
+	ip link del mqv0 2>/dev/null
+	ip link del mqd0 2>/dev/null
+	ip addr del 10.9.1.1/32 dev lo 2>/dev/null
+}
+trap cleanup EXIT
+cleanup
+
+# broker side: the dummy interface holds the broker address, the veth end is the gateway of the namespace
+if ip link add mqd0 type dummy 2>/dev/null; then
+	ip addr add 10.9.1.1/32 dev mqd0
+	ip link set mqd0 up
+else
+	ip addr add 10.9.1.1/32 dev lo || exit 1
+fi
+ip netns add $NS || exit 1
+ip link add mqv0 type veth peer name mqv1 netns $NS || exit 1
+ip addr add 10.9.0.1/24 dev mqv0
+ip link set mqv0 up
+
+# client side: the broker is only reachable through the default route
+ip -n $NS link set lo up
+ip -n $NS addr add 10.9.0.2/24 dev mqv1
+ip -n $NS link set mqv1 up
+ip -n $NS route add default via 10.9.0.1
+
+"$BIN" broker 10.9.1.1 $PORT &
+BROKER=$!
+sleep 0.5
+
+ip netns exec $NS "$BIN" client 10.9.1.1 $PORT $RUN_S &
+CLIENT=$!
+sleep 3
+
+case "$SCENARIO" in
+	addr)
+		ip -n $NS addr del 10.9.0.2/24 dev mqv1
+		ip -n $NS addr add 10.9.0.3/24 dev mqv1
+		ip -n $NS route add default via 10.9.0.1
+		;;
+	link)
+		ip -n $NS link set mqv1 down
+		sleep $UPLINK_DOWN_S
+		ip -n $NS link set mqv1 up
+		# the routes of the link left with it
+		ip -n $NS route add default via 10.9.0.1
+		;;
+	route)
+		ip -n $NS route del default
+		sleep $UPLINK_DOWN_S
+		ip -n $NS route add default via 10.9.0.1
+		;;
+esac
+kill -USR1 $CLIENT
+
+wait $CLIENT
@@ -0,0 +1,609 @@
+/**************************************************************************//**
+*  @par Language: C
+*******************************************************************************
+*  @par 	Project:
+*  @brief   Keep alive and reconnection scenario run on a virtual clock
+*  @author  dr-paradox
+*  @version 1.0.0
+*******************************************************************************
+*  @file 	VirtualTimeScenario.c
+*
+*  A host driven client is connected to a broker played by the scenario itself, on the loopback interface. The
+*  client timers read a t_MqttVirtualClock and MqttClient_VirtualClockAdvance() moves it from one cycle of the
+*  timer wheel to the next, the client and the broker are run after each move. Minutes of keep alive and backoff
+*  run in well under a second of wall clock, and each transition is checked at its exact virtual time:
+*    - the ping request is sent one ping interval after the CONNACK,
+*    - the broker does not answer it, the connection is closed at the PINGRESP deadline (rto + margin),
+*    - the broker refuses the connections, each attempt waits a random delay below a bound doubled on every
+*      attempt and capped to MQTT_RECONNECT_CAP_MS,
+*    - the broker comes back, the client connects again within the bound of its next attempt.
+*  Refused attempts never reach the broker, the scenario sees them through its own connect(), which takes the
+*  place of the one of the C library in this program. The log lines of the library are written to /dev/null, the
+*  results to stderr. The client has to be host driven: MQTT_SELF_DRIVEN_MODE at 0 in MqttClientCfg.h.
+*
+*  Build and run:
+*      gcc -O2 -pthread -o VirtualTimeScenario VirtualTimeScenario.c MqttClient*.c
+*      ./VirtualTimeScenario
+*
+*******************************************************************************/
+
+/* -------------------------------- Includes -------------------------------- */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "MqttClient.h"
+#include "MqttClientCfg.h"
+
+/* -------------------------------- Defines --------------------------------- */
+
+/* Invalid file descriptor */
+#define INVALID_FD					((int)-1)
+
+/* Ping interval of the client, half the keep alive interval announced in the connect packet */
+#define SCEN_PING_INTERVAL_MS		((int)KEEP_ALIVE_INTERVAL * 500)
+
+/* PINGRESP deadline before any round trip sample, the timeout starts at MQTT_RTO_INITIAL_MS */
+#define SCEN_PINGRESP_DEADLINE_MS	((int)(MQTT_RTO_INITIAL_MS + MQTT_PINGRESP_MARGIN_MS))
+
+/* Connection attempts refused by the broker, enough for the bound to reach MQTT_RECONNECT_CAP_MS */
+#define SCEN_REFUSED_ATTEMPTS		((unsigned char)10)
+
+/* Connection attempts recorded */
+#define SCEN_MAX_ATTEMPTS			((unsigned int)32)
+
+/* Wall clock given to the client and the broker to react to one step of the virtual clock */
+#define SCEN_DRIVE_MS				((int)2000)
+
+/* Slice of wall clock of one poll() of the scenario */
+#define SCEN_POLL_MS				((int)5)
+
+/* Size of the receive buffer of the broker */
+#define SCEN_RX_SIZE				((int)1024)
+
+/* MQTT control packet types seen by the broker */
+#define SCEN_CONNECT				((unsigned char)0x10)
+#define SCEN_PINGREQ				((unsigned char)0xC0)
+
+/* ------------------------------- Data Types ------------------------------- */
+
+/* Broker played by the scenario: one connection at a time, CONNECT is accepted, PINGREQ is never answered */
+typedef struct {
+	int				listen_fd;/*listening socket, INVALID_FD while the broker refuses connections*/
+	int				conn_fd;/*connection of the client*/
+	unsigned short	port;/*port the broker listens to*/
+	unsigned char	rx[SCEN_RX_SIZE];/*bytes received and not parsed yet*/
+	int				rx_len;/*number of bytes in rx*/
+	unsigned int	accepts;/*connections accepted*/
+	unsigned int	connects;/*CONNECT packets answered*/
+	unsigned int	pings;/*PINGREQ packets received*/
+	unsigned int	closes;/*connections closed by the client*/
+} t_ScenBroker;
+
+/* Condition a drive of the scenario waits for */
+typedef bool (*ScenDone)(t_MqttClient *client, const t_ScenBroker *broker, unsigned int expected);
+
+/* ---------------------------- Global Variables ---------------------------- */
+
+/* Checks that failed */
+static unsigned int scen_failures = 0U;
+
+/* Clock of the client */
+static t_MqttVirtualClock scen_clock;
+
+/* Virtual time of each connection attempt of the client */
+static uint64_t scen_attempt_ms[SCEN_MAX_ATTEMPTS];
+static unsigned int scen_attempts = 0U;
+
+/* --------------------------- Routine prototypes --------------------------- */
+
+/**
+ * @brief	Report a check of the scenario.
+ *
+ * @param[in]	: ok		: result of the check
+ * @param[in]	: what		: description of the check
+ * @param[in]	: value		: value checked, printed with the description
+ * @return 	void
+ *
+*/
+static void ScenCheck(bool ok, const char *what, long value);
+
+/**
+ * @brief	Open the listening socket of the broker, on an ephemeral port the first time and on the same port after.
+ *
+ * @param[in]	: broker	: broker of the scenario
+ * @return 	bool
+ * @retval	true	: broker listening
+ * @retval	false	: socket error
+ *
+*/
+static bool ScenBrokerListen(t_ScenBroker *broker);
+
+/**
+ * @brief	Close the listening socket of the broker, the connections are refused from then on.
+ *
+ * @param[in]	: broker	: broker of the scenario
+ * @return 	void
+ *
+*/
+static void ScenBrokerRefuse(t_ScenBroker *broker);
+
+/**
+ * @brief	Accept a connection, read the client and answer its CONNECT packets.
+ *
+ * @param[in]	: broker	: broker of the scenario
+ * @return 	void
+ *
+*/
+static void ScenBrokerService(t_ScenBroker *broker);
+
+/**
+ * @brief	Run the client and the broker on the wall clock until a condition holds, the virtual clock stands still.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: broker	: broker of the scenario
+ * @param[in]	: done		: condition waited for, NULL to run until neither the client nor the broker has work
+ * @param[in]	: expected	: value given to done
+ * @return 	bool
+ * @retval	true	: condition reached, or nothing left to do
+ * @retval	false	: not reached within SCEN_DRIVE_MS
+ *
+*/
+static bool ScenDrive(t_MqttClient *client, t_ScenBroker *broker, ScenDone done, unsigned int expected);
+
+/**
+ * @brief	Move the virtual clock cycle after cycle, running the client and the broker after each move, until a
+ * 			condition holds.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: broker	: broker of the scenario
+ * @param[in]	: done		: condition waited for
+ * @param[in]	: expected	: value given to done
+ * @param[in]	: limit_ms	: virtual time given to the condition
+ * @return 	int
+ * @retval	virtual milli seconds elapsed until the condition held
+ * @retval	-1 : condition not reached within limit_ms, or no timer left
+ *
+*/
+static int ScenAdvance(t_MqttClient *client, t_ScenBroker *broker, ScenDone done, unsigned int expected, unsigned int limit_ms);
+
+/**
+ * @brief	Conditions of ScenDrive() and ScenAdvance(): client connected, number of PINGREQ received, of connections
+ * 			closed by the client and of connection attempts reached.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: broker	: broker of the scenario
+ * @param[in]	: expected	: count waited for
+ * @return 	bool
+ *
+*/
+static bool ScenConnected(t_MqttClient *client, const t_ScenBroker *broker, unsigned int expected);
+static bool ScenPinged(t_MqttClient *client, const t_ScenBroker *broker, unsigned int expected);
+static bool ScenClosed(t_MqttClient *client, const t_ScenBroker *broker, unsigned int expected);
+static bool ScenAttempted(t_MqttClient *client, const t_ScenBroker *broker, unsigned int expected);
+
+/**
+ * @brief	Bound of the backoff delay following a connection attempt.
+ *
+ * @param[in]	: attempt	: number of the attempt, 1 for the first one
+ * @return 	unsigned int
+ * @retval	bound in milli seconds
+ *
+*/
+static unsigned int ScenBackoffBoundMs(unsigned int attempt);
+
+/* -------------------------------- Routines -------------------------------- */
+
+/**
+ * @brief	Report a check of the scenario.
+ *
+ * @param[in]	: ok		: result of the check
+ * @param[in]	: what		: description of the check
+ * @param[in]	: value		: value checked, printed with the description
+ * @return 	void
+ *
+*/
+static void ScenCheck(bool ok, const char *what, long value)
+{
+	fprintf(stderr, "  %s %s: %ld\n", (true == ok) ? "ok  " : "FAIL", what, value);
+
+	if ( false == ok )
+	{
+		scen_failures++;
+	}
+}
+
+/**
+ * @brief	Open the listening socket of the broker, on an ephemeral port the first time and on the same port after.
+ *
+ * @param[in]	: broker	: broker of the scenario
+ * @return 	bool
+ * @retval	true	: broker listening
+ * @retval	false	: socket error
+ *
+*/
+static bool ScenBrokerListen(t_ScenBroker *broker)
+{
+	struct sockaddr_in address;
+	socklen_t address_len = sizeof(address);
+	int reuse = 1;
+
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(broker->port);
+
+	broker->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if ( INVALID_FD == broker->listen_fd )
+	{
+		return false;
+	}
+
+	(void)setsockopt(broker->listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	if ( (0 != bind(broker->listen_fd, (struct sockaddr *)&address, sizeof(address))) ||
+		 (0 != listen(broker->listen_fd, 4)) ||
+		 (0 != getsockname(broker->listen_fd, (struct sockaddr *)&address, &address_len)) )
+	{
+		(void)close(broker->listen_fd);
+		broker->listen_fd = INVALID_FD;
+		return false;
+	}
+
+	broker->port = ntohs(address.sin_port);
+
+	return true;
+}
+
+/**
+ * @brief	Close the listening socket of the broker, the connections are refused from then on.
+ *
+ * @param[in]	: broker	: broker of the scenario
+ * @return 	void
+ *
+*/
+static void ScenBrokerRefuse(t_ScenBroker *broker)
+{
+	if ( INVALID_FD != broker->listen_fd )
+	{
+		(void)close(broker->listen_fd);
+		broker->listen_fd = INVALID_FD;
+	}
+}
+
+/**
+ * @brief	Accept a connection, read the client and answer its CONNECT packets.
+ *
+ * @param[in]	: broker	: broker of the scenario
+ * @return 	void
+ *
+*/
+static void ScenBrokerService(t_ScenBroker *broker)
+{
+	static const unsigned char connack[] = { 0x20, 0x02, 0x00, 0x00 };
+	int fd = INVALID_FD;
+	ssize_t len = 0;
+	int remaining = 0;
+	int header = 0;
+	int shift = 0;
+
+	/* the last connection is the one of the client, an older one was already given up */
+	if ( INVALID_FD != broker->listen_fd )
+	{
+		fd = accept4(broker->listen_fd, NULL, NULL, SOCK_NONBLOCK);
+		if ( INVALID_FD != fd )
+		{
+			if ( INVALID_FD != broker->conn_fd )
+			{
+				(void)close(broker->conn_fd);
+			}
+			broker->conn_fd = fd;
+			broker->rx_len = 0;
+			broker->accepts++;
+		}
+	}
+
+	if ( INVALID_FD == broker->conn_fd )
+	{
+		return;
+	}
+
+	len = recv(broker->conn_fd, &broker->rx[broker->rx_len], (size_t)(SCEN_RX_SIZE - broker->rx_len), 0);
+	if ( (0 == len) || ((len < 0) && (EAGAIN != errno) && (EWOULDBLOCK != errno)) )
+	{
+		(void)close(broker->conn_fd);
+		broker->conn_fd = INVALID_FD;
+		broker->closes++;
+		return;
+	}
+
+	if ( len > 0 )
+	{
+		broker->rx_len += (int)len;
+	}
+
+	/* whole packets only: type byte, remaining length on up to 4 bytes, then the rest */
+	for (;;)
+	{
+		remaining = 0;
+		shift = 0;
+		for (header = 1; (header < broker->rx_len) && (header <= 4); header++)
+		{
+			remaining |= (broker->rx[header] & 0x7F) << shift;
+			shift += 7;
+			if ( 0 == (broker->rx[header] & 0x80) )
+			{
+				break;
+			}
+		}
+
+		if ( (header >= broker->rx_len) || ((header + 1 + remaining) > broker->rx_len) )
+		{
+			break;
+		}
+
+		if ( SCEN_CONNECT == (broker->rx[0] & 0xF0) )
+		{
+			(void)send(broker->conn_fd, connack, sizeof(connack), MSG_NOSIGNAL);
+			broker->connects++;
+		}
+		else if ( SCEN_PINGREQ == (broker->rx[0] & 0xF0) )
+		{
+			/* never answered, the connection looks half open to the client */
+			broker->pings++;
+		}
+		else
+		{
+			/* nothing else is published in the scenario */
+		}
+
+		broker->rx_len -= header + 1 + remaining;
+		memmove(broker->rx, &broker->rx[header + 1 + remaining], (size_t)broker->rx_len);
+	}
+}
+
+/**
+ * @brief	Connection attempt of the client: its virtual time is recorded, then the system call is made.
+ *
+ * @param[in]	: fd		: socket
+ * @param[in]	: addr		: address of the broker
+ * @param[in]	: addr_len	: length of addr
+ * @return 	int
+ * @retval	result of the system call
+ *
+*/
+int connect(int fd, const struct sockaddr *addr, socklen_t addr_len)
+{
+	if ( scen_attempts < SCEN_MAX_ATTEMPTS )
+	{
+		scen_attempt_ms[scen_attempts] = MqttClient_VirtualClockNow(&scen_clock);
+	}
+	scen_attempts++;
+
+	return (int)syscall(SYS_connect, fd, addr, addr_len);
+}
+
+/**
+ * @brief	Run the client and the broker on the wall clock until a condition holds, the virtual clock stands still.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: broker	: broker of the scenario
+ * @param[in]	: done		: condition waited for, NULL to run until neither the client nor the broker has work
+ * @param[in]	: expected	: value given to done
+ * @return 	bool
+ * @retval	true	: condition reached, or nothing left to do
+ * @retval	false	: not reached within SCEN_DRIVE_MS
+ *
+*/
+static bool ScenDrive(t_MqttClient *client, t_ScenBroker *broker, ScenDone done, unsigned int expected)
+{
+	t_MqttPollFd client_fds[MQTT_MAX_POLL_FDS];
+	struct pollfd fds[MQTT_MAX_POLL_FDS + 2U];
+	unsigned char count = 0U;
+	unsigned char idx;
+	int timeout_ms = 0;
+	int ready = 0;
+	int elapsed_ms;
+
+	for (elapsed_ms = 0; elapsed_ms < SCEN_DRIVE_MS; elapsed_ms += SCEN_POLL_MS)
+	{
+		count = MqttClient_GetPollFds(client, client_fds, MQTT_MAX_POLL_FDS);
+		for (idx = 0U; idx < count; idx++)
+		{
+			fds[idx].fd = client_fds[idx].fd;
+			fds[idx].events = (short)(((0U != (client_fds[idx].events & MQTT_POLL_IN)) ? POLLIN : 0) |
+									  ((0U != (client_fds[idx].events & MQTT_POLL_OUT)) ? POLLOUT : 0));
+		}
+		fds[count].fd = broker->listen_fd;
+		fds[count++].events = POLLIN;
+		fds[count].fd = broker->conn_fd;
+		fds[count++].events = POLLIN;
+
+		/* only the timers already due run, waiting here never moves the virtual clock */
+		timeout_ms = MqttClient_GetTimeoutMs(client);
+		ready = poll(fds, count, (0 == timeout_ms) ? 0 : SCEN_POLL_MS);
+
+		MqttClient_ProcessEvents(client);
+		ScenBrokerService(broker);
+
+		if ( ((NULL != done) && (true == done(client, broker, expected))) ||
+			 ((NULL == done) && (0 == ready) && (0 != timeout_ms)) )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * @brief	Move the virtual clock cycle after cycle, running the client and the broker after each move, until a
+ * 			condition holds.
+ *
+ * @param[in]	: client	: client context
+ * @param[in]	: broker	: broker of the scenario
+ * @param[in]	: done		: condition waited for
+ * @param[in]	: expected	: value given to done
+ * @param[in]	: limit_ms	: virtual time given to the condition
+ * @return 	int
+ * @retval	virtual milli seconds elapsed until the condition held
+ * @retval	-1 : condition not reached within limit_ms, or no timer left
+ *
+*/
+static int ScenAdvance(t_MqttClient *client, t_ScenBroker *broker, ScenDone done, unsigned int expected, unsigned int limit_ms)
+{
+	uint64_t start_ms = scen_clock.now_ms;
+
+	while ( false == done(client, broker, expected) )
+	{
+		if ( ((scen_clock.now_ms - start_ms) > limit_ms) || (MqttClient_VirtualClockAdvance(&scen_clock, &client, 1U) < 0) )
+		{
+			return -1;
+		}
+
+		(void)ScenDrive(client, broker, NULL, 0U);
+	}
+
+	return (int)(scen_clock.now_ms - start_ms);
+}
+
+static bool ScenConnected(t_MqttClient *client, const t_ScenBroker *broker, unsigned int expected)
+{
+	(void)broker;
+	(void)expected;
+
+	return (0U != MqttClient_IsConnected(client));
+}
+
+static bool ScenPinged(t_MqttClient *client, const t_ScenBroker *broker, unsigned int expected)
+{
+	(void)client;
+
+	return (broker->pings >= expected);
+}
+
+static bool ScenClosed(t_MqttClient *client, const t_ScenBroker *broker, unsigned int expected)
+{
+	(void)client;
+
+	return (broker->closes >= expected);
+}
+
+static bool ScenAttempted(t_MqttClient *client, const t_ScenBroker *broker, unsigned int expected)
+{
+	(void)client;
+	(void)broker;
+
+	return (scen_attempts >= expected);
+}
+
+/**
+ * @brief	Bound of the backoff delay following a connection attempt.
+ *
+ * @param[in]	: attempt	: number of the attempt, 1 for the first one
+ * @return 	unsigned int
+ * @retval	bound in milli seconds
+ *
+*/
+static unsigned int ScenBackoffBoundMs(unsigned int attempt)
+{
+	uint64_t bound_ms = (attempt <= 32U) ? ((uint64_t)MQTT_RECONNECT_BASE_MS << (attempt - 1U)) : MQTT_RECONNECT_CAP_MS;
+
+	return (bound_ms < MQTT_RECONNECT_CAP_MS) ? (unsigned int)bound_ms : MQTT_RECONNECT_CAP_MS;
+}
+
+int main(void)
+{
+	t_MqttClientConfig config;
+	t_ScenBroker broker;
+	t_MqttClient *client = NULL;
+	t_MqttPollFd client_fds[MQTT_MAX_POLL_FDS];
+	unsigned int attempt;
+	unsigned int bound_ms = 0U;
+	unsigned int delay_ms = 0U;
+	unsigned int waited_ms = 0U;
+	int elapsed_ms = 0;
+
+	/* the library logs every step on stdout, only the checks are of interest */
+	if ( NULL == freopen("/dev/null", "w", stdout) )
+	{
+		fprintf(stderr, "VirtualTimeScenario: can't discard stdout\n");
+		return 1;
+	}
+
+	memset(&broker, 0, sizeof(broker));
+	broker.conn_fd = INVALID_FD;
+	if ( false == ScenBrokerListen(&broker) )
+	{
+		fprintf(stderr, "VirtualTimeScenario: broker can't listen on the loopback interface\n");
+		return 1;
+	}
+
+	memset(&scen_clock, 0, sizeof(scen_clock));
+	memset(&config, 0, sizeof(config));
+	config.server_address = "127.0.0.1";
+	config.server_port = broker.port;
+	config.client_id = "virtual-time-scenario";
+	config.clock = MqttClient_VirtualClockNow;
+	config.clock_ctx = &scen_clock;
+	client = MqttClient_Init(&config);
+	if ( (NULL == client) || (0U == MqttClient_GetPollFds(client, client_fds, MQTT_MAX_POLL_FDS)) )
+	{
+		fprintf(stderr, "VirtualTimeScenario: no host driven client context, MQTT_SELF_DRIVEN_MODE has to be 0\n");
+		return 1;
+	}
+
+	fprintf(stderr, "VirtualTimeScenario: broker on port %u\n", (unsigned int)broker.port);
+
+	/* connection: no timer has to elapse, the clock stays at 0 */
+	ScenCheck(ScenDrive(client, &broker, ScenConnected, 0U), "connected at virtual ms", (long)scen_clock.now_ms);
+
+	/* keep alive: the ping is sent one ping interval after the CONNACK, the broker keeps quiet */
+	elapsed_ms = ScenAdvance(client, &broker, ScenPinged, 1U, (unsigned int)SCEN_PING_INTERVAL_MS);
+	ScenCheck(SCEN_PING_INTERVAL_MS == elapsed_ms, "ping request sent after ms", elapsed_ms);
+	ScenCheck(0U != MqttClient_IsConnected(client), "connected while the PINGRESP is awaited", (long)MqttClient_IsConnected(client));
+
+	/* half open connection: the client gives up at rto + margin and connects again at once, the broker refuses */
+	ScenBrokerRefuse(&broker);
+	elapsed_ms = ScenAdvance(client, &broker, ScenClosed, 1U, (unsigned int)SCEN_PINGRESP_DEADLINE_MS);
+	ScenCheck(SCEN_PINGRESP_DEADLINE_MS == elapsed_ms, "half open connection closed after ms", elapsed_ms);
+	ScenCheck(0U == MqttClient_IsConnected(client), "disconnected at virtual ms", (long)scen_clock.now_ms);
+	ScenCheck((2U == scen_attempts) && (scen_attempt_ms[1] == scen_clock.now_ms), "connection attempts, the last one at once", (long)scen_attempts);
+
+	/* backoff: each refused attempt waits a random delay below a bound doubled from one attempt to the next */
+	for (attempt = 2U; attempt < (2U + SCEN_REFUSED_ATTEMPTS); attempt++)
+	{
+		bound_ms = ScenBackoffBoundMs(attempt);
+		elapsed_ms = ScenAdvance(client, &broker, ScenAttempted, attempt + 1U, bound_ms);
+		delay_ms = (unsigned int)(scen_attempt_ms[attempt] - scen_attempt_ms[attempt - 1U]);
+		waited_ms += delay_ms;
+
+		fprintf(stderr, "  attempt %2u after %5u ms, bound %5u ms\n", attempt + 1U, delay_ms, bound_ms);
+		ScenCheck((elapsed_ms >= 0) && (delay_ms <= bound_ms), "backoff delay within its bound, ms", (long)delay_ms);
+	}
+	ScenCheck(1U == broker.accepts, "connections accepted while refusing", (long)(broker.accepts - 1U));
+	ScenCheck(0U == MqttClient_IsConnected(client), "disconnected at virtual ms", (long)scen_clock.now_ms);
+
+	/* recovery: the broker is back, the next attempt connects within its bound */
+	ScenCheck(ScenBrokerListen(&broker), "broker listening again on port", (long)broker.port);
+	bound_ms = ScenBackoffBoundMs(attempt);
+	elapsed_ms = ScenAdvance(client, &broker, ScenConnected, 0U, bound_ms);
+	delay_ms = (unsigned int)(scen_attempt_ms[attempt] - scen_attempt_ms[attempt - 1U]);
+	ScenCheck((elapsed_ms >= 0) && (delay_ms <= bound_ms), "connected again after a backoff delay of ms", (long)delay_ms);
+	ScenCheck(2U == broker.connects, "CONNECT packets answered", (long)broker.connects);
+
+	fprintf(stderr, "VirtualTimeScenario: %u ms of backoff over %u refused attempts, %lu virtual ms in all, %u failed checks\n",
+			waited_ms, (unsigned int)SCEN_REFUSED_ATTEMPTS, (unsigned long)scen_clock.now_ms, scen_failures);
+
+	return (0U == scen_failures) ? 0 : 1;
+}